@@ -50,9 +50,11 @@ ptr<log_entry> inmem_log_store::make_clone(const ptr<log_entry>& entry) {
     // NOTE:
     //   Timestamp is used only when `replicate_log_timestamp_` option is on.
     //   Otherwise, log store does not need to store or load it.
-    ptr<log_entry> clone = cs_new<log_entry>
+    buffer& buf = entry->get_buf();
+    ptr<log_entry> clone = log_entry::make
                            ( entry->get_term(),
-                             buffer::clone( entry->get_buf() ),
+                             buf.data_begin(),
+                             buf.size(),
                              entry->get_val_type(),
                              entry->get_timestamp(),
                              entry->has_crc32(),
@@ -0,0 +1,942 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "shared_wal.hxx"
+
+#include "crc32.hxx"
+#include "nuraft.hxx"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nuraft {
+
+// Record layout:
+//   magic (4) | CRC32 (4) | payload length (4) | type (1) | group ID (8) |
+//   payload (payload length)
+// CRC32 covers type, group ID, and payload.
+static const uint32_t WAL_RECORD_MAGIC = 0x57414c31; // "WAL1"
+static const size_t WAL_RECORD_HEADER_SIZE = 21;
+static const size_t WAL_RECORD_CRC_OFFSET = 4;
+static const size_t WAL_RECORD_CRC_BEGIN = 12;
+
+enum wal_record_type : uint8_t {
+    // Log entry: log index (8) | serialized log entry.
+    WAL_LOG = 1,
+
+    // Compaction: last compacted log index (8).
+    WAL_COMPACT = 2,
+
+    // Discard all logs, and start from the given index (8).
+    WAL_RESET = 3,
+
+    // Serialized `srv_state`.
+    WAL_STATE = 4,
+
+    // Serialized `cluster_config`.
+    WAL_CONFIG = 5,
+};
+
+struct shared_wal::segment {
+    segment(uint64_t seq, int fd, const std::string& path)
+        : seq_(seq), fd_(fd), path_(path), size_(0)
+        {}
+
+    ~segment() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    uint64_t seq_;
+    int fd_;
+    std::string path_;
+    uint64_t size_;
+};
+
+struct shared_wal::log_loc {
+    log_loc() : offset_(0), len_(0), term_(0) {}
+
+    /**
+     * Segment where the log is, and the location of
+     * the serialized log entry in it.
+     */
+    ptr<segment> seg_;
+    uint64_t offset_;
+    uint32_t len_;
+
+    /**
+     * Term of the log, to serve `term_at` without disk reads.
+     */
+    ulong term_;
+};
+
+struct shared_wal::group {
+    group(uint64_t id)
+        : id_(id)
+        , start_idx_(1)
+        , durable_idx_(0)
+        , last_log_lsn_(0)
+        , notified_lsn_(0)
+        , raft_(nullptr)
+        {}
+
+    ulong last_index() const {
+        return logs_.empty() ? start_idx_ - 1 : logs_.rbegin()->first;
+    }
+
+    uint64_t id_;
+
+    /**
+     * Lock for all fields below, except for `raft_`.
+     */
+    std::mutex lock_;
+
+    ulong start_idx_;
+
+    /**
+     * Map of {log index, location}.
+     */
+    std::map<ulong, log_loc> logs_;
+
+    /**
+     * Cache of the last log entry.
+     */
+    ptr<log_entry> last_entry_;
+
+    /**
+     * List of {record sequence number, log index} of logs
+     * that are not durable yet.
+     */
+    std::list< std::pair<uint64_t, ulong> > unsynced_logs_;
+
+    /**
+     * The last durable log index, valid only when
+     * `unsynced_logs_` is not empty.
+     */
+    ulong durable_idx_;
+
+    /**
+     * Sequence number of the last log record.
+     */
+    uint64_t last_log_lsn_;
+
+    /**
+     * Sequence number synced when `raft_` was notified last time.
+     */
+    uint64_t notified_lsn_;
+
+    ptr<buffer> state_;
+    ptr<segment> state_seg_;
+
+    ptr<buffer> config_;
+    ptr<segment> config_seg_;
+
+    std::atomic<raft_server*> raft_;
+};
+
+static ptr<log_entry> make_dummy_entry() {
+    ptr<buffer> buf = buffer::alloc(sz_ulong);
+    return cs_new<log_entry>(0, buf);
+}
+
+static std::string get_segment_name(uint64_t seq) {
+    char name[32];
+    snprintf(name, 32, "wal_%016" PRIx64 ".log", seq);
+    return name;
+}
+
+shared_wal::shared_wal(const std::string& path,
+                       const shared_wal_options& opt)
+    : path_(path)
+    , opt_(opt)
+    , written_lsn_(0)
+    , synced_lsn_(0)
+    , requested_lsn_(0)
+    , stopping_(false)
+    , io_failed_(false)
+    , num_syncs_(0)
+    {}
+
+shared_wal::~shared_wal() {
+    close();
+}
+
+bool shared_wal::open() {
+    std::vector<uint64_t> seqs;
+    DIR* dir = opendir(path_.c_str());
+    if (!dir) return false;
+    struct dirent* ent = nullptr;
+    while ( (ent = readdir(dir)) ) {
+        uint64_t seq = 0;
+        if (sscanf(ent->d_name, "wal_%" SCNx64 ".log", &seq) == 1) {
+            seqs.push_back(seq);
+        }
+    }
+    closedir(dir);
+    std::sort(seqs.begin(), seqs.end());
+
+    std::lock_guard<std::mutex> l(wal_lock_);
+    for (size_t ii = 0; ii < seqs.size(); ++ii) {
+        ptr<segment> seg = open_segment(seqs[ii], false);
+        if (!seg) return false;
+        segments_.push_back(seg);
+        if (!recover_segment(seg, ii + 1 == seqs.size())) return false;
+    }
+    if (segments_.empty()) {
+        ptr<segment> seg = open_segment(0, true);
+        if (!seg || !sync_dir()) return false;
+        segments_.push_back(seg);
+    }
+
+    // All recovered logs are durable.
+    for (auto& entry: groups_) {
+        group& gg = *entry.second;
+        if (!gg.logs_.empty()) {
+            gg.last_entry_ = read_log(gg, gg.last_index());
+        }
+    }
+
+    stopping_ = false;
+    sync_thread_ = std::thread(&shared_wal::sync_loop, this);
+    return true;
+}
+
+void shared_wal::close() {
+    if (!sync_thread_.joinable()) return;
+    sync();
+    {   std::lock_guard<std::mutex> l(sync_lock_);
+        stopping_ = true;
+    }
+    sync_cv_.notify_all();
+    synced_cv_.notify_all();
+    sync_thread_.join();
+}
+
+ptr<shared_wal::segment> shared_wal::open_segment(uint64_t seq, bool create) {
+    std::string seg_path = path_ + "/" + get_segment_name(seq);
+    int flags = O_RDWR;
+    if (create) flags |= O_CREAT | O_TRUNC;
+    int fd = ::open(seg_path.c_str(), flags, 0644);
+    if (fd < 0) return nullptr;
+    return cs_new<segment>(seq, fd, seg_path);
+}
+
+bool shared_wal::sync_dir() {
+    // Creating or removing a file is durable only after
+    // the directory is synced.
+    if (!opt_.do_sync_) return true;
+    int fd = ::open(path_.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool ok = (fsync(fd) == 0);
+    ::close(fd);
+    return ok;
+}
+
+bool shared_wal::recover_segment(ptr<segment>& seg, bool is_last) {
+    struct stat st;
+    if (fstat(seg->fd_, &st) != 0) return false;
+    uint64_t file_size = st.st_size;
+
+    ptr<buffer> data = buffer::alloc(file_size ? file_size : 1);
+    uint64_t read_bytes = 0;
+    while (read_bytes < file_size) {
+        ssize_t rr = ::pread( seg->fd_, data->data_begin() + read_bytes,
+                              file_size - read_bytes, read_bytes );
+        if (rr <= 0) return false;
+        read_bytes += rr;
+    }
+
+    uint64_t offset = 0;
+    while (offset + WAL_RECORD_HEADER_SIZE <= file_size) {
+        buffer_serializer bs(data);
+        bs.pos(offset);
+        uint32_t magic = bs.get_u32();
+        uint32_t crc = bs.get_u32();
+        uint32_t len = bs.get_u32();
+        if ( magic != WAL_RECORD_MAGIC ||
+             offset + WAL_RECORD_HEADER_SIZE + len > file_size ) break;
+
+        byte* crc_begin = data->data_begin() + offset + WAL_RECORD_CRC_BEGIN;
+        size_t crc_len = WAL_RECORD_HEADER_SIZE - WAL_RECORD_CRC_BEGIN + len;
+        if (crc32_8(crc_begin, crc_len, 0) != crc) break;
+
+        uint8_t type = bs.get_u8();
+        uint64_t group_id = bs.get_u64();
+        ptr<buffer> payload = buffer::alloc(len ? len : 1);
+        if (len) {
+            memcpy(payload->data_begin(), bs.get_raw(len), len);
+        }
+        payload->pos(0);
+        replay(type, group_id, *payload, seg, offset + WAL_RECORD_HEADER_SIZE);
+        offset += WAL_RECORD_HEADER_SIZE + len;
+    }
+
+    if (offset < file_size) {
+        // Torn or corrupted record. Only the tail of the last segment
+        // can be incomplete, as the others were synced when rotated.
+        if (!is_last) return false;
+        if (ftruncate(seg->fd_, offset) != 0) return false;
+    }
+    seg->size_ = offset;
+    return true;
+}
+
+void shared_wal::replay(uint8_t type, uint64_t group_id,
+                        buffer& payload, ptr<segment>& seg, uint64_t offset)
+{
+    ptr<group> gg = groups_[group_id];
+    if (!gg) {
+        gg = cs_new<group>(group_id);
+        groups_[group_id] = gg;
+    }
+    buffer_serializer bs(payload);
+
+    switch (type) {
+    case WAL_LOG: {
+        ulong index = bs.get_u64();
+        ptr<buffer> le_buf = buffer::alloc(payload.size() - sz_ulong);
+        memcpy(le_buf->data_begin(), payload.data_begin() + sz_ulong, le_buf->size());
+        ptr<log_entry> le = log_entry::deserialize(*le_buf);
+
+        // The same as `write_at`: overwrites all logs after `index`.
+        gg->logs_.erase(gg->logs_.lower_bound(index), gg->logs_.end());
+        if (gg->logs_.empty()) gg->start_idx_ = index;
+        log_loc& loc = gg->logs_[index];
+        loc.seg_ = seg;
+        loc.offset_ = offset + sz_ulong;
+        loc.len_ = le_buf->size();
+        loc.term_ = le->get_term();
+        break;
+    }
+    case WAL_COMPACT: {
+        ulong last_log_index = bs.get_u64();
+        gg->logs_.erase(gg->logs_.begin(), gg->logs_.upper_bound(last_log_index));
+        gg->start_idx_ = std::max(gg->start_idx_, last_log_index + 1);
+        break;
+    }
+    case WAL_RESET: {
+        gg->logs_.clear();
+        gg->start_idx_ = bs.get_u64();
+        break;
+    }
+    case WAL_STATE:
+        gg->state_ = buffer::clone(payload);
+        gg->state_seg_ = seg;
+        break;
+    case WAL_CONFIG:
+        gg->config_ = buffer::clone(payload);
+        gg->config_seg_ = seg;
+        break;
+    default:
+        break;
+    }
+}
+
+ptr<shared_wal::group> shared_wal::get_group(uint64_t group_id, bool create) {
+    std::lock_guard<std::mutex> l(wal_lock_);
+    auto entry = groups_.find(group_id);
+    if (entry != groups_.end()) return entry->second;
+    if (!create) return nullptr;
+    ptr<group> gg = cs_new<group>(group_id);
+    groups_[group_id] = gg;
+    return gg;
+}
+
+ptr<shared_wal_log_store> shared_wal::get_log_store(uint64_t group_id) {
+    return cs_new<shared_wal_log_store>( shared_from_this(),
+                                         get_group(group_id, true) );
+}
+
+std::vector<uint64_t> shared_wal::get_group_ids() {
+    std::vector<uint64_t> ret;
+    std::lock_guard<std::mutex> l(wal_lock_);
+    for (auto& entry: groups_) ret.push_back(entry.first);
+    return ret;
+}
+
+uint64_t shared_wal::write_record(uint8_t type,
+                                  uint64_t group_id,
+                                  const buffer& payload,
+                                  ptr<segment>* seg_out,
+                                  uint64_t* offset_out)
+{
+    size_t len = payload.size();
+    ptr<buffer> rec = buffer::alloc(WAL_RECORD_HEADER_SIZE + len);
+    buffer_serializer bs(rec);
+    bs.put_u32(WAL_RECORD_MAGIC);
+    bs.put_u32(0);
+    bs.put_u32(len);
+    bs.put_u8(type);
+    bs.put_u64(group_id);
+    if (len) bs.put_raw(payload.data_begin(), len);
+
+    byte* crc_begin = rec->data_begin() + WAL_RECORD_CRC_BEGIN;
+    uint32_t crc = crc32_8( crc_begin,
+                            rec->size() - WAL_RECORD_CRC_BEGIN, 0 );
+    bs.pos(WAL_RECORD_CRC_OFFSET);
+    bs.put_u32(crc);
+
+    std::lock_guard<std::mutex> l(wal_lock_);
+    // Nothing can be durable after a failure.
+    if (io_failed_) return 0;
+
+    ptr<segment> seg = segments_.back();
+    if (seg->size_ && seg->size_ + rec->size() > opt_.segment_size_) {
+        // Rotate the segment. Records in the previous segment should be
+        // durable, as the sync thread only syncs the current one.
+        if (opt_.do_sync_) {
+            num_syncs_++;
+            if (fdatasync(seg->fd_) != 0) {
+                io_failed_ = true;
+                return 0;
+            }
+        }
+        ptr<segment> new_seg = open_segment(seg->seq_ + 1, true);
+        if (!new_seg || !sync_dir()) {
+            io_failed_ = true;
+            return 0;
+        }
+        segments_.push_back(new_seg);
+        seg = new_seg;
+    }
+
+    size_t written = 0;
+    while (written < rec->size()) {
+        ssize_t ww = ::pwrite( seg->fd_, rec->data_begin() + written,
+                               rec->size() - written, seg->size_ + written );
+        if (ww <= 0) {
+            io_failed_ = true;
+            return 0;
+        }
+        written += ww;
+    }
+    if (seg_out) *seg_out = seg;
+    if (offset_out) *offset_out = seg->size_ + WAL_RECORD_HEADER_SIZE;
+    seg->size_ += rec->size();
+    return ++written_lsn_;
+}
+
+bool shared_wal::read_payload(const log_loc& loc, ptr<buffer>& payload_out) {
+    payload_out = buffer::alloc(loc.len_);
+    size_t read_bytes = 0;
+    while (read_bytes < loc.len_) {
+        ssize_t rr = ::pread( loc.seg_->fd_,
+                              payload_out->data_begin() + read_bytes,
+                              loc.len_ - read_bytes,
+                              loc.offset_ + read_bytes );
+        if (rr <= 0) return false;
+        read_bytes += rr;
+    }
+    return true;
+}
+
+bool shared_wal::request_sync(uint64_t lsn) {
+    if (io_failed_) return false;
+    if (synced_lsn_ >= lsn) return true;
+    {   std::lock_guard<std::mutex> l(sync_lock_);
+        if (requested_lsn_ >= lsn) return true;
+        requested_lsn_ = lsn;
+    }
+    sync_cv_.notify_one();
+    return true;
+}
+
+bool shared_wal::wait_for_sync(uint64_t lsn) {
+    if (io_failed_) return false;
+    if (synced_lsn_ >= lsn) return true;
+    request_sync(lsn);
+    std::unique_lock<std::mutex> l(sync_lock_);
+    synced_cv_.wait(l, [&]() {
+        return synced_lsn_ >= lsn || stopping_ || io_failed_;
+    });
+    return !io_failed_ && synced_lsn_ >= lsn;
+}
+
+bool shared_wal::sync() {
+    uint64_t lsn = 0;
+    {   std::lock_guard<std::mutex> l(wal_lock_);
+        lsn = written_lsn_;
+    }
+    return wait_for_sync(lsn);
+}
+
+void shared_wal::sync_loop() {
+    while (true) {
+        {   std::unique_lock<std::mutex> l(sync_lock_);
+            sync_cv_.wait(l, [&]() {
+                return stopping_ || requested_lsn_ > synced_lsn_;
+            });
+            if (stopping_) break;
+        }
+
+        // All records written so far are covered by one sync,
+        // no matter which group they belong to.
+        ptr<segment> seg;
+        uint64_t lsn = 0;
+        {   std::lock_guard<std::mutex> l(wal_lock_);
+            seg = segments_.back();
+            lsn = written_lsn_;
+        }
+        bool ok = true;
+        if (opt_.do_sync_) {
+            ok = (fdatasync(seg->fd_) == 0);
+            num_syncs_++;
+        }
+
+        {   std::lock_guard<std::mutex> l(sync_lock_);
+            if (!ok) {
+                io_failed_ = true;
+            } else if (lsn > synced_lsn_) {
+                synced_lsn_ = lsn;
+            }
+        }
+        if (!ok) {
+            synced_cv_.notify_all();
+            notify_io_failure();
+            break;
+        }
+        synced_cv_.notify_all();
+        notify_durable_logs();
+    }
+}
+
+void shared_wal::notify_durable_logs() {
+    std::vector< ptr<group> > groups;
+    {   std::lock_guard<std::mutex> l(wal_lock_);
+        for (auto& entry: groups_) {
+            if (entry.second->raft_) groups.push_back(entry.second);
+        }
+    }
+
+    uint64_t synced = synced_lsn_;
+    for (ptr<group>& gg: groups) {
+        {   std::lock_guard<std::mutex> l(gg->lock_);
+            if ( gg->last_log_lsn_ <= gg->notified_lsn_ ||
+                 synced <= gg->notified_lsn_ ) continue;
+            gg->notified_lsn_ = synced;
+        }
+        raft_server* raft = gg->raft_;
+        if (raft) raft->notify_log_append_completion(true);
+    }
+}
+
+void shared_wal::notify_io_failure() {
+    std::vector< ptr<group> > groups;
+    {   std::lock_guard<std::mutex> l(wal_lock_);
+        for (auto& entry: groups_) {
+            if (entry.second->raft_) groups.push_back(entry.second);
+        }
+    }
+
+    // Logs waiting for the background sync will never be durable.
+    for (ptr<group>& gg: groups) {
+        raft_server* raft = gg->raft_;
+        if (raft) raft->notify_log_append_completion(false);
+    }
+}
+
+ulong shared_wal::append_log(group& gg, ulong index, log_entry& entry) {
+    ptr<buffer> le_buf = entry.serialize();
+    ptr<buffer> payload = buffer::alloc(sz_ulong + le_buf->size());
+    buffer_serializer bs(payload);
+    bs.put_u64(index);
+    bs.put_raw(le_buf->data_begin(), le_buf->size());
+
+    log_loc loc;
+    uint64_t lsn = write_record(WAL_LOG, gg.id_, *payload, &loc.seg_, &loc.offset_);
+    if (!lsn) {
+        // Not written, should not be indexed. The failure is reported
+        // by the next sync.
+        return 0;
+    }
+    loc.offset_ += sz_ulong;
+    loc.len_ = le_buf->size();
+    loc.term_ = entry.get_term();
+
+    ulong last_idx = gg.last_index();
+    if (gg.unsynced_logs_.empty()) {
+        gg.durable_idx_ = std::min(last_idx, index - 1);
+    } else {
+        gg.durable_idx_ = std::min(gg.durable_idx_, index - 1);
+    }
+    while ( !gg.unsynced_logs_.empty() &&
+            gg.unsynced_logs_.back().second >= index ) {
+        gg.unsynced_logs_.pop_back();
+    }
+    gg.unsynced_logs_.push_back( std::make_pair(lsn, index) );
+    gg.last_log_lsn_ = lsn;
+
+    gg.logs_.erase(gg.logs_.lower_bound(index), gg.logs_.end());
+    if (gg.logs_.empty()) gg.start_idx_ = index;
+    gg.logs_[index] = loc;
+    gg.last_entry_ = log_entry::deserialize(*le_buf);
+    return lsn;
+}
+
+void shared_wal::compact_logs(group& gg, ulong last_log_index) {
+    ptr<buffer> payload = buffer::alloc(sz_ulong);
+    buffer_serializer bs(payload);
+    bs.put_u64(last_log_index);
+    write_record(WAL_COMPACT, gg.id_, *payload, nullptr, nullptr);
+
+    gg.logs_.erase(gg.logs_.begin(), gg.logs_.upper_bound(last_log_index));
+    gg.start_idx_ = std::max(gg.start_idx_, last_log_index + 1);
+    if (gg.logs_.empty()) gg.last_entry_.reset();
+}
+
+void shared_wal::reset_logs(group& gg, ulong start_index) {
+    ptr<buffer> payload = buffer::alloc(sz_ulong);
+    buffer_serializer bs(payload);
+    bs.put_u64(start_index);
+    write_record(WAL_RESET, gg.id_, *payload, nullptr, nullptr);
+
+    gg.logs_.clear();
+    gg.unsynced_logs_.clear();
+    gg.start_idx_ = start_index;
+    gg.last_entry_.reset();
+}
+
+ptr<log_entry> shared_wal::read_log(group& gg, ulong index) {
+    auto entry = gg.logs_.find(index);
+    if (entry == gg.logs_.end()) return nullptr;
+    ptr<buffer> le_buf;
+    if (!read_payload(entry->second, le_buf)) return nullptr;
+    return log_entry::deserialize(*le_buf);
+}
+
+ulong shared_wal::get_durable_index(group& gg) {
+    uint64_t synced = synced_lsn_;
+    while ( !gg.unsynced_logs_.empty() &&
+            gg.unsynced_logs_.front().first <= synced ) {
+        gg.durable_idx_ = gg.unsynced_logs_.front().second;
+        gg.unsynced_logs_.pop_front();
+    }
+    if (gg.unsynced_logs_.empty()) return gg.last_index();
+    return gg.durable_idx_;
+}
+
+bool shared_wal::save_state(uint64_t group_id, const srv_state& state) {
+    ptr<group> gg = get_group(group_id, true);
+    ptr<buffer> buf = state.serialize();
+    uint64_t lsn = 0;
+    {   std::lock_guard<std::mutex> l(gg->lock_);
+        ptr<segment> seg;
+        lsn = write_record(WAL_STATE, group_id, *buf, &seg, nullptr);
+        if (!lsn) return false;
+        gg->state_ = buf;
+        gg->state_seg_ = seg;
+    }
+    return wait_for_sync(lsn);
+}
+
+ptr<srv_state> shared_wal::read_state(uint64_t group_id) {
+    ptr<group> gg = get_group(group_id, false);
+    if (!gg) return nullptr;
+    std::lock_guard<std::mutex> l(gg->lock_);
+    if (!gg->state_) return nullptr;
+    gg->state_->pos(0);
+    return srv_state::deserialize(*gg->state_);
+}
+
+bool shared_wal::save_config(uint64_t group_id, const cluster_config& config) {
+    ptr<group> gg = get_group(group_id, true);
+    ptr<buffer> buf = config.serialize();
+    uint64_t lsn = 0;
+    {   std::lock_guard<std::mutex> l(gg->lock_);
+        ptr<segment> seg;
+        lsn = write_record(WAL_CONFIG, group_id, *buf, &seg, nullptr);
+        if (!lsn) return false;
+        gg->config_ = buf;
+        gg->config_seg_ = seg;
+    }
+    return wait_for_sync(lsn);
+}
+
+ptr<cluster_config> shared_wal::load_config(uint64_t group_id) {
+    ptr<group> gg = get_group(group_id, false);
+    if (!gg) return nullptr;
+    std::lock_guard<std::mutex> l(gg->lock_);
+    if (!gg->config_) return nullptr;
+    gg->config_->pos(0);
+    return cluster_config::deserialize(*gg->config_);
+}
+
+size_t shared_wal::checkpoint() {
+    std::vector< ptr<group> > groups;
+    uint64_t cur_seq = 0;
+    {   std::lock_guard<std::mutex> l(wal_lock_);
+        for (auto& entry: groups_) groups.push_back(entry.second);
+        cur_seq = segments_.back()->seq_;
+    }
+
+    // Find the oldest segment that any group still needs. State,
+    // config, and log start index are small, so they are re-written
+    // instead of pinning old segments.
+    uint64_t min_seq = cur_seq;
+    for (ptr<group>& gg: groups) {
+        std::lock_guard<std::mutex> l(gg->lock_);
+        if (gg->start_idx_ > 1) {
+            // The last compaction (or reset) record may be in a segment
+            // to be removed. Otherwise, the start index will be lost
+            // if the group has no logs, or logs compacted in the
+            // remaining segments will be recovered.
+            ptr<buffer> payload = buffer::alloc(sz_ulong);
+            buffer_serializer bs(payload);
+            bs.put_u64(gg->start_idx_ - 1);
+            write_record(WAL_COMPACT, gg->id_, *payload, nullptr, nullptr);
+        }
+        if (gg->state_seg_ && gg->state_seg_->seq_ < cur_seq) {
+            write_record(WAL_STATE, gg->id_, *gg->state_, &gg->state_seg_, nullptr);
+        }
+        if (gg->config_seg_ && gg->config_seg_->seq_ < cur_seq) {
+            write_record(WAL_CONFIG, gg->id_, *gg->config_, &gg->config_seg_, nullptr);
+        }
+        if (!gg->logs_.empty()) {
+            min_seq = std::min(min_seq, gg->logs_.begin()->second.seg_->seq_);
+        }
+    }
+
+    // Compaction records and re-written records
+    // should be durable before removing segments.
+    if (!sync()) return 0;
+
+    size_t num_removed = 0;
+    std::lock_guard<std::mutex> l(wal_lock_);
+    while ( segments_.size() > 1 &&
+            segments_.front()->seq_ < min_seq ) {
+        // Logs being read keep the file descriptor open.
+        ::unlink(segments_.front()->path_.c_str());
+        segments_.pop_front();
+        num_removed++;
+    }
+    if (num_removed && !sync_dir()) {
+        io_failed_ = true;
+    }
+    return num_removed;
+}
+
+size_t shared_wal::get_num_segments() {
+    std::lock_guard<std::mutex> l(wal_lock_);
+    return segments_.size();
+}
+
+
+shared_wal_log_store::shared_wal_log_store(ptr<shared_wal> wal,
+                                           ptr<shared_wal::group> gg)
+    : wal_(wal)
+    , group_(gg)
+    {}
+
+shared_wal_log_store::~shared_wal_log_store() {
+    set_raft_server(nullptr);
+}
+
+ulong shared_wal_log_store::next_slot() const {
+    std::lock_guard<std::mutex> l(group_->lock_);
+    return group_->last_index() + 1;
+}
+
+ulong shared_wal_log_store::start_index() const {
+    std::lock_guard<std::mutex> l(group_->lock_);
+    return group_->start_idx_;
+}
+
+ptr<log_entry> shared_wal_log_store::last_entry() const {
+    std::lock_guard<std::mutex> l(group_->lock_);
+    if (!group_->last_entry_) return make_dummy_entry();
+    return group_->last_entry_;
+}
+
+ulong shared_wal_log_store::append(ptr<log_entry>& entry) {
+    std::lock_guard<std::mutex> l(group_->lock_);
+    ulong idx = group_->last_index() + 1;
+    wal_->append_log(*group_, idx, *entry);
+    return idx;
+}
+
+void shared_wal_log_store::write_at(ulong index, ptr<log_entry>& entry) {
+    std::lock_guard<std::mutex> l(group_->lock_);
+    wal_->append_log(*group_, index, *entry);
+}
+
+void shared_wal_log_store::end_of_append_batch(ulong start, ulong cnt) {
+    uint64_t lsn = 0;
+    {   std::lock_guard<std::mutex> l(group_->lock_);
+        lsn = group_->last_log_lsn_;
+    }
+    raft_server* raft = group_->raft_;
+    if (raft) {
+        // Synced in background, Raft server will be notified.
+        if (!wal_->request_sync(lsn)) {
+            raft->notify_log_append_completion(false);
+        }
+    } else if (!wal_->wait_for_sync(lsn)) {
+        throw std::runtime_error("failed to sync appended logs");
+    }
+}
+
+ptr< std::vector< ptr<log_entry> > >
+    shared_wal_log_store::log_entries(ulong start, ulong end)
+{
+    ptr< std::vector< ptr<log_entry> > > ret =
+        cs_new< std::vector< ptr<log_entry> > >();
+    ret->reserve(end - start);
+    std::lock_guard<std::mutex> l(group_->lock_);
+    for (ulong ii = start; ii < end; ++ii) {
+        ptr<log_entry> le = wal_->read_log(*group_, ii);
+        if (!le) le = make_dummy_entry();
+        ret->push_back(le);
+    }
+    return ret;
+}
+
+ptr<log_entry> shared_wal_log_store::entry_at(ulong index) {
+    std::lock_guard<std::mutex> l(group_->lock_);
+    ptr<log_entry> le = wal_->read_log(*group_, index);
+    if (!le) le = make_dummy_entry();
+    return le;
+}
+
+ulong shared_wal_log_store::term_at(ulong index) {
+    std::lock_guard<std::mutex> l(group_->lock_);
+    auto entry = group_->logs_.find(index);
+    if (entry == group_->logs_.end()) return 0;
+    return entry->second.term_;
+}
+
+ptr<buffer> shared_wal_log_store::pack(ulong index, int32 cnt) {
+    std::vector< ptr<buffer> > logs;
+    size_t size_total = 0;
+    {   std::lock_guard<std::mutex> l(group_->lock_);
+        for (ulong ii = index; ii < index + cnt; ++ii) {
+            auto entry = group_->logs_.find(ii);
+            if (entry == group_->logs_.end()) break;
+            ptr<buffer> buf;
+            if (!wal_->read_payload(entry->second, buf)) break;
+            size_total += buf->size();
+            logs.push_back(buf);
+        }
+    }
+
+    ptr<buffer> buf_out = buffer::alloc
+                          ( sizeof(int32) +
+                            logs.size() * sizeof(int32) +
+                            size_total );
+    buf_out->pos(0);
+    buf_out->put((int32)logs.size());
+    for (ptr<buffer>& bb: logs) {
+        buf_out->put((int32)bb->size());
+        buf_out->put(*bb);
+    }
+    return buf_out;
+}
+
+void shared_wal_log_store::apply_pack(ulong index, buffer& pack) {
+    pack.pos(0);
+    int32 num_logs = pack.get_int();
+
+    std::lock_guard<std::mutex> l(group_->lock_);
+    if ( index < group_->start_idx_ ||
+         index > group_->last_index() + 1 ) {
+        wal_->reset_logs(*group_, index);
+    }
+    for (int32 ii = 0; ii < num_logs; ++ii) {
+        int32 buf_size = pack.get_int();
+        ptr<buffer> buf_local = buffer::alloc(buf_size);
+        pack.get(buf_local);
+        ptr<log_entry> le = log_entry::deserialize(*buf_local);
+        wal_->append_log(*group_, index + ii, *le);
+    }
+    uint64_t lsn = group_->last_log_lsn_;
+    if (!wal_->wait_for_sync(lsn)) {
+        throw std::runtime_error("failed to sync the applied pack");
+    }
+}
+
+bool shared_wal_log_store::compact(ulong last_log_index) {
+    std::lock_guard<std::mutex> l(group_->lock_);
+    wal_->compact_logs(*group_, last_log_index);
+    return true;
+}
+
+bool shared_wal_log_store::flush() {
+    uint64_t lsn = 0;
+    {   std::lock_guard<std::mutex> l(group_->lock_);
+        lsn = group_->last_log_lsn_;
+    }
+    return wal_->wait_for_sync(lsn);
+}
+
+ulong shared_wal_log_store::last_durable_index() {
+    std::lock_guard<std::mutex> l(group_->lock_);
+    return wal_->get_durable_index(*group_);
+}
+
+void shared_wal_log_store::set_raft_server(raft_server* raft) {
+    group_->raft_ = raft;
+}
+
+
+shared_wal_state_mgr::shared_wal_state_mgr(int32 srv_id,
+                                           const std::string& endpoint,
+                                           ptr<shared_wal> wal,
+                                           uint64_t group_id)
+    : my_id_(srv_id)
+    , my_endpoint_(endpoint)
+    , wal_(wal)
+    , group_id_(group_id)
+    , log_store_( wal->get_log_store(group_id) )
+    {}
+
+ptr<cluster_config> shared_wal_state_mgr::load_config() {
+    ptr<cluster_config> config = wal_->load_config(group_id_);
+    if (config) return config;
+
+    // Initial cluster config: contains only one server (myself).
+    config = cs_new<cluster_config>();
+    config->get_servers().push_back( cs_new<srv_config>(my_id_, my_endpoint_) );
+    return config;
+}
+
+void shared_wal_state_mgr::save_config(const cluster_config& config) {
+    // Raft should not proceed as if the config is durable.
+    if (!wal_->save_config(group_id_, config)) {
+        throw std::runtime_error("failed to save cluster config");
+    }
+}
+
+void shared_wal_state_mgr::save_state(const srv_state& state) {
+    if (!wal_->save_state(group_id_, state)) {
+        throw std::runtime_error("failed to save server state");
+    }
+}
+
+ptr<srv_state> shared_wal_state_mgr::read_state() {
+    return wal_->read_state(group_id_);
+}
+
+ptr<log_store> shared_wal_state_mgr::load_log_store() {
+    return log_store_;
+}
+
+}
+
@@ -0,0 +1,358 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "log_store.hxx"
+#include "state_mgr.hxx"
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nuraft {
+
+class cluster_config;
+class raft_server;
+class shared_wal_log_store;
+class srv_config;
+class srv_state;
+
+struct shared_wal_options {
+    shared_wal_options()
+        : segment_size_(64 * 1024 * 1024)
+        , do_sync_(true)
+        {}
+
+    /**
+     * Once the current segment file gets bigger than this size
+     * (in bytes), a new segment file is created.
+     */
+    size_t segment_size_;
+
+    /**
+     * If `false`, `fdatasync` is not called and the data is only
+     * written to the page cache. For testing purpose.
+     */
+    bool do_sync_;
+};
+
+/**
+ * Write-ahead log shared by multiple Raft groups on the same host.
+ *
+ * Log appends and server state/config updates of all groups go into
+ * a single sequence of segment files. Sync requests from different
+ * groups are served by a dedicated thread which calls `fdatasync`
+ * once for all records written so far (group commit), so that the
+ * number of flushes does not grow with the number of groups.
+ *
+ * Each group has its own in-memory index of log locations, and reads
+ * logs from the segment files. Segments are removed by `checkpoint()`
+ * once no group has live data in them, that is, all the logs in them
+ * have been compacted by each group's `log_store::compact()`.
+ */
+class shared_wal : public std::enable_shared_from_this<shared_wal> {
+    friend class shared_wal_log_store;
+public:
+    shared_wal(const std::string& path,
+               const shared_wal_options& opt = shared_wal_options());
+
+    ~shared_wal();
+
+    __nocopy__(shared_wal);
+
+public:
+    /**
+     * Open the WAL in the given directory, and recover all groups
+     * from the existing segment files. A torn record at the end of
+     * the last segment is truncated.
+     *
+     * @return `true` on success.
+     */
+    bool open();
+
+    /**
+     * Sync all records and close the WAL.
+     */
+    void close();
+
+    /**
+     * Get the log store of the given group. The group is created
+     * if it does not exist.
+     *
+     * @param group_id Group ID.
+     * @return Log store.
+     */
+    ptr<shared_wal_log_store> get_log_store(uint64_t group_id);
+
+    /**
+     * Get the IDs of all groups.
+     */
+    std::vector<uint64_t> get_group_ids();
+
+    /**
+     * Write the server state of the given group, and wait until it
+     * becomes durable.
+     *
+     * @return `true` on success.
+     */
+    bool save_state(uint64_t group_id, const srv_state& state);
+
+    /**
+     * @return The last saved server state of the given group,
+     *         `nullptr` if not exist.
+     */
+    ptr<srv_state> read_state(uint64_t group_id);
+
+    /**
+     * Write the cluster config of the given group, and wait until it
+     * becomes durable.
+     *
+     * @return `true` on success.
+     */
+    bool save_config(uint64_t group_id, const cluster_config& config);
+
+    /**
+     * @return The last saved cluster config of the given group,
+     *         `nullptr` if not exist.
+     */
+    ptr<cluster_config> load_config(uint64_t group_id);
+
+    /**
+     * Wait until all records written so far become durable.
+     *
+     * @return `true` on success.
+     */
+    bool sync();
+
+    /**
+     * Re-write the latest server state, cluster config, and log start
+     * index of groups into the current segment, and remove the segment
+     * files that no group needs anymore.
+     *
+     * @return Number of removed segment files.
+     */
+    size_t checkpoint();
+
+    /**
+     * @return Number of segment files.
+     */
+    size_t get_num_segments();
+
+    /**
+     * @return Number of `fdatasync` calls made so far.
+     */
+    uint64_t get_num_syncs() const { return num_syncs_; }
+
+private:
+    struct segment;
+    struct log_loc;
+    struct group;
+
+    ptr<group> get_group(uint64_t group_id, bool create);
+
+    uint64_t write_record(uint8_t type,
+                          uint64_t group_id,
+                          const buffer& payload,
+                          ptr<segment>* seg_out,
+                          uint64_t* offset_out);
+
+    bool read_payload(const log_loc& loc, ptr<buffer>& payload_out);
+
+    bool recover_segment(ptr<segment>& seg, bool is_last);
+
+    void replay(uint8_t type, uint64_t group_id,
+                buffer& payload, ptr<segment>& seg, uint64_t offset);
+
+    ptr<segment> open_segment(uint64_t seq, bool create);
+
+    bool sync_dir();
+
+    bool request_sync(uint64_t lsn);
+
+    bool wait_for_sync(uint64_t lsn);
+
+    void sync_loop();
+
+    void notify_durable_logs();
+
+    void notify_io_failure();
+
+    // Called by `shared_wal_log_store`.
+    ulong append_log(group& gg, ulong index, log_entry& entry);
+    void compact_logs(group& gg, ulong last_log_index);
+    void reset_logs(group& gg, ulong start_index);
+    ptr<log_entry> read_log(group& gg, ulong index);
+    ulong get_durable_index(group& gg);
+
+    std::string path_;
+
+    shared_wal_options opt_;
+
+    /**
+     * Lock for the segment list, writes, and `groups_`.
+     */
+    std::mutex wal_lock_;
+
+    /**
+     * List of segments, the last one is the current segment.
+     */
+    std::list< ptr<segment> > segments_;
+
+    /**
+     * Map of {group ID, group}.
+     */
+    std::map< uint64_t, ptr<group> > groups_;
+
+    /**
+     * Sequence number of the last written record.
+     */
+    uint64_t written_lsn_;
+
+    /**
+     * Sequence number of the last durable record.
+     */
+    std::atomic<uint64_t> synced_lsn_;
+
+    /**
+     * The greatest sequence number that sync has been requested for.
+     */
+    uint64_t requested_lsn_;
+
+    /**
+     * Lock and condition variable for sync requests and completions.
+     */
+    std::mutex sync_lock_;
+    std::condition_variable sync_cv_;
+    std::condition_variable synced_cv_;
+
+    /**
+     * Thread serving sync requests.
+     */
+    std::thread sync_thread_;
+
+    std::atomic<bool> stopping_;
+
+    /**
+     * Set if any write or sync has failed. All further
+     * sync requests fail once it is set.
+     */
+    std::atomic<bool> io_failed_;
+
+    std::atomic<uint64_t> num_syncs_;
+};
+
+/**
+ * `log_store` of a group, backed by `shared_wal`.
+ * If logs cannot be made durable, `end_of_append_batch` and
+ * `apply_pack` throw `std::runtime_error`, as they return nothing.
+ */
+class shared_wal_log_store : public log_store {
+public:
+    shared_wal_log_store(ptr<shared_wal> wal, ptr<shared_wal::group> gg);
+
+    ~shared_wal_log_store();
+
+    __nocopy__(shared_wal_log_store);
+
+public:
+    ulong next_slot() const;
+
+    ulong start_index() const;
+
+    ptr<log_entry> last_entry() const;
+
+    ulong append(ptr<log_entry>& entry);
+
+    void write_at(ulong index, ptr<log_entry>& entry);
+
+    void end_of_append_batch(ulong start, ulong cnt);
+
+    ptr<std::vector<ptr<log_entry>>> log_entries(ulong start, ulong end);
+
+    ptr<log_entry> entry_at(ulong index);
+
+    ulong term_at(ulong index);
+
+    ptr<buffer> pack(ulong index, int32 cnt);
+
+    void apply_pack(ulong index, buffer& pack);
+
+    bool compact(ulong last_log_index);
+
+    bool flush();
+
+    ulong last_durable_index();
+
+    /**
+     * If set, appended logs are synced in the background, and
+     * `raft_server::notify_log_append_completion` of the given server
+     * is called once they become durable, or with `false` if the sync
+     * fails. It is needed for
+     * `raft_params::parallel_log_appending_`.
+     *
+     * @param raft Raft server, `nullptr` to unset.
+     */
+    void set_raft_server(raft_server* raft);
+
+private:
+    ptr<shared_wal> wal_;
+    ptr<shared_wal::group> group_;
+};
+
+/**
+ * `state_mgr` of a group, backed by `shared_wal`.
+ * If the state or config cannot be made durable, `save_state` and
+ * `save_config` throw `std::runtime_error`.
+ */
+class shared_wal_state_mgr : public state_mgr {
+public:
+    shared_wal_state_mgr(int32 srv_id,
+                         const std::string& endpoint,
+                         ptr<shared_wal> wal,
+                         uint64_t group_id);
+
+    ~shared_wal_state_mgr() {}
+
+    ptr<cluster_config> load_config();
+
+    void save_config(const cluster_config& config);
+
+    void save_state(const srv_state& state);
+
+    ptr<srv_state> read_state();
+
+    ptr<log_store> load_log_store();
+
+    int32 server_id() { return my_id_; }
+
+    void system_exit(const int exit_code) {}
+
+private:
+    int32 my_id_;
+    std::string my_endpoint_;
+    ptr<shared_wal> wal_;
+    uint64_t group_id_;
+    ptr<shared_wal_log_store> log_store_;
+};
+
+}
+
@@ -33,6 +33,12 @@ limitations under the License.
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+#include <coroutine>
+#define NURAFT_COROUTINE_SUPPORT 1
+#endif
 
 namespace nuraft {
 
@@ -49,15 +55,24 @@ enum cmd_result_code {
     CANNOT_REMOVE_LEADER            = -9,
     SERVER_IS_LEAVING               = -10,
     TERM_MISMATCH                   = -11,
+    SERVER_IS_BUSY                  = -12,
 
     RESULT_NOT_EXIST_YET            = -10000,
 
     FAILED                          = -32768,
 };
 
+/**
+ * Executor to run completion tasks of `cmd_result`.
+ * It should run (or schedule) the given task exactly once.
+ */
+using cmd_result_executor = std::function< void( std::function<void()> ) >;
+
 template< typename T,
           typename TE = ptr<std::exception> >
-class cmd_result {
+class cmd_result
+    : public std::enable_shared_from_this< cmd_result<T, TE> >
+{
 public:
     /**
      * This handler will be invoked with the result value only.
@@ -77,6 +92,7 @@ public:
         , accepted_(false)
         , handler_(nullptr)
         , handler2_(nullptr)
+        , executor_(nullptr)
         {}
 
     explicit cmd_result(T& result,
@@ -88,6 +104,7 @@ public:
         , accepted_(false)
         , handler_(nullptr)
         , handler2_(nullptr)
+        , executor_(nullptr)
         {}
 
     explicit cmd_result(T& result,
@@ -100,6 +117,7 @@ public:
         , accepted_(_accepted)
         , handler_(nullptr)
         , handler2_(nullptr)
+        , executor_(nullptr)
         {}
 
     explicit cmd_result(const handler_type& handler)
@@ -109,6 +127,7 @@ public:
         , accepted_(false)
         , handler_(handler)
         , handler2_(nullptr)
+        , executor_(nullptr)
         {}
 
     ~cmd_result() {}
@@ -128,9 +147,30 @@ public:
         accepted_ = false;
         handler_ = nullptr;
         handler2_ = nullptr;
+        executor_ = nullptr;
         result_ = T();
     }
 
+    /**
+     * Bind an executor that will run the handler, instead of
+     * the thread setting the result. If the result already exists
+     * when the handler is installed, the handler is invoked by the
+     * caller of `when_ready` as usual.
+     *
+     * The instance should be owned by a `ptr` to use an executor,
+     * as the completion task holds a reference to it. Otherwise,
+     * the executor is ignored and the handler is invoked by the thread
+     * setting the result (if built with `_NO_EXCEPTION`, it is not
+     * allowed at all).
+     *
+     * @param executor Executor.
+     * @return void.
+     */
+    void set_executor(const cmd_result_executor& executor) {
+        std::lock_guard<std::mutex> guard(lock_);
+        executor_ = executor;
+    }
+
     /**
      * Install a handler that will be invoked when
      * we get the result of replication.
@@ -163,6 +203,40 @@ public:
         if (call_handler) handler(*this, err_);
     }
 
+    /**
+     * Chain a continuation that will be invoked with this instance
+     * once the result is set, and return a new result that will be
+     * set to the return value of the continuation.
+     *
+     * If this result is not successful, the continuation is skipped
+     * and the result code and error are propagated as they are.
+     *
+     * As it installs a handler, it cannot be used together with
+     * `when_ready` on the same instance.
+     *
+     * @param func Continuation.
+     * @return Result of the continuation.
+     */
+    template<typename F,
+             typename U = typename std::decay<
+                 decltype( std::declval<F>()( std::declval<cmd_result<T, TE>&>() ) )
+             >::type>
+    ptr< cmd_result<U, TE> > then(F func) {
+        ptr< cmd_result<U, TE> > next = cs_new< cmd_result<U, TE> >();
+        when_ready( handler_type2(
+            [next, func](cmd_result<T, TE>& res, TE& err) mutable {
+                if (res.get_accepted()) next->accept();
+                cmd_result_code code = res.get_result_code();
+                TE next_err = err;
+                U next_val = U();
+                if (code == cmd_result_code::OK && !next_err) {
+                    next_val = func(res);
+                }
+                next->set_result(next_val, next_err, code);
+            } ) );
+        return next;
+    }
+
     /**
      * Set result value.
      *
@@ -180,8 +254,28 @@ public:
             if (handler_ || handler2_) call_handler = true;
         }
         if (call_handler) {
-            if (handler2_) handler2_(*this, err);
-            else if (handler_) handler_(result, err);
+            ptr< cmd_result<T, TE> > self = nullptr;
+            if (executor_) {
+#ifndef _NO_EXCEPTION
+                // Not owned by a `ptr`, cannot outlive this call.
+                try {
+                    self = this->shared_from_this();
+                } catch (const std::bad_weak_ptr&) {
+                    self = nullptr;
+                }
+#else
+                self = this->shared_from_this();
+#endif
+            }
+            if (self) {
+                executor_( [self]() {
+                    if (self->handler2_) self->handler2_(*self, self->err_);
+                    else if (self->handler_) self->handler_(self->result_, self->err_);
+                } );
+            } else {
+                if (handler2_) handler2_(*this, err);
+                else if (handler_) handler_(result, err);
+            }
         }
         cv_.notify_all();
     }
@@ -266,6 +360,8 @@ public:
                  "Cannot remove leader."},
                 {cmd_result_code::TERM_MISMATCH,
                  "The current term does not match the expected term."},
+                {cmd_result_code::SERVER_IS_BUSY,
+                 "Too many pending logs, try again later."},
                 {cmd_result_code::RESULT_NOT_EXIST_YET,
                  "Operation is in progress and the result does not exist yet."},
                 {cmd_result_code::FAILED,
@@ -302,6 +398,38 @@ public:
         return empty_result_;
     }
 
+#ifdef NURAFT_COROUTINE_SUPPORT
+    /**
+     * Awaiter for C++20 coroutines: `co_await` resumes the coroutine
+     * once the result is set, and returns this instance so that the
+     * caller can check the result code and error along with the value.
+     * If an executor is bound, the coroutine is resumed by the executor.
+     *
+     * As it installs a handler, it cannot be used together with
+     * `when_ready` on the same instance.
+     */
+    class awaiter {
+    public:
+        explicit awaiter(const ptr< cmd_result<T, TE> >& res) : res_(res) {}
+
+        bool await_ready() const { return res_->has_result(); }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> guard(res_->lock_);
+            if (res_->has_result_) return false;
+            res_->handler2_ = [handle](cmd_result<T, TE>&, TE&) {
+                handle.resume();
+            };
+            return true;
+        }
+
+        ptr< cmd_result<T, TE> > await_resume() { return res_; }
+
+    private:
+        ptr< cmd_result<T, TE> > res_;
+    };
+#endif
+
 private:
     T empty_result_;
     T result_;
@@ -311,6 +439,7 @@ private:
     bool accepted_;
     handler_type handler_;
     handler_type2 handler2_;
+    cmd_result_executor executor_;
     mutable std::mutex lock_;
     std::condition_variable cv_;
 };
@@ -320,6 +449,23 @@ template< typename T,
           typename TE = ptr<std::exception> >
 using async_result = cmd_result<T, TE>;
 
+#ifdef NURAFT_COROUTINE_SUPPORT
+/**
+ * Make `ptr< cmd_result<...> >` awaitable, so that it can be used as
+ * `auto ret = co_await raft_instance->append_entries(...);`
+ * in a coroutine. `ret` is the same `ptr< cmd_result<...> >`, whose
+ * result is already set.
+ *
+ * The library itself is built as C++11; this is available only when
+ * the user's code is compiled as C++20 with coroutine support.
+ */
+template< typename T, typename TE >
+typename cmd_result<T, TE>::awaiter
+operator co_await(const ptr< cmd_result<T, TE> >& res) {
+    return typename cmd_result<T, TE>::awaiter(res);
+}
+#endif
+
 }
 
 #endif //_ASYNC_HXX_
@@ -78,6 +78,26 @@ public:
      */
     static ptr<buffer> expand(const buffer& buf, uint32_t new_size);
 
+    /**
+     * Get the size of memory block required for a buffer with
+     * given data size, including meta section.
+     *
+     * @param size Size of data.
+     * @return Size of memory block.
+     */
+    static size_t get_block_size(const size_t size);
+
+    /**
+     * Initialize a buffer on the given memory block, whose size should be
+     * at least `get_block_size(size)`. The memory block is owned by the
+     * caller, so that it can be a part of another object.
+     *
+     * @param block Memory block.
+     * @param size Size of data.
+     * @return buffer instance, the same address as `block`.
+     */
+    static buffer* init_block(void* block, const size_t size);
+
     /**
      * Get total size of entire buffer container, including meta section.
      *
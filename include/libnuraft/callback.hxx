@@ -207,6 +207,36 @@ public:
          */
         ResignationFromLeader = 27,
 
+        /**
+         * This server enters hibernation,
+         * by `raft_params::hibernation_timeout_ms_`.
+         * ctx: null.
+         */
+        Hibernation = 28,
+
+        /**
+         * This server wakes up from hibernation.
+         * ctx: null.
+         */
+        WakeUpFromHibernation = 29,
+
+        /**
+         * A follower is quarantined as a slow follower,
+         * by `raft_params::slow_follower_rtt_ratio_`.
+         * Only the leader will see this event.
+         * ctx: pointer to the smoothed round-trip time to the follower
+         *      in microseconds (`uint64_t*`).
+         */
+        FollowerQuarantined = 30,
+
+        /**
+         * A quarantined follower is restored.
+         * Only the leader will see this event.
+         * ctx: pointer to the smoothed round-trip time to the follower
+         *      in microseconds (`uint64_t*`).
+         */
+        FollowerRestored = 31,
+
     };
 
     struct Param {
@@ -271,12 +301,67 @@ public:
 
     using func_type = std::function<ReturnCode(Type, Param*)>;
 
-    cb_func() : func(nullptr) {}
+    /**
+     * Bitmask of event types, bit `N` corresponds to `Type` value `N`.
+     */
+    using event_mask = uint64_t;
+
+    /**
+     * Mask that subscribes all event types.
+     */
+    static const event_mask ALL_EVENTS = ~(event_mask)0;
+
+    /**
+     * Event types invoked multiple times per request, replication
+     * round, or commit. If `NURAFT_DISABLE_HOT_PATH_CALLBACKS` is
+     * defined at build time, these events are never delivered
+     * regardless of the mask.
+     */
+    static event_mask hot_path_events() {
+        return event_bit(ProcessReq) |
+               event_bit(GotAppendEntryRespFromPeer) |
+               event_bit(AppendLogs) |
+               event_bit(HeartBeat) |
+               event_bit(RequestAppendEntries) |
+               event_bit(GotAppendEntryReqFromLeader) |
+               event_bit(StateMachineExecution) |
+               event_bit(SentAppendEntriesReq) |
+               event_bit(ReceivedAppendEntriesReq) |
+               event_bit(SentAppendEntriesResp) |
+               event_bit(ReceivedAppendEntriesResp);
+    }
+
+    /**
+     * Get the bit corresponding to the given event type.
+     */
+    static event_mask event_bit(Type type) {
+        return (event_mask)1 << (uint32_t)type;
+    }
+
+    cb_func() : func(nullptr), mask(0) {}
+
+    cb_func(func_type _func, event_mask _mask = ALL_EVENTS)
+        : func(_func), mask(_func ? _mask : 0) {}
 
-    cb_func(func_type _func) : func(_func) {}
+    /**
+     * Check if the callback function wants to get the given event type.
+     * Callers on hot paths should check this before building `Param`.
+     *
+     * @param type Event type.
+     * @return `true` if subscribed.
+     */
+    bool is_subscribed(Type type) const;
+
+    /**
+     * Check if the library was built with
+     * `NURAFT_DISABLE_HOT_PATH_CALLBACKS`.
+     *
+     * @return `true` if hot path events are never delivered.
+     */
+    static bool hot_path_disabled();
 
     ReturnCode call(Type type, Param* param) {
-        if (func) {
+        if (is_subscribed(type)) {
             return func(type, param);
         }
         return Ok;
@@ -284,6 +369,8 @@ public:
 
 private:
     func_type func;
+
+    event_mask mask;
 };
 
 }
@@ -62,9 +62,14 @@ public:
      * Register an event callback function.
      *
      * @param func Callback function to register.
+     * @param mask Event types that `func` will be invoked for.
+     *             Use `cb_func::event_bit()` to build the mask.
+     *             Unsubscribed events are skipped without
+     *             building their parameters.
      */
-    void set_cb_func(cb_func::func_type func) {
-        cb_func_ = cb_func(func);
+    void set_cb_func(cb_func::func_type func,
+                     cb_func::event_mask mask = cb_func::ALL_EVENTS) {
+        cb_func_ = cb_func(func, mask);
     }
 
     /**
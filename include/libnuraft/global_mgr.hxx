@@ -25,8 +25,11 @@ limitations under the License.
 #include "ptr.hxx"
 
 #include <atomic>
+#include <functional>
 #include <list>
+#include <map>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <unordered_set>
 #include <vector>
@@ -34,8 +37,10 @@ limitations under the License.
 namespace nuraft {
 
 class asio_service;
+class cluster_config;
 class logger;
 class raft_server;
+class srv_config;
 
 class global_mgr {
     __interface_body__(global_mgr);
@@ -80,6 +85,8 @@ struct nuraft_global_config {
         : num_commit_threads_(1)
         , num_append_threads_(1)
         , max_scheduling_unit_ms_(200)
+        , leader_balancing_interval_ms_(0)
+        , max_leader_moves_per_round_(1)
         {}
 
     /**
@@ -99,6 +106,35 @@ struct nuraft_global_config {
      * and schedule the next instance, to avoid starvation issue.
      */
     size_t max_scheduling_unit_ms_;
+
+    /**
+     * (Experimental)
+     * If non-zero, leaderships of the Raft instances on this process
+     * are balanced across hosts with this interval. Each round, a
+     * leader on a host leading more groups than another member host
+     * (by 2 or more) hands over its leadership to a member on the
+     * least loaded host, by `raft_server::yield_leadership`.
+     *
+     * Only the groups that this process is a member of are counted.
+     * A group is identified by its members (IDs and endpoints) and
+     * the user context of its `cluster_config`. If multiple groups
+     * have the same members, e.g., groups sharing the RPC endpoints,
+     * each of them should have a unique user context
+     * (`cluster_config::set_user_ctx`); otherwise, they are counted
+     * as one group.
+     */
+    size_t leader_balancing_interval_ms_;
+
+    /**
+     * The maximum number of leaderships moved by a balancing round.
+     */
+    size_t max_leader_moves_per_round_;
+
+    /**
+     * Function that returns the host name of the given server.
+     * If not given, the host part of the endpoint is used.
+     */
+    std::function< std::string(const srv_config&) > host_resolver_;
 };
 
 static nuraft_global_config __DEFAULT_NURAFT_GLOBAL_CONFIG;
@@ -183,6 +219,28 @@ public:
      */
     virtual void request_commit(ptr<raft_server> server) __override__;
 
+    /**
+     * Run a round of leader balancing now.
+     *
+     * @return Number of leaderships being moved.
+     */
+    size_t balance_leaders();
+
+    /**
+     * Get the number of Raft groups led by each host, seen by
+     * the Raft instances on this process.
+     *
+     * @return Map of {host, number of groups}.
+     */
+    std::map<std::string, size_t> get_leader_counts();
+
+    /**
+     * Get the number of leaderships moved by leader balancing so far.
+     *
+     * @return Number of moves.
+     */
+    uint64_t get_num_leader_moves() const { return num_leader_moves_; }
+
 private:
     struct worker_handle;
 
@@ -201,6 +259,31 @@ private:
      */
     void append_worker_loop(ptr<worker_handle> handle);
 
+    /**
+     * Loop for leader balancing thread.
+     */
+    void balancer_loop(ptr<worker_handle> handle);
+
+    /**
+     * Get the host name of the given server.
+     */
+    std::string get_host(const srv_config& s_config) const;
+
+    /**
+     * Get the key identifying the group of the given config, made of
+     * the user context and the IDs and endpoints of all members.
+     * Members of the same group on this process have the same key.
+     * Groups with the same members are told apart only by the
+     * user context, which should be unique for each of them.
+     */
+    std::string get_group_key(const cluster_config& c_config) const;
+
+    /**
+     * Get the number of groups led by each host, based on the
+     * servers in `servers_`. `servers_lock_` should be held.
+     */
+    std::map<std::string, size_t> get_leader_counts_locked();
+
     /**
      * Lock for global Asio service instance.
      */
@@ -264,6 +347,27 @@ private:
      * Lock for `append_queue_` and `append_server_set_`.
      */
     std::mutex append_queue_lock_;
+
+    /**
+     * All Raft servers using this manager.
+     */
+    std::unordered_set<raft_server*> servers_;
+
+    /**
+     * Lock for `servers_`. It is also held while a balancing round
+     * accesses the servers, so that they are not destroyed meanwhile.
+     */
+    std::mutex servers_lock_;
+
+    /**
+     * Leader balancing thread.
+     */
+    ptr<worker_handle> balancer_;
+
+    /**
+     * Number of leaderships moved by leader balancing so far.
+     */
+    std::atomic<uint64_t> num_leader_moves_;
 };
 
 } // namespace nuraft;
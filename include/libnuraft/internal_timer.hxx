@@ -17,6 +17,8 @@ limitations under the License.
 
 #pragma once
 
+#include "monotonic_clock.hxx"
+
 #include <chrono>
 #include <mutex>
 #include <thread>
@@ -24,9 +26,21 @@ limitations under the License.
 namespace nuraft {
 
 struct timer_helper {
-    timer_helper(size_t duration_us = 0, bool fire_first_event = false)
+    /**
+     * @param duration_us Duration for `timeout()`.
+     * @param fire_first_event If `true`, the first `timeout()` call
+     *                         returns `true` regardless of the time.
+     * @param coarse If `true`, use `monotonic_clock::coarse_now_ns()`,
+     *               whose resolution is a few milliseconds. Suitable for
+     *               timers on hot paths with long durations, such as
+     *               rate-limiting log messages.
+     */
+    timer_helper(size_t duration_us = 0,
+                 bool fire_first_event = false,
+                 bool coarse = false)
         : duration_us_(duration_us)
         , first_event_fired_(!fire_first_event)
+        , coarse_(coarse)
     {
         reset();
     }
@@ -44,8 +58,9 @@ struct timer_helper {
     }
 
     void reset() {
+        uint64_t cur = now_ns();
         std::lock_guard<std::mutex> l(lock_);
-        t_created_ = std::chrono::system_clock::now();
+        t_created_ns_ = cur;
     }
 
     size_t get_duration_us() const {
@@ -67,28 +82,19 @@ struct timer_helper {
     }
 
     uint64_t get_us() {
-        std::lock_guard<std::mutex> l(lock_);
-        auto cur = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed = cur - t_created_;
-        return (uint64_t)(1000000 * elapsed.count());
+        return get_elapsed_ns(now_ns()) / 1000;
     }
 
     uint64_t get_ms() {
-        std::lock_guard<std::mutex> l(lock_);
-        auto cur = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed = cur - t_created_;
-        return (uint64_t)(1000 * elapsed.count());
+        return get_elapsed_ns(now_ns()) / 1000000;
     }
 
     uint64_t get_sec() {
-        std::lock_guard<std::mutex> l(lock_);
-        auto cur = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed = cur - t_created_;
-        return (uint64_t)elapsed.count();
+        return get_elapsed_ns(now_ns()) / 1000000000;
     }
 
     bool timeout() {
-        auto cur = std::chrono::system_clock::now();
+        uint64_t cur = now_ns();
 
         std::lock_guard<std::mutex> l(lock_);
         if (!first_event_fired_) {
@@ -97,12 +103,12 @@ struct timer_helper {
             return true;
         }
 
-        std::chrono::duration<double> elapsed = cur - t_created_;
-        return (duration_us_ < elapsed.count() * 1000000);
+        uint64_t elapsed_ns = cur > t_created_ns_ ? cur - t_created_ns_ : 0;
+        return ((uint64_t)duration_us_ * 1000 < elapsed_ns);
     }
 
     bool timeout_and_reset() {
-        auto cur = std::chrono::system_clock::now();
+        uint64_t cur = now_ns();
 
         std::lock_guard<std::mutex> l(lock_);
         if (!first_event_fired_) {
@@ -111,9 +117,9 @@ struct timer_helper {
             return true;
         }
 
-        std::chrono::duration<double> elapsed = cur - t_created_;
-        if (duration_us_ < elapsed.count() * 1000000) {
-            t_created_ = cur;
+        uint64_t elapsed_ns = cur > t_created_ns_ ? cur - t_created_ns_ : 0;
+        if ((uint64_t)duration_us_ * 1000 < elapsed_ns) {
+            t_created_ns_ = cur;
             return true;
         }
         return false;
@@ -126,9 +132,20 @@ struct timer_helper {
         return s;
     }
 
-    std::chrono::time_point<std::chrono::system_clock> t_created_;
+    uint64_t now_ns() const {
+        return coarse_ ? monotonic_clock::coarse_now_ns()
+                       : monotonic_clock::now_ns();
+    }
+
+    uint64_t get_elapsed_ns(uint64_t cur) const {
+        std::lock_guard<std::mutex> l(lock_);
+        return cur > t_created_ns_ ? cur - t_created_ns_ : 0;
+    }
+
+    uint64_t t_created_ns_;
     size_t duration_us_;
     mutable bool first_event_fired_;
+    const bool coarse_;
     mutable std::mutex lock_;
 };
 
@@ -34,7 +34,7 @@ limitations under the License.
 
 namespace nuraft {
 
-class log_entry {
+class log_entry : public std::enable_shared_from_this<log_entry> {
 public:
     log_entry(ulong term,
               const ptr<buffer>& buff,
@@ -47,6 +47,33 @@ public:
     __nocopy__(log_entry);
 
 public:
+    /**
+     * Create a log entry with a copy of the given payload.
+     *
+     * If the payload is small enough, the log entry and its payload
+     * are placed in a single memory allocation, sharing the same
+     * reference counter. `get_buf_ptr()` still returns a valid
+     * `ptr<buffer>`, which keeps the log entry alive.
+     *
+     * @param term Term of the log.
+     * @param data Payload data.
+     * @param size Size of payload.
+     * @param value_type Type of the log.
+     * @param log_timestamp Timestamp of the log.
+     * @param has_crc32 `true` if `crc32` is given.
+     * @param crc32 CRC32 checksum of the payload.
+     * @param compute_crc If `true` and `crc32` is not given, compute it.
+     * @return Log entry.
+     */
+    static ptr<log_entry> make(ulong term,
+                               const byte* data,
+                               size_t size,
+                               log_val_type value_type = log_val_type::app_log,
+                               uint64_t log_timestamp = 0,
+                               bool has_crc32 = false,
+                               uint32_t crc32 = 0,
+                               bool compute_crc = true);
+
     ulong get_term() const {
         return term_;
     }
@@ -59,11 +86,22 @@ public:
         return value_type_;
     }
 
+    /**
+     * Return `true` if this log carries client command(s),
+     * either `app_log` or `packed_app_log`.
+     */
+    bool is_app_log() const {
+        return value_type_ == log_val_type::app_log ||
+               value_type_ == log_val_type::packed_app_log;
+    }
+
     bool is_buf_null() const {
-        return (buff_.get()) ? false : true;
+        return (buff_.get() || inline_buf_) ? false : true;
     }
 
     buffer& get_buf() const {
+        if (inline_buf_) return *inline_buf_;
+
         // We accept nil buffer, but in that case,
         // the get_buf() shouldn't be called, throw runtime exception
         // instead of having segment fault (AV on Windows)
@@ -80,6 +118,10 @@ public:
     }
 
     ptr<buffer> get_buf_ptr() const {
+        if (inline_buf_) {
+            // Share the reference counter of this log entry.
+            return ptr<buffer>(shared_from_this(), inline_buf_);
+        }
         return buff_;
     }
 
@@ -106,13 +148,14 @@ public:
     }
 
     ptr<buffer> serialize() {
-        buff_->pos(0);
+        buffer& data = get_buf();
+        data.pos(0);
         ptr<buffer> buf = buffer::alloc( sizeof(ulong) +
                                          sizeof(char) +
-                                         buff_->size() );
+                                         data.size() );
         buf->put(term_);
         buf->put( (static_cast<byte>(value_type_)) );
-        buf->put(*buff_);
+        buf->put(data);
         buf->pos(0);
         return buf;
     }
@@ -120,8 +163,10 @@ public:
     static ptr<log_entry> deserialize(buffer& buf) {
         ulong term = buf.get_ulong();
         log_val_type t = static_cast<log_val_type>(buf.get_byte());
-        ptr<buffer> data = buffer::copy(buf);
-        return cs_new<log_entry>(term, data, t);
+        size_t data_size = buf.size() - buf.pos();
+        ptr<log_entry> entry = make(term, buf.data(), data_size, t);
+        buf.pos(buf.size());
+        return entry;
     }
 
     static ulong term_in_buffer(buffer& buf) {
@@ -146,6 +191,12 @@ private:
      */
     ptr<buffer> buff_;
 
+    /**
+     * If not null, data is placed in the same memory block
+     * as this log entry (see `make`), and `buff_` is not used.
+     */
+    buffer* inline_buf_;
+
     /**
      * The timestamp (since epoch) when this log entry was generated
      * in microseconds. Used only when `replicate_log_timestamp_` in
@@ -30,6 +30,8 @@ enum log_val_type : byte {
     cluster_server  = 3,
     log_pack        = 4,
     snp_sync_req    = 5,
+    packed_app_log  = 6,
+    ingest_marker   = 7,
     custom          = 231,
 };
 
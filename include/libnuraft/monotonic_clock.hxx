@@ -0,0 +1,182 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if !defined(NURAFT_DISABLE_TSC_CLOCK) && \
+    (defined(__x86_64__) || defined(_M_X64))
+    #define NURAFT_TSC_CLOCK_SUPPORTED 1
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+        #include <x86intrin.h>
+    #endif
+#endif
+
+#if defined(__linux__)
+    #include <time.h>
+#endif
+
+namespace nuraft {
+
+/**
+ * Monotonic clock sources used by `timer_helper`.
+ *
+ * `now_ns()` is a fine-grained clock. If the CPU has an invariant TSC
+ * (constant rate, not stopped in deep C-states), it is read by `rdtsc`
+ * and converted to nanoseconds using the rate calibrated against
+ * `std::chrono::steady_clock` at the first use. Otherwise, it is
+ * `std::chrono::steady_clock` itself.
+ *
+ * `coarse_now_ns()` is a cheaper clock whose resolution is a few
+ * milliseconds (the kernel tick), which is enough for timeout checks
+ * of hundreds of milliseconds or longer. If the platform does not
+ * provide such a clock, it is the same as `now_ns()`.
+ *
+ * Both clocks have arbitrary epochs, and they may drift apart from
+ * each other. Values from different clocks should not be compared.
+ */
+class monotonic_clock {
+public:
+    enum source {
+        /**
+         * `std::chrono::steady_clock`.
+         */
+        steady = 0,
+
+        /**
+         * Calibrated CPU time stamp counter.
+         */
+        tsc = 1,
+    };
+
+    /**
+     * Get the source of `now_ns()`.
+     *
+     * @return Clock source.
+     */
+    static source get_source() {
+        return get_calibration().src_;
+    }
+
+    /**
+     * Get the current time of the fine-grained clock.
+     *
+     * @return Time in nanoseconds since an arbitrary epoch.
+     */
+    static uint64_t now_ns() {
+#ifdef NURAFT_TSC_CLOCK_SUPPORTED
+        const calibration& cal = get_calibration();
+        if (cal.src_ == tsc) {
+            uint64_t cur_tsc = __rdtsc();
+            if (cur_tsc <= cal.base_tsc_) return cal.base_ns_;
+            return cal.base_ns_ +
+                   (uint64_t)( (double)(cur_tsc - cal.base_tsc_) *
+                               cal.ns_per_tick_ );
+        }
+#endif
+        return steady_now_ns();
+    }
+
+    /**
+     * Get the current time of the coarse clock.
+     *
+     * @return Time in nanoseconds since an arbitrary epoch.
+     */
+    static uint64_t coarse_now_ns() {
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_COARSE)
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0) {
+            return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+        }
+#endif
+        return now_ns();
+    }
+
+private:
+    struct calibration {
+        calibration()
+            : src_(steady)
+            , base_tsc_(0)
+            , base_ns_(0)
+            , ns_per_tick_(0)
+        {
+#ifdef NURAFT_TSC_CLOCK_SUPPORTED
+            if (!is_invariant_tsc()) return;
+
+            // Spin for a short period, and compare the number of ticks
+            // with the elapsed time of `steady_clock`.
+            const uint64_t CALIBRATION_NS = 5 * 1000 * 1000;
+            uint64_t ns_begin = steady_now_ns();
+            uint64_t tsc_begin = __rdtsc();
+            uint64_t ns_end = ns_begin;
+            while (ns_end - ns_begin < CALIBRATION_NS) {
+                ns_end = steady_now_ns();
+            }
+            uint64_t tsc_end = __rdtsc();
+            if (tsc_end <= tsc_begin) return;
+
+            ns_per_tick_ = (double)(ns_end - ns_begin) /
+                           (double)(tsc_end - tsc_begin);
+            base_tsc_ = tsc_end;
+            base_ns_ = ns_end;
+            src_ = tsc;
+#endif
+        }
+
+        source src_;
+        uint64_t base_tsc_;
+        uint64_t base_ns_;
+        double ns_per_tick_;
+    };
+
+    static const calibration& get_calibration() {
+        static calibration cal;
+        return cal;
+    }
+
+    static uint64_t steady_now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>
+               ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+    }
+
+#ifdef NURAFT_TSC_CLOCK_SUPPORTED
+    static bool is_invariant_tsc() {
+        // CPUID.80000007H:EDX[8] indicates invariant TSC.
+        const unsigned int LEAF = 0x80000007;
+        const unsigned int INVARIANT_TSC_BIT = 1u << 8;
+#if defined(_MSC_VER)
+        int regs[4] = {0, 0, 0, 0};
+        __cpuid(regs, 0x80000000);
+        if ((unsigned int)regs[0] < LEAF) return false;
+        __cpuid(regs, LEAF);
+        return ((unsigned int)regs[3] & INVARIANT_TSC_BIT) != 0;
+#else
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (__get_cpuid_max(0x80000000, nullptr) < LEAF) return false;
+        if (!__get_cpuid(LEAF, &eax, &ebx, &ecx, &edx)) return false;
+        return (edx & INVARIANT_TSC_BIT) != 0;
+#endif
+    }
+#endif
+};
+
+}
+
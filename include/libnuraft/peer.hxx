@@ -70,6 +70,14 @@ public:
         , leave_requested_(false)
         , hb_cnt_since_leave_(0)
         , stepping_down_(false)
+        , rtt_us_(0)
+        , ping_rtt_us_(0)
+        , ping_in_flight_(false)
+        , quarantined_(false)
+        , quarantine_check_cnt_(0)
+        , recovering_logs_(false)
+        , ingest_staged_idx_(0)
+        , features_(0)
         , reconn_scheduled_(false)
         , reconn_backoff_(0)
         , suppress_following_error_(false)
@@ -98,6 +106,10 @@ public:
         return config_->is_learner();
     }
 
+    bool is_witness() const {
+        return config_->is_witness();
+    }
+
     const srv_config& get_config() {
         return *config_;
     }
@@ -218,6 +230,22 @@ public:
                   ptr<req_msg>& req,
                   rpc_handler& handler);
 
+    /**
+     * Send a ping request to measure the round-trip time. It uses
+     * a dedicated RPC client and does not take the busy flag, so that
+     * it neither waits for nor blocks other requests such as
+     * append entries.
+     *
+     * @param myself Shared pointer of this peer.
+     * @param req Ping request.
+     * @param ctx Context to create the RPC client.
+     * @return `false` if the previous ping has not returned yet,
+     *         or the request could not be sent.
+     */
+    bool send_ping(ptr<peer> myself,
+                   ptr<req_msg>& req,
+                   context& ctx);
+
     void shutdown();
 
     // Time that sent the last request.
@@ -247,6 +275,16 @@ public:
     bool recreate_rpc(ptr<srv_config>& config,
                       context& ctx);
 
+    /**
+     * Release the RPC client to this server. A new client will be
+     * created by `recreate_rpc` when it is needed again.
+     */
+    void release_rpc() {
+        std::lock_guard<std::mutex> l(rpc_protector_);
+        rpc_.reset();
+        ping_rpc_.reset();
+    }
+
     void reset_rpc_errs()   { rpc_errs_ = 0; }
     void inc_rpc_errs()     { rpc_errs_.fetch_add(1); }
     int32 get_rpc_errs()    { return rpc_errs_; }
@@ -268,6 +306,95 @@ public:
     void inc_hb_cnt_since_leave()           { hb_cnt_since_leave_.fetch_add(1); }
     int32 get_hb_cnt_since_leave() const    { return hb_cnt_since_leave_; }
 
+    /**
+     * Update the smoothed round-trip time to this peer
+     * (EWMA with weight 1/8, as TCP does).
+     *
+     * @param rtt_us Sampled round-trip time in microseconds.
+     */
+    void update_rtt_us(uint64_t rtt_us) {
+        uint64_t prev = rtt_us_;
+        if (!prev) {
+            rtt_us_ = rtt_us;
+            return;
+        }
+        rtt_us_ = (prev * 7 + rtt_us) / 8;
+    }
+
+    /**
+     * Smoothed round-trip time of append entries requests
+     * to this peer, in microseconds. 0 if not measured yet.
+     */
+    uint64_t get_rtt_us() const     { return rtt_us_; }
+
+    /**
+     * Update the smoothed round-trip time of ping requests
+     * to this peer, in the same way as `update_rtt_us`.
+     *
+     * @param rtt_us Sampled round-trip time in microseconds.
+     */
+    void update_ping_rtt_us(uint64_t rtt_us) {
+        uint64_t prev = ping_rtt_us_;
+        if (!prev) {
+            ping_rtt_us_ = rtt_us;
+            return;
+        }
+        ping_rtt_us_ = (prev * 7 + rtt_us) / 8;
+    }
+
+    /**
+     * Smoothed round-trip time of ping requests to this peer,
+     * which does not include the time to append logs,
+     * in microseconds. 0 if not measured yet.
+     */
+    uint64_t get_ping_rtt_us() const    { return ping_rtt_us_; }
+
+    /**
+     * Quarantine this peer as a slow follower, or restore it.
+     * See `raft_params::slow_follower_rtt_ratio_`.
+     */
+    void set_quarantined(bool to) {
+        quarantined_ = to;
+        quarantine_check_cnt_ = 0;
+    }
+    bool is_quarantined() const             { return quarantined_; }
+
+    void reset_quarantine_check_cnt()       { quarantine_check_cnt_ = 0; }
+    int32 inc_quarantine_check_cnt()        { return ++quarantine_check_cnt_; }
+
+    /**
+     * Set if this peer reports that it is recovering its lost logs.
+     * See `raft_server::is_recovering_logs`.
+     */
+    void set_recovering_logs(bool to)       { recovering_logs_ = to; }
+    bool is_recovering_logs() const         { return recovering_logs_; }
+
+    /**
+     * Set the log index of the ingested snapshot that this peer
+     * has staged, so that the marker log can be sent to it.
+     * See `raft_server::bulk_ingest`.
+     */
+    void set_ingest_staged_idx(ulong to)    { ingest_staged_idx_ = to; }
+    ulong get_ingest_staged_idx() const     { return ingest_staged_idx_; }
+
+    /**
+     * Features that a member of this version understands. Members
+     * report them to the leader, so that the leader does not use
+     * a feature until all members support it.
+     */
+    enum feature : uint8_t {
+        // `srv_config` with the witness flag.
+        WITNESS_CONFIG = 0x1,
+    };
+
+    /**
+     * Set the features reported by this peer, see `feature`.
+     * They are cleared on reconnection, as the peer may have been
+     * restarted with a different version.
+     */
+    void set_features(uint8_t to)           { features_ = to; }
+    bool has_feature(feature f) const       { return (features_ & f) != 0; }
+
     void schedule_reconnection() {
         reconn_timer_.set_duration_sec(3);
         reconn_timer_.reset();
@@ -307,6 +434,7 @@ private:
                            ptr<rpc_client> my_rpc_client,
                            ptr<req_msg>& req,
                            ptr<rpc_result>& pending_result,
+                           uint64_t sent_ns,
                            ptr<resp_msg>& resp,
                            ptr<rpc_exception>& err);
 
@@ -326,7 +454,12 @@ private:
     ptr<rpc_client> rpc_;
 
     /**
-     * Guard of `rpc_`.
+     * RPC client to this server, used for ping requests only.
+     */
+    ptr<rpc_client> ping_rpc_;
+
+    /**
+     * Guard of `rpc_` and `ping_rpc_`.
      */
     std::mutex rpc_protector_;
 
@@ -471,6 +604,48 @@ private:
      */
     std::atomic<bool> stepping_down_;
 
+    /**
+     * Smoothed round-trip time in microseconds.
+     */
+    std::atomic<uint64_t> rtt_us_;
+
+    /**
+     * Smoothed round-trip time of ping requests in microseconds.
+     */
+    std::atomic<uint64_t> ping_rtt_us_;
+
+    /**
+     * `true` if a ping request has been sent and not returned yet.
+     */
+    std::atomic<bool> ping_in_flight_;
+
+    /**
+     * `true` if this peer is quarantined as a slow follower.
+     */
+    std::atomic<bool> quarantined_;
+
+    /**
+     * Number of consecutive responses that suggest to change
+     * `quarantined_`.
+     */
+    std::atomic<int32> quarantine_check_cnt_;
+
+    /**
+     * `true` if this peer is recovering its lost logs,
+     * it should not be counted for the commit quorum.
+     */
+    std::atomic<bool> recovering_logs_;
+
+    /**
+     * Log index of the ingested snapshot staged by this peer.
+     */
+    std::atomic<ulong> ingest_staged_idx_;
+
+    /**
+     * Features reported by this peer, see `feature`.
+     */
+    std::atomic<uint8_t> features_;
+
     /**
      * For re-connection.
      */
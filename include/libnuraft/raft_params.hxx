@@ -97,6 +97,28 @@ struct raft_params {
         , use_bg_thread_for_snapshot_io_(false)
         , use_full_consensus_among_healthy_members_(false)
         , parallel_log_appending_(false)
+        , memory_only_durability_(false)
+        , checkpoint_interval_ms_(0)
+        , snapshot_save_queue_size_(0)
+        , async_pre_commit_(false)
+        , max_uncommitted_logs_(0)
+        , max_unapplied_logs_(0)
+        , max_pending_bytes_(0)
+        , admission_wait_ms_(0)
+        , auto_forwarding_max_batch_size_(0)
+        , max_packed_cmds_(0)
+        , max_packed_cmd_size_(256)
+        , adaptive_election_timeout_(false)
+        , failure_detection_phi_threshold_(8.0)
+        , adaptive_heart_beat_min_interval_(0)
+        , leader_placement_interval_ms_(0)
+        , leader_placement_min_gain_pct_(20)
+        , leadership_handoff_(false)
+        , hibernation_timeout_ms_(0)
+        , min_commit_zones_(0)
+        , min_election_zones_(0)
+        , slow_follower_rtt_ratio_(0)
+        , slow_follower_detection_count_(10)
         {}
 
     /**
@@ -531,6 +553,9 @@ public:
 
     /**
      * To choose blocking call or asynchronous call.
+     * It applies to local callers only. Client requests forwarded
+     * from followers through the Asio RPC are always completed
+     * asynchronously, without blocking the RPC thread.
      */
     return_method_type return_method_;
 
@@ -601,9 +626,310 @@ public:
      *
      * Note that parallel log appending is available for the leader only,
      * and followers will wait for `notify_log_append_completion` call
-     * before returning the response.
+     * before returning the response. The response is deferred without
+     * blocking the thread, using the async callback of `resp_msg`.
+     * Custom RPC listeners should handle `resp_msg::has_async_cb`
+     * for all message types, not only for client requests.
+     * While responses are deferred, the follower ignores its election
+     * timeout for up to one election timeout. Deferred responses are
+     * rejected if the term changes or their logs are overwritten.
      */
     bool parallel_log_appending_;
+
+    /**
+     * (Experimental)
+     * If `true`, the durability of logs is satisfied by the replication to
+     * a quorum of members in memory, instead of the local persistence of
+     * each member. Users can keep log entries in RAM, and
+     *
+     *   - `log_store::flush()` will not be invoked in the commit path,
+     *   - `log_store::last_durable_index()` will not be waited for even
+     *     when `parallel_log_appending_` is set, so that a log is
+     *     acknowledged as soon as it is appended to the log store, and
+     *   - if the log store is empty on restart, it will start right after
+     *     the last snapshot (checkpoint) of the state machine.
+     *
+     * A member restarted with lost logs may have acknowledged some of
+     * them, so that it does not vote, does not start an election, and
+     * is not counted for the commit quorum until it catches up with
+     * the commit index of the leader.
+     *
+     * Committed logs survive as long as a quorum of members have not
+     * lost them at the same time. Otherwise, no leader can be elected
+     * until `raft_server::end_log_recovery()` is called on the restarted
+     * members, and then the cluster falls back to the last checkpoint:
+     * the logs committed after that are lost.
+     */
+    bool memory_only_durability_;
+
+    /**
+     * If non-zero and `memory_only_durability_` is set, a snapshot
+     * (checkpoint) will be created every given amount of time in
+     * milliseconds if there are newly committed logs, regardless of
+     * `snapshot_distance_`.
+     */
+    int32 checkpoint_interval_ms_;
+
+    /**
+     * (Experimental)
+     * If non-zero, the receiver of a snapshot acknowledges each object
+     * right after receiving it, and a dedicated background thread writes
+     * the objects through `state_machine::save_logical_snp_obj`, so that
+     * the sender does not wait for the receiver's disk write. This value
+     * is the max number of received objects waiting to be written. If the
+     * queue is full, the receiver waits for an empty slot before the ack.
+     *
+     * `state_machine::apply_snapshot` is invoked once all objects are
+     * written. If any write fails, the next ack rejects the snapshot, and
+     * the leader will start it over.
+     *
+     * Note that the object IDs should be sequential: `save_logical_snp_obj`
+     * should set `obj_id` to the given `obj_id + 1`.
+     */
+    int32 snapshot_save_queue_size_;
+
+    /**
+     * (Experimental)
+     * If `true`, `state_machine::pre_commit_ext` will not be invoked inline
+     * while appending logs. Instead, a dedicated background thread delivers
+     * the appended logs in batches through `state_machine::pre_commit_batch`,
+     * so that log appending and replication do not wait for the pre-commit.
+     *
+     *   - A log is committed only after its pre-commit is done.
+     *   - Before rolling back logs, all pending pre-commits are delivered
+     *     first, so that a rollback always follows the pre-commit of the log.
+     *   - In async replication mode, the result of pre-commit is not
+     *     returned to the client, as it is not available yet.
+     *   - `req_ext_params::after_precommit_` is invoked by the background
+     *     thread.
+     *
+     * This parameter is applied at the initialization only.
+     */
+    bool async_pre_commit_;
+
+    /**
+     * (Experimental)
+     * Admission control of the leader. If non-zero, new requests will be
+     * rejected with `cmd_result_code::SERVER_IS_BUSY` while the number of
+     * appended but not yet committed logs is equal to or greater than
+     * this value.
+     */
+    int32 max_uncommitted_logs_;
+
+    /**
+     * (Experimental)
+     * Admission control of the leader. If non-zero, new requests will be
+     * rejected with `cmd_result_code::SERVER_IS_BUSY` while the number of
+     * committed but not yet applied (to the state machine) logs is equal to
+     * or greater than this value.
+     */
+    int32 max_unapplied_logs_;
+
+    /**
+     * (Experimental)
+     * Admission control of the leader. If non-zero, new requests will be
+     * rejected with `cmd_result_code::SERVER_IS_BUSY` while the total size
+     * of appended but not yet applied logs, in bytes, is equal to or greater
+     * than this value.
+     */
+    int64 max_pending_bytes_;
+
+    /**
+     * If non-zero, a local request exceeding the above admission limits
+     * will wait for the state machine to catch up, up to the given time in
+     * milliseconds, before being rejected. Requests forwarded from other
+     * members are always rejected immediately.
+     */
+    int32 admission_wait_ms_;
+
+    /**
+     * (Experimental)
+     * If greater than 1 and `auto_forwarding_` is set, requests waiting for
+     * an available auto-forwarding connection are coalesced into a single
+     * forwarded request carrying up to the given number of logs, instead of
+     * being sent one by one. The leader returns the results of all logs
+     * in the batch, and each original request gets its own result.
+     *
+     * Requests are batched only after a response from the current leader
+     * says that it accepts batches, so that a leader running an older
+     * version still gets requests one by one.
+     *
+     * In blocking mode, requests will be queued instead of waiting for
+     * an available connection.
+     */
+    int32 auto_forwarding_max_batch_size_;
+
+    /**
+     * (Experimental)
+     * If greater than 1, small commands given to the leader through
+     * `append_entries` by concurrent callers are packed into a single
+     * log (`log_val_type::packed_app_log`), carrying up to the given
+     * number of commands. The state machine receives them through
+     * `state_machine::commit_packed`, and each caller gets the result
+     * of its own (last) command.
+     *
+     * Requests with `req_ext_params` callbacks or an expected term,
+     * and requests on followers, are not packed.
+     */
+    int32 max_packed_cmds_;
+
+    /**
+     * Commands larger than this size in bytes are not packed,
+     * effective only when `max_packed_cmds_` is set.
+     */
+    int32 max_packed_cmd_size_;
+
+    /**
+     * (Experimental)
+     * If `true`, followers derive the election timeout from the
+     * statistics of heartbeat inter-arrival times from the current
+     * leader (phi-accrual failure detection), instead of the static
+     * range given by `election_timeout_lower_bound_` and
+     * `election_timeout_upper_bound_`.
+     *
+     * The timeout is randomized in the same ratio as the static
+     * range, and it will never exceed `election_timeout_upper_bound_`.
+     * Until enough heartbeats are observed, the static range is used.
+     */
+    bool adaptive_election_timeout_;
+
+    /**
+     * Suspicion threshold of the adaptive election timeout. The leader
+     * is suspected once the probability that its next heartbeat is
+     * still on the way falls below `10^-phi`. Higher values tolerate
+     * more jitter but make failover slower.
+     */
+    double failure_detection_phi_threshold_;
+
+    /**
+     * (Experimental)
+     * If non-zero, the leader adjusts the heartbeat interval to each
+     * follower based on the measured round-trip time, between this
+     * value and `heart_beat_interval_`, in milliseconds.
+     * Followers also use this value to tell heartbeats from regular
+     * traffic when `adaptive_election_timeout_` is set, so that it
+     * should be the same on all members.
+     */
+    int32 adaptive_heart_beat_min_interval_;
+
+    /**
+     * (Experimental)
+     * If non-zero, members measure round-trip times to each other
+     * by ping requests at this interval in milliseconds, and followers
+     * report them to the leader along with append entries responses.
+     * The leader estimates the commit latency as if each member were
+     * the leader, and yields the leadership to the best one if it is
+     * better than the current one by `leader_placement_min_gain_pct_`.
+     *
+     * To avoid flapping, the same member should win consecutive
+     * evaluations, and a newly elected leader does not move the
+     * leadership for a while. Members with zero priority are never
+     * chosen. This value should be the same on all members.
+     */
+    int32 leader_placement_interval_ms_;
+
+    /**
+     * Minimum improvement of the estimated commit latency, in percent,
+     * to move the leadership by `leader_placement_interval_ms_`.
+     */
+    int32 leader_placement_min_gain_pct_;
+
+    /**
+     * (Experimental)
+     * If `true`, in-flight client requests are handed off to the new
+     * leader during a graceful leadership transfer by `yield_leadership`,
+     * instead of being cancelled:
+     *   1) Logs are sent to the successor right away, so that it
+     *      takes over the leadership as soon as it catches up.
+     *   2) Requests appended before the resignation are not cancelled.
+     *      Their results are returned once the new leader commits them.
+     *      If they are overwritten by another leader, or not committed
+     *      in time, they are cancelled.
+     *   3) Requests made by `append_entries` during the transfer are
+     *      held until the new leader is known, and then forwarded to it
+     *      if `auto_forwarding_` is set. Otherwise, they are returned
+     *      with `NOT_LEADER`.
+     *
+     * The handoff lasts up to twice `election_timeout_upper_bound_`.
+     */
+    bool leadership_handoff_;
+
+    /**
+     * (Experimental)
+     * If non-zero, an idle group hibernates after this time in
+     * milliseconds: if no new log has been appended, and all members
+     * have the same logs and commit index, the leader stops sending
+     * heartbeats, and followers stop their election timers. All of
+     * them release the RPC clients to the other members.
+     *
+     * Any incoming request (except for ping) or client request wakes
+     * the server up, and the group resumes as if nothing happened.
+     * If the leader fails while the group is hibernating, it is
+     * detected once any member wakes up.
+     *
+     * This value should be the same on all members.
+     */
+    int32 hibernation_timeout_ms_;
+
+    /**
+     * (Experimental)
+     * Placement-aware commit quorum. If greater than 1, a log is
+     * committed only when, in addition to the commit quorum, members
+     * in at least this number of different data centers (by
+     * `srv_config::dc_id_`, including the leader's) have it.
+     * For example, 2 means "a quorum, and at least one remote zone".
+     * Witnesses are not counted, as they do not keep log payloads.
+     *
+     * The commit index follows the fastest members satisfying both
+     * the quorum and the placement, so that the commit latency is
+     * decided by the nearest zones.
+     *
+     * If it is greater than the number of data centers among voting
+     * members, the number of data centers is used instead.
+     */
+    int32 min_commit_zones_;
+
+    /**
+     * (Experimental)
+     * Placement-aware election quorum. If greater than 1, a candidate
+     * becomes the leader only when, in addition to the election
+     * quorum, it gets votes (including its own) from at least this
+     * number of different data centers. It is capped in the same way
+     * as `min_commit_zones_`.
+     */
+    int32 min_election_zones_;
+
+    /**
+     * (Experimental)
+     * If non-zero, the leader quarantines persistently slow followers:
+     * if the smoothed round-trip time of append entries requests to a
+     * voting follower exceeds this multiple of the median of the
+     * other voting followers' ones, for `slow_follower_detection_count_`
+     * consecutive responses, the follower is quarantined.
+     *
+     * While a follower is quarantined,
+     *   1) it is regarded as an unhealthy member for
+     *      `use_full_consensus_among_healthy_members_`, so that the
+     *      leader does not wait for it as long as the others form
+     *      the quorum,
+     *   2) it is not chosen as the successor by `yield_leadership`
+     *      unless it is explicitly designated, and
+     *   3) the leader sends requests to it after the other members,
+     *      with a quarter of `max_append_size_`.
+     *
+     * It is still a voting member, and its response is counted for
+     * the regular quorum. It is restored once its round-trip time
+     * gets back below half of the threshold, for the same number
+     * of consecutive responses.
+     */
+    int32 slow_follower_rtt_ratio_;
+
+    /**
+     * Number of consecutive responses to quarantine a slow follower,
+     * or to restore it. Used only when `slow_follower_rtt_ratio_`
+     * is set.
+     */
+    int32 slow_follower_detection_count_;
 };
 
 }
@@ -48,13 +48,17 @@ class custom_notification_msg;
 class delayed_task_scheduler;
 class global_mgr;
 class EventAwaiter;
+class leader_placement;
 class logger;
 class peer;
+class phi_accrual_detector;
+class pre_commit_pipeline;
 class rpc_client;
 class raft_server_handler;
 class req_msg;
 class resp_msg;
 class rpc_exception;
+class snapshot_obj_writer;
 class snapshot_sync_ctx;
 class state_machine;
 class state_mgr;
@@ -68,6 +72,7 @@ public:
     struct init_options {
         init_options()
             : skip_initial_election_timeout_(false)
+            , raft_callback_event_mask_(cb_func::ALL_EVENTS)
             , start_server_in_constructor_(true)
             , test_mode_flag_(false)
             {}
@@ -76,6 +81,7 @@ public:
                      bool start_server_in_constructor,
                      bool test_mode_flag)
             : skip_initial_election_timeout_(skip_initial_election_timeout)
+            , raft_callback_event_mask_(cb_func::ALL_EVENTS)
             , start_server_in_constructor_(start_server_in_constructor)
             , test_mode_flag_(test_mode_flag)
             {}
@@ -96,6 +102,15 @@ public:
          */
         cb_func::func_type raft_callback_;
 
+        /**
+         * Event types that `raft_callback_` will be invoked for.
+         * Events not in this mask are skipped without building
+         * their parameters, which saves the cost of the callback
+         * on hot paths (e.g., `RequestAppendEntries`, `AppendLogs`).
+         * Use `cb_func::event_bit()` to build the mask.
+         */
+        cb_func::event_mask raft_callback_event_mask_;
+
         /**
          * Option for compatiblity. Starts background commit and append threads
          * in constructor. Initialize election timer.
@@ -106,6 +121,17 @@ public:
           * If `true`, test mode is enabled.
          */
         bool test_mode_flag_;
+
+        /**
+         * (Optional)
+         * Executor to deliver the results of `append_entries` when
+         * `raft_params::return_method_` is `async_handler`.
+         *
+         * If given, the commit thread does not invoke the handlers of
+         * results by itself. Instead, the results of logs committed
+         * together are set in a single task submitted to this executor.
+         */
+        cmd_result_executor result_executor_;
     };
 
     struct limits {
@@ -277,7 +303,7 @@ public:
      * Extended parameters for advanced features.
      */
     struct req_ext_params {
-        req_ext_params() : expected_term_(0) {}
+        req_ext_params() : expected_term_(0), async_cli_resp_(false) {}
 
         /**
          * If given, this function will be invokced right after the pre-commit
@@ -295,6 +321,15 @@ public:
          * Opaque cookie which will be passed as is to the req_ext_cb
          */
         void* context_{nullptr};
+
+        /**
+         * If `true`, the response to a client request will be completed
+         * asynchronously through `resp_msg::call_async_cb`, regardless of
+         * `raft_params::return_method_`. RPC listeners that can send the
+         * response later set this flag, so that their threads are not
+         * blocked until the commit of forwarded requests.
+         */
+        bool async_cli_resp_;
     };
 
     /**
@@ -562,6 +597,79 @@ public:
         return true;
     }
 
+    /**
+     * Check if this server is hibernating,
+     * by `raft_params::hibernation_timeout_ms_`.
+     *
+     * @return `true` if it is hibernating.
+     */
+    bool is_hibernating() const { return hibernating_; }
+
+    /**
+     * Check if this server is recovering the logs lost by restart,
+     * by `raft_params::memory_only_durability_`. While recovering,
+     * this server does not vote, and is not counted for the commit
+     * quorum.
+     *
+     * @return `true` if it is recovering.
+     */
+    bool is_recovering_logs() const { return recovering_logs_; }
+
+    /**
+     * Stop recovering the lost logs without catching up with a leader,
+     * so that this server can vote again. It is needed only when a
+     * quorum of members have lost their logs at the same time, and
+     * no leader can be elected. Logs committed after the last
+     * checkpoint may be lost.
+     */
+    void end_log_recovery();
+
+    /**
+     * Wake up this server from hibernation. It does nothing if this
+     * server is not hibernating. Any incoming request or client request
+     * wakes up the server as well, but this function can be used to
+     * check the liveness of the group, as a hibernating follower does
+     * not detect the failure of the leader.
+     */
+    void wake_up();
+
+    /**
+     * Pending log info structure, for admission control.
+     */
+    struct pending_log_info {
+        pending_log_info()
+            : num_uncommitted_logs_(0)
+            , num_unapplied_logs_(0)
+            , pending_bytes_(0)
+            {}
+
+        /**
+         * Number of logs appended but not committed yet.
+         */
+        ulong num_uncommitted_logs_;
+
+        /**
+         * Number of logs committed but not applied to
+         * the state machine yet.
+         */
+        ulong num_unapplied_logs_;
+
+        /**
+         * Total size of logs appended but not applied to
+         * the state machine yet, in bytes.
+         */
+        ulong pending_bytes_;
+    };
+
+    /**
+     * Get the current depth of the pending logs, so that clients can
+     * apply back-pressure before hitting the admission limits
+     * (`raft_params::max_uncommitted_logs_` and so on).
+     *
+     * @return Pending log info.
+     */
+    pending_log_info get_pending_log_info() const;
+
     /**
      * Get the configuration of given server.
      *
@@ -585,6 +693,9 @@ public:
             : id_(-1)
             , last_log_idx_(0)
             , last_succ_resp_us_(0)
+            , rtt_us_(0)
+            , hb_interval_ms_(0)
+            , quarantined_(false)
             {}
 
         /**
@@ -602,6 +713,23 @@ public:
          * in microsecond.
          */
         ulong last_succ_resp_us_;
+
+        /**
+         * Smoothed round-trip time of append entries requests to this peer,
+         * in microsecond. 0 if not measured yet.
+         */
+        ulong rtt_us_;
+
+        /**
+         * Current heartbeat interval to this peer, in millisecond.
+         */
+        int32 hb_interval_ms_;
+
+        /**
+         * `true` if this peer is quarantined as a slow follower.
+         * See `raft_params::slow_follower_rtt_ratio_`.
+         */
+        bool quarantined_;
     };
 
     /**
@@ -826,10 +954,47 @@ public:
      */
     ulong get_last_snapshot_idx() const;
 
+    /**
+     * Bulk-ingest an external data set, bypassing Raft log.
+     * Only leader can call this API.
+     *
+     * All existing logs should be committed, and new client requests
+     * and membership changes are rejected until this API returns.
+     * The state machine stages the data via `state_machine::ingest_snapshot()`
+     * as a snapshot at a new log index, and the leader appends a marker log
+     * at that index. Followers will receive the staged data through the
+     * snapshot transport in parallel, instead of replicating individual logs,
+     * and then the marker log.
+     *
+     * The ingested data set becomes visible on each member only when the
+     * marker log is committed, by `state_machine::apply_snapshot()`. If the
+     * marker log is rolled back instead, the staged data is discarded by
+     * `state_machine::abort_ingest()`. This API blocks until the leader
+     * applies the data set. If it returns `TIMEOUT` or `NOT_LEADER` after
+     * the marker log is appended, the data set may or may not survive,
+     * as with a timed-out client request, but members never diverge.
+     *
+     * @param ingest_ctx User-defined context that will be passed to
+     *                   `state_machine::ingest_snapshot()`.
+     * @param[out] snapshot_idx_out Log index number of the new snapshot.
+     * @return `OK` on success.
+     */
+    cmd_result_code bulk_ingest(void* ingest_ctx, ulong& snapshot_idx_out);
+
+    /**
+     * Check if bulk ingestion is in progress.
+     *
+     * @return `true` if in progress.
+     */
+    bool is_bulk_ingest_in_progress() const { return bulk_ingest_in_progress_; }
+
 protected:
     typedef std::unordered_map<int32, ptr<peer>>::const_iterator peer_itor;
 
     struct commit_ret_elem;
+    struct packed_cmd_req;
+    struct handoff_req;
+    struct deferred_append_resp;
 
     struct pre_vote_status_t {
         pre_vote_status_t()
@@ -863,6 +1028,11 @@ protected:
      */
     struct auto_fwd_pkg;
 
+    /**
+     * Request-response pair for auto-forwarding.
+     */
+    struct auto_fwd_req_resp;
+
 protected:
     /**
      * Process Raft request.
@@ -879,14 +1049,27 @@ protected:
     bool check_leadership_validity();
     void check_leadership_transfer();
     void update_rand_timeout();
+    int32 get_election_timeout_ms();
+    void record_leader_hb(int32 leader_id);
+    void adapt_hb_interval(peer& p);
+    void probe_peer_rtts();
+    std::map<int32, uint64_t> get_peer_rtts();
+    void check_leader_placement(peer& p,
+                                const std::map<int32, uint64_t>* rtts);
+    bool try_hibernate();
     void cancel_global_requests();
+    bool is_membership_changing();
+    void check_slow_follower(peer& p);
+    void set_quarantine(peer& p, bool to, uint64_t rtt_us);
 
     bool is_regular_member(const ptr<peer>& p);
     int32 get_num_voting_members();
     int32 get_quorum_for_election();
+    bool check_election_zones();
     int32 get_quorum_for_commit();
     int32 get_leadership_expiry();
     size_t get_not_responding_peers();
+    size_t get_num_quarantined_peers();
     size_t get_num_stale_peers();
 
     ptr<resp_msg> handle_append_entries(req_msg& req);
@@ -896,6 +1079,16 @@ protected:
     ptr<resp_msg> handle_cli_req(req_msg& req,
                                  const req_ext_params& ext_params,
                                  uint64_t timestamp_us);
+    ptr<buffer> pack_fwd_batch_results
+                ( const std::vector< ptr<commit_ret_elem> >& elems,
+                  ptr<buffer> last_result,
+                  cmd_result_code last_result_code );
+    ptr< cmd_result< ptr<buffer> > >
+        append_packed_cmds(const std::vector< ptr<buffer> >& cmds);
+    void flush_packed_cmds(const ptr<packed_cmd_req>& my_req);
+    bool check_admission();
+    void wait_for_admission();
+    void notify_admission_waiters();
     ptr<resp_msg> handle_cli_req_callback(ptr<commit_ret_elem> elem,
                                           ptr<resp_msg> resp);
     ptr< cmd_result< ptr<buffer> > >
@@ -903,6 +1096,12 @@ protected:
 
     void drop_all_pending_commit_elems();
 
+    void defer_append_resp(ptr<resp_msg>& resp, ulong durable_idx);
+    void complete_deferred_append_resps(ulong durable_idx);
+    void drop_deferred_append_resps();
+    void reject_deferred_append_resps(ulong from_idx);
+    uint64_t get_deferred_append_resps_wait_ms();
+
     ptr<resp_msg> handle_ext_msg(req_msg& req, std::unique_lock<std::recursive_mutex>& guard);
     ptr<resp_msg> handle_install_snapshot_req(req_msg& req, std::unique_lock<std::recursive_mutex>& guard);
     ptr<resp_msg> handle_rm_srv_req(req_msg& req);
@@ -918,7 +1117,11 @@ protected:
     void handle_log_sync_resp(resp_msg& resp);
     void handle_leave_cluster_resp(resp_msg& resp);
 
-    bool handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_lock<std::recursive_mutex>& guard);
+    bool handle_snapshot_sync_req(snapshot_sync_req& req,
+                                  bool staged,
+                                  std::unique_lock<std::recursive_mutex>& guard);
+    bool apply_ingested_snapshot(ulong marker_idx);
+    void abort_ingested_snapshot(ulong from_idx);
 
     bool check_cond_for_zp_election();
     void request_prevote();
@@ -989,13 +1192,24 @@ protected:
 
     void commit_app_log(ulong idx_to_commit,
                         ptr<log_entry>& le,
-                        bool need_to_handle_commit_elem);
+                        bool need_to_handle_commit_elem,
+                        std::list< ptr<commit_ret_elem> >& async_elems);
+    void deliver_async_results(std::list< ptr<commit_ret_elem> >& async_elems);
+    ptr<buffer> pre_commit_app_log(ulong log_idx, ptr<log_entry>& le);
+    void rollback_app_log(ulong log_idx, ptr<log_entry>& le);
     void commit_conf(ulong idx_to_commit, ptr<log_entry>& le);
 
     ptr< cmd_result< ptr<buffer> > >
         send_msg_to_leader(ptr<req_msg>& req,
                            const req_ext_params& ext_params = req_ext_params());
 
+    ptr< cmd_result< ptr<buffer> > >
+        hold_req_for_handoff(ptr<req_msg>& req,
+                             const req_ext_params& ext_params);
+    bool is_handoff_pending();
+    void check_handoff();
+    void flush_handoff_reqs();
+
     void auto_fwd_release_rpc_cli(ptr<auto_fwd_pkg> cur_pkg,
                                   ptr<rpc_client> rpc_cli);
 
@@ -1005,11 +1219,17 @@ protected:
                                ptr<rpc_client> rpc_cli,
                                ptr<resp_msg>& resp,
                                ptr<rpc_exception>& err);
+    void auto_fwd_batch_resp_handler(std::list<auto_fwd_req_resp> batch,
+                                     ptr<auto_fwd_pkg> cur_pkg,
+                                     ptr<rpc_client> rpc_cli,
+                                     ptr<resp_msg>& resp,
+                                     ptr<rpc_exception>& err);
     void cleanup_auto_fwd_pkgs();
 
     void set_config(const ptr<cluster_config>& new_config);
     ptr<snapshot> get_last_snapshot() const;
     void set_last_snapshot(const ptr<snapshot>& new_snapshot);
+    ptr<snapshot> get_ingest_snapshot() const;
 
     ulong store_log_entry(ptr<log_entry>& entry, ulong index = 0);
 
@@ -1025,6 +1245,10 @@ protected:
                                              ptr<custom_notification_msg> msg,
                                              ptr<resp_msg> resp);
 
+    ptr<resp_msg> handle_hibernation_msg(req_msg& req,
+                                         ptr<custom_notification_msg> msg,
+                                         ptr<resp_msg> resp);
+
     void remove_peer_from_peers(const ptr<peer>& pp);
 
     void check_overall_status();
@@ -1102,11 +1326,38 @@ protected:
      */
     int32 votes_granted_;
 
+    /**
+     * Data centers of the servers voted for me, used for
+     * `raft_params::min_election_zones_`. Protected by `lock_`.
+     */
+    std::unordered_set<int32> votes_granted_dcs_;
+
     /**
      * Last pre-committed index.
      */
     std::atomic<ulong> precommit_index_;
 
+    /**
+     * Total size of app logs appended but not applied yet, in bytes.
+     * Logs appended before restart are counted at initialization.
+     */
+    std::atomic<int64> pending_bytes_;
+
+    /**
+     * Number of threads waiting in `wait_for_admission()`.
+     */
+    std::atomic<size_t> num_admission_waiters_;
+
+    /**
+     * Condition variable for `wait_for_admission()`.
+     */
+    std::condition_variable admission_cv_;
+
+    /**
+     * Lock for `admission_cv_`.
+     */
+    std::mutex admission_cv_lock_;
+
     /**
      * Leader commit index, seen by this node last time.
      * Only valid when the current role is `follower`.
@@ -1246,6 +1497,13 @@ protected:
      */
     bool im_learner_;
 
+    /**
+     * (Read-only)
+     * `true` if this server is a witness. Will not initiate
+     * leader election, and will not execute logs.
+     */
+    bool im_witness_;
+
     /**
      * `true` if this server is in the middle of
      * `append_entries` handler.
@@ -1270,6 +1528,12 @@ protected:
      */
     std::atomic<bool> snp_creation_scheduled_;
 
+    /**
+     * Timer that measures the elapsed time since the last snapshot
+     * creation, used for periodic checkpoints of memory-only durability.
+     */
+    timer_helper checkpoint_timer_;
+
     /**
      * Non-null if a manual snapshot creation is cheduled by the user.
      */
@@ -1343,6 +1607,51 @@ protected:
      */
     std::mutex auto_fwd_reqs_lock_;
 
+    /**
+     * Small commands waiting to be packed into a single log,
+     * used when `raft_params::max_packed_cmds_` is set.
+     */
+    std::list< ptr<packed_cmd_req> > packed_cmd_queue_;
+
+    /**
+     * Lock for `packed_cmd_queue_`.
+     */
+    std::mutex packed_cmd_queue_lock_;
+
+    /**
+     * Only one thread can pack and append commands at a time, so that
+     * other commands are accumulated in the queue meanwhile.
+     */
+    std::mutex packer_lock_;
+
+    /**
+     * `true` while in-flight requests are being handed off to the
+     * new leader, used when `raft_params::leadership_handoff_` is set.
+     */
+    std::atomic<bool> handoff_in_progress_;
+
+    /**
+     * Deadline of the current handoff.
+     */
+    timer_helper handoff_timer_;
+
+    /**
+     * Client requests (async handler mode) made during the handoff,
+     * to be sent once the new leader is known.
+     */
+    std::list< ptr<handoff_req> > handoff_reqs_;
+
+    /**
+     * Lock for `handoff_reqs_` and `handoff_cv_`.
+     */
+    std::mutex handoff_lock_;
+
+    /**
+     * Client threads (blocking mode) waiting for the new leader
+     * during the handoff sleep on this.
+     */
+    std::condition_variable handoff_cv_;
+
     /**
      * Current role of this server.
      */
@@ -1371,6 +1680,39 @@ protected:
      */
     std::atomic<bool> receiving_snapshot_;
 
+    /**
+     * `true` if this server (leader) is ingesting an external
+     * data set by `bulk_ingest()`.
+     */
+    std::atomic<bool> bulk_ingest_in_progress_;
+
+    /**
+     * Log index of a committed marker log whose ingested data set
+     * this server does not have (e.g., lost by restart).
+     * Non-zero until this server installs the snapshot from the leader.
+     */
+    std::atomic<ulong> ingest_snp_missing_idx_;
+
+    /**
+     * Snapshot of the ingested data set staged by this server,
+     * waiting for the commit of its marker log.
+     * Protected by `last_snapshot_lock_`.
+     */
+    ptr<snapshot> ingest_snp_;
+
+    /**
+     * Background writer of received snapshot objects.
+     * Created on the first object if `snapshot_save_queue_size_` is set.
+     * Protected by `lock_`.
+     */
+    ptr<snapshot_obj_writer> snp_obj_writer_;
+
+    /**
+     * Background pre-commit stage.
+     * Created at initialization if `async_pre_commit_` is set.
+     */
+    ptr<pre_commit_pipeline> pre_commit_pipeline_;
+
     /**
      * Election timeout count while receiving snapshot.
      * This happens when the sender (i.e., leader) is too slow
@@ -1547,18 +1889,96 @@ protected:
     /**
      * (Experimental)
      * Used when `raft_params::parallel_log_appending_` is set.
-     * Follower will wait for the asynchronous log appending using
-     * this event awaiter.
-     *
-     * WARNING: We are assuming that only one thraed is using this
-     *          awaiter at a time, by the help of `lock_`.
+     * Responses to append_entries requests whose logs are not durable
+     * yet. They are sent once `notify_log_append_completion` reports
+     * the logs durable, ordered by log index.
      */
-    EventAwaiter* ea_follower_log_append_;
+    std::list< ptr<deferred_append_resp> > deferred_append_resps_;
+
+    /**
+     * Lock for `deferred_append_resps_`.
+     */
+    std::mutex deferred_append_resps_lock_;
 
     /**
      * If `true`, test mode is enabled.
      */
     std::atomic<bool> test_mode_flag_;
+
+    /**
+     * Executor to deliver the results of async handlers,
+     * given by `init_options::result_executor_`.
+     */
+    cmd_result_executor result_executor_;
+
+    /**
+     * Election timeout scheduled last time, in milliseconds.
+     */
+    std::atomic<int32> cur_election_timeout_ms_;
+
+    /**
+     * Failure detector of heartbeats from the current leader,
+     * used if `raft_params::adaptive_election_timeout_` is set.
+     * Protected by `lock_`.
+     */
+    ptr<phi_accrual_detector> hb_detector_;
+
+    /**
+     * RTTs between members reported by followers, used if
+     * `raft_params::leader_placement_interval_ms_` is set.
+     * Protected by `lock_`.
+     */
+    ptr<leader_placement> placement_;
+
+    /**
+     * Timer for sending ping requests to peers to measure RTTs.
+     */
+    timer_helper rtt_probe_timer_;
+
+    /**
+     * ID of the leader that this server reported its features to.
+     */
+    std::atomic<int32> features_reported_to_;
+
+    /**
+     * Timer for reporting the features of this server to the leader.
+     */
+    timer_helper features_report_timer_;
+
+    /**
+     * Timer for evaluating the leader placement.
+     */
+    timer_helper placement_timer_;
+
+    /**
+     * The leader placement is not evaluated until this timer
+     * expires after becoming a leader.
+     */
+    timer_helper placement_hold_timer_;
+
+    /**
+     * `true` if this server is hibernating,
+     * by `raft_params::hibernation_timeout_ms_`.
+     */
+    std::atomic<bool> hibernating_;
+
+    /**
+     * The last log index when the leader checked the hibernation
+     * condition. Protected by `lock_`.
+     */
+    ulong hibernation_log_idx_;
+
+    /**
+     * Time since the last log index was changed.
+     */
+    timer_helper hibernation_timer_;
+
+    /**
+     * `true` if this server restarted after losing its logs, by
+     * `raft_params::memory_only_durability_`, and has not caught up
+     * with the commit index of the leader yet.
+     */
+    std::atomic<bool> recovering_logs_;
 };
 
 } // namespace nuraft;
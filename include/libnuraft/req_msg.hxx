@@ -42,6 +42,7 @@ public:
         , last_log_idx_(last_log_idx)
         , commit_idx_(commit_idx)
         , log_entries_()
+        , fwd_batch_(false)
         { }
 
     virtual ~req_msg() __override__ { }
@@ -65,6 +66,14 @@ public:
         return log_entries_;
     }
 
+    void set_forwarded_batch(bool to) {
+        fwd_batch_ = to;
+    }
+
+    bool is_forwarded_batch() const {
+        return fwd_batch_;
+    }
+
 private:
     // Term of last log below.
     ulong last_log_term_;
@@ -81,6 +90,11 @@ private:
 
     // Logs. Can be empty.
     std::vector<ptr<log_entry>> log_entries_;
+
+    // `true` if this client request is a batch of requests forwarded
+    // by a follower. Then the leader returns the results of all logs,
+    // so that the follower can demultiplex them to the original requests.
+    bool fwd_batch_;
 };
 
 }
@@ -51,6 +51,7 @@ public:
         , cb_func_(nullptr)
         , async_cb_func_(nullptr)
         , result_code_(cmd_result_code::OK)
+        , fwd_batch_supported_(false)
         {}
 
     __nocopy__(resp_msg);
@@ -77,6 +78,11 @@ public:
         accepted_ = true;
     }
 
+    void reject(ulong next_idx) {
+        next_idx_ = next_idx;
+        accepted_ = false;
+    }
+
     void set_ctx(ptr<buffer> src) {
         ctx_ = src;
     }
@@ -127,6 +133,14 @@ public:
         return result_code_;
     }
 
+    void set_fwd_batch_supported(bool to) {
+        fwd_batch_supported_ = to;
+    }
+
+    bool is_fwd_batch_supported() const {
+        return fwd_batch_supported_;
+    }
+
 private:
     ulong next_idx_;
     int64 next_batch_size_hint_in_bytes_;
@@ -136,6 +150,11 @@ private:
     resp_cb cb_func_;
     resp_async_cb async_cb_func_;
     cmd_result_code result_code_;
+
+    // `true` if the sender of this response to a client request accepts
+    // a batch of requests forwarded by a follower. A server that does not
+    // know forwarded batches never sets it.
+    bool fwd_batch_supported_;
 };
 
 }
@@ -27,6 +27,7 @@ limitations under the License.
 #include "pp_util.hxx"
 #include "ptr.hxx"
 
+#include <condition_variable>
 #include <functional>
 #include <list>
 #include <mutex>
@@ -37,11 +38,14 @@ class EventAwaiter;
 
 namespace nuraft {
 
+class buffer;
+class logger;
 class peer;
 class raft_server;
 class resp_msg;
 class rpc_exception;
 class snapshot;
+class state_machine;
 class snapshot_sync_ctx {
 public:
     snapshot_sync_ctx(const ptr<snapshot>& s,
@@ -180,6 +184,141 @@ private:
     std::mutex queue_lock_;
 };
 
+/**
+ * Background writer of snapshot objects on the receiver side,
+ * used when `raft_params::snapshot_save_queue_size_` is set.
+ */
+class snapshot_obj_writer {
+public:
+    snapshot_obj_writer(const ptr<state_machine>& sm,
+                        const ptr<logger>& l);
+
+    ~snapshot_obj_writer();
+
+    __nocopy__(snapshot_obj_writer);
+
+public:
+    /**
+     * Push a received snapshot object to the queue.
+     * If the queue is full, it will be blocked until an object
+     * in the queue is written.
+     *
+     * @param s Snapshot that the object belongs to.
+     * @param obj_id Object ID.
+     * @param data Object data.
+     * @param is_first_obj `true` if this is the first object.
+     * @param is_last_obj `true` if this is the last object.
+     * @param max_queue_size Max number of objects in the queue.
+     * @param generation Generation returned by `get_generation()`
+     *                   before the caller released its lock.
+     * @return `false` if a previous write failed, the writer is shutting down,
+     *         or `reset()` was called after `generation` was obtained.
+     */
+    bool push(const ptr<snapshot>& s,
+              ulong obj_id,
+              const ptr<buffer>& data,
+              bool is_first_obj,
+              bool is_last_obj,
+              size_t max_queue_size,
+              uint64_t generation);
+
+    /**
+     * Wait until all objects in the queue are written.
+     *
+     * @param generation Generation returned by `get_generation()`.
+     * @return `false` if any write failed, or `reset()` was called
+     *         after `generation` was obtained.
+     */
+    bool wait_for_all(uint64_t generation);
+
+    /**
+     * Get the current generation, which is incremented by `reset()`.
+     *
+     * @return Generation.
+     */
+    uint64_t get_generation();
+
+    /**
+     * Check if any write has failed since the last `reset()`.
+     *
+     * @return `true` if failed.
+     */
+    bool has_failed();
+
+    /**
+     * Drop all pending objects and clear the failure, to start
+     * receiving a new snapshot.
+     */
+    void reset();
+
+    /**
+     * Stop the writer thread.
+     */
+    void shutdown();
+
+private:
+    struct write_elem;
+
+    void writer_loop();
+
+    /**
+     * State machine to write objects.
+     */
+    ptr<state_machine> sm_;
+
+    /**
+     * Logger.
+     */
+    ptr<logger> l_;
+
+    /**
+     * Dedicated thread for writing snapshot objects.
+     */
+    std::thread writer_thread_;
+
+    /**
+     * Objects waiting to be written.
+     */
+    std::list< ptr<write_elem> > queue_;
+
+    /**
+     * `true` if the writer thread is writing an object.
+     */
+    bool writing_;
+
+    /**
+     * `true` if any write has failed since the last `reset()`.
+     */
+    bool failed_;
+
+    /**
+     * Incremented by `reset()`, to ignore the result of
+     * the object being written by the writer thread at that moment.
+     */
+    uint64_t generation_;
+
+    /**
+     * `true` if we are closing this writer.
+     */
+    bool terminating_;
+
+    /**
+     * Lock for above members.
+     */
+    std::mutex lock_;
+
+    /**
+     * Condition variable for the writer thread.
+     */
+    std::condition_variable writer_cv_;
+
+    /**
+     * Condition variable for the threads waiting for empty queue slots
+     * or the completion of writes.
+     */
+    std::condition_variable waiter_cv_;
+};
+
 }
 
 #endif //_SNAPSHOT_SYNC_CTX_HXX_
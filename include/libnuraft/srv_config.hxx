@@ -42,6 +42,7 @@ public:
         , endpoint_(endpoint)
         , learner_(false)
         , priority_(INIT_PRIORITY)
+        , witness_(false)
         {}
 
     srv_config(int32 id,
@@ -49,13 +50,15 @@ public:
                const std::string& endpoint,
                const std::string& aux,
                bool learner,
-               int32 priority = INIT_PRIORITY)
+               int32 priority = INIT_PRIORITY,
+               bool witness = false)
         : id_(id)
         , dc_id_(dc_id)
         , endpoint_(endpoint)
         , aux_(aux)
         , learner_(learner)
         , priority_(priority)
+        , witness_(witness)
         {}
 
     __nocopy__(srv_config);
@@ -79,6 +82,8 @@ public:
 
     void set_priority(const int32 new_val) { priority_ = new_val; }
 
+    bool is_witness() const { return witness_; }
+
     ptr<buffer> serialize() const;
 
 private:
@@ -116,6 +121,18 @@ private:
      * 0 will never be a leader.
      */
     int32 priority_;
+
+    /**
+     * (Experimental)
+     * `true` if this node is witness.
+     * Witness participates in leader election and commit quorum,
+     * but it keeps only the metadata of logs (term, type, and checksum
+     * of the payload), not the payload or snapshot data. Its state
+     * machine does not execute logs. Witness never becomes a leader.
+     * All members should be upgraded to the version supporting witness
+     * before adding one, as older versions decode it as a learner.
+     */
+    bool witness_;
 };
 
 } // namespace nuraft
@@ -37,12 +37,16 @@ public:
         : term_(0L)
         , voted_for_(-1)
         , election_timer_allowed_(true)
+        , witness_snp_idx_(0)
+        , witness_snp_term_(0)
         {}
 
     srv_state(ulong term, int voted_for, bool et_allowed)
         : term_(term)
         , voted_for_(voted_for)
         , election_timer_allowed_(et_allowed)
+        , witness_snp_idx_(0)
+        , witness_snp_term_(0)
         {}
 
     /**
@@ -73,11 +77,16 @@ public:
     static ptr<srv_state> deserialize_v1p(buffer& buf) {
         buffer_serializer bs(buf);
         uint8_t ver = bs.get_u8();
-        (void)ver;
         ulong term = bs.get_u64();
         int voted_for = bs.get_i32();
         bool et_allowed = (bs.get_u8() == 1);
-        return cs_new<srv_state>(term, voted_for, et_allowed);
+        ptr<srv_state> ret = cs_new<srv_state>(term, voted_for, et_allowed);
+        if (ver >= 2 && bs.pos() + sizeof(uint64_t) * 2 <= buf.size()) {
+            ulong snp_idx = bs.get_u64();
+            ulong snp_term = bs.get_u64();
+            ret->set_witness_snapshot(snp_idx, snp_term);
+        }
+        return ret;
     }
 
     void set_inc_term_func(inc_term_func to) {
@@ -118,6 +127,24 @@ public:
         election_timer_allowed_ = to;
     }
 
+    /**
+     * Witness does not have a state machine keeping snapshots,
+     * so that it keeps the last log index and term of its metadata
+     * snapshot here, to recover its commit index after restart.
+     */
+    ulong get_witness_snapshot_idx() const {
+        return witness_snp_idx_;
+    }
+
+    ulong get_witness_snapshot_term() const {
+        return witness_snp_term_;
+    }
+
+    void set_witness_snapshot(ulong idx, ulong term) {
+        witness_snp_idx_ = idx;
+        witness_snp_term_ = term;
+    }
+
     ptr<buffer> serialize() const {
         return serialize_v1p(CURRENT_VERSION);
     }
@@ -136,20 +163,32 @@ public:
         // term             8 bytes
         // voted_for        4 bytes
         // election timer   1 byte
-        ptr<buffer> buf = buffer::alloc( sizeof(uint8_t) +
-                                         sizeof(uint64_t) +
-                                         sizeof(int32_t) +
-                                         sizeof(uint8_t) );
+        //
+        //   << Version 2 or above >>
+        // witness snapshot log index   8 bytes
+        // witness snapshot log term    8 bytes
+        size_t buf_len = sizeof(uint8_t) +
+                         sizeof(uint64_t) +
+                         sizeof(int32_t) +
+                         sizeof(uint8_t);
+        if (version >= 2) {
+            buf_len += sizeof(uint64_t) * 2;
+        }
+        ptr<buffer> buf = buffer::alloc(buf_len);
         buffer_serializer bs(buf);
         bs.put_u8(version);
         bs.put_u64(term_);
         bs.put_i32(voted_for_);
         bs.put_u8( election_timer_allowed_ ? 1 : 0 );
+        if (version >= 2) {
+            bs.put_u64(witness_snp_idx_);
+            bs.put_u64(witness_snp_term_);
+        }
         return buf;
     }
 
 private:
-    const uint8_t CURRENT_VERSION = 1;
+    const uint8_t CURRENT_VERSION = 2;
 
     /**
      * Term.
@@ -167,6 +206,13 @@ private:
      */
     std::atomic<bool> election_timer_allowed_;
 
+    /**
+     * Last log index and term of the witness's metadata snapshot.
+     * `0` if this server is not a witness.
+     */
+    std::atomic<ulong> witness_snp_idx_;
+    std::atomic<ulong> witness_snp_term_;
+
     /**
      * Custom callback function for increasing term.
      * If not given, term will be increased by 1.
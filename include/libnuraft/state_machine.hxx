@@ -28,6 +28,7 @@ limitations under the License.
 #include "ptr.hxx"
 
 #include <unordered_map>
+#include <vector>
 
 namespace nuraft {
 
@@ -74,6 +75,31 @@ public:
     virtual ptr<buffer> commit_ext(const ext_op_params& params)
     {   return commit(params.log_idx, *params.data);    }
 
+    /**
+     * (Optional)
+     * Commit a packed log (`log_val_type::packed_app_log`), which carries
+     * multiple commands in a single Raft log. It is used only when
+     * `raft_params::max_packed_cmds_` is set.
+     *
+     * Here provide a default implementation calling `commit_ext` for
+     * each command, with the same log number.
+     *
+     * @param log_idx Raft log number of the packed log.
+     * @param cmds Commands in the packed log.
+     * @return Result value of each command, in the same order.
+     */
+    virtual std::vector< ptr<buffer> >
+        commit_packed(const ulong log_idx,
+                      const std::vector< ptr<buffer> >& cmds)
+    {
+        std::vector< ptr<buffer> > ret;
+        ret.reserve(cmds.size());
+        for (ptr<buffer> cmd: cmds) {
+            ret.push_back( commit_ext( ext_op_params(log_idx, cmd) ) );
+        }
+        return ret;
+    }
+
     /**
      * (Optional)
      * Handler on the commit of a configuration change.
@@ -107,6 +133,41 @@ public:
     virtual ptr<buffer> pre_commit_ext(const ext_op_params& params)
     {   return pre_commit(params.log_idx, *params.data);  }
 
+    /**
+     * (Optional)
+     * Batched version of `pre_commit_ext`, invoked by a background thread
+     * when `raft_params::async_pre_commit_` is set. Given logs are in log
+     * index order, and the same log will not be given again unless it is
+     * rolled back. A rollback of a log is invoked only after its pre-commit
+     * returns.
+     *
+     * Here provide a default implementation calling `pre_commit_ext`
+     * for each log.
+     *
+     * @param params List of logs to pre-commit.
+     */
+    virtual void pre_commit_batch(const std::vector<ext_op_params>& params) {
+        for (const ext_op_params& pp: params) pre_commit_ext(pp);
+    }
+
+    /**
+     * (Optional)
+     * Pre-commit a packed log, see `commit_packed`.
+     *
+     * Here provide a default implementation calling `pre_commit_ext`
+     * for each command, with the same log number.
+     *
+     * @param log_idx Raft log number of the packed log.
+     * @param cmds Commands in the packed log.
+     */
+    virtual void pre_commit_packed(const ulong log_idx,
+                                   const std::vector< ptr<buffer> >& cmds)
+    {
+        for (ptr<buffer> cmd: cmds) {
+            pre_commit_ext( ext_op_params(log_idx, cmd) );
+        }
+    }
+
     /**
      * Rollback the state machine to given Raft log number.
      *
@@ -142,6 +203,25 @@ public:
     virtual void rollback_ext(const ext_op_params& params)
     {   rollback(params.log_idx, *params.data);  }
 
+    /**
+     * (Optional)
+     * Rollback a packed log, see `commit_packed`.
+     *
+     * Here provide a default implementation calling `rollback_ext`
+     * for each command in reverse order, with the same log number.
+     *
+     * @param log_idx Raft log number of the packed log.
+     * @param cmds Commands in the packed log.
+     */
+    virtual void rollback_packed(const ulong log_idx,
+                                 const std::vector< ptr<buffer> >& cmds)
+    {
+        for (auto it = cmds.rbegin(); it != cmds.rend(); ++it) {
+            ptr<buffer> cmd = *it;
+            rollback_ext( ext_op_params(log_idx, cmd) );
+        }
+    }
+
     /**
      * (Optional)
      * Return a hint about the preferred size (in number of bytes)
@@ -304,6 +384,35 @@ public:
     virtual void create_snapshot(snapshot& s,
                                  async_result<bool>::handler_type& when_done) = 0;
 
+    /**
+     * (Optional)
+     * Load an external data set (e.g., a data stream or a prepared snapshot
+     * file) into the state machine in bulk, bypassing Raft log.
+     * It will be invoked on the leader by `raft_server::bulk_ingest()`.
+     *
+     * Once this function returns `true`, the ingested data should be
+     * staged as snapshot `s`: `read_logical_snp_obj()` should be able to
+     * serve it to followers, but it should not be visible yet. It becomes
+     * the current state of the state machine only when `apply_snapshot(s)`
+     * is invoked, after a quorum has it. If the ingestion fails before
+     * that, `abort_ingest(s)` will be invoked instead.
+     *
+     * @param s Snapshot info at the new log index.
+     * @param ingest_ctx User-defined context given to `raft_server::bulk_ingest()`.
+     * @return `true` on success.
+     */
+    virtual bool ingest_snapshot(snapshot& s, void* ingest_ctx) { return false; }
+
+    /**
+     * (Optional)
+     * Discard the data staged for the given snapshot by `ingest_snapshot()`
+     * (on the leader) or by `save_logical_snp_obj()` (on followers), as the
+     * bulk ingestion is not going to be committed.
+     *
+     * @param s Snapshot info of the staged data.
+     */
+    virtual void abort_ingest(snapshot& s) {}
+
     /**
      * Decide to create snapshot or not.
      * Once the pre-defined condition is satisfied, Raft core will invoke
@@ -6,6 +6,11 @@ set -e
 ./tests/timer_test --abort-on-failure
 ./tests/strfmt_test --abort-on-failure
 ./tests/stat_mgr_test --abort-on-failure
+if [ -f ./tests/coroutine_test ]; then
+    # Built only if the compiler supports C++20.
+    ./tests/coroutine_test --abort-on-failure
+fi
 ./tests/raft_server_test --abort-on-failure
 ./tests/failure_test --abort-on-failure
+./tests/shared_wal_test --abort-on-failure
 ./tests/asio_service_test --abort-on-failure
@@ -45,6 +45,7 @@ limitations under the License.
 #endif
 
 #include <atomic>
+#include <cstring>
 #include <ctime>
 #include <exception>
 #include <fstream>
@@ -127,6 +128,10 @@ limitations under the License.
 // If set, each log entry will contain a CRC on the payload.
 #define CRC_ON_PAYLOAD (0x10)
 
+// If set, client request is a batch of requests forwarded by a follower.
+// If set in a response, the sender accepts such a batch.
+#define FORWARDED_BATCH (0x20)
+
 // =======================
 
 namespace nuraft {
@@ -134,6 +139,7 @@ namespace nuraft {
 static const size_t SSL_GRACE_PERIOD_MS = 500;
 static const size_t SEND_RETRY_MS       = 500;
 static const size_t SEND_RETRY_MAX      = 6;
+static const size_t RPC_RECV_BUF_SIZE   = 64 * 1024;
 
 asio_service::meta_cb_params req_to_params(req_msg* req, resp_msg* resp) {
     return asio_service::meta_cb_params
@@ -163,6 +169,17 @@ public:
         else        asio::async_write(tcp_socket, buffer, func);
     }
 
+    template<typename BB, typename FF>
+    static void read_some(bool is_ssl,
+                          ssl_socket& _ssl_socket,
+                          asio::ip::tcp::socket& tcp_socket,
+                          const BB& buffer,
+                          FF func)
+    {
+        if (is_ssl) _ssl_socket.async_read_some(buffer, func);
+        else        tcp_socket.async_read_some(buffer, func);
+    }
+
     template<typename BB, typename FF>
     static void read(bool is_ssl,
                      ssl_socket& _ssl_socket,
@@ -239,6 +256,9 @@ public:
         , flags_(0x0)
         , log_data_()
         , header_(buffer::alloc(RPC_REQ_HEADER_SIZE))
+        , rbuf_(buffer::alloc(RPC_RECV_BUF_SIZE))
+        , rbuf_begin_(0)
+        , rbuf_end_(0)
         , l_(logger)
         , callback_(callback)
         , src_id_(-1)
@@ -325,110 +345,91 @@ public:
     }
 
     void start(ptr<rpc_session> self) {
-        header_->pos(0);
-        aa::read( ssl_enabled_, ssl_socket_, socket_,
-                  asio::buffer( header_->data(), RPC_REQ_HEADER_SIZE ),
-                  [this, self]
-                  (const ERROR_CODE& err, size_t) -> void
-        {
-            if (err) {
-                p_er( "session %" PRIu64 " failed to read rpc header from socket %s:%u "
-                      "due to error %d, %s, ref count %ld",
-                      session_id_,
-                      cached_address_.c_str(),
-                      cached_port_,
-                      err.value(),
-                      err.message().c_str(),
-                      self.use_count() );
-                this->stop();
-                return;
-            }
-
-            // NOTE:
-            //  due to async_read() above, header_ size will be always
-            //  equal to or greater than RPC_REQ_HEADER_SIZE.
-
-            // Deprecate `buffer::get` and use `buffer_serializer`.
-
-            // header_->pos(0);
-            buffer_serializer h_bs(header_);
-            byte* header_data = header_->data_begin();
-            crc_header_ = crc32_8( header_data,
-                                   RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
-                                   0 );
-
-            // header_->pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN);
-            h_bs.pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN);
-            // uint64_t flags_and_crc = header_->get_ulong();
-            uint64_t flags_and_crc = h_bs.get_u64();
-            crc_from_msg_ = flags_and_crc & (uint32_t)0xffffffff;
-            flags_ = (flags_and_crc >> 32);
+        if (rbuf_end_ - rbuf_begin_ < RPC_REQ_HEADER_SIZE) {
+            // Header is not received yet.
+            receive(self, 0);
+            return;
+        }
 
-            // Verify CRC (if entire message validation is disbaled).
-            if ( !(flags_ & CRC_ON_ENTIRE_MESSAGE) &&
-                 crc_header_ != crc_from_msg_ ) {
-                p_er("header CRC mismatch: local calculation %x, from message %x",
-                     crc_header_, crc_from_msg_);
+        // Take the header out of the receive buffer.
+        memcpy( header_->data_begin(),
+                rbuf_->data_begin() + rbuf_begin_,
+                RPC_REQ_HEADER_SIZE );
+        rbuf_begin_ += RPC_REQ_HEADER_SIZE;
+        header_->pos(0);
 
-                if (impl_->get_options().corrupted_msg_handler_) {
-                    impl_->get_options().corrupted_msg_handler_(header_, nullptr);
-                }
+        // Deprecate `buffer::get` and use `buffer_serializer`.
 
-                this->stop();
-                return;
+        // header_->pos(0);
+        buffer_serializer h_bs(header_);
+        byte* header_data = header_->data_begin();
+        crc_header_ = crc32_8( header_data,
+                               RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN,
+                               0 );
+
+        // header_->pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN);
+        h_bs.pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN);
+        // uint64_t flags_and_crc = header_->get_ulong();
+        uint64_t flags_and_crc = h_bs.get_u64();
+        crc_from_msg_ = flags_and_crc & (uint32_t)0xffffffff;
+        flags_ = (flags_and_crc >> 32);
+
+        // Verify CRC (if entire message validation is disbaled).
+        if ( !(flags_ & CRC_ON_ENTIRE_MESSAGE) &&
+             crc_header_ != crc_from_msg_ ) {
+            p_er("header CRC mismatch: local calculation %x, from message %x",
+                 crc_header_, crc_from_msg_);
+
+            if (impl_->get_options().corrupted_msg_handler_) {
+                impl_->get_options().corrupted_msg_handler_(header_, nullptr);
             }
 
-            // header_->pos(0);
-            // byte marker = header_->get_byte();
-            h_bs.pos(0);
-            byte marker = h_bs.get_u8();
-            if (marker == 0x1) {
-                // Means that this is RPC_RESP, shouldn't happen.
-                p_er("Wrong packet: expected REQ, got RESP");
+            this->stop();
+            return;
+        }
 
-                if (impl_->get_options().corrupted_msg_handler_) {
-                    impl_->get_options().corrupted_msg_handler_(header_, nullptr);
-                }
+        // header_->pos(0);
+        // byte marker = header_->get_byte();
+        h_bs.pos(0);
+        byte marker = h_bs.get_u8();
+        if (marker == 0x1) {
+            // Means that this is RPC_RESP, shouldn't happen.
+            p_er("Wrong packet: expected REQ, got RESP");
 
-                this->stop();
-                return;
+            if (impl_->get_options().corrupted_msg_handler_) {
+                impl_->get_options().corrupted_msg_handler_(header_, nullptr);
             }
 
-            // header_->pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN - DATA_SIZE_LEN);
-            // int32 data_size = header_->get_int();
-            h_bs.pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN - DATA_SIZE_LEN);
-            int32 data_size = h_bs.get_i32();
-            // Up to 1GB.
-            if (data_size < 0 || data_size > 0x40000000) {
-                p_er("bad log data size in the header %d, stop "
-                     "this session to protect further corruption",
-                     data_size);
-
-                if (impl_->get_options().corrupted_msg_handler_) {
-                    impl_->get_options().corrupted_msg_handler_(header_, nullptr);
-                }
+            this->stop();
+            return;
+        }
 
-                this->stop();
-                return;
+        // header_->pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN - DATA_SIZE_LEN);
+        // int32 data_size = header_->get_int();
+        h_bs.pos(RPC_REQ_HEADER_SIZE - CRC_FLAGS_LEN - DATA_SIZE_LEN);
+        int32 data_size = h_bs.get_i32();
+        // Up to 1GB.
+        if (data_size < 0 || data_size > 0x40000000) {
+            p_er("bad log data size in the header %d, stop "
+                 "this session to protect further corruption",
+                 data_size);
+
+            if (impl_->get_options().corrupted_msg_handler_) {
+                impl_->get_options().corrupted_msg_handler_(header_, nullptr);
             }
 
-            if (data_size == 0) {
-                // Don't carry data, immediately process request.
-                this->read_complete(header_, nullptr);
+            this->stop();
+            return;
+        }
 
-            } else {
-                // Carry some data, need to read further.
-                ptr<buffer> log_ctx = buffer::alloc((size_t)data_size);
-                aa::read( ssl_enabled_, ssl_socket_, socket_,
-                          asio::buffer( log_ctx->data(),
-                                        (size_t)data_size ),
-                          std::bind( &rpc_session::read_log_data,
-                                     self,
-                                     log_ctx,
-                                     std::placeholders::_1,
-                                     std::placeholders::_2 ) );
-            }
-        } );
+        if (data_size == 0) {
+            // Don't carry data, immediately process request.
+            this->read_complete(header_, nullptr);
+
+        } else {
+            // Carry some data, need to read further.
+            this->read_body(self, (size_t)data_size);
+        }
     }
 
     void stop() {
@@ -480,6 +481,92 @@ private:
 #endif
     }
 
+    /**
+     * Receive more data into the receive buffer, and then
+     * continue to parse the header (if `body_size == 0`),
+     * or the body of the given size.
+     */
+    void receive(ptr<rpc_session> self, size_t body_size) {
+        // Move the unprocessed data to the beginning of the buffer.
+        size_t remaining = rbuf_end_ - rbuf_begin_;
+        if (rbuf_begin_) {
+            if (remaining) {
+                memmove( rbuf_->data_begin(),
+                         rbuf_->data_begin() + rbuf_begin_,
+                         remaining );
+            }
+            rbuf_begin_ = 0;
+            rbuf_end_ = remaining;
+        }
+
+        // Read as much as available, it may contain multiple messages.
+        aa::read_some( ssl_enabled_, ssl_socket_, socket_,
+                       asio::buffer( rbuf_->data_begin() + rbuf_end_,
+                                     rbuf_->size() - rbuf_end_ ),
+                       [this, self, body_size]
+                       (const ERROR_CODE& err, size_t bytes_read) -> void
+        {
+            if (err) {
+                p_er( "session %" PRIu64 " failed to read rpc %s from socket %s:%u "
+                      "due to error %d, %s, ref count %ld",
+                      session_id_,
+                      body_size ? "log data" : "header",
+                      cached_address_.c_str(),
+                      cached_port_,
+                      err.value(),
+                      err.message().c_str(),
+                      self.use_count() );
+                this->stop();
+                return;
+            }
+
+            rbuf_end_ += bytes_read;
+            if (body_size) {
+                this->read_body(self, body_size);
+            } else {
+                this->start(self);
+            }
+        } );
+    }
+
+    void read_body(ptr<rpc_session> self, size_t data_size) {
+        size_t avail = rbuf_end_ - rbuf_begin_;
+        if (avail >= data_size) {
+            // Entire body is already in the receive buffer.
+            ptr<buffer> log_ctx = buffer::alloc(data_size);
+            memcpy( log_ctx->data_begin(),
+                    rbuf_->data_begin() + rbuf_begin_,
+                    data_size );
+            rbuf_begin_ += data_size;
+            this->read_complete(header_, log_ctx);
+            return;
+        }
+
+        if (data_size <= rbuf_->size()) {
+            // Fits in the receive buffer, read more.
+            this->receive(self, data_size);
+            return;
+        }
+
+        // Bigger than the receive buffer, read the rest
+        // directly into the body buffer.
+        ptr<buffer> log_ctx = buffer::alloc(data_size);
+        if (avail) {
+            memcpy( log_ctx->data_begin(),
+                    rbuf_->data_begin() + rbuf_begin_,
+                    avail );
+        }
+        rbuf_begin_ = rbuf_end_ = 0;
+        aa::read( ssl_enabled_, ssl_socket_, socket_,
+                  asio::buffer( log_ctx->data_begin() + avail,
+                                data_size - avail ),
+                  std::bind( &rpc_session::read_log_data,
+                             self,
+                             log_ctx,
+                             std::placeholders::_1,
+                             std::placeholders::_2 ) );
+    }
+
     void read_log_data(ptr<buffer> log_ctx,
                        const ERROR_CODE& err,
                        size_t bytes_read) {
@@ -582,6 +669,9 @@ private:
         std::string meta_str;
         ptr<req_msg> req = cs_new<req_msg>
                            ( term, t, src, dst, last_term, last_idx, commit_idx );
+        if (flags_ & FORWARDED_BATCH) {
+            req->set_forwarded_batch(true);
+        }
         if (log_data_size > 0 && log_ctx) {
             buffer_serializer ss(log_ctx);
             size_t log_ctx_size = log_ctx->size();
@@ -637,15 +727,16 @@ private:
                     return;
                 }
 
-                ptr<buffer> buf( buffer::alloc(val_size) );
-                ss.get_buffer(buf);
-                ptr<log_entry> entry(
-                    cs_new<log_entry>(term, buf, val_type, timestamp, has_crc32, crc32, false) );
+                // Log entry and its payload in a single allocation.
+                const byte* val_raw = (const byte*)ss.get_raw(val_size);
+                ptr<log_entry> entry = log_entry::make
+                                       ( term, val_raw, val_size, val_type,
+                                         timestamp, has_crc32, crc32, false );
 
                 if ((flags_ & CRC_ON_PAYLOAD) && has_crc32) {
                     // Verify CRC.
-                    uint32_t crc_payload = crc32_8( buf->data_begin(),
-                                                    buf->size(),
+                    uint32_t crc_payload = crc32_8( entry->get_buf().data_begin(),
+                                                    val_size,
                                                     0 );
                     if (crc_payload != crc32) {
                         p_er("log entry CRC mismatch: local calculation %x, "
@@ -677,7 +768,12 @@ private:
         }
 
         // === RAFT server processes the request here. ===
-        ptr<resp_msg> resp = raft_server_handler::process_req(handler_.get(), *req);
+        // Client requests forwarded by followers will be completed
+        // asynchronously, not to block this thread until commit.
+        raft_server::req_ext_params ext_params;
+        ext_params.async_cli_resp_ = true;
+        ptr<resp_msg> resp =
+            raft_server_handler::process_req(handler_.get(), *req, ext_params);
         if (!resp) {
             p_wn("no response is returned from raft message handler");
             this->stop();
@@ -686,8 +782,9 @@ private:
 
         if (resp->has_async_cb()) {
             // Response will be ready later, setup a callback function
-            // (only for auto-forwarding with `client_request` type
-            //  in async handling mode).
+            // (for auto-forwarding with `client_request` type,
+            //  or for `append_entries_request` waiting for
+            //  the durability of logs).
             ptr< cmd_result< ptr<buffer> > > ret = resp->call_async_cb();
 
             // WARNING: `self` should be captured to avoid releasing this `rpc_session`.
@@ -696,6 +793,7 @@ private:
                 ( cmd_result<ptr<buffer>, ptr<std::exception>>& res,
                   ptr<std::exception>& exp ) {
                     resp->set_ctx(res.get());
+                    resp->set_result_code(res.get_result_code());
                     on_resp_ready(req, resp);
                     // This is needed to avoid circular reference.
                     res.reset();
@@ -748,6 +846,10 @@ private:
             resp_hint_size += sizeof(uint16_t) * 2 + sizeof(int64);
         }
 
+        if (resp->is_fwd_batch_supported()) {
+            flags |= FORWARDED_BATCH;
+        }
+
         size_t carried_data_size = resp_meta_size + resp_hint_size + resp_ctx_size;
 
         int buf_size = RPC_RESP_HEADER_SIZE + carried_data_size;
@@ -826,6 +928,15 @@ private:
     uint32_t flags_;
     ptr<buffer> log_data_;
     ptr<buffer> header_;
+
+    /**
+     * Receive buffer. Multiple messages can be read at once, and
+     * `[rbuf_begin_, rbuf_end_)` is the data not processed yet.
+     */
+    ptr<buffer> rbuf_;
+    size_t rbuf_begin_;
+    size_t rbuf_end_;
+
     ptr<logger> l_;
     session_closed_callback callback_;
 
@@ -1238,6 +1349,9 @@ public:
             LOG_ENTRY_SIZE += 5;
             flags |= CRC_ON_PAYLOAD;
         }
+        if (req->is_forwarded_batch()) {
+            flags |= FORWARDED_BATCH;
+        }
 
         for (auto& entry: req->log_entries()) {
             ptr<log_entry>& le = entry;
@@ -1628,6 +1742,9 @@ private:
             ( cs_new<resp_msg>
               ( term, (msg_type)msg_type_val, src, dst,
                 nxt_idx, accepted_val == 1 ) );
+        if (flags & FORWARDED_BATCH) {
+            rsp->set_fwd_batch_supported(true);
+        }
 
         if ( !(flags & INCLUDE_META) &&
              impl_->get_options().read_resp_meta_ &&
@@ -1936,7 +2053,7 @@ void asio_service_impl::worker_entry() {
     }
 
     static std::atomic<size_t> exception_count(0);
-    static timer_helper timer(60 * 1000000); // 1 min.
+    static timer_helper timer(60 * 1000000, false, true); // 1 min.
     const size_t MAX_COUNT = 10;
 
     do {
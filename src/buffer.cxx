@@ -126,6 +126,26 @@ ptr<buffer> buffer::alloc(const size_t size) {
     return buf;
 }
 
+size_t buffer::get_block_size(const size_t size) {
+    if (size >= 0x8000) {
+        return size + sizeof(uint) * 2;
+    }
+    return size + sizeof(ushort) * 2;
+}
+
+buffer* buffer::init_block(void* block, const size_t size) {
+    if (size >= 0x80000000) {
+        throw std::out_of_range( "size exceed the max size that "
+                                 "nuraft::buffer could support" );
+    }
+    if (size >= 0x8000) {
+        __init_b_block(block, size);
+    } else {
+        __init_s_block(block, size);
+    }
+    return reinterpret_cast<buffer*>(block);
+}
+
 ptr<buffer> buffer::copy(const buffer& buf) {
     ptr<buffer> other = alloc(buf.size() - buf.pos());
     other->put(buf);
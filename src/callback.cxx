@@ -0,0 +1,39 @@
+/************************************************************************
+Copyright 2017-present eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "callback.hxx"
+
+namespace nuraft {
+
+// `NURAFT_DISABLE_HOT_PATH_CALLBACKS` is given to the library build only,
+// so it should not be checked in the header.
+bool cb_func::is_subscribed(Type type) const {
+#ifdef NURAFT_DISABLE_HOT_PATH_CALLBACKS
+    if (hot_path_events() & event_bit(type)) return false;
+#endif
+    return (mask & event_bit(type)) != 0;
+}
+
+bool cb_func::hot_path_disabled() {
+#ifdef NURAFT_DISABLE_HOT_PATH_CALLBACKS
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace nuraft;
+
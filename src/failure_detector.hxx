@@ -0,0 +1,175 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace nuraft {
+
+/**
+ * Phi-accrual failure detector, based on the statistics of
+ * heartbeat inter-arrival times from the leader.
+ *
+ * Inter-arrival times are assumed to follow a normal distribution.
+ * For the given threshold `phi`, the detector suspects the leader
+ * once no heartbeat has arrived for `mean + z * stddev`, where the
+ * probability that a healthy heartbeat is later than that is `10^-phi`.
+ *
+ * Not thread-safe, should be protected by the caller.
+ */
+class phi_accrual_detector {
+public:
+    phi_accrual_detector(size_t window_size = 100,
+                         size_t min_samples = 10)
+        : window_size_(window_size)
+        , min_samples_(min_samples)
+        , next_(0)
+        , sum_(0)
+        , sum_sq_(0)
+        , last_arrival_us_(0)
+        , source_(-1)
+        , cached_phi_(-1)
+        , cached_z_(0)
+        {}
+
+    /**
+     * Clear all samples.
+     */
+    void reset() {
+        samples_.clear();
+        next_ = 0;
+        sum_ = sum_sq_ = 0;
+        last_arrival_us_ = 0;
+        source_ = -1;
+    }
+
+    /**
+     * Record the arrival of a heartbeat.
+     *
+     * @param source ID of the sender. Samples are cleared
+     *               if it is different from the previous one.
+     * @param now_us Current time in microseconds.
+     * @param min_interval_us Intervals shorter than this are not
+     *                        sampled, as they are not from heartbeats
+     *                        but from regular traffic.
+     */
+    void heartbeat(int32_t source, uint64_t now_us, uint64_t min_interval_us) {
+        if (source != source_) {
+            reset();
+            source_ = source;
+        }
+        uint64_t prev_us = last_arrival_us_;
+        last_arrival_us_ = now_us;
+        if (!prev_us || now_us <= prev_us) return;
+
+        uint64_t interval_us = now_us - prev_us;
+        if (interval_us < min_interval_us) return;
+        add_sample( (double)interval_us );
+    }
+
+    /**
+     * @return `true` if there are enough samples.
+     */
+    bool ready() const {
+        return samples_.size() >= min_samples_;
+    }
+
+    /**
+     * @return Mean of heartbeat intervals in microseconds.
+     */
+    double mean_us() const {
+        if (samples_.empty()) return 0;
+        return sum_ / samples_.size();
+    }
+
+    /**
+     * @return Standard deviation of heartbeat intervals in microseconds.
+     */
+    double stddev_us() const {
+        if (samples_.empty()) return 0;
+        double mean = mean_us();
+        double var = sum_sq_ / samples_.size() - mean * mean;
+        return var > 0 ? std::sqrt(var) : 0;
+    }
+
+    /**
+     * Get the time since the last heartbeat after which the suspicion
+     * level reaches `phi`. Standard deviation smaller than 1/10 of the
+     * mean is rounded up, so as not to get an overly tight timeout
+     * from a perfectly regular sender.
+     *
+     * @param phi Suspicion threshold.
+     * @return Timeout in microseconds, 0 if not `ready()`.
+     */
+    uint64_t get_timeout_us(double phi) {
+        if (!ready()) return 0;
+        double mean = mean_us();
+        double stddev = std::max(stddev_us(), mean / 10);
+        return (uint64_t)(mean + get_z(phi) * stddev);
+    }
+
+private:
+    void add_sample(double val) {
+        if (samples_.size() < window_size_) {
+            samples_.push_back(val);
+        } else {
+            double old = samples_[next_];
+            sum_ -= old;
+            sum_sq_ -= old * old;
+            samples_[next_] = val;
+            next_ = (next_ + 1) % window_size_;
+        }
+        sum_ += val;
+        sum_sq_ += val * val;
+    }
+
+    /**
+     * Find `z` such that `P(X > mean + z * stddev) = 10^-phi`
+     * for normal distribution, by bisection.
+     */
+    double get_z(double phi) {
+        if (phi == cached_phi_) return cached_z_;
+        double target = std::pow(10.0, -phi);
+        double lo = 0, hi = 40;
+        for (size_t ii = 0; ii < 100; ++ii) {
+            double mid = (lo + hi) / 2;
+            double tail = 0.5 * std::erfc(mid / std::sqrt(2.0));
+            if (tail > target) lo = mid;
+            else hi = mid;
+        }
+        cached_phi_ = phi;
+        cached_z_ = (lo + hi) / 2;
+        return cached_z_;
+    }
+
+    size_t window_size_;
+    size_t min_samples_;
+    std::vector<double> samples_;
+    size_t next_;
+    double sum_;
+    double sum_sq_;
+    uint64_t last_arrival_us_;
+    int32_t source_;
+    double cached_phi_;
+    double cached_z_;
+};
+
+}
+
@@ -19,12 +19,15 @@ limitations under the License.
 
 #include "global_mgr.hxx"
 
+#include "cluster_config.hxx"
 #include "event_awaiter.hxx"
 #include "logger.hxx"
+#include "raft_params.hxx"
 #include "raft_server.hxx"
 #include "tracer.hxx"
 
 #include <memory>
+#include <set>
 
 namespace nuraft {
 
@@ -98,9 +101,15 @@ struct nuraft_global_mgr::worker_handle {
 nuraft_global_mgr::nuraft_global_mgr()
     : asio_service_(nullptr)
     , thread_id_counter_(0)
+    , num_leader_moves_(0)
     {}
 
 nuraft_global_mgr::~nuraft_global_mgr() {
+    if (balancer_) {
+        balancer_->shutdown();
+        balancer_.reset();
+    }
+
     for (auto& entry: append_workers_) {
         ptr<worker_handle>& wh = entry;
         wh->shutdown();
@@ -153,9 +162,20 @@ void nuraft_global_mgr::init_thread_pool() {
                                               w_hdl );
         append_workers_.push_back(w_hdl);
     }
+
+    if (config_.leader_balancing_interval_ms_) {
+        balancer_ = cs_new<worker_handle>( thread_id_counter_.fetch_add(1) );
+        balancer_->thread_ = cs_new<std::thread>( &nuraft_global_mgr::balancer_loop,
+                                                  this,
+                                                  balancer_ );
+    }
 }
 
 void nuraft_global_mgr::init_raft_server(raft_server* server) {
+    {   std::lock_guard<std::mutex> l(servers_lock_);
+        servers_.insert(server);
+    }
+
     ptr<logger>& l_ = server->l_;
     p_in("global manager detected, %zu commit workers, %zu append workers",
          config_.num_commit_threads_,
@@ -196,6 +216,10 @@ void nuraft_global_mgr::close_raft_server(raft_server* server) {
         }
     }
 
+    {   std::lock_guard<std::mutex> l(servers_lock_);
+        servers_.erase(server);
+    }
+
     ptr<logger>& l_ = server->l_;
     p_in("global manager detected, %zu appends %zu commits are aborted",
          num_aborted_append,
@@ -266,6 +290,153 @@ void nuraft_global_mgr::request_commit(ptr<raft_server> server) {
     // If all workers are working, nothing to do for now.
 }
 
+std::string nuraft_global_mgr::get_host(const srv_config& s_config) const {
+    if (config_.host_resolver_) return config_.host_resolver_(s_config);
+
+    // Strip the scheme and port, e.g., "tcp://host:port" -> "host".
+    const std::string& endpoint = s_config.get_endpoint();
+    size_t begin = endpoint.find("://");
+    begin = (begin == std::string::npos) ? 0 : begin + 3;
+    size_t end = endpoint.rfind(':');
+    if (end == std::string::npos || end < begin) end = endpoint.size();
+    return endpoint.substr(begin, end - begin);
+}
+
+std::string nuraft_global_mgr::get_group_key(const cluster_config& c_config) const {
+    std::map<int32, std::string> members;
+    for (const ptr<srv_config>& s_config: c_config.get_servers()) {
+        members[s_config->get_id()] = s_config->get_endpoint();
+    }
+    std::string key = c_config.get_user_ctx();
+    for (auto& entry: members) {
+        key += "|" + std::to_string(entry.first) + "@" + entry.second;
+    }
+    return key;
+}
+
+std::map<std::string, size_t> nuraft_global_mgr::get_leader_counts_locked() {
+    std::map<std::string, size_t> counts;
+    // Multiple members of the same group can be on this process,
+    // count each group once. A leader endpoint cannot identify
+    // the group, as it can lead multiple groups.
+    std::unordered_set<std::string> groups;
+    // Member IDs on this process, per group key. The same member
+    // cannot be on this process twice in a group, so a duplicate
+    // means that different groups have the same key.
+    std::map< std::string, std::set<int32> > local_members;
+    for (raft_server* server: servers_) {
+        if (!server->is_initialized()) continue;
+        ptr<cluster_config> c_config = server->get_config();
+        if (!c_config) continue;
+
+        std::string group_key = get_group_key(*c_config);
+        if (!local_members[group_key].insert(server->get_id()).second) {
+            ptr<logger>& l_ = server->l_;
+            p_wn("[LEADER BALANCING] another group on this process has the "
+                 "same members and user context, leaders will be miscounted; "
+                 "set a unique user context to each group");
+        }
+
+        int32 leader_id = server->get_leader();
+        for (ptr<srv_config>& s_config: c_config->get_servers()) {
+            if (s_config->is_learner() || s_config->is_witness()) continue;
+            size_t& count = counts[ get_host(*s_config) ];
+            if ( s_config->get_id() == leader_id &&
+                 groups.insert(group_key).second ) {
+                count++;
+            }
+        }
+    }
+    return counts;
+}
+
+std::map<std::string, size_t> nuraft_global_mgr::get_leader_counts() {
+    std::lock_guard<std::mutex> l(servers_lock_);
+    return get_leader_counts_locked();
+}
+
+size_t nuraft_global_mgr::balance_leaders() {
+    std::lock_guard<std::mutex> l(servers_lock_);
+    std::map<std::string, size_t> counts = get_leader_counts_locked();
+
+    size_t num_moves = 0;
+    for (raft_server* server: servers_) {
+        if (num_moves >= config_.max_leader_moves_per_round_) break;
+        if (!server->is_initialized() || !server->is_leader()) continue;
+
+        // Membership change is in progress, leave the group as it is.
+        if (server->is_membership_changing()) continue;
+
+        ptr<cluster_config> c_config = server->get_config();
+        ptr<srv_config> my_config = c_config->get_server(server->get_id());
+        if (!my_config) continue;
+        std::string my_host = get_host(*my_config);
+        size_t my_count = counts[my_host];
+
+        // Find a member on the least loaded host. It should be able to
+        // be the leader, not less preferred than the current leader
+        // by priority, and up-to-date.
+        raft_params params = server->get_current_params();
+        ulong committed_idx = server->get_committed_log_idx();
+        int32 successor = -1;
+        std::string successor_host;
+        size_t successor_count = my_count;
+        for (ptr<srv_config>& s_config: c_config->get_servers()) {
+            if ( s_config->get_id() == server->get_id() ||
+                 s_config->is_learner() ||
+                 s_config->is_witness() ||
+                 s_config->get_priority() < my_config->get_priority() ) continue;
+
+            std::string host = get_host(*s_config);
+            size_t count = counts[host];
+            if (count >= successor_count) continue;
+
+            raft_server::peer_info pi = server->get_peer_info(s_config->get_id());
+            if ( pi.id_ < 0 ||
+                 pi.last_log_idx_ < committed_idx ||
+                 pi.last_succ_resp_us_ >
+                     (ulong)params.heart_beat_interval_ * 2 * 1000 ) continue;
+
+            successor = s_config->get_id();
+            successor_host = host;
+            successor_count = count;
+        }
+
+        // Moving one leadership should reduce the difference,
+        // not just reverse it.
+        if (successor < 0 || my_count < successor_count + 2) continue;
+
+        ptr<logger>& l_ = server->l_;
+        p_in("[LEADER BALANCING] host %s leads %zu groups, host %s leads %zu "
+             "groups, yield leadership to %d",
+             my_host.c_str(), my_count,
+             successor_host.c_str(), successor_count,
+             successor);
+        server->yield_leadership(false, successor);
+        counts[my_host]--;
+        counts[successor_host]++;
+        num_moves++;
+        num_leader_moves_++;
+    }
+    return num_moves;
+}
+
+void nuraft_global_mgr::balancer_loop(ptr<worker_handle> handle) {
+    std::string thread_name = "nuraft_g_b" + std::to_string(handle->id_);
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+#elif __APPLE__
+    pthread_setname_np(thread_name.c_str());
+#endif
+
+    while (!handle->stopping_) {
+        handle->ea_.wait_ms(config_.leader_balancing_interval_ms_);
+        handle->ea_.reset();
+        if (handle->stopping_) break;
+        balance_leaders();
+    }
+}
+
 void nuraft_global_mgr::commit_worker_loop(ptr<worker_handle> handle) {
     std::string thread_name = "nuraft_g_c" + std::to_string(handle->id_);
 #ifdef __linux__
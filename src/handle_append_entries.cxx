@@ -23,10 +23,12 @@ limitations under the License.
 #include "raft_server.hxx"
 
 #include "cluster_config.hxx"
+#include "crc32.hxx"
 #include "error_code.hxx"
 #include "event_awaiter.hxx"
 #include "handle_custom_notification.hxx"
 #include "peer.hxx"
+#include "pre_commit_pipeline.hxx"
 #include "snapshot.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
@@ -34,6 +36,8 @@ limitations under the License.
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <map>
 #include <sstream>
 
 namespace nuraft {
@@ -45,22 +49,49 @@ struct resp_appendix {
     enum extra_order : uint8_t {
         NONE = 0,
         DO_NOT_REWIND = 1,
+        // Along with an accepted response: the sender is recovering
+        // its lost logs, should not be counted for commit.
+        RECOVERING_LOGS = 2,
     };
 
-    resp_appendix() : extra_order_(NONE) {}
+    resp_appendix() : extra_order_(NONE), features_(0) {}
 
     ptr<buffer> serialize() const {
         const static uint8_t CUR_VERSION = 0;
         size_t buf_len = sizeof(CUR_VERSION) + sizeof(extra_order_);
+        if (!rtts_.empty() || features_) {
+            buf_len += sizeof(uint32_t) +
+                       rtts_.size() * (sizeof(int32) + sizeof(uint64_t));
+        }
+        if (features_) {
+            buf_len += sizeof(features_);
+        }
 
         //  << Format >>
         // Format version       1 byte
         // Extra order          1 byte
+        //
+        //  << Optional >>
+        // Number of RTTs       4 bytes
+        // RTTs                 (4 + 8) * (number of RTTs) bytes
+        //   Server ID          4 bytes
+        //   RTT in us          8 bytes
+        // Features             1 byte
 
         ptr<buffer> result = buffer::alloc(buf_len);
         buffer_serializer bs(*result);
         bs.put_u8(CUR_VERSION);
         bs.put_u8(extra_order_);
+        if (!rtts_.empty() || features_) {
+            bs.put_u32(rtts_.size());
+            for (auto& entry: rtts_) {
+                bs.put_i32(entry.first);
+                bs.put_u64(entry.second);
+            }
+        }
+        if (features_) {
+            bs.put_u8(features_);
+        }
 
         return result;
     }
@@ -76,6 +107,23 @@ struct resp_appendix {
         }
 
         res->extra_order_ = static_cast<extra_order>(bs.get_u8());
+
+        // Optional fields, may not exist if the sender is an old version.
+        if (bs.pos() + sizeof(uint32_t) <= buf.size()) {
+            uint32_t num_rtts = bs.get_u32();
+            size_t rtt_size = sizeof(int32) + sizeof(uint64_t);
+            if (bs.pos() + (size_t)num_rtts * rtt_size > buf.size()) {
+                // Corrupted.
+                return res;
+            }
+            for (uint32_t ii = 0; ii < num_rtts; ++ii) {
+                int32 srv_id = bs.get_i32();
+                res->rtts_[srv_id] = bs.get_u64();
+            }
+        }
+        if (bs.pos() + sizeof(uint8_t) <= buf.size()) {
+            res->features_ = bs.get_u8();
+        }
         return res;
     }
 
@@ -85,14 +133,55 @@ struct resp_appendix {
             return "NONE";
         case DO_NOT_REWIND:
             return "DO_NOT_REWIND";
+        case RECOVERING_LOGS:
+            return "RECOVERING_LOGS";
         default:
             return "UNKNOWN";
         }
     };
 
     extra_order extra_order_;
+
+    /**
+     * Map of {server ID, RTT in microseconds} measured by the sender,
+     * used for the leader placement.
+     */
+    std::map<int32, uint64_t> rtts_;
+
+    /**
+     * Features understood by the sender, see `peer::feature`.
+     * `0` if not reported.
+     */
+    uint8_t features_;
 };
 
+/**
+ * Features that this version understands.
+ */
+static const uint8_t LOCAL_FEATURES = peer::WITNESS_CONFIG;
+
+/**
+ * Make a log entry for witness, which has the same metadata as the
+ * given one, while its payload is replaced with the CRC32 checksum
+ * of the original payload. Non-app logs are returned as they are.
+ */
+static ptr<log_entry> make_witness_log_entry(const ptr<log_entry>& le) {
+    if (!le->is_app_log()) return le;
+
+    uint32_t crc = le->get_crc32();
+    if (!le->has_crc32()) {
+        buffer& data = le->get_buf();
+        crc = crc32_8(data.data_begin(), data.size(), 0);
+    }
+    byte crc_buf[sizeof(uint32_t)];
+    memcpy(crc_buf, &crc, sizeof(crc_buf));
+    return log_entry::make( le->get_term(),
+                            crc_buf,
+                            sizeof(crc_buf),
+                            le->get_val_type(),
+                            le->get_timestamp() );
+}
+
 void raft_server::append_entries_in_bg() {
     std::string thread_name = "nuraft_append";
 #ifdef __linux__
@@ -127,19 +216,29 @@ void raft_server::request_append_entries() {
     // which calls `commit()` function.
     // We should call it here.
     if ( peers_.size() == 0 ||
-         get_quorum_for_commit() == 0 ) {
+         ( get_quorum_for_commit() == 0 &&
+           ctx_->get_params()->min_commit_zones_ <= 1 ) ) {
         uint64_t leader_index = get_current_leader_index();
         commit(leader_index);
         return;
     }
 
+    // Quarantined (slow) followers are served after the others.
+    std::vector< ptr<peer> > quarantined_peers;
     for (peer_itor it = peers_.begin(); it != peers_.end(); ++it) {
+        if (it->second->is_quarantined()) {
+            quarantined_peers.push_back(it->second);
+            continue;
+        }
         request_append_entries(it->second);
     }
+    for (ptr<peer>& pp: quarantined_peers) {
+        request_append_entries(pp);
+    }
 }
 
 bool raft_server::request_append_entries(ptr<peer> p) {
-    static timer_helper chk_timer(1000*1000);
+    static timer_helper chk_timer(1000*1000, false, true);
 
     // Checking the validity of role first.
     if (role_ != srv_role::leader) {
@@ -148,11 +247,14 @@ bool raft_server::request_append_entries(ptr<peer> p) {
         return false;
     }
 
-    cb_func::Param cb_param(id_, leader_, p->get_id());
-    CbReturnCode rc = ctx_->cb_func_.call(cb_func::RequestAppendEntries, &cb_param);
-    if (rc == CbReturnCode::ReturnNull) {
-        p_wn("by callback, abort request_append_entries");
-        return true;
+    if (ctx_->cb_func_.is_subscribed(cb_func::RequestAppendEntries)) {
+        cb_func::Param cb_param(id_, leader_, p->get_id());
+        CbReturnCode rc =
+            ctx_->cb_func_.call(cb_func::RequestAppendEntries, &cb_param);
+        if (rc == CbReturnCode::ReturnNull) {
+            p_wn("by callback, abort request_append_entries");
+            return true;
+        }
     }
 
     ptr<raft_params> params = ctx_->get_params();
@@ -332,8 +434,10 @@ bool raft_server::request_append_entries(ptr<peer> p) {
         p->send_req(p, msg, m_handler);
         p->reset_ls_timer();
 
-        cb_func::Param param(id_, leader_, p->get_id(), msg.get());
-        ctx_->cb_func_.call(cb_func::SentAppendEntriesReq, &param);
+        if (ctx_->cb_func_.is_subscribed(cb_func::SentAppendEntriesReq)) {
+            cb_func::Param param(id_, leader_, p->get_id(), msg.get());
+            ctx_->cb_func_.call(cb_func::SentAppendEntriesReq, &param);
+        }
 
         if ( srv_to_leave_ &&
              srv_to_leave_->get_id() == p->get_id() &&
@@ -383,6 +487,7 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp) {
     ulong last_log_idx(0L);
     ulong term(0L);
     ulong starting_idx(1L);
+    ptr<snapshot> ingest_snp(nullptr);
 
     {
         recur_lock(lock_);
@@ -390,6 +495,7 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp) {
         cur_nxt_idx = precommit_index_ + 1;
         commit_idx = quick_commit_index_;
         term = state_->get_term();
+        ingest_snp = get_ingest_snapshot();
     }
 
     {
@@ -426,8 +532,29 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp) {
     // Read log entries. The underlying log store may have removed some log entries
     // causing some of the requested entries to be unavailable. The log store should
     // return nullptr to indicate such errors.
+    ulong max_append_size = ctx_->get_params()->max_append_size_;
+    if (p.is_quarantined()) {
+        // Smaller batches for a slow follower, not to hold
+        // the send capacity that the others need.
+        max_append_size = std::max<ulong>(1, max_append_size / 4);
+    }
     ulong end_idx = std::min( cur_nxt_idx,
-                              last_log_idx + 1 + ctx_->get_params()->max_append_size_ );
+                              last_log_idx + 1 + max_append_size );
+
+    if ( ingest_snp &&
+         p.get_ingest_staged_idx() != ingest_snp->get_last_log_idx() ) {
+        // The marker log of bulk ingestion should not be sent before
+        // the peer stages the data set.
+        ulong ingest_idx = ingest_snp->get_last_log_idx();
+        if (last_log_idx + 1 == ingest_idx) {
+            bool succeeded_out = false;
+            return create_sync_snapshot_req( pp, last_log_idx, term,
+                                             commit_idx, succeeded_out );
+        }
+        if (last_log_idx + 1 < ingest_idx) {
+            end_idx = std::min(end_idx, ingest_idx);
+        }
+    }
 
     // NOTE: If this is a retry, probably the follower is down.
     //       Send just one log until it comes back
@@ -486,7 +613,7 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp) {
         }
 
         // Cannot recover using snapshot. Return here to protect the leader.
-        static timer_helper msg_timer(5000000);
+        static timer_helper msg_timer(5000000, false, true);
         int log_lv = msg_timer.timeout_and_reset() ? L_ERROR : L_TRACE;
         p_lv(log_lv,
              "neither snapshot nor log exists, peer %d, last log %" PRIu64 ", "
@@ -543,7 +670,13 @@ ptr<req_msg> raft_server::create_append_entries_req(ptr<peer>& pp) {
           ( term, msg_type::append_entries_request, id_, p.get_id(),
             last_log_term, last_log_idx, commit_idx ) );
     std::vector<ptr<log_entry>>& v = req->log_entries();
-    if (log_entries) {
+    if (log_entries && p.is_witness()) {
+        // Witness needs only the metadata of logs.
+        v.reserve(log_entries->size());
+        for (const ptr<log_entry>& le: *log_entries) {
+            v.push_back( make_witness_log_entry(le) );
+        }
+    } else if (log_entries) {
         v.insert(v.end(), log_entries->begin(), log_entries->end());
     }
     p.set_last_sent_idx(last_log_idx + 1);
@@ -597,6 +730,9 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
             return nullptr;
         } else {
             update_target_priority();
+            if (ctx_->get_params()->adaptive_election_timeout_) {
+                record_leader_hb(req.get_src());
+            }
             // Modified by JungSang Ahn, Mar 28 2018:
             //   As we have `serving_req_` flag, restarting election timer
             //   should be move to the end of this function.
@@ -633,7 +769,7 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
               local_snp->get_last_log_term() == req.get_last_log_term() );
 
     int log_lv = log_okay ? L_TRACE : (supp_exp_warning ? L_INFO : L_WARN);
-    static timer_helper log_timer(500*1000, true);
+    static timer_helper log_timer(500*1000, true, true);
     if (log_lv == L_WARN) {
         // To avoid verbose logs.
         if (!log_timer.timeout_and_reset()) {
@@ -674,9 +810,11 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
     if (!initialized_) initialized_ = true;
 
     // Callback if necessary.
-    cb_func::Param param(id_, leader_, -1, &req);
-    cb_func::ReturnCode cb_ret =
-        ctx_->cb_func_.call(cb_func::GotAppendEntryReqFromLeader, &param);
+    cb_func::ReturnCode cb_ret = cb_func::Ok;
+    if (ctx_->cb_func_.is_subscribed(cb_func::GotAppendEntryReqFromLeader)) {
+        cb_func::Param param(id_, leader_, -1, &req);
+        cb_ret = ctx_->cb_func_.call(cb_func::GotAppendEntryReqFromLeader, &param);
+    }
     // If callback function decided to refuse this request, return here.
     if (cb_ret != cb_func::Ok) {
         // If this request is declined by the application, not because of
@@ -689,7 +827,7 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
         // to slow down the leader.
         resp->set_next_batch_size_hint_in_bytes(-1);
 
-        static timer_helper log_timer(1000 * 1000);
+        static timer_helper log_timer(1000 * 1000, false, true);
         int log_lv = log_timer.timeout_and_reset() ? L_INFO : L_TRACE;
         p_lv(log_lv, "appended extra order %s",
              resp_appendix::extra_order_msg(appendix.extra_order_));
@@ -701,6 +839,25 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
         return resp;
     }
 
+    ulong missing_idx = ingest_snp_missing_idx_;
+    if (missing_idx) {
+        // Committed marker log without the ingested data set,
+        // ask the leader to send the snapshot instead.
+        static timer_helper missing_timer(1000 * 1000, true, true);
+        int log_lv = missing_timer.timeout_and_reset() ? L_WARN : L_TRACE;
+        p_lv(log_lv, "ingested snapshot %" PRIu64 " is missing, request it",
+             missing_idx);
+        leader_ = req.get_src();
+        restart_election_timer();
+        return cs_new<resp_msg>( state_->get_term(),
+                                 msg_type::append_entries_response,
+                                 id_,
+                                 req.get_src(),
+                                 missing_idx );
+    }
+
+    // Last log index that should be durable before responding.
+    ulong durable_wait_idx = 0;
     if (req.log_entries().size() > 0) {
         // Write logs to store, start from overlapped logs
 
@@ -749,6 +906,10 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                   req.log_entries().size(),
                   cnt );
             rollback_in_progress = true;
+            if (pre_commit_pipeline_) {
+                // Rollback should be invoked after the pre-commit.
+                pre_commit_pipeline_->flush();
+            }
             // If rollback point is smaller than commit index,
             // should rollback commit index as well
             // (should not happen in Raft though).
@@ -770,10 +931,9 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                 uint64_t idx = my_last_log_idx - ii;
                 ptr<log_entry> old_entry = log_store_->entry_at(idx);
                 ptr<buffer> buf = old_entry->get_buf_ptr();
-                if (old_entry->get_val_type() == log_val_type::app_log) {
-                    buf->pos(0);
-                    state_machine_->rollback_ext
-                        ( state_machine::ext_op_params( idx, buf ) );
+                if (old_entry->is_app_log()) {
+                    pending_bytes_ -= buf->size();
+                    rollback_app_log(idx, old_entry);
                     p_in( "rollback log %" PRIu64 ", term %" PRIu64,
                           idx, old_entry->get_term() );
 
@@ -784,11 +944,19 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                     p_in( "revert from a prev config change to config at %" PRIu64,
                           get_config()->get_log_idx() );
                     config_changing_ = false;
+
+                } else if (old_entry->get_val_type() == log_val_type::ingest_marker) {
+                    abort_ingested_snapshot(idx);
                 }
             }
         }
 
         // Dealing with overwrites (logs with different term).
+        if ( log_idx < log_store_->next_slot() &&
+             cnt < req.log_entries().size() ) {
+            // Deferred responses should not acknowledge overwritten logs.
+            reject_deferred_append_resps(log_idx);
+        }
         while ( log_idx < log_store_->next_slot() &&
                 cnt < req.log_entries().size() )
         {
@@ -797,11 +965,12 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                  log_idx, entry->get_term(), entry->get_timestamp());
             store_log_entry(entry, log_idx);
 
-            if (entry->get_val_type() == log_val_type::app_log) {
-                ptr<buffer> buf = entry->get_buf_ptr();
-                buf->pos(0);
-                state_machine_->pre_commit_ext
-                    ( state_machine::ext_op_params( log_idx, buf ) );
+            if (entry->is_app_log()) {
+                if (pre_commit_pipeline_) {
+                    pre_commit_pipeline_->enqueue(log_idx, entry);
+                } else {
+                    pre_commit_app_log(log_idx, entry);
+                }
 
             } else if(entry->get_val_type() == log_val_type::conf) {
                 p_in("receive a config change from leader at %" PRIu64, log_idx);
@@ -831,11 +1000,12 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                       idx_for_entry );
                 config_changing_ = true;
 
-            } else if(entry->get_val_type() == log_val_type::app_log) {
-                ptr<buffer> buf = entry->get_buf_ptr();
-                buf->pos(0);
-                state_machine_->pre_commit_ext
-                    ( state_machine::ext_op_params( idx_for_entry, buf ) );
+            } else if(entry->is_app_log()) {
+                if (pre_commit_pipeline_) {
+                    pre_commit_pipeline_->enqueue(idx_for_entry, entry);
+                } else {
+                    pre_commit_app_log(idx_for_entry, entry);
+                }
             }
 
             if (stopping_) return resp;
@@ -846,26 +1016,17 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
                                          req.log_entries().size() );
 
         ptr<raft_params> params = ctx_->get_params();
-        if (params->parallel_log_appending_) {
-            uint64_t last_durable_index = log_store_->last_durable_index();
-            while ( last_durable_index <
-                    req.get_last_log_idx() + req.log_entries().size() ) {
-                // Some logs are not durable yet, wait here and block the thread.
-                p_tr( "durable index %" PRIu64
-                      ", sleep and wait for log appending completion",
-                      last_durable_index );
-                ea_follower_log_append_->wait_ms(params->heart_beat_interval_);
-
-                // --- `notify_log_append_completion` API will wake it up. ---
-
-                ea_follower_log_append_->reset();
-                last_durable_index = log_store_->last_durable_index();
-                p_tr( "wake up, durable index %" PRIu64, last_durable_index );
-            }
+        if ( params->parallel_log_appending_ &&
+             !params->memory_only_durability_ ) {
+            // Logs may not be durable yet. Instead of blocking the thread
+            // here, the response will be deferred until
+            // `notify_log_append_completion` reports them durable.
+            durable_wait_idx = req.get_last_log_idx() + req.log_entries().size();
         }
     }
 
     leader_ = req.get_src();
+    check_handoff();
 
     // WARNING:
     //   If this node was leader but now follower, and right after
@@ -915,6 +1076,39 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
 
     resp->accept(target_precommit_index + 1);
 
+    resp_appendix appendix;
+    if (recovering_logs_) {
+        if (target_precommit_index >= req.get_commit_idx()) {
+            // Now this server has all logs that the leader has committed,
+            // including the ones it acknowledged before the restart.
+            p_in("caught up with the leader's commit index %" PRIu64
+                 ", log recovery is done", req.get_commit_idx());
+            recovering_logs_ = false;
+        } else {
+            appendix.extra_order_ = resp_appendix::RECOVERING_LOGS;
+        }
+    }
+    if ( ctx_->get_params()->leader_placement_interval_ms_ > 0 &&
+         rtt_probe_timer_.timeout_and_reset() ) {
+        // Report the RTTs measured so far to the leader,
+        // and measure them again.
+        appendix.rtts_ = get_peer_rtts();
+        probe_peer_rtts();
+    }
+    if ( features_reported_to_ != req.get_src() ||
+         features_report_timer_.timeout_and_reset() ) {
+        // Report to a new leader, and periodically as the leader
+        // forgets them when it reconnects to this server.
+        appendix.features_ = LOCAL_FEATURES;
+        features_reported_to_ = req.get_src();
+        features_report_timer_.reset();
+    }
+    if ( appendix.extra_order_ != resp_appendix::NONE ||
+         !appendix.rtts_.empty() ||
+         appendix.features_ ) {
+        resp->set_ctx( appendix.serialize() );
+    }
+
     int32 time_ms = tt.get_us() / 1000;
     if (time_ms >= ctx_->get_params()->heart_beat_interval_) {
         // Append entries took longer than HB interval. Warning.
@@ -940,9 +1134,135 @@ ptr<resp_msg> raft_server::handle_append_entries(req_msg& req)
 
     out_of_log_range_ = false;
 
+    if (durable_wait_idx) {
+        defer_append_resp(resp, durable_wait_idx);
+    }
     return resp;
 }
 
+struct raft_server::deferred_append_resp {
+    deferred_append_resp(ulong durable_idx, ptr<resp_msg>& resp)
+        : durable_idx_(durable_idx)
+        , resp_(resp)
+        , result_( cs_new< cmd_result< ptr<buffer> > >() )
+        {}
+
+    /**
+     * The response can be sent once logs up to this index are durable.
+     */
+    ulong durable_idx_;
+
+    /**
+     * The response. Its context will be set again
+     * by the transport with the value of `result_`.
+     */
+    ptr<resp_msg> resp_;
+
+    /**
+     * Set when the logs become durable.
+     */
+    ptr< cmd_result< ptr<buffer> > > result_;
+
+    /**
+     * Time since the response is deferred.
+     */
+    timer_helper timer_;
+};
+
+void raft_server::defer_append_resp(ptr<resp_msg>& resp, ulong durable_idx) {
+    ptr<deferred_append_resp> elem =
+        cs_new<deferred_append_resp>(durable_idx, resp);
+    {   auto_lock(deferred_append_resps_lock_);
+        // Check again under the lock, as the notification may have
+        // been made before we reach here.
+        uint64_t last_durable_index = log_store_->last_durable_index();
+        if (last_durable_index >= durable_idx) return;
+
+        p_tr( "durable index %" PRIu64 ", defer the response until %" PRIu64,
+              last_durable_index, durable_idx );
+        deferred_append_resps_.push_back(elem);
+    }
+
+    ptr< cmd_result< ptr<buffer> > > result = elem->result_;
+    resp->set_async_cb( [result]() -> ptr< cmd_result< ptr<buffer> > > {
+        return result;
+    } );
+}
+
+void raft_server::complete_deferred_append_resps(ulong durable_idx) {
+    std::list< ptr<deferred_append_resp> > ready;
+    {   auto_lock(deferred_append_resps_lock_);
+        auto entry = deferred_append_resps_.begin();
+        while (entry != deferred_append_resps_.end()) {
+            if ((*entry)->durable_idx_ > durable_idx) {
+                entry++;
+                continue;
+            }
+            ready.push_back(*entry);
+            entry = deferred_append_resps_.erase(entry);
+        }
+    }
+    if (ready.empty()) return;
+
+    for (ptr<deferred_append_resp>& elem: ready) {
+        p_tr( "durable index %" PRIu64 ", send the response deferred until %" PRIu64
+              ", next idx %" PRIu64,
+              durable_idx, elem->durable_idx_, elem->resp_->get_next_idx() );
+        ptr<buffer> ctx = elem->resp_->get_ctx();
+        ptr<std::exception> no_err = nullptr;
+        elem->result_->set_result(ctx, no_err);
+    }
+}
+
+void raft_server::drop_deferred_append_resps() {
+    // Responses whose logs are not durable should never be sent,
+    // the leader will send the logs again.
+    std::list< ptr<deferred_append_resp> > dropped;
+    {   auto_lock(deferred_append_resps_lock_);
+        dropped.swap(deferred_append_resps_);
+    }
+    if (!dropped.empty()) {
+        p_in("dropped %zu deferred append_entries responses", dropped.size());
+    }
+}
+
+void raft_server::reject_deferred_append_resps(ulong from_idx) {
+    // Responses acknowledging logs from `from_idx` (or all if `0`)
+    // should not be sent, as the logs are being overwritten or the
+    // term has changed. Reject them instead, so that the sender does
+    // not wait for the responses, and sends the logs again.
+    std::list< ptr<deferred_append_resp> > rejected;
+    {   auto_lock(deferred_append_resps_lock_);
+        auto entry = deferred_append_resps_.begin();
+        while (entry != deferred_append_resps_.end()) {
+            if ((*entry)->durable_idx_ < from_idx) {
+                entry++;
+                continue;
+            }
+            rejected.push_back(*entry);
+            entry = deferred_append_resps_.erase(entry);
+        }
+    }
+    if (rejected.empty()) return;
+
+    ulong next_idx = from_idx ? from_idx : log_store_->last_durable_index() + 1;
+    p_in("reject %zu deferred append_entries responses, next idx %" PRIu64,
+         rejected.size(), next_idx);
+    for (ptr<deferred_append_resp>& elem: rejected) {
+        elem->resp_->reject( std::min(elem->resp_->get_next_idx(), next_idx) );
+        ptr<buffer> no_ctx = nullptr;
+        ptr<std::exception> no_err = nullptr;
+        elem->result_->set_result(no_ctx, no_err);
+    }
+}
+
+uint64_t raft_server::get_deferred_append_resps_wait_ms() {
+    auto_lock(deferred_append_resps_lock_);
+    if (deferred_append_resps_.empty()) return 0;
+    // The oldest one is always at the front.
+    return deferred_append_resps_.front()->timer_.get_ms();
+}
+
 bool raft_server::try_update_precommit_index(ulong desired, const size_t MAX_ATTEMPTS) {
     // If `MAX_ATTEMPTS == 0`, try forever.
     size_t num_attempts = 0;
@@ -1001,6 +1321,17 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
     p->set_next_batch_size_hint_in_bytes(bs_hint);
 
     if (resp.get_accepted()) {
+        ptr<resp_appendix> appendix;
+        if (resp.get_ctx()) {
+            appendix = resp_appendix::deserialize(*resp.get_ctx());
+        }
+        p->set_recovering_logs
+           ( appendix &&
+             appendix->extra_order_ == resp_appendix::RECOVERING_LOGS );
+        if (appendix && appendix->features_) {
+            p->set_features(appendix->features_);
+        }
+
         uint64_t prev_matched_idx = 0;
         uint64_t new_matched_idx = 0;
         {
@@ -1013,18 +1344,33 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
             p->set_matched_idx(new_matched_idx);
             p->set_last_accepted_log_idx(new_matched_idx);
         }
-        cb_func::Param param(id_, leader_, p->get_id());
-        param.ctx = &new_matched_idx;
-        CbReturnCode rc = ctx_->cb_func_.call
-                          ( cb_func::GotAppendEntryRespFromPeer, &param );
-        (void)rc;
-
-        // Try to commit with this response.
-        ulong committed_index = get_expected_committed_log_idx();
-        commit( committed_index );
+        if (ctx_->cb_func_.is_subscribed(cb_func::GotAppendEntryRespFromPeer)) {
+            cb_func::Param param(id_, leader_, p->get_id());
+            param.ctx = &new_matched_idx;
+            CbReturnCode rc = ctx_->cb_func_.call
+                              ( cb_func::GotAppendEntryRespFromPeer, &param );
+            (void)rc;
+        }
+        adapt_hb_interval(*p);
+        check_slow_follower(*p);
+
+        if ( new_matched_idx > prev_matched_idx ||
+             new_matched_idx > quick_commit_index_ ) {
+            // Try to commit with this response.
+            ulong committed_index = get_expected_committed_log_idx();
+            commit( committed_index );
+        } else {
+            // The ack does not tell anything new (e.g., heartbeat or
+            // duplicated ack), it cannot advance the commit index.
+            p_tr("peer %d, matched idx %" PRIu64 " not advanced, "
+                 "skip commit", p->get_id(), new_matched_idx);
+        }
         need_to_catchup = p->clear_pending_commit() ||
                           resp.get_next_idx() < log_store_->next_slot();
 
+        check_leader_placement( *p, ( appendix && !appendix->rtts_.empty() )
+                                    ? &appendix->rtts_ : nullptr );
+
     } else {
         std::lock_guard<std::mutex> guard(p->get_lock());
         ulong prev_next_log = p->get_next_log_idx();
@@ -1040,7 +1386,7 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
                     do_log_rewind = false;
                 }
 
-                static timer_helper extra_order_timer(1000 * 1000, true);
+                static timer_helper extra_order_timer(1000 * 1000, true, true);
                 int log_lv = extra_order_timer.timeout_and_reset() ? L_INFO : L_TRACE;
                 p_lv(log_lv, "received extra order: %s",
                      resp_appendix::extra_order_msg(appendix->extra_order_));
@@ -1054,7 +1400,7 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
         bool suppress = p->need_to_suppress_error();
 
         // To avoid verbose logs here.
-        static timer_helper log_timer(500 * 1000, true);
+        static timer_helper log_timer(500 * 1000, true, true);
         int log_lv = suppress ? L_INFO : L_WARN;
         if (log_lv == L_WARN) {
             if (!log_timer.timeout_and_reset()) {
@@ -1151,7 +1497,8 @@ void raft_server::handle_append_entries_resp(resp_msg& resp) {
 uint64_t raft_server::get_current_leader_index() {
     uint64_t leader_index = precommit_index_;
     ptr<raft_params> params = ctx_->get_params();
-    if (params->parallel_log_appending_) {
+    if ( params->parallel_log_appending_ &&
+         !params->memory_only_durability_ ) {
         // For parallel appending, take the smaller one.
         uint64_t durable_index = log_store_->last_durable_index();
         p_tr("last durable index %" PRIu64 ", precommit index %" PRIu64,
@@ -1172,12 +1519,51 @@ ulong raft_server::get_expected_committed_log_idx() {
     matched_indexes.push_back( leader_index );
     aci_params.peer_index_map_[id_] = leader_index;
 
+    // Largest matched index of each zone (data center) among members
+    // keeping log payloads, used only when `min_commit_zones_` is set.
+    // The number of zones is small, so a vector is used.
+    int32 min_zones = ctx_->get_params()->min_commit_zones_;
+    std::vector< std::pair<int32, ulong> > zone_indexes;
+    auto update_zone_index = [&zone_indexes](int32 dc_id, ulong idx) {
+        for (auto& entry: zone_indexes) {
+            if (entry.first == dc_id) {
+                entry.second = std::max(entry.second, idx);
+                return;
+            }
+        }
+        zone_indexes.push_back( std::make_pair(dc_id, idx) );
+    };
+    if (min_zones > 1) update_zone_index( get_dc_id(id_), leader_index );
+
+    // Largest matched index among followers keeping log payloads,
+    // used only when there are witnesses.
+    bool witness_exists = false;
+    bool data_follower_exists = false;
+    ulong data_follower_index = 0;
     for (auto& entry: peers_) {
         ptr<peer>& p = entry.second;
         aci_params.peer_index_map_[p->get_id()] = p->get_matched_idx();
 
         if (!is_regular_member(p)) continue;
+        if (p->is_recovering_logs()) {
+            // Still voting member, but does not contribute to commit
+            // until it recovers the logs it may have acknowledged.
+            matched_indexes.push_back(0);
+            continue;
+        }
         matched_indexes.push_back( p->get_matched_idx() );
+
+        if (p->is_witness()) {
+            witness_exists = true;
+        } else {
+            data_follower_exists = true;
+            data_follower_index = std::max( data_follower_index,
+                                            p->get_matched_idx() );
+            if (min_zones > 1) {
+                update_zone_index( p->get_config().get_dc_id(),
+                                   p->get_matched_idx() );
+            }
+        }
     }
     int voting_members = get_num_voting_members();
     assert((int32)matched_indexes.size() == voting_members);
@@ -1191,14 +1577,17 @@ ulong raft_server::get_expected_committed_log_idx() {
 
     size_t quorum_idx = get_quorum_for_commit();
     if (ctx_->get_params()->use_full_consensus_among_healthy_members_) {
-        size_t not_responding_peers = get_not_responding_peers();
+        // Quarantined slow followers are regarded as unhealthy.
+        size_t not_responding_peers = get_not_responding_peers() +
+                                      get_num_quarantined_peers();
         if (not_responding_peers < voting_members - quorum_idx) {
             // If full consensus option is on, commit should be
             // agreed by all healthy members, and the number of
             // aggreed members should be bigger than regular quorum size.
             size_t prev_quorum_idx = quorum_idx;
             quorum_idx = voting_members - not_responding_peers - 1;
-            p_tr( "full consensus mode: %zu peers are not responding out of %d, "
+            p_tr( "full consensus mode: %zu peers are not responding "
+                  "or quarantined out of %d, "
                   "adjust quorum %zu -> %zu",
                   not_responding_peers, voting_members,
                   prev_quorum_idx, quorum_idx );
@@ -1219,6 +1608,34 @@ ulong raft_server::get_expected_committed_log_idx() {
 
     aci_params.current_commit_index_ = quick_commit_index_;
     aci_params.expected_commit_index_ = matched_indexes[quorum_idx];
+    if ( witness_exists &&
+         data_follower_exists &&
+         aci_params.expected_commit_index_ > data_follower_index ) {
+        // Quorum consisting of the leader and witnesses only has a
+        // single copy of the payload. If the leader is lost, no other
+        // member could win the election, as witnesses have newer logs.
+        // Wait until at least one follower keeping payloads has it.
+        p_tr( "wait for a data follower: %" PRIu64 " -> %" PRIu64,
+              aci_params.expected_commit_index_, data_follower_index );
+        aci_params.expected_commit_index_ = data_follower_index;
+    }
+    if (min_zones > 1) {
+        // A log should exist in `min_zones` zones: among the largest
+        // index of each zone, take the `min_zones`-th largest one.
+        size_t num_zones = std::min( (size_t)min_zones, zone_indexes.size() );
+        std::sort( zone_indexes.begin(), zone_indexes.end(),
+                   []( const std::pair<int32, ulong>& a,
+                       const std::pair<int32, ulong>& b ) {
+                       return a.second > b.second;
+                   } );
+        ulong zone_commit_index = zone_indexes[num_zones - 1].second;
+        if (aci_params.expected_commit_index_ > zone_commit_index) {
+            p_tr( "wait for %zu zones: %" PRIu64 " -> %" PRIu64,
+                  num_zones, aci_params.expected_commit_index_,
+                  zone_commit_index );
+            aci_params.expected_commit_index_ = zone_commit_index;
+        }
+    }
     uint64_t adjusted_commit_index = state_machine_->adjust_commit_index(aci_params);
     if (aci_params.expected_commit_index_ != adjusted_commit_index) {
         p_tr( "commit index adjusted: %" PRIu64 " -> %" PRIu64,
@@ -1243,6 +1660,9 @@ void raft_server::notify_log_append_completion(bool ok) {
             return;
         }
 
+        // Responses deferred while this server was a follower.
+        complete_deferred_append_resps( log_store_->last_durable_index() );
+
         // Leader: commit the log and send append_entries request, if needed.
         uint64_t prev_committed_index = quick_commit_index_.load();
         uint64_t committed_index = get_expected_committed_log_idx();
@@ -1263,8 +1683,8 @@ void raft_server::notify_log_append_completion(bool ok) {
             return;
         }
 
-        // Follower: wake up the waiting thread.
-        ea_follower_log_append_->invoke();
+        // Follower: send the responses waiting for the logs to be durable.
+        complete_deferred_append_resps( log_store_->last_durable_index() );
     }
 }
 
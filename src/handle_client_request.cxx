@@ -25,6 +25,8 @@ limitations under the License.
 #include "debugging_options.hxx"
 #include "error_code.hxx"
 #include "global_mgr.hxx"
+#include "packed_buffers.hxx"
+#include "pre_commit_pipeline.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
 #include "tracer.hxx"
@@ -56,6 +58,8 @@ ptr<resp_msg> raft_server::handle_cli_req_prelock(req_msg& req,
             break;
         }
     }
+    // Let the follower know that it can forward requests in a batch.
+    if (resp) resp->set_fwd_batch_supported(true);
 
     // Urgent commit, so that the commit will not depend on hb.
     request_append_entries_for_all();
@@ -102,6 +106,17 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
         return resp;
     }
 
+    if (bulk_ingest_in_progress_) {
+        // Log index is reserved for the ingested snapshot.
+        resp->set_result_code( cmd_result_code::CANCELLED );
+        return resp;
+    }
+
+    if (!check_admission()) {
+        resp->set_result_code( cmd_result_code::SERVER_IS_BUSY );
+        return resp;
+    }
+
     if (ext_params.expected_term_) {
         // If expected term is given, check the current term.
         if (ext_params.expected_term_ != cur_term) {
@@ -113,6 +128,32 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
     std::vector< ptr<log_entry> >& entries = req.log_entries();
     size_t num_entries = entries.size();
 
+    // Batch of requests forwarded by a follower: the follower wants the
+    // results of all logs, to demultiplex them to the original requests.
+    bool fwd_batch = req.is_forwarded_batch() && num_entries > 0;
+    bool sync_replication = !get_config()->is_async_replication();
+    // Requests from RPC are always completed asynchronously,
+    // so as not to block the RPC thread until commit.
+    bool async_resp = ( params->return_method_ == raft_params::async_handler ||
+                        ext_params.async_cli_resp_ );
+    std::vector< ptr<commit_ret_elem> > fwd_batch_elems;
+    std::vector< ptr<buffer> > fwd_batch_precommit_results;
+    if (fwd_batch && sync_replication) {
+        // Register the results of all logs except for the last one,
+        // before the commit thread can reach them.
+        ulong first_idx = log_store_->next_slot();
+        auto_lock(commit_ret_elems_lock_);
+        for (size_t i = 0; i + 1 < num_entries; ++i) {
+            ptr<commit_ret_elem> elem = cs_new<commit_ret_elem>();
+            elem->idx_ = first_idx + i;
+            elem->term_ = cur_term;
+            elem->result_code_ = cmd_result_code::TIMEOUT;
+            elem->async_ = async_resp;
+            commit_ret_elems_.insert( std::make_pair(elem->idx_, elem) );
+            fwd_batch_elems.push_back(elem);
+        }
+    }
+
     for (size_t i = 0; i < num_entries; ++i) {
         // force the log's term to current term
         entries.at(i)->set_term(cur_term);
@@ -123,16 +164,30 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
              next_slot, timestamp_us);
         last_idx = next_slot;
 
-        ptr<buffer> buf = entries.at(i)->get_buf_ptr();
-        buf->pos(0);
-        ret_value = state_machine_->pre_commit_ext
-                    ( state_machine::ext_op_params( last_idx, buf ) );
+        req_ext_cb_params cb_params;
+        cb_params.log_idx = last_idx;
+        cb_params.log_term = cur_term;
+        cb_params.context = ext_params.context_;
+
+        if (pre_commit_pipeline_) {
+            // Pre-commit will be done by the pipeline,
+            // without blocking log appending and replication.
+            pre_commit_pipeline_->enqueue( last_idx, entries.at(i),
+                                           ext_params.after_precommit_,
+                                           cb_params );
+            if (fwd_batch && !sync_replication) {
+                // Result of pre-commit is not available yet.
+                fwd_batch_precommit_results.push_back(nullptr);
+            }
+            continue;
+        }
+
+        ret_value = pre_commit_app_log(last_idx, entries.at(i));
+        if (fwd_batch && !sync_replication) {
+            fwd_batch_precommit_results.push_back(ret_value);
+        }
 
         if (ext_params.after_precommit_) {
-            req_ext_cb_params cb_params;
-            cb_params.log_idx = last_idx;
-            cb_params.log_term = cur_term;
-            cb_params.context = ext_params.context_;
             ext_params.after_precommit_(cb_params);
         }
     }
@@ -143,10 +198,12 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
     resp_idx = log_store_->next_slot();
 
     // Finished appending logs and pre_commit of itself.
-    cb_func::Param param(id_, leader_);
-    param.ctx = &last_idx;
-    CbReturnCode rc = ctx_->cb_func_.call(cb_func::AppendLogs, &param);
-    if (rc == CbReturnCode::ReturnNull) return nullptr;
+    if (ctx_->cb_func_.is_subscribed(cb_func::AppendLogs)) {
+        cb_func::Param param(id_, leader_);
+        param.ctx = &last_idx;
+        CbReturnCode rc = ctx_->cb_func_.call(cb_func::AppendLogs, &param);
+        if (rc == CbReturnCode::ReturnNull) return nullptr;
+    }
 
     size_t sleep_us = debugging_options::get_instance()
                       .handle_cli_req_sleep_us_.load(std::memory_order_relaxed);
@@ -155,11 +212,12 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
         timer_helper::sleep_us(sleep_us);
     }
 
-    if (!get_config()->is_async_replication()) {
+    if (sync_replication) {
         // Sync replication:
         //   Set callback function for `last_idx`.
         ptr<commit_ret_elem> elem = cs_new<commit_ret_elem>();
         elem->idx_ = last_idx;
+        elem->term_ = cur_term;
         elem->result_code_ = cmd_result_code::TIMEOUT;
 
         {   auto_lock(commit_ret_elems_lock_);
@@ -168,30 +226,73 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
                 // Commit thread was faster than this.
                 elem = entry->second;
                 p_tr("commit thread was faster than this thread: %p", elem.get());
+                if (async_resp) {
+                    // Nobody will wait for it, the result will be
+                    // delivered through `async_result_` below.
+                    commit_ret_elems_.erase(entry);
+                }
             } else {
                 commit_ret_elems_.insert( std::make_pair(last_idx, elem) );
             }
 
-            switch (ctx_->get_params()->return_method_) {
-            case raft_params::blocking:
-            default:
+            elem->async_ = async_resp;
+            if (!async_resp) {
                 // Blocking call: set callback function waiting for the result.
-                resp->set_cb( std::bind( &raft_server::handle_cli_req_callback,
-                                         this,
-                                         elem,
-                                         std::placeholders::_1 ) );
-                break;
+                if (fwd_batch) {
+                    resp->set_cb( [this, elem, fwd_batch_elems]
+                                  (ptr<resp_msg> r) -> ptr<resp_msg> {
+                        r = handle_cli_req_callback(elem, r);
+                        r->set_ctx( pack_fwd_batch_results( fwd_batch_elems,
+                                                            r->get_ctx(),
+                                                            r->get_result_code() ) );
+                        return r;
+                    } );
+                } else {
+                    resp->set_cb( std::bind( &raft_server::handle_cli_req_callback,
+                                             this,
+                                             elem,
+                                             std::placeholders::_1 ) );
+                }
 
-            case raft_params::async_handler:
+            } else {
                 // Async handler: create & set async result object.
                 if (!elem->async_result_) {
-                    elem->async_result_ = cs_new< cmd_result< ptr<buffer> > >();
+                    if (elem->result_code_ == cmd_result_code::TIMEOUT) {
+                        elem->async_result_ = cs_new< cmd_result< ptr<buffer> > >();
+                    } else {
+                        // Commit thread was faster than this, and did not
+                        // create the result object in blocking mode.
+                        elem->async_result_ = cs_new< cmd_result< ptr<buffer> > >
+                                              ( elem->ret_value_, elem->result_code_ );
+                    }
+                }
+                if (fwd_batch) {
+                    ptr< cmd_result< ptr<buffer> > > last_result =
+                        elem->async_result_;
+                    resp->set_async_cb( [this, last_result, fwd_batch_elems]()
+                                        -> ptr< cmd_result< ptr<buffer> > > {
+                        ptr< cmd_result< ptr<buffer> > > batch_result =
+                            cs_new< cmd_result< ptr<buffer> > >();
+                        batch_result->accept();
+                        last_result->when_ready
+                            ( [this, batch_result, fwd_batch_elems]
+                              ( cmd_result< ptr<buffer> >& res,
+                                ptr<std::exception>& err ) {
+                                  ptr<buffer> packed =
+                                      pack_fwd_batch_results( fwd_batch_elems,
+                                                              res.get(),
+                                                              res.get_result_code() );
+                                  batch_result->set_result
+                                      ( packed, err, res.get_result_code() );
+                              } );
+                        return batch_result;
+                    } );
+                } else {
+                    resp->set_async_cb
+                          ( std::bind( &raft_server::handle_cli_req_callback_async,
+                                       this,
+                                       elem->async_result_ ) );
                 }
-                resp->set_async_cb
-                      ( std::bind( &raft_server::handle_cli_req_callback_async,
-                                   this,
-                                   elem->async_result_ ) );
-                break;
             }
         }
 
@@ -200,13 +301,100 @@ ptr<resp_msg> raft_server::handle_cli_req(req_msg& req,
         //   Immediately return with the result of pre-commit.
         p_dv( "asynchronously replicated %" PRIu64 ", return value %p",
               last_idx, ret_value.get() );
-        resp->set_ctx(ret_value);
+        if (fwd_batch) {
+            std::vector<cmd_result_code> codes( fwd_batch_precommit_results.size(),
+                                                cmd_result_code::OK );
+            resp->set_ctx( pack_results( fwd_batch_precommit_results, codes ) );
+        } else {
+            resp->set_ctx(ret_value);
+        }
     }
 
     resp->accept(resp_idx);
     return resp;
 }
 
+ptr<buffer> raft_server::pack_fwd_batch_results
+            ( const std::vector< ptr<commit_ret_elem> >& elems,
+              ptr<buffer> last_result,
+              cmd_result_code last_result_code )
+{
+    std::vector< ptr<buffer> > results;
+    std::vector<cmd_result_code> codes;
+    results.reserve(elems.size() + 1);
+    codes.reserve(elems.size() + 1);
+    {   auto_lock(commit_ret_elems_lock_);
+        for (const ptr<commit_ret_elem>& elem: elems) {
+            results.push_back( elem->result_code_ == cmd_result_code::OK
+                               ? elem->ret_value_ : nullptr );
+            codes.push_back(elem->result_code_);
+            elem->callback_invoked_ = true;
+            if (elem->result_code_ == cmd_result_code::TIMEOUT) {
+                // Commit thread will remove it.
+                continue;
+            }
+            auto entry = commit_ret_elems_.find(elem->idx_);
+            if (entry != commit_ret_elems_.end() && entry->second == elem) {
+                commit_ret_elems_.erase(entry);
+            }
+        }
+    }
+    results.push_back(last_result);
+    codes.push_back(last_result_code);
+    return pack_results(results, codes);
+}
+
+bool raft_server::check_admission() {
+    ptr<raft_params> params = ctx_->get_params();
+    if ( !params->max_uncommitted_logs_ &&
+         !params->max_unapplied_logs_ &&
+         !params->max_pending_bytes_ ) {
+        return true;
+    }
+
+    pending_log_info info = get_pending_log_info();
+    if ( params->max_uncommitted_logs_ &&
+         info.num_uncommitted_logs_ >= (ulong)params->max_uncommitted_logs_ ) {
+        p_db("reject request: %" PRIu64 " uncommitted logs, limit %d",
+             info.num_uncommitted_logs_, params->max_uncommitted_logs_);
+        return false;
+    }
+    if ( params->max_unapplied_logs_ &&
+         info.num_unapplied_logs_ >= (ulong)params->max_unapplied_logs_ ) {
+        p_db("reject request: %" PRIu64 " unapplied logs, limit %d",
+             info.num_unapplied_logs_, params->max_unapplied_logs_);
+        return false;
+    }
+    if ( params->max_pending_bytes_ &&
+         info.pending_bytes_ >= (ulong)params->max_pending_bytes_ ) {
+        p_db("reject request: %" PRIu64 " pending bytes, limit %" PRId64,
+             info.pending_bytes_, params->max_pending_bytes_);
+        return false;
+    }
+    return true;
+}
+
+void raft_server::wait_for_admission() {
+    ptr<raft_params> params = ctx_->get_params();
+    if (!params->admission_wait_ms_ || check_admission()) return;
+
+    // Will be woken up whenever the state machine makes progress.
+    num_admission_waiters_.fetch_add(1);
+    {   std::unique_lock<std::mutex> l(admission_cv_lock_);
+        admission_cv_.wait_for
+            ( l,
+              std::chrono::milliseconds(params->admission_wait_ms_),
+              [this]() { return stopping_ || check_admission(); } );
+    }
+    num_admission_waiters_.fetch_sub(1);
+}
+
+void raft_server::notify_admission_waiters() {
+    if (!num_admission_waiters_) return;
+    std::lock_guard<std::mutex> l(admission_cv_lock_);
+    admission_cv_.notify_all();
+}
+
 ptr<resp_msg> raft_server::handle_cli_req_callback(ptr<commit_ret_elem> elem,
                                                    ptr<resp_msg> resp) {
     p_dv("commit_ret_cv %" PRIu64 " %p sleep", elem->idx_, &elem->awaiter_);
@@ -260,14 +448,21 @@ ptr< cmd_result< ptr<buffer> > >
 }
 
 void raft_server::drop_all_pending_commit_elems() {
-    // Blocking mode:
-    //   Invoke all awaiting requests to return `CANCELLED`.
-    if (ctx_->get_params()->return_method_ == raft_params::blocking) {
-        auto_lock(commit_ret_elems_lock_);
+    // Non-blocking requests will be set `CANCELLED` with an error.
+    std::list< ptr<commit_ret_elem> > async_elems;
+
+    {   auto_lock(commit_ret_elems_lock_);
+        // Blocking requests:
+        //   Invoke all awaiting requests to return `CANCELLED`.
+        size_t num_blocking = 0;
         ulong min_idx = std::numeric_limits<ulong>::max();
         ulong max_idx = 0;
         for (auto& entry: commit_ret_elems_) {
             ptr<commit_ret_elem>& elem = entry.second;
+            if (elem->async_) {
+                async_elems.push_back(elem);
+                continue;
+            }
             elem->ret_value_ = nullptr;
             elem->result_code_ = cmd_result_code::CANCELLED;
             elem->awaiter_.invoke();
@@ -277,33 +472,22 @@ void raft_server::drop_all_pending_commit_elems() {
             if (max_idx < elem->idx_) {
                 max_idx = elem->idx_;
             }
+            num_blocking++;
             p_db("cancelled blocking client request %" PRIu64 ", waited %" PRIu64 " us",
                  elem->idx_, elem->timer_.get_us());
         }
-        if (!commit_ret_elems_.empty()) {
+        if (num_blocking) {
             p_wn("cancelled %zu blocking client requests from %" PRIu64
                  " to %" PRIu64 ".",
-                 commit_ret_elems_.size(), min_idx, max_idx);
-        }
-        commit_ret_elems_.clear();
-        return;
-    }
-
-    // Non-blocking mode:
-    //   Set `CANCELLED` and set result & error.
-    std::list< ptr<commit_ret_elem> > elems;
-
-    {   auto_lock(commit_ret_elems_lock_);
-        for (auto& entry: commit_ret_elems_) {
-            ptr<commit_ret_elem>& ee = entry.second;
-            elems.push_back(ee);
+                 num_blocking, min_idx, max_idx);
         }
         commit_ret_elems_.clear();
     }
 
     // Calling handler should be done outside the mutex.
-    for (auto& entry: elems) {
+    for (auto& entry: async_elems) {
         ptr<commit_ret_elem>&ee = entry;
+        if (!ee->async_result_) continue;
         p_wn("cancelled non-blocking client request %" PRIu64, ee->idx_);
 
         ptr<buffer> result = nullptr;
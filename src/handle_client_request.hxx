@@ -35,6 +35,8 @@ struct raft_server::commit_ret_elem {
         , result_code_(cmd_result_code::OK)
         , async_result_(nullptr)
         , callback_invoked_(false)
+        , term_(0)
+        , async_(false)
         {}
 
     ~commit_ret_elem() {}
@@ -46,6 +48,13 @@ struct raft_server::commit_ret_elem {
     cmd_result_code result_code_;
     ptr< cmd_result< ptr<buffer> > > async_result_;
     bool callback_invoked_;
+
+    // Term of the log, 0 if unknown.
+    ulong term_;
+
+    // `true` if the result is delivered through `async_result_`,
+    // instead of waking up `awaiter_`.
+    bool async_;
 };
 
 } // namespace nuraft;
@@ -25,7 +25,9 @@ limitations under the License.
 #include "error_code.hxx"
 #include "handle_client_request.hxx"
 #include "global_mgr.hxx"
+#include "packed_buffers.hxx"
 #include "peer.hxx"
+#include "pre_commit_pipeline.hxx"
 #include "snapshot.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
@@ -121,7 +123,25 @@ void raft_server::commit_in_bg() {
                          quick_commit_index_ > sm_commit_index_ );
             };
             p_tr("commit_cv_ sleep\n");
-            commit_cv_.wait(lock, wait_check);
+            ptr<raft_params> params = ctx_->get_params();
+            if ( params->memory_only_durability_ &&
+                 params->checkpoint_interval_ms_ > 0 ) {
+                // Wake up periodically to create a checkpoint,
+                // even though there is no new commit.
+                if ( !commit_cv_.wait_for
+                         ( lock,
+                           std::chrono::milliseconds
+                               ( params->checkpoint_interval_ms_ ),
+                           wait_check ) ) {
+                    lock.unlock();
+                    if (!sm_commit_paused_) {
+                        snapshot_and_compact(sm_commit_index_);
+                    }
+                    continue;
+                }
+            } else {
+                commit_cv_.wait(lock, wait_check);
+            }
 
             p_tr("commit_cv_ wake up\n");
             if (stopping_) {
@@ -196,9 +216,14 @@ bool raft_server::commit_in_bg_exec(size_t timeout_ms) {
     }
 
     ptr<cluster_config> cur_config = get_config();
-    bool need_to_handle_commit_elem = ( is_leader() &&
+    // During the leadership handoff, requests appended when this
+    // server was the leader are completed by the commit as a follower.
+    bool need_to_handle_commit_elem = ( ( is_leader() || handoff_in_progress_ ) &&
                                         !cur_config->is_async_replication() );
 
+    // Results to be delivered by the user executor at once.
+    std::list< ptr<commit_ret_elem> > async_elems;
+
     bool first_loop_exec = true;
     bool finished_in_time = true;
     timer_helper tt(timeout_ms * 1000);
@@ -243,22 +268,38 @@ bool raft_server::commit_in_bg_exec(size_t timeout_ms) {
             // LCOV_EXCL_STOP
         }
 
-        if (le->get_val_type() == log_val_type::app_log) {
-            commit_app_log(index_to_commit, le, need_to_handle_commit_elem);
+        if ( pre_commit_pipeline_ &&
+             le->is_app_log() &&
+             !pre_commit_pipeline_->wait_for(index_to_commit) ) {
+            // Shutting down.
+            break;
+        }
+
+        if (le->is_app_log()) {
+            commit_app_log(index_to_commit, le, need_to_handle_commit_elem, async_elems);
+            if (!result_executor_) deliver_async_results(async_elems);
 
         } else if (le->get_val_type() == log_val_type::conf) {
             commit_conf(index_to_commit, le);
+
+        } else if ( le->get_val_type() == log_val_type::ingest_marker &&
+                    !apply_ingested_snapshot(index_to_commit) ) {
+            // Should not go further without the ingested data set.
+            break;
         }
 
         ulong exp_idx = index_to_commit - 1;
         if (sm_commit_index_.compare_exchange_strong(exp_idx, index_to_commit)) {
             snapshot_and_compact(sm_commit_index_);
 
-            cb_func::Param param(id_, leader_);
-            // Copy to other local variable to be safe.
-            uint64_t log_idx = index_to_commit;
-            param.ctx = &log_idx;
-            ctx_->cb_func_.call(cb_func::StateMachineExecution, &param);
+            if (ctx_->cb_func_.is_subscribed(cb_func::StateMachineExecution)) {
+                cb_func::Param param(id_, leader_);
+                // Copy to other local variable to be safe.
+                uint64_t log_idx = index_to_commit;
+                param.ctx = &log_idx;
+                ctx_->cb_func_.call(cb_func::StateMachineExecution, &param);
+            }
+            notify_admission_waiters();
         } else {
             p_er("sm_commit_index_ has been changed from %" PRIu64 " to %" PRIu64 ", "
                  "this thread attempted %" PRIu64,
@@ -267,6 +308,8 @@ bool raft_server::commit_in_bg_exec(size_t timeout_ms) {
                  index_to_commit);
         }
     }
+    deliver_async_results(async_elems);
+
     p_db( "DONE: commit upto %" PRIu64 ", curruent idx %" PRIu64,
           quick_commit_index_.load(), sm_commit_index_.load() );
     if (role_ == srv_role::follower) {
@@ -292,7 +335,8 @@ bool raft_server::commit_in_bg_exec(size_t timeout_ms) {
 
 void raft_server::commit_app_log(ulong idx_to_commit,
                                  ptr<log_entry>& le,
-                                 bool need_to_handle_commit_elem)
+                                 bool need_to_handle_commit_elem,
+                                 std::list< ptr<commit_ret_elem> >& async_elems)
 {
     ptr<buffer> ret_value = nullptr;
     ptr<buffer> buf = le->get_buf_ptr();
@@ -306,11 +350,21 @@ void raft_server::commit_app_log(ulong idx_to_commit,
         ctx_->state_mgr_->system_exit(raft_err::N23_precommit_order_inversion);
         ::exit(-1);
     }
-    ret_value = state_machine_->commit_ext
-                ( state_machine::ext_op_params( sm_idx, buf ) );
+    if (im_witness_) {
+        // Witness has only the metadata of logs, nothing to execute.
+
+    } else if (le->get_val_type() == log_val_type::packed_app_log) {
+        // Results of all commands are returned in the same format.
+        ret_value = pack_buffers
+                    ( state_machine_->commit_packed( sm_idx,
+                                                     unpack_buffers(*buf) ) );
+    } else {
+        ret_value = state_machine_->commit_ext
+                    ( state_machine::ext_op_params( sm_idx, buf ) );
+    }
+    pending_bytes_ -= buf->size();
     if (ret_value) ret_value->pos(0);
 
-    std::list< ptr<commit_ret_elem> > async_elems;
     if (need_to_handle_commit_elem) {
         std::unique_lock<std::mutex> cre_lock(commit_ret_elems_lock_);
         /// Sometimes user can batch requests to RAFT: for example send 30
@@ -331,14 +385,22 @@ void raft_server::commit_app_log(ulong idx_to_commit,
         if (entry != commit_ret_elems_.end()) {
             ptr<commit_ret_elem> elem = entry->second;
             if (elem->idx_ == sm_idx) {
-                elem->result_code_ = cmd_result_code::OK;
-                elem->ret_value_ = ret_value;
+                if (elem->term_ && elem->term_ != le->get_term()) {
+                    // The log has been overwritten by another leader
+                    // during the handoff, it is not the request's result.
+                    p_wn("log %" PRIu64 " term %" PRIu64 " is not the log of "
+                         "the request (term %" PRIu64 "), cancel the request",
+                         sm_idx, le->get_term(), elem->term_);
+                    elem->result_code_ = cmd_result_code::CANCELLED;
+                    elem->ret_value_ = nullptr;
+                } else {
+                    elem->result_code_ = cmd_result_code::OK;
+                    elem->ret_value_ = ret_value;
+                }
                 need_to_check_commit_ret = false;
                 p_dv("notify cb %" PRIu64 " %p", sm_idx, &elem->awaiter_);
 
-                switch (ctx_->get_params()->return_method_) {
-                case raft_params::blocking:
-                default:
+                if (!elem->async_) {
                     // Blocking mode:
                     if (elem->callback_invoked_) {
                         // If elem callback invoked, remove it
@@ -347,18 +409,15 @@ void raft_server::commit_app_log(ulong idx_to_commit,
                         // or notify client that request done
                         elem->awaiter_.invoke();
                     }
-                    break;
-
-                case raft_params::async_handler:
+                } else {
                     // Async handler: put into list.
                     async_elems.push_back(elem);
                     commit_ret_elems_.erase(entry);
-                    break;
                 }
             }
         }
 
-        if (need_to_check_commit_ret) {
+        if (need_to_check_commit_ret && is_leader()) {
             // If not found, commit thread is invoked earlier than user thread.
             // Create one here.
             ptr<commit_ret_elem> elem = cs_new<commit_ret_elem>();
@@ -371,6 +430,8 @@ void raft_server::commit_app_log(ulong idx_to_commit,
             switch (ctx_->get_params()->return_method_) {
             case raft_params::blocking:
             default:
+                // Requests from RPC may still create the async result
+                // object out of `ret_value_`, in `handle_cli_req`.
                 elem->awaiter_.invoke(); // Callback will not sleep.
                 break;
             case raft_params::async_handler:
@@ -378,6 +439,7 @@ void raft_server::commit_app_log(ulong idx_to_commit,
                 //   Set the result, but should not put it into the
                 //   `async_elems` list, as the user thread (supposed to be
                 //   executed right after this) will invoke the callback immediately.
+                elem->async_ = true;
                 elem->async_result_ =
                     cs_new< cmd_result< ptr<buffer> > >( elem->ret_value_ );
                 break;
@@ -385,17 +447,68 @@ void raft_server::commit_app_log(ulong idx_to_commit,
             commit_ret_elems_.insert( std::make_pair(sm_idx, elem) );
         }
     }
+}
 
-    // Calling handler should be done outside the mutex.
-    for (auto& entry: async_elems) {
-        ptr<commit_ret_elem>& elem = entry;
-        if (elem->async_result_) {
-            ptr<std::exception> err = nullptr;
-            elem->async_result_->set_result( elem->ret_value_, err, cmd_result_code::OK );
-            elem->ret_value_.reset();
-            elem->async_result_.reset();
+void raft_server::deliver_async_results
+                  ( std::list< ptr<commit_ret_elem> >& async_elems )
+{
+    if (async_elems.empty()) return;
+
+    std::list< ptr<commit_ret_elem> > elems;
+    elems.swap(async_elems);
+    auto exec_func = [elems]() {
+        // Calling handler should be done outside the mutex.
+        for (auto& entry: elems) {
+            const ptr<commit_ret_elem>& elem = entry;
+            if (elem->async_result_) {
+                ptr<std::exception> err = nullptr;
+                if (elem->result_code_ != cmd_result_code::OK) {
+                    err = cs_new<std::runtime_error>("Request cancelled.");
+                }
+                elem->async_result_->set_result( elem->ret_value_, err,
+                                                 elem->result_code_ );
+                elem->ret_value_.reset();
+                elem->async_result_.reset();
+            }
         }
+    };
+
+    if (result_executor_) {
+        p_tr("deliver %zu results using user executor", elems.size());
+        result_executor_(exec_func);
+    } else {
+        exec_func();
+    }
+}
+
+ptr<buffer> raft_server::pre_commit_app_log(ulong log_idx,
+                                            ptr<log_entry>& le)
+{
+    if (im_witness_) return nullptr;
+
+    ptr<buffer> buf = le->get_buf_ptr();
+    buf->pos(0);
+    if (le->get_val_type() == log_val_type::packed_app_log) {
+        state_machine_->pre_commit_packed(log_idx, unpack_buffers(*buf));
+        return nullptr;
     }
+    return state_machine_->pre_commit_ext
+           ( state_machine::ext_op_params( log_idx, buf ) );
+}
+
+void raft_server::rollback_app_log(ulong log_idx,
+                                   ptr<log_entry>& le)
+{
+    if (im_witness_) return;
+
+    ptr<buffer> buf = le->get_buf_ptr();
+    buf->pos(0);
+    if (le->get_val_type() == log_val_type::packed_app_log) {
+        state_machine_->rollback_packed(log_idx, unpack_buffers(*buf));
+        return;
+    }
+    state_machine_->rollback_ext
+        ( state_machine::ext_op_params( log_idx, buf ) );
 }
 
 void raft_server::commit_conf(ulong idx_to_commit,
@@ -506,7 +619,17 @@ bool raft_server::snapshot_and_compact(ulong committed_idx, bool forced_creation
         snapshot_distance = first_snapshot_distance_;
     }
 
-    if (!forced_creation && !snp_creation_scheduled_) {
+    // Periodic checkpoint for memory-only durability.
+    bool checkpoint_due = false;
+    if ( params->memory_only_durability_ &&
+         params->checkpoint_interval_ms_ > 0 &&
+         checkpoint_timer_.get_ms() >= (uint64_t)params->checkpoint_interval_ms_ ) {
+        ptr<snapshot> last_snp = get_last_snapshot();
+        checkpoint_due = ( !last_snp ||
+                           committed_idx > last_snp->get_last_log_idx() );
+    }
+
+    if (!forced_creation && !snp_creation_scheduled_ && !checkpoint_due) {
         // If `forced_creation == true`, ignore below conditions.
         if ( params->snapshot_distance_ == 0 ||
              ( committed_idx - log_store_->start_index() + 1 ) < snapshot_distance ) {
@@ -514,7 +637,7 @@ bool raft_server::snapshot_and_compact(ulong committed_idx, bool forced_creation
             return false;
         }
 
-        if ( !state_machine_->chk_create_snapshot() ) {
+        if ( !im_witness_ && !state_machine_->chk_create_snapshot() ) {
             // User-defined state machine doesn't want to create a snapshot.
             return false;
         }
@@ -535,11 +658,13 @@ bool raft_server::snapshot_and_compact(ulong committed_idx, bool forced_creation
 
     if ( ( forced_creation ||
            snp_creation_scheduled_ ||
+           checkpoint_due ||
            !local_snp ||
            committed_idx >= snapshot_distance + local_snp->get_last_log_idx() ) &&
          snp_in_progress_.compare_exchange_strong(f, true) )
     {
         snapshot_in_action = true;
+        checkpoint_timer_.reset();
         p_in("creating a snapshot for index %" PRIu64 "", committed_idx);
 
         // NOTE:
@@ -618,7 +743,15 @@ bool raft_server::snapshot_and_compact(ulong committed_idx, bool forced_creation
                        std::placeholders::_1,
                        std::placeholders::_2 );
         timer_helper tt;
-        state_machine_->create_snapshot(*new_snapshot, handler);
+        if (im_witness_) {
+            // Witness has nothing to write, the snapshot is
+            // just a marker of the log compaction.
+            bool created = true;
+            ptr<std::exception> no_err = nullptr;
+            handler(created, no_err);
+        } else {
+            state_machine_->create_snapshot(*new_snapshot, handler);
+        }
         p_in( "create snapshot idx %" PRIu64 " log_term %" PRIu64
               " done: %" PRIu64 " us elapsed",
               committed_idx, log_term_to_compact, tt.get_us() );
@@ -663,8 +796,15 @@ void raft_server::on_snapshot_completed
              "compact the log store if needed",
              s->get_last_log_idx(), s->get_last_log_term());
 
-        ptr<snapshot> new_snp = state_machine_->last_snapshot();
+        ptr<snapshot> new_snp = im_witness_ ? s : state_machine_->last_snapshot();
         set_last_snapshot(new_snp);
+        if (im_witness_) {
+            // Should be durable before compaction, as there is no
+            // state machine to recover the commit index from.
+            state_->set_witness_snapshot( new_snp->get_last_log_idx(),
+                                          new_snp->get_last_log_term() );
+            ctx_->state_mgr_->save_state(*state_);
+        }
         ptr<raft_params> params = ctx_->get_params();
         if ( new_snp->get_last_log_idx() >
                  (ulong)params->reserved_log_items_ ) {
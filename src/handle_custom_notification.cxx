@@ -168,6 +168,9 @@ ptr<resp_msg> raft_server::handle_custom_notification_req(req_msg& req) {
     case custom_notification_msg::request_resignation: {
         return handle_resignation_request(req, msg, resp);
     }
+    case custom_notification_msg::hibernation: {
+        return handle_hibernation_msg(req, msg, resp);
+    }
     default:
         break;
     }
@@ -179,7 +182,7 @@ ptr<resp_msg> raft_server::handle_out_of_log_msg(req_msg& req,
                                                  ptr<custom_notification_msg> msg,
                                                  ptr<resp_msg> resp)
 {
-    static timer_helper msg_timer(5000000);
+    static timer_helper msg_timer(5000000, false, true);
     int log_lv = msg_timer.timeout_and_reset() ? L_WARN : L_TRACE;
 
     // As it is a special form of heartbeat, need to update term.
@@ -217,6 +220,16 @@ ptr<resp_msg> raft_server::handle_leadership_takeover
              "I'm already a leader", req.get_src());
         return resp;
     }
+    if (im_witness_) {
+        p_er("got leadership takeover request from peer %d, "
+             "but I'm a witness", req.get_src());
+        return resp;
+    }
+    if (recovering_logs_) {
+        p_wn("got leadership takeover request from peer %d, "
+             "but I'm recovering lost logs", req.get_src());
+        return resp;
+    }
     p_in("[LEADERSHIP TAKEOVER] got request");
 
     // Initiate force vote (ignoring priority).
@@ -246,8 +259,62 @@ ptr<resp_msg> raft_server::handle_resignation_request
     return resp;
 }
 
+ptr<resp_msg> raft_server::handle_hibernation_msg
+                           ( req_msg& req,
+                             ptr<custom_notification_msg> msg,
+                             ptr<resp_msg> resp )
+{
+    // Hibernate only if this server has exactly the same logs and
+    // commit index as the leader. Otherwise, reject it so that
+    // the leader wakes up.
+    ulong last_log_idx = log_store_->next_slot() - 1;
+    if ( req.get_term() != state_->get_term() ||
+         role_ != srv_role::follower ||
+         req.get_src() != leader_ ||
+         catching_up_ ||
+         req.get_last_log_idx() != last_log_idx ||
+         req.get_last_log_term() != term_for_log(last_log_idx) ||
+         req.get_commit_idx() != quick_commit_index_ ) {
+        p_in("reject hibernation request from %d, term %" PRIu64 " "
+             "last log %" PRIu64 " (term %" PRIu64 ") commit %" PRIu64 ", "
+             "my term %" PRIu64 " last log %" PRIu64 " (term %" PRIu64 ") "
+             "commit %" PRIu64,
+             req.get_src(), req.get_term(),
+             req.get_last_log_idx(), req.get_last_log_term(),
+             req.get_commit_idx(),
+             state_->get_term(), last_log_idx, term_for_log(last_log_idx),
+             quick_commit_index_.load());
+        return cs_new<resp_msg>( state_->get_term(),
+                                 msg_type::custom_notification_response,
+                                 id_,
+                                 req.get_src(),
+                                 log_store_->next_slot() );
+    }
+
+    p_in("[HIBERNATION] requested by leader %d, last log %" PRIu64,
+         req.get_src(), last_log_idx);
+    hibernating_ = true;
+    if (election_task_) cancel_task(election_task_);
+
+    // Connections will be re-established when they are needed.
+    for (auto& entry: peers_) {
+        entry.second->release_rpc();
+    }
+
+    cb_func::Param param(id_, leader_);
+    ctx_->cb_func_.call(cb_func::Hibernation, &param);
+    return resp;
+}
+
 void raft_server::handle_custom_notification_resp(resp_msg& resp) {
-    if (!resp.get_accepted()) return;
+    if (!resp.get_accepted()) {
+        // The only notification that can be rejected is hibernation.
+        if (hibernating_) {
+            p_in("peer %d rejected hibernation", resp.get_src());
+            wake_up();
+        }
+        return;
+    }
 
     peer_itor it = peers_.find(resp.get_src());
     if (it == peers_.end()) {
@@ -257,6 +324,11 @@ void raft_server::handle_custom_notification_resp(resp_msg& resp) {
     ptr<peer> p = it->second;
 
     p->set_next_log_idx(resp.get_next_idx());
+
+    if (hibernating_) {
+        // The peer is hibernating, nothing to send until wake-up.
+        p->release_rpc();
+    }
 }
 
 } // namespace nuraft;
@@ -30,6 +30,7 @@ public:
         out_of_log_range_warning    = 1,
         leadership_takeover         = 2,
         request_resignation         = 3,
+        hibernation                 = 4,
     };
 
     custom_notification_msg(type t = out_of_log_range_warning)
@@ -76,6 +76,28 @@ ptr<resp_msg> raft_server::handle_add_srv_req(req_msg& req) {
         return resp;
     }
 
+    if (bulk_ingest_in_progress_) {
+        // Log index is reserved for the ingested snapshot.
+        p_wn("bulk ingestion is in progress");
+        resp->set_result_code(cmd_result_code::CONFIG_CHANGING);
+        return resp;
+    }
+
+    if (srv_conf->is_witness()) {
+        // Older versions decode the witness flag as the learner flag,
+        // so that all members should understand it.
+        for (auto& entry: peers_) {
+            ptr<peer> pp = entry.second;
+            if (!pp->has_feature(peer::WITNESS_CONFIG)) {
+                p_wn("cannot add witness %d, peer %d has not reported "
+                     "that it supports witness",
+                     srv_conf->get_id(), pp->get_id());
+                resp->set_result_code(cmd_result_code::BAD_REQUEST);
+                return resp;
+            }
+        }
+    }
+
     if (srv_to_join_) {
         // Adding server is already in progress.
 
@@ -409,6 +431,13 @@ ptr<resp_msg> raft_server::handle_rm_srv_req(req_msg& req) {
         return resp;
     }
 
+    if (bulk_ingest_in_progress_) {
+        // Log index is reserved for the ingested snapshot.
+        p_wn("bulk ingestion is in progress");
+        resp->set_result_code(cmd_result_code::CONFIG_CHANGING);
+        return resp;
+    }
+
     int32 srv_id = entries[0]->get_buf().get_int();
     if (srv_id == id_) {
         p_wn("cannot request to remove leader");
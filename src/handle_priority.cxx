@@ -54,6 +54,11 @@ raft_server::set_priority(const int srv_id,
         return PrioritySetResult::IGNORED;
     }
 
+    if (bulk_ingest_in_progress_) {
+        p_wn("bulk ingestion is in progress, ignore priority change");
+        return PrioritySetResult::IGNORED;
+    }
+
     if (id_ == srv_id && new_priority == 0) {
         // Step down.
         // Even though current leader (myself) can send append_entries()
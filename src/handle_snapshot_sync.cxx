@@ -24,6 +24,7 @@ limitations under the License.
 #include "error_code.hxx"
 #include "event_awaiter.hxx"
 #include "peer.hxx"
+#include "pre_commit_pipeline.hxx"
 #include "snapshot.hxx"
 #include "snapshot_sync_ctx.hxx"
 #include "state_machine.hxx"
@@ -110,6 +111,13 @@ ptr<req_msg> raft_server::create_sync_snapshot_req(ptr<peer>& pp,
     //        last_snapshot_->get_last_log_idx() > snp->get_last_log_idx() )*/ ) {
     if ( !snp || sync_ctx->get_offset() == 0 ) {
         snp = get_last_snapshot();
+        ptr<snapshot> ingest_snp = get_ingest_snapshot();
+        if ( ingest_snp &&
+             last_log_idx + 1 == ingest_snp->get_last_log_idx() ) {
+            // The peer is right before the staged data set of
+            // bulk ingestion, see `bulk_ingest()`.
+            snp = ingest_snp;
+        }
         if ( snp == nilptr ||
              last_log_idx > snp->get_last_log_idx() ) {
             // LCOV_EXCL_START
@@ -157,7 +165,19 @@ ptr<req_msg> raft_server::create_sync_snapshot_req(ptr<peer>& pp,
         p.set_snapshot_in_sync(snp, snp_timeout_ms);
     }
 
-    if (params->use_bg_thread_for_snapshot_io_) {
+    bool last_request = false;
+    ptr<buffer> data = nullptr;
+    ulong data_idx = 0;
+    if (p.is_witness()) {
+        // Witness does not keep the data of the state machine. Send only
+        // the metadata of the snapshot, as if all data have been sent.
+        data = buffer::alloc(0);
+        data_idx = (snp->get_type() == snapshot::raw_binary) ? snp->size() : 0;
+        last_request = true;
+        p_db("send snapshot metadata (idx %" PRIu64 ") to witness %d",
+             snp->get_last_log_idx(), p.get_id());
+
+    } else if (params->use_bg_thread_for_snapshot_io_) {
         // If async snapshot IO, push the snapshot read request to the manager
         // and immediately return here.
         snapshot_io_mgr::instance().push( this->shared_from_this(),
@@ -167,13 +187,9 @@ ptr<req_msg> raft_server::create_sync_snapshot_req(ptr<peer>& pp,
                                             : resp_handler_ ) );
         succeeded_out = true;
         return nullptr;
-    }
-    // Otherwise (sync snapshot IO), read the requested object here and then return.
 
-    bool last_request = false;
-    ptr<buffer> data = nullptr;
-    ulong data_idx = 0;
-    if (snp->get_type() == snapshot::raw_binary) {
+    // Otherwise (sync snapshot IO), read the requested object here and then return.
+    } else if (snp->get_type() == snapshot::raw_binary) {
         // LCOV_EXCL_START
         // Raw binary snapshot (original)
         ulong offset = p.get_snapshot_sync_ctx()->get_offset();
@@ -284,7 +300,13 @@ ptr<resp_msg> raft_server::handle_install_snapshot_req(req_msg& req, std::unique
 
     ptr<snapshot_sync_req> sync_req =
         snapshot_sync_req::deserialize(entries[0]->get_buf());
-    if (sync_req->get_snapshot().get_last_log_idx() <= quick_commit_index_) {
+    ulong snp_idx = sync_req->get_snapshot().get_last_log_idx();
+    // A snapshot beyond the commit index of the leader is the staged
+    // data set of bulk ingestion, see `bulk_ingest()`.
+    bool staged = snp_idx > req.get_commit_idx();
+    ulong missing_idx = ingest_snp_missing_idx_;
+    if ( snp_idx <= quick_commit_index_ &&
+         ( !missing_idx || snp_idx < missing_idx ) ) {
         p_wn( "received a snapshot (%" PRIu64 ") that is older than "
               "current commit idx (%" PRIu64 "), last log idx %" PRIu64,
               sync_req->get_snapshot().get_last_log_idx(),
@@ -299,7 +321,7 @@ ptr<resp_msg> raft_server::handle_install_snapshot_req(req_msg& req, std::unique
         return resp;
     }
 
-    if (handle_snapshot_sync_req(*sync_req, guard)) {
+    if (handle_snapshot_sync_req(*sync_req, staged, guard)) {
         if (sync_req->get_snapshot().get_type() == snapshot::raw_binary) {
             // LCOV_EXCL_START
             // Raw binary: add received byte to offset.
@@ -358,7 +380,16 @@ void raft_server::handle_install_snapshot_resp(resp_msg& resp) {
                  ( snp->get_type() == snapshot::logical_object &&
                    resp.get_ctx() );
 
-            if (snp_install_done) {
+            if (snp_install_done && snp == get_ingest_snapshot()) {
+                // The peer staged the data set of bulk ingestion,
+                // now the marker log can be sent to it.
+                p_in("peer %d staged ingested snapshot %" PRIu64,
+                     p->get_id(), snp->get_last_log_idx());
+                p->set_ingest_staged_idx(snp->get_last_log_idx());
+                p->set_next_log_idx(snp->get_last_log_idx());
+                clear_snapshot_sync_ctx(*p);
+
+            } else if (snp_install_done) {
                 p_db("snapshot sync is done (raw type)");
                 p->set_next_log_idx(sync_ctx->get_snapshot()->get_last_log_idx() + 1);
                 p->set_matched_idx(sync_ctx->get_snapshot()->get_last_log_idx());
@@ -456,7 +487,9 @@ void raft_server::handle_install_snapshot_resp_new_member(resp_msg& resp) {
     sync_log_to_new_srv(srv_to_join_->get_next_log_idx());
 }
 
-bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_lock<std::recursive_mutex>& guard) {
+bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req,
+                                           bool staged,
+                                           std::unique_lock<std::recursive_mutex>& guard) {
  try {
     // if offset == 0, it is the first object.
     bool is_first_obj = (req.get_offset()) ? false : true;
@@ -493,10 +526,22 @@ bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_l
     receiving_snapshot_ = true;
     et_cnt_receiving_snapshot_ = 0;
 
+    if (is_first_obj) {
+        // Previously staged data set, if any, will be overwritten.
+        abort_ingested_snapshot(0);
+    }
+
     // Set initialized flag
     if (!initialized_) initialized_ = true;
 
-    if (req.get_snapshot().get_type() == snapshot::raw_binary) {
+    if (im_witness_) {
+        // Witness keeps only the metadata of the snapshot,
+        // ignore the data if any.
+        if (req.get_snapshot().get_type() == snapshot::logical_object) {
+            req.set_offset(req.get_offset() + 1);
+        }
+
+    } else if (req.get_snapshot().get_type() == snapshot::raw_binary) {
         // LCOV_EXCL_START
         // Raw binary type (original).
         state_machine_->save_snapshot_data(req.get_snapshot(),
@@ -504,6 +549,57 @@ bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_l
                                            req.get_data());
         // LCOV_EXCL_STOP
 
+    } else if (ctx_->get_params()->snapshot_save_queue_size_ > 0) {
+        // Logical object type, pipelined:
+        //   acknowledge right away and write the object in background.
+        ulong obj_id = req.get_offset();
+        if (!snp_obj_writer_) {
+            snp_obj_writer_ = cs_new<snapshot_obj_writer>(state_machine_, l_);
+        }
+        ptr<snapshot_obj_writer> writer = snp_obj_writer_;
+        if (is_first_obj) {
+            // Discard anything left from the previous attempt.
+            writer->reset();
+        } else if (writer->has_failed()) {
+            p_wn("previous snapshot object write failed, "
+                 "reject object %" PRIu64 " to start over", obj_id);
+            writer->reset();
+            return false;
+        }
+
+        ptr<buffer> snp_buf = req.get_snapshot().serialize();
+        ptr<snapshot> snp = snapshot::deserialize(*snp_buf);
+        ptr<buffer> data = buffer::clone(req.get_data());
+
+        // Wait for an empty slot without holding `lock_`.
+        // A retried first object can reset the writer in the meantime,
+        // then this request belongs to the stale attempt.
+        uint64_t generation = writer->get_generation();
+        guard.unlock();
+        bool pushed = writer->push( snp, obj_id, data,
+                                    is_first_obj, is_last_obj,
+                                    ctx_->get_params()->snapshot_save_queue_size_,
+                                    generation );
+        if (pushed && is_last_obj) {
+            // All objects should be durable before applying the snapshot.
+            pushed = writer->wait_for_all(generation);
+        }
+        guard.lock();
+
+        if ( writer != snp_obj_writer_ ||
+             writer->get_generation() != generation ) {
+            // Should not reset the writer, as it is used by the new attempt.
+            p_wn("snapshot object %" PRIu64 " belongs to a stale attempt, "
+                 "reject it", obj_id);
+            return false;
+        }
+        if (!pushed) {
+            p_wn("failed to write snapshot object %" PRIu64 ", start over", obj_id);
+            writer->reset();
+            return false;
+        }
+        req.set_offset(obj_id + 1);
+
     } else {
         // Logical object type.
         ulong obj_id = req.get_offset();
@@ -517,7 +613,23 @@ bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_l
         req.set_offset(obj_id);
     }
 
-    if (is_last_obj) {
+    if (is_last_obj && staged) {
+        receiving_snapshot_ = false;
+
+        // Keep the data set staged until the marker log is committed,
+        // the logs are not compacted here.
+        ptr<buffer> snp_buf = req.get_snapshot().serialize();
+        ptr<snapshot> new_snp = snapshot::deserialize(*snp_buf);
+        {   std::lock_guard<std::mutex> l(last_snapshot_lock_);
+            ingest_snp_ = new_snp;
+        }
+        p_in( "staged ingested snapshot (idx %" PRIu64 " term %" PRIu64
+              ") from leader, last log idx %" PRIu64,
+              new_snp->get_last_log_idx(),
+              new_snp->get_last_log_term(),
+              log_store_->next_slot() - 1 );
+
+    } else if (is_last_obj) {
         // let's pause committing in backgroud so it doesn't access logs
         // while they are being compacted
         guard.unlock();
@@ -551,15 +663,31 @@ bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_l
               ") from leader",
               req.get_snapshot().get_last_log_idx(),
               req.get_snapshot().get_last_log_term() );
+        if (im_witness_) {
+            // Should be durable before compaction, as there is no
+            // state machine to recover the commit index from.
+            state_->set_witness_snapshot
+                ( req.get_snapshot().get_last_log_idx(),
+                  req.get_snapshot().get_last_log_term() );
+            ctx_->state_mgr_->save_state(*state_);
+        }
         if (log_store_->compact(req.get_snapshot().get_last_log_idx())) {
             // The state machine will not be able to commit anything before the
             // snapshot is applied, so make this synchronously with election
             // timer stopped as usually applying a snapshot may take a very
             // long time
             stop_election_timer();
+            // All pending logs are replaced by the snapshot.
+            pending_bytes_ = 0;
             p_in("successfully compact the log store, will now ask the "
                  "statemachine to apply the snapshot");
-            if (!state_machine_->apply_snapshot(req.get_snapshot())) {
+            if (pre_commit_pipeline_) {
+                // Pending pre-commits should not be delivered
+                // after the snapshot is applied.
+                pre_commit_pipeline_->flush();
+            }
+            if ( !im_witness_ &&
+                 !state_machine_->apply_snapshot(req.get_snapshot()) ) {
                 // LCOV_EXCL_START
                 p_er("failed to apply the snapshot after log compacted, "
                      "to ensure the safety, will shutdown the system");
@@ -569,16 +697,30 @@ bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_l
                 // LCOV_EXCL_STOP
             }
 
-            reconfigure(req.get_snapshot().get_last_config());
+            ulong snp_idx = req.get_snapshot().get_last_log_idx();
+            ulong missing_idx = ingest_snp_missing_idx_;
+            if (missing_idx && snp_idx >= missing_idx) {
+                // This server committed a marker log without having its
+                // ingested data set. The logs after the snapshot have been
+                // pre-committed, and they should be kept as they are.
+                p_in("installed missing ingested snapshot %" PRIu64, snp_idx);
+                ingest_snp_missing_idx_ = 0;
+                if (precommit_index_ < snp_idx) precommit_index_ = snp_idx;
+                if (quick_commit_index_ < snp_idx) quick_commit_index_ = snp_idx;
+                sm_commit_index_ = snp_idx;
+
+            } else {
+                reconfigure(req.get_snapshot().get_last_config());
+
+                precommit_index_ = snp_idx;
+                sm_commit_index_ = snp_idx;
+                quick_commit_index_ = snp_idx;
+                lagging_sm_target_index_ = snp_idx;
+            }
 
             ptr<cluster_config> c_conf = get_config();
             ctx_->state_mgr_->save_config(*c_conf);
 
-            precommit_index_ = req.get_snapshot().get_last_log_idx();
-            sm_commit_index_ = req.get_snapshot().get_last_log_idx();
-            quick_commit_index_ = req.get_snapshot().get_last_log_idx();
-            lagging_sm_target_index_ = req.get_snapshot().get_last_log_idx();
-
             ctx_->state_mgr_->save_state(*state_);
 
             ptr<snapshot> new_snp = cs_new<snapshot>
@@ -616,5 +758,209 @@ bool raft_server::handle_snapshot_sync_req(snapshot_sync_req& req, std::unique_l
     return true;
 }
 
-} // namespace nuraft;
+cmd_result_code raft_server::bulk_ingest(void* ingest_ctx, ulong& snapshot_idx_out) {
+    snapshot_idx_out = 0;
+    ulong term = 0;
+    {   recur_lock(lock_);
+        if (role_ != srv_role::leader || write_paused_) {
+            p_wn("bulk ingestion is allowed only on leader");
+            return cmd_result_code::NOT_LEADER;
+        }
+        if (config_changing_ || srv_to_join_ || srv_to_leave_) {
+            p_wn("bulk ingestion is not allowed during membership change");
+            return cmd_result_code::CONFIG_CHANGING;
+        }
+        ptr<snapshot> prev_snp = get_ingest_snapshot();
+        if (prev_snp) {
+            p_wn("previously ingested snapshot %" PRIu64 " is not committed yet",
+                 prev_snp->get_last_log_idx());
+            return cmd_result_code::CANCELLED;
+        }
+        bool exp = false;
+        if (!bulk_ingest_in_progress_.compare_exchange_strong(exp, true)) {
+            p_wn("another bulk ingestion is in progress");
+            return cmd_result_code::CANCELLED;
+        }
+        term = state_->get_term();
+    }
+
+    struct IngestAutoClear {
+        explicit IngestAutoClear(std::function<void()> func) : clean_func_(func) {}
+        ~IngestAutoClear() { clean_func_(); }
+        std::function<void()> clean_func_;
+    } ingest_auto_clear([this](){ bulk_ingest_in_progress_ = false; });
+
+    // From now on, no more logs will be appended. If the dual mutex mode is
+    // used, wait for the client request currently being handled, if any.
+    {   auto_lock(cli_lock_);
+    }
+    ulong last_log_idx = 0;
+    {   recur_lock(lock_);
+        last_log_idx = log_store_->next_slot() - 1;
+    }
+
+    // Wait until all existing logs are committed and executed.
+    ptr<raft_params> params = ctx_->get_params();
+    timer_helper timer( (size_t)params->client_req_timeout_ * 1000 );
+    while (sm_commit_index_ < last_log_idx) {
+        if (timer.timeout()) {
+            p_wn("bulk ingestion timeout: last log idx %" PRIu64
+                 ", state machine commit idx %" PRIu64,
+                 last_log_idx, sm_commit_index_.load());
+            return cmd_result_code::TIMEOUT;
+        }
+        if (role_ != srv_role::leader || state_->get_term() != term) {
+            return cmd_result_code::NOT_LEADER;
+        }
+        timer_helper::sleep_ms(1);
+    }
+
+    // Ingested data set will be placed at the next log index.
+    ulong snp_idx = last_log_idx + 1;
+    ptr<snapshot> new_snp = cs_new<snapshot>( snp_idx, term, get_config() );
+
+    // Loading data may take long time, do it without holding `lock_`
+    // so that heartbeat is not blocked. The data set is only staged,
+    // the state machine keeps serving the committed state.
+    p_in("start bulk ingestion at log idx %" PRIu64 " term %" PRIu64,
+         snp_idx, term);
+    timer_helper ingest_timer;
+    if (!state_machine_->ingest_snapshot(*new_snp, ingest_ctx)) {
+        p_er("state machine failed to ingest snapshot at log idx %" PRIu64,
+             snp_idx);
+        return cmd_result_code::FAILED;
+    }
+
+    {   recur_lock(lock_);
+        if (role_ != srv_role::leader || state_->get_term() != term) {
+            // Nothing has been appended, just discard the data set.
+            p_er("lost leadership while ingesting snapshot at log idx %" PRIu64,
+                 snp_idx);
+            state_machine_->abort_ingest(*new_snp);
+            return cmd_result_code::NOT_LEADER;
+        }
+
+        // Append a marker log at the index of the snapshot. Followers
+        // receive the marker log only after staging the data set, so that
+        // once it is committed, a quorum has the data set. Then each member
+        // applies the data set when it commits the marker log, or discards
+        // it if the marker log is rolled back.
+        ptr<buffer> marker_buf = buffer::alloc(sz_ulong);
+        marker_buf->put(snp_idx);
+        marker_buf->pos(0);
+        ptr<log_entry> marker =
+            cs_new<log_entry>(term, marker_buf, log_val_type::ingest_marker);
+        {   std::lock_guard<std::mutex> l(last_snapshot_lock_);
+            ingest_snp_ = new_snp;
+        }
+        store_log_entry(marker);
+        try_update_precommit_index(snp_idx);
+
+        p_in("staged ingested snapshot idx %" PRIu64 " term %" PRIu64
+             " in %" PRIu64 " ms, last log idx %" PRIu64,
+             snp_idx, term, ingest_timer.get_ms(), log_store_->next_slot() - 1);
+
+        // All followers are now right before the snapshot, so that
+        // it will be sent to them in parallel.
+        request_append_entries();
+    }
+
+    // Wait until the marker log is committed and the data set is applied.
+    // Even though this API returns an error, the data set remains staged
+    // until the marker log is either committed or rolled back.
+    timer.reset();
+    while (sm_commit_index_ < snp_idx) {
+        if (timer.timeout()) {
+            p_wn("bulk ingestion timeout: snapshot idx %" PRIu64
+                 " is not committed, commit idx %" PRIu64,
+                 snp_idx, quick_commit_index_.load());
+            return cmd_result_code::TIMEOUT;
+        }
+        if (role_ != srv_role::leader || state_->get_term() != term) {
+            p_wn("lost leadership before snapshot idx %" PRIu64
+                 " is committed", snp_idx);
+            return cmd_result_code::NOT_LEADER;
+        }
+        timer_helper::sleep_ms(1);
+    }
+    if (role_ != srv_role::leader || state_->get_term() != term) {
+        // The log at the index may have been overwritten by the new leader.
+        p_wn("lost leadership while committing snapshot idx %" PRIu64, snp_idx);
+        return cmd_result_code::NOT_LEADER;
+    }
+    p_in("ingested snapshot idx %" PRIu64 " is committed", snp_idx);
 
+    snapshot_idx_out = snp_idx;
+    return cmd_result_code::OK;
+}
+
+bool raft_server::apply_ingested_snapshot(ulong marker_idx) {
+    ptr<snapshot> snp = get_ingest_snapshot();
+    if ( !snp ||
+         snp->get_last_log_idx() != marker_idx ||
+         snp->get_last_log_term() != log_store_->term_at(marker_idx) ) {
+        // The data set is lost (e.g., by restart), cannot go further.
+        // The leader will send the snapshot instead, once it asks for it.
+        if (ingest_snp_missing_idx_ != marker_idx) {
+            p_er("marker log %" PRIu64 " is committed, but the ingested data "
+                 "set is missing", marker_idx);
+            ingest_snp_missing_idx_ = marker_idx;
+        }
+        recur_lock(lock_);
+        if (role_ == srv_role::leader) {
+            // Nobody can send it to the leader, let the others lead.
+            p_er("leader cannot apply marker log %" PRIu64 ", step down",
+                 marker_idx);
+            become_follower();
+        }
+        return false;
+    }
+
+    if ( !im_witness_ &&
+         !state_machine_->apply_snapshot(*snp) ) {
+        // LCOV_EXCL_START
+        p_er("failed to apply the ingested snapshot, "
+             "to ensure the safety, will shutdown the system");
+        ctx_->state_mgr_->system_exit(raft_err::N12_apply_snapshot_failed);
+        ::exit(-1);
+        return false;
+        // LCOV_EXCL_STOP
+    }
+
+    recur_lock(lock_);
+    if (im_witness_) {
+        state_->set_witness_snapshot( snp->get_last_log_idx(),
+                                      snp->get_last_log_term() );
+        ctx_->state_mgr_->save_state(*state_);
+    }
+    {   std::lock_guard<std::mutex> l(last_snapshot_lock_);
+        last_snapshot_ = snp;
+        if (ingest_snp_ == snp) ingest_snp_.reset();
+    }
+    // Members behind the snapshot will receive it from now on.
+    if (!log_store_->compact(marker_idx)) {
+        p_wn("failed to compact the log store up to ingested snapshot "
+             "at log idx %" PRIu64, marker_idx);
+    }
+    p_in("applied ingested snapshot idx %" PRIu64 " term %" PRIu64
+         ", log start %" PRIu64 " last idx %" PRIu64,
+         snp->get_last_log_idx(), snp->get_last_log_term(),
+         log_store_->start_index(), log_store_->next_slot() - 1);
+    return true;
+}
+
+void raft_server::abort_ingested_snapshot(ulong from_idx) {
+    ptr<snapshot> snp;
+    {   std::lock_guard<std::mutex> l(last_snapshot_lock_);
+        if (!ingest_snp_ || ingest_snp_->get_last_log_idx() < from_idx) return;
+        snp = ingest_snp_;
+        ingest_snp_.reset();
+    }
+    p_in("discard ingested snapshot idx %" PRIu64 " term %" PRIu64,
+         snp->get_last_log_idx(), snp->get_last_log_term());
+    if (!im_witness_) {
+        state_machine_->abort_ingest(*snp);
+    }
+}
+
+} // namespace nuraft;
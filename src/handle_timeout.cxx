@@ -21,6 +21,7 @@ limitations under the License.
 #include "raft_server.hxx"
 
 #include "event_awaiter.hxx"
+#include "handle_custom_notification.hxx"
 #include "peer.hxx"
 #include "state_machine.hxx"
 #include "state_mgr.hxx"
@@ -125,11 +126,13 @@ void raft_server::handle_hb_timeout(int32 srv_id) {
         }
     }
 
-    cb_func::Param param(id_, leader_, p->get_id());
-    uint64_t last_log_idx = log_store_->next_slot() - 1;
-    param.ctx = &last_log_idx;
-    CbReturnCode rc = ctx_->cb_func_.call(cb_func::HeartBeat, &param);
-    (void)rc;
+    if (ctx_->cb_func_.is_subscribed(cb_func::HeartBeat)) {
+        cb_func::Param param(id_, leader_, p->get_id());
+        uint64_t last_log_idx = log_store_->next_slot() - 1;
+        param.ctx = &last_log_idx;
+        CbReturnCode rc = ctx_->cb_func_.call(cb_func::HeartBeat, &param);
+        (void)rc;
+    }
 
     // Server is being shut down.
     if (stopping_) {
@@ -141,6 +144,8 @@ void raft_server::handle_hb_timeout(int32 srv_id) {
 
     p_db("heartbeat timeout for %d", p->get_id());
     if (role_ == srv_role::leader) {
+        if (try_hibernate()) return;
+
         update_target_priority();
         request_append_entries(p);
         {
@@ -159,6 +164,116 @@ void raft_server::handle_hb_timeout(int32 srv_id) {
     }
 }
 
+bool raft_server::try_hibernate() {
+    ptr<raft_params> params = ctx_->get_params();
+    if (params->hibernation_timeout_ms_ <= 0) return false;
+    if (hibernating_) return true;
+
+    // Any new log resets the idle time.
+    ulong last_log_idx = log_store_->next_slot() - 1;
+    if (last_log_idx != hibernation_log_idx_) {
+        hibernation_log_idx_ = last_log_idx;
+        hibernation_timer_.reset();
+        return false;
+    }
+    if ( hibernation_timer_.get_ms() <
+             (uint64_t)params->hibernation_timeout_ms_ ) {
+        return false;
+    }
+
+    // Membership change or leadership transfer is in progress.
+    if (config_changing_ || srv_to_join_ || srv_to_leave_ || write_paused_) {
+        return false;
+    }
+
+    // All logs should be committed and applied,
+    // and all members should have them.
+    if ( quick_commit_index_ != last_log_idx ||
+         sm_commit_index_ != last_log_idx ) {
+        return false;
+    }
+    for (auto& entry: peers_) {
+        ptr<peer>& pp = entry.second;
+        if ( pp->get_matched_idx() != last_log_idx ||
+             pp->is_busy() ||
+             pp->get_snapshot_sync_ctx() ) {
+            return false;
+        }
+    }
+    if (get_not_responding_peers()) return false;
+
+    p_in("[HIBERNATION] no new log for %" PRIu64 " ms, last log %" PRIu64 ", "
+         "hibernate the group",
+         hibernation_timer_.get_ms(), last_log_idx);
+    hibernating_ = true;
+
+    for (auto& entry: peers_) {
+        ptr<peer> pp = entry.second;
+        {   std::lock_guard<std::mutex> l(pp->get_lock());
+            pp->enable_hb(false);
+        }
+        cancel_task(pp->get_hb_task());
+
+        // Let the peer hibernate as well. The RPC client is released
+        // once the peer accepts it.
+        ptr<req_msg> req = cs_new<req_msg>
+                           ( state_->get_term(),
+                             msg_type::custom_notification_request,
+                             id_, pp->get_id(),
+                             term_for_log(last_log_idx),
+                             last_log_idx,
+                             quick_commit_index_.load() );
+        ptr<custom_notification_msg> custom_noti =
+            cs_new<custom_notification_msg>
+            ( custom_notification_msg::hibernation );
+        ptr<log_entry> custom_noti_le =
+            cs_new<log_entry>(0, custom_noti->serialize(), log_val_type::custom);
+        req->log_entries().push_back(custom_noti_le);
+        pp->send_req(pp, req, resp_handler_);
+    }
+
+    cb_func::Param param(id_, leader_);
+    ctx_->cb_func_.call(cb_func::Hibernation, &param);
+    return true;
+}
+
+void raft_server::end_log_recovery() {
+    recur_lock(lock_);
+    if (!recovering_logs_) return;
+    p_wn("log recovery is stopped by user, logs committed after "
+         "the last checkpoint may be lost");
+    recovering_logs_ = false;
+}
+
+void raft_server::wake_up() {
+    recur_lock(lock_);
+    if (!hibernating_) return;
+    hibernating_ = false;
+
+    // The idle time starts over.
+    hibernation_timer_.reset();
+    p_in("[WAKE UP] role %s, last log %" PRIu64 "",
+         srv_role_to_string(role_).c_str(),
+         log_store_->next_slot() - 1);
+
+    if (role_ == srv_role::leader) {
+        for (auto& entry: peers_) {
+            ptr<peer>& pp = entry.second;
+            // Peers were silent as requested, they are not dead.
+            pp->reset_resp_timer();
+            pp->reset_active_timer();
+            enable_hb_for_peer(*pp);
+        }
+        // Wake up followers as well.
+        request_append_entries();
+    } else {
+        restart_election_timer();
+    }
+
+    cb_func::Param param(id_, leader_);
+    ctx_->cb_func_.call(cb_func::WakeUpFromHibernation, &param);
+}
+
 void raft_server::restart_election_timer() {
     // don't start the election timer while this server is still catching up the logs
     // or this server is the leader
@@ -185,7 +300,8 @@ void raft_server::restart_election_timer() {
     p_tr("re-schedule election timer");
     last_election_timer_reset_.reset();
 
-    schedule_task(election_task_, rand_timeout_());
+    cur_election_timeout_ms_ = get_election_timeout_ms();
+    schedule_task(election_task_, cur_election_timeout_ms_);
 }
 
 void raft_server::stop_election_timer() {
@@ -206,6 +322,10 @@ void raft_server::handle_election_timeout() {
         return;
     }
 
+    // No leader for a while, requests held for the handoff
+    // should be rejected if it is over.
+    check_handoff();
+
     if (steps_to_down_ > 0) {
         if (--steps_to_down_ == 0) {
             p_in("no hearing further news from leader, "
@@ -250,6 +370,32 @@ void raft_server::handle_election_timeout() {
         return;
     }
 
+    if (recovering_logs_) {
+        // Should not be a leader without the logs lost by restart.
+        p_in("election timeout while recovering lost logs, ignore it.");
+        restart_election_timer();
+        return;
+    }
+
+    uint64_t deferred_wait_ms = get_deferred_append_resps_wait_ms();
+    if (deferred_wait_ms) {
+        // The leader is waiting for the responses to the logs being
+        // written, and cannot send heartbeats until then. But if logs
+        // are not durable for longer than an election timeout, the log
+        // store may be stuck, this server should not block the election.
+        int32 et_upper = ctx_->get_params()->election_timeout_upper_bound_;
+        if (deferred_wait_ms < (uint64_t)et_upper) {
+            p_in("election timeout while responses are waiting for "
+                 "the durability of logs (%" PRIu64 " ms), ignore it.",
+                 deferred_wait_ms);
+            restart_election_timer();
+            return;
+        }
+        p_wn("responses have been waiting for the durability of logs "
+             "for %" PRIu64 " ms, do not ignore election timeout",
+             deferred_wait_ms);
+    }
+
     if (out_of_log_range_) {
         p_wn("Triggered election timer but server is out of log range");
         return;
@@ -267,7 +413,8 @@ void raft_server::handle_election_timeout() {
 
     int time_ms = last_election_timer_reset_.get_us() / 1000;
     if ( serving_req_ ||
-         time_ms < ctx_->get_params()->election_timeout_lower_bound_ ) {
+         time_ms < std::min( ctx_->get_params()->election_timeout_lower_bound_,
+                             cur_election_timeout_ms_.load() ) ) {
         // Handling appending entries is now taking long time,
         // so that server keeps skipping sending heartbeat.
         // It doesn't mean server is gone. Just ignore.
@@ -283,7 +430,8 @@ void raft_server::handle_election_timeout() {
     }
 
     // Only voting member can suggest vote.
-    if (!im_learner_) {
+    // Witness votes, but cannot be a leader.
+    if (!im_learner_ && !im_witness_) {
         p_wn("Election timeout, initiate leader election");
         if (!hb_alive_) {
             // Not the first election timeout, decay the target priority.
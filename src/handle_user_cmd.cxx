@@ -23,15 +23,19 @@ limitations under the License.
 #include "cluster_config.hxx"
 #include "context.hxx"
 #include "event_awaiter.hxx"
+#include "packed_buffers.hxx"
 #include "rpc_cli_factory.hxx"
 #include "tracer.hxx"
 
 #include <cassert>
+#include <chrono>
 #include <sstream>
 
 namespace nuraft {
 
 struct raft_server::auto_fwd_pkg {
+    auto_fwd_pkg() : fwd_batch_supported_(false) {}
+
     /**
      * Available RPC clients.
      */
@@ -51,6 +55,13 @@ struct raft_server::auto_fwd_pkg {
      * Event awaiter.
      */
     EventAwaiter ea_;
+
+    /**
+     * `true` if the last response from the leader says that it accepts
+     * a batch of forwarded requests. A leader running an older version
+     * would take a batch as a single request with multiple logs.
+     */
+    std::atomic<bool> fwd_batch_supported_;
 };
 
 ptr< cmd_result< ptr<buffer> > > raft_server::add_srv(const srv_config& srv)
@@ -94,6 +105,24 @@ ptr< cmd_result< ptr<buffer> > > raft_server::append_entries_ext
         return cs_new< cmd_result< ptr<buffer> > >(result);
     }
 
+    if (hibernating_) wake_up();
+
+    ptr<raft_params> params = ctx_->get_params();
+    if ( params->max_packed_cmds_ > 1 &&
+         leader_ == id_ &&
+         !ext_params.after_precommit_ &&
+         !ext_params.expected_term_ &&
+         logs.size() <= (size_t)params->max_packed_cmds_ ) {
+        bool small_cmds = true;
+        for (const ptr<buffer>& bb: logs) {
+            if (bb->size() > (size_t)params->max_packed_cmd_size_) {
+                small_cmds = false;
+                break;
+            }
+        }
+        if (small_cmds) return append_packed_cmds(logs);
+    }
+
     ptr<req_msg> req = cs_new<req_msg>
                        ( (ulong)0, msg_type::client_request, 0, 0,
                          (ulong)0, (ulong)0, (ulong)0 ) ;
@@ -109,12 +138,191 @@ ptr< cmd_result< ptr<buffer> > > raft_server::append_entries_ext
     return send_msg_to_leader(req, ext_params);
 }
 
+struct raft_server::packed_cmd_req {
+    packed_cmd_req(const std::vector< ptr<buffer> >& cmds)
+        : cmds_(cmds)
+        , result_( cs_new< cmd_result< ptr<buffer> > >() )
+        , taken_(false)
+        {}
+
+    /**
+     * Commands given by the caller.
+     */
+    std::vector< ptr<buffer> > cmds_;
+
+    /**
+     * Result to return to the caller.
+     */
+    ptr< cmd_result< ptr<buffer> > > result_;
+
+    /**
+     * `true` if a packer took this request from the queue,
+     * protected by `packed_cmd_queue_lock_`.
+     */
+    bool taken_;
+
+    /**
+     * Invoked once the packed log containing `cmds_` is appended
+     * (and committed, in blocking mode).
+     */
+    EventAwaiter ea_;
+};
+
+struct raft_server::handoff_req {
+    handoff_req(ptr<req_msg>& req,
+                const req_ext_params& ext_params)
+        : req_(req)
+        , ext_params_(ext_params)
+        , result_( cs_new< cmd_result< ptr<buffer> > >() )
+        {}
+
+    /**
+     * Request held during the handoff.
+     */
+    ptr<req_msg> req_;
+
+    /**
+     * Parameters given by the caller.
+     */
+    req_ext_params ext_params_;
+
+    /**
+     * Result to return to the caller.
+     */
+    ptr< cmd_result< ptr<buffer> > > result_;
+};
+
+ptr< cmd_result< ptr<buffer> > > raft_server::append_packed_cmds
+                                 ( const std::vector< ptr<buffer> >& cmds )
+{
+    ptr<packed_cmd_req> my_req = cs_new<packed_cmd_req>(cmds);
+    {   auto_lock(packed_cmd_queue_lock_);
+        packed_cmd_queue_.push_back(my_req);
+    }
+
+    // Whoever grabs the packer lock first will pack all commands in the
+    // queue, including the ones queued while the previous packer was busy.
+    // Every caller whose request is not taken by others packs by itself,
+    // so that all queued commands will be appended.
+    flush_packed_cmds(my_req);
+
+    my_req->ea_.wait();
+    return my_req->result_;
+}
+
+void raft_server::flush_packed_cmds(const ptr<packed_cmd_req>& my_req) {
+    ptr<raft_params> params = ctx_->get_params();
+    size_t max_cmds = std::max(1, params->max_packed_cmds_);
+
+    std::unique_lock<std::mutex> pl(packer_lock_);
+    std::list< ptr<packed_cmd_req> > batch;
+    size_t num_cmds = 0;
+    {   auto_lock(packed_cmd_queue_lock_);
+        if (my_req->taken_) {
+            // Already packed by others.
+            return;
+        }
+        while (!packed_cmd_queue_.empty()) {
+            ptr<packed_cmd_req>& front = packed_cmd_queue_.front();
+            if (num_cmds && num_cmds + front->cmds_.size() > max_cmds) break;
+            num_cmds += front->cmds_.size();
+            front->taken_ = true;
+            batch.push_back(front);
+            packed_cmd_queue_.pop_front();
+        }
+    }
+
+    std::vector< ptr<buffer> > cmds;
+    cmds.reserve(num_cmds);
+    for (const ptr<packed_cmd_req>& rr: batch) {
+        cmds.insert(cmds.end(), rr->cmds_.begin(), rr->cmds_.end());
+    }
+    ptr<req_msg> req = cs_new<req_msg>
+                       ( (ulong)0, msg_type::client_request, 0, 0,
+                         (ulong)0, (ulong)0, (ulong)0 );
+    req->log_entries().push_back
+        ( cs_new<log_entry>( 0, pack_buffers(cmds),
+                             log_val_type::packed_app_log ) );
+    p_tr("pack %zu commands from %zu requests", num_cmds, batch.size());
+
+    wait_for_admission();
+    ptr<resp_msg> resp = process_req(*req, req_ext_params());
+
+    // Next packer can append its log while we are waiting for the result.
+    pl.unlock();
+
+    // Give each request the result of its last command.
+    auto set_results = [batch]( ptr<buffer> packed_results,
+                                cmd_result_code code,
+                                ptr<std::exception> err ) {
+        std::vector< ptr<buffer> > results;
+        if (packed_results && code == cmd_result_code::OK) {
+            try {
+                packed_results->pos(0);
+                results = unpack_buffers(*packed_results);
+            } catch (std::exception&) {
+                results.clear();
+            }
+        }
+        size_t cmd_offset = 0;
+        for (const ptr<packed_cmd_req>& rr: batch) {
+            cmd_offset += rr->cmds_.size();
+            ptr<buffer> result = ( cmd_offset <= results.size() )
+                                 ? results[cmd_offset - 1] : nullptr;
+            rr->result_->set_result(result, err, code);
+        }
+    };
+
+    ptr< cmd_result< ptr<buffer> > > async_ret = nullptr;
+    ptr<buffer> result = nullptr;
+    bool accepted = false;
+    cmd_result_code code = cmd_result_code::BAD_REQUEST;
+    if (resp) {
+        if (resp->has_cb()) {
+            // Blocking mode: wait for the commit.
+            resp = resp->call_cb(resp);
+        }
+        accepted = resp->get_accepted();
+        code = resp->get_result_code();
+        if (accepted) {
+            result = resp->get_ctx();
+            if (resp->has_async_cb()) {
+                async_ret = resp->call_async_cb();
+            }
+        }
+    }
+
+    if (accepted) {
+        for (const ptr<packed_cmd_req>& rr: batch) rr->result_->accept();
+    }
+    if (async_ret) {
+        async_ret->when_ready( cmd_result< ptr<buffer> >::handler_type2(
+            [set_results]( cmd_result< ptr<buffer> >& res,
+                           ptr<std::exception>& err ) {
+                set_results(res.get(), res.get_result_code(), err);
+            } ) );
+    } else {
+        set_results(result, code, nullptr);
+    }
+
+    for (const ptr<packed_cmd_req>& rr: batch) rr->ea_.invoke();
+}
+
 ptr< cmd_result< ptr<buffer> > > raft_server::send_msg_to_leader
                                  ( ptr<req_msg>& req,
                                    const req_ext_params& ext_params )
 {
+    if (hibernating_) wake_up();
+
     int32 leader_id = leader_;
     ptr<buffer> result = nullptr;
+    if ( req->get_type() == msg_type::client_request &&
+         is_handoff_pending() ) {
+        // Leadership is being transferred, wait for the new leader
+        // instead of rejecting the request.
+        return hold_req_for_handoff(req, ext_params);
+    }
+
     if (leader_id == -1) {
         p_in("return null as leader does not exist in the current group");
         ptr< cmd_result< ptr<buffer> > > ret =
@@ -123,6 +331,11 @@ ptr< cmd_result< ptr<buffer> > > raft_server::send_msg_to_leader
     }
 
     if (leader_id == id_) {
+        if (req->get_type() == msg_type::client_request) {
+            // Give the state machine a chance to catch up,
+            // instead of rejecting the request right away.
+            wait_for_admission();
+        }
         ptr<resp_msg> resp = process_req(*req, ext_params);
         if (!resp) {
             p_in("server returns null");
@@ -215,7 +428,10 @@ ptr< cmd_result< ptr<buffer> > > raft_server::send_msg_to_leader
 
             } else {
                 // Already reached the max, wait for idle connection.
-                if (is_blocking_mode) {
+                bool batching = ( params->auto_forwarding_max_batch_size_ > 1 &&
+                                  req->get_type() == msg_type::client_request &&
+                                  cur_pkg->fwd_batch_supported_ );
+                if (is_blocking_mode && !batching) {
                     // Blocking mode, sleep here.
                     l.unlock();
                     p_tr("reached max connection, wait");
@@ -225,15 +441,23 @@ ptr< cmd_result< ptr<buffer> > > raft_server::send_msg_to_leader
                     continue;
 
                 } else {
-                    // Async mode, put it into the queue, and return immediately.
+                    // Async mode (or batching), put it into the queue,
+                    // and return immediately.
                     auto_fwd_req_resp req_resp_pair;
                     req_resp_pair.req = req;
                     req_resp_pair.resp = cs_new< cmd_result< ptr<buffer> > >();
 
-                    auto_lock(auto_fwd_reqs_lock_);
-                    auto_fwd_reqs_.push_back(req_resp_pair);
-                    p_tr("reached max connection, put into the queue, %zu elems",
-                         auto_fwd_reqs_.size());
+                    {   auto_lock(auto_fwd_reqs_lock_);
+                        auto_fwd_reqs_.push_back(req_resp_pair);
+                        p_tr("reached max connection, put into the queue, "
+                             "%zu elems", auto_fwd_reqs_.size());
+                    }
+                    l.unlock();
+
+                    if (is_blocking_mode) {
+                        // Will be sent along with other requests in the queue.
+                        req_resp_pair.resp->get();
+                    }
                     return req_resp_pair.resp;
                 }
             }
@@ -276,6 +500,123 @@ ptr< cmd_result< ptr<buffer> > > raft_server::send_msg_to_leader
     return presult;
 }
 
+ptr< cmd_result< ptr<buffer> > > raft_server::hold_req_for_handoff
+                                 ( ptr<req_msg>& req,
+                                   const req_ext_params& ext_params )
+{
+    ptr<raft_params> params = ctx_->get_params();
+    size_t max_wait_ms = params->election_timeout_upper_bound_ * 2;
+
+    if (params->return_method_ == raft_params::blocking) {
+        // Blocking mode: wait for the new leader in this thread,
+        // and then send the request to it.
+        {   std::unique_lock<std::mutex> l(handoff_lock_);
+            handoff_cv_.wait_for( l,
+                                  std::chrono::milliseconds(max_wait_ms),
+                                  [this]() {
+                                      return stopping_ || !is_handoff_pending();
+                                  } );
+        }
+        if (stopping_ || is_handoff_pending()) {
+            p_wn("new leader is not found during the handoff");
+            ptr<buffer> result = nullptr;
+            return cs_new< cmd_result< ptr<buffer> > >
+                   ( result, cmd_result_code::NOT_LEADER );
+        }
+        return send_msg_to_leader(req, ext_params);
+    }
+
+    // Async handler mode: put it into the queue,
+    // it will be sent by `flush_handoff_reqs`.
+    ptr<handoff_req> hreq = cs_new<handoff_req>(req, ext_params);
+    size_t num_reqs = 0;
+    {   auto_lock(handoff_lock_);
+        handoff_reqs_.push_back(hreq);
+        num_reqs = handoff_reqs_.size();
+    }
+    p_db("hold client request during the handoff, %zu requests", num_reqs);
+
+    // The handoff may have been done in the meantime.
+    if (!is_handoff_pending()) {
+        flush_handoff_reqs();
+    }
+    return hreq->result_;
+}
+
+bool raft_server::is_handoff_pending() {
+    if (!handoff_in_progress_) return false;
+
+    // Waiting for the successor to take over,
+    // or for the new leader to be elected.
+    int32 leader_id = leader_;
+    return leader_id == -1 || (leader_id == id_ && write_paused_);
+}
+
+void raft_server::check_handoff() {
+    if (!handoff_in_progress_) return;
+
+    if (handoff_timer_.timeout()) {
+        p_wn("leadership handoff timeout, %" PRIu64 " us elapsed",
+             handoff_timer_.get_us());
+        handoff_in_progress_ = false;
+        flush_handoff_reqs();
+        if (!is_leader()) {
+            drop_all_pending_commit_elems();
+        }
+        return;
+    }
+    if (is_handoff_pending()) return;
+
+    // The new leader is known, send the requests held so far to it.
+    flush_handoff_reqs();
+
+    if (is_leader()) {
+        // This server got the leadership back,
+        // the pending requests will be handled as usual.
+        handoff_in_progress_ = false;
+        return;
+    }
+
+    // Keep the handoff until the new leader
+    // commits all pending requests.
+    {   auto_lock(commit_ret_elems_lock_);
+        if (!commit_ret_elems_.empty()) return;
+    }
+    p_in("leadership handoff to %d is done, %" PRIu64 " us elapsed",
+         leader_.load(), handoff_timer_.get_us());
+    handoff_in_progress_ = false;
+}
+
+void raft_server::flush_handoff_reqs() {
+    std::list< ptr<handoff_req> > reqs;
+    {   auto_lock(handoff_lock_);
+        reqs.swap(handoff_reqs_);
+        handoff_cv_.notify_all();
+    }
+
+    for (ptr<handoff_req>& hreq: reqs) {
+        ptr< cmd_result< ptr<buffer> > > dst = hreq->result_;
+        if (stopping_) {
+            ptr<buffer> result = nullptr;
+            ptr<std::exception> err =
+                cs_new<std::runtime_error>("Request cancelled.");
+            dst->set_result(result, err, cmd_result_code::CANCELLED);
+            continue;
+        }
+
+        // If the handoff is over without a new leader,
+        // it will be rejected here.
+        ptr< cmd_result< ptr<buffer> > > src =
+            send_msg_to_leader(hreq->req_, hreq->ext_params_);
+        src->when_ready( cmd_result< ptr<buffer> >::handler_type2(
+            [dst]( cmd_result< ptr<buffer> >& res,
+                   ptr<std::exception>& err ) {
+                if (res.get_accepted()) dst->accept();
+                dst->set_result(res.get(), err, res.get_result_code());
+            } ) );
+    }
+}
+
 void raft_server::auto_fwd_release_rpc_cli( ptr<auto_fwd_pkg> cur_pkg,
                                             ptr<rpc_client> rpc_cli )
 {
@@ -295,41 +636,79 @@ void raft_server::auto_fwd_release_rpc_cli( ptr<auto_fwd_pkg> cur_pkg,
     };
 
     std::unique_lock<std::mutex> l(cur_pkg->lock_);
-    if (is_blocking_mode) {
-        // Blocking mode, put the connection back to idle list,
-        // and wake up the sleeping thread.
+    std::unique_lock<std::mutex> ll(auto_fwd_reqs_lock_);
+    if (auto_fwd_reqs_.empty()) {
+        ll.unlock();
+        // If no request is waiting, put the connection back to idle list.
         put_back_to_idle_list();
-        cur_pkg->ea_.invoke();
+        if (is_blocking_mode) {
+            // Wake up the sleeping thread.
+            cur_pkg->ea_.invoke();
+        }
+        return;
+    }
 
+    // Send the request in the queue. If batching is enabled,
+    // coalesce consecutive client requests into one.
+    size_t max_batch_size = 1;
+    if (cur_pkg->fwd_batch_supported_) {
+        max_batch_size = std::max(1, params->auto_forwarding_max_batch_size_);
+    }
+    std::list<auto_fwd_req_resp> batch;
+    size_t num_logs = 0;
+    while (!auto_fwd_reqs_.empty()) {
+        auto_fwd_req_resp& entry = auto_fwd_reqs_.front();
+        size_t cur_num_logs = entry.req->log_entries().size();
+        if ( !batch.empty() &&
+             ( entry.req->get_type() != msg_type::client_request ||
+               batch.front().req->get_type() != msg_type::client_request ||
+               num_logs + cur_num_logs > max_batch_size ) ) {
+            break;
+        }
+        batch.push_back(entry);
+        num_logs += cur_num_logs;
+        auto_fwd_reqs_.pop_front();
+    }
+    p_tr( "found %zu waiting requests (%zu logs) in the queue, "
+          "remaining elems %zu",
+          batch.size(), num_logs, auto_fwd_reqs_.size() );
+    ll.unlock();
+
+    ptr<req_msg> req_to_send;
+    rpc_handler handler;
+    if (batch.size() == 1) {
+        req_to_send = batch.front().req;
+        handler = std::bind( &raft_server::auto_fwd_resp_handler,
+                             this,
+                             batch.front().resp,
+                             cur_pkg,
+                             rpc_cli,
+                             std::placeholders::_1,
+                             std::placeholders::_2 );
     } else {
-        // Async mode, send the request in the queue.
-        std::unique_lock<std::mutex> ll(auto_fwd_reqs_lock_);
-        if (!auto_fwd_reqs_.empty()) {
-            auto_fwd_req_resp entry = *auto_fwd_reqs_.begin();
-            auto_fwd_reqs_.pop_front();
-            p_tr( "found waiting request in the queue, remaining elems %zu",
-                  auto_fwd_reqs_.size() );
-            ll.unlock();
-
-            rpc_handler handler = std::bind( &raft_server::auto_fwd_resp_handler,
-                                             this,
-                                             entry.resp,
-                                             cur_pkg,
-                                             rpc_cli,
-                                             std::placeholders::_1,
-                                             std::placeholders::_2 );
-
-            // Should be unlocked before calling `send`, as resp handler can be
-            // invoked in the same thread in case of error.
-            l.unlock();
-            rpc_cli->send(entry.req, handler, params->auto_forwarding_req_timeout_);
-
-        } else {
-            // If no request is waiting, put the connection back to idle list.
-            ll.unlock();
-            put_back_to_idle_list();
+        // Mark it as a batch, so that the leader returns all results.
+        req_to_send = cs_new<req_msg>
+                      ( (ulong)0, msg_type::client_request, 0, 0,
+                        (ulong)0, (ulong)0, (ulong)0 );
+        req_to_send->set_forwarded_batch(true);
+        for (auto& entry: batch) {
+            for (auto& le: entry.req->log_entries()) {
+                req_to_send->log_entries().push_back(le);
+            }
         }
+        handler = std::bind( &raft_server::auto_fwd_batch_resp_handler,
+                             this,
+                             batch,
+                             cur_pkg,
+                             rpc_cli,
+                             std::placeholders::_1,
+                             std::placeholders::_2 );
     }
+
+    // Should be unlocked before calling `send`, as resp handler can be
+    // invoked in the same thread in case of error.
+    l.unlock();
+    rpc_cli->send(req_to_send, handler, params->auto_forwarding_req_timeout_);
 }
 
 void raft_server::auto_fwd_resp_handler( ptr<cmd_result<ptr<buffer>>> presult,
@@ -343,6 +722,7 @@ void raft_server::auto_fwd_resp_handler( ptr<cmd_result<ptr<buffer>>> presult,
     if (err) {
         perr = err;
     } else {
+        cur_pkg->fwd_batch_supported_ = resp->is_fwd_batch_supported();
         if (resp->get_accepted()) {
             resp_ctx = resp->get_ctx();
             presult->accept();
@@ -353,6 +733,68 @@ void raft_server::auto_fwd_resp_handler( ptr<cmd_result<ptr<buffer>>> presult,
     auto_fwd_release_rpc_cli(cur_pkg, rpc_cli);
 }
 
+void raft_server::auto_fwd_batch_resp_handler( std::list<auto_fwd_req_resp> batch,
+                                               ptr<auto_fwd_pkg> cur_pkg,
+                                               ptr<rpc_client> rpc_cli,
+                                               ptr<resp_msg>& resp,
+                                               ptr<rpc_exception>& err )
+{
+    size_t num_logs = 0;
+    for (auto& entry: batch) {
+        num_logs += entry.req->log_entries().size();
+    }
+
+    // Unpack the results of all logs (see `pack_fwd_batch_results`).
+    std::vector< ptr<buffer> > results;
+    std::vector<cmd_result_code> codes;
+    bool accepted = (!err && resp && resp->get_accepted());
+    bool results_ok = false;
+    if (!err && resp) {
+        cur_pkg->fwd_batch_supported_ = resp->is_fwd_batch_supported();
+    }
+    if (accepted) {
+        ptr<buffer> resp_ctx = resp->get_ctx();
+        if (resp_ctx) {
+            try {
+                resp_ctx->pos(0);
+                unpack_results(*resp_ctx, results, codes);
+                results_ok = true;
+            } catch (std::exception& ee) {
+                p_er("failed to parse forwarded batch result: %s", ee.what());
+            }
+        }
+        if (results_ok && results.size() != num_logs) {
+            p_wn("the number of results %zu does not match the number of "
+                 "forwarded logs %zu", results.size(), num_logs);
+            results_ok = false;
+        } else if (!results_ok) {
+            p_wn("no valid result for the forwarded batch of %zu logs", num_logs);
+        }
+    }
+
+    ptr<std::exception> perr;
+    if (err) perr = err;
+    size_t log_offset = 0;
+    for (auto& entry: batch) {
+        log_offset += entry.req->log_entries().size();
+        ptr<buffer> result = nullptr;
+        cmd_result_code code = cmd_result_code::OK;
+        if (accepted) {
+            entry.resp->accept();
+            if (results_ok) {
+                // Each request gets the result of its own last log.
+                result = results[log_offset - 1];
+                code = codes[log_offset - 1];
+            } else {
+                // The logs were accepted, but their results are unknown.
+                code = cmd_result_code::FAILED;
+            }
+        }
+        entry.resp->set_result(result, perr, code);
+    }
+    auto_fwd_release_rpc_cli(cur_pkg, rpc_cli);
+}
+
 void raft_server::cleanup_auto_fwd_pkgs() {
     auto_lock(rpc_clients_lock_);
     for (auto& entry: auto_fwd_pkgs_) {
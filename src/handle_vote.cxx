@@ -220,6 +220,7 @@ void raft_server::initiate_vote(bool force_vote) {
         index_at_becoming_leader_ = 0;
         votes_granted_ = 0;
         votes_responded_ = 0;
+        votes_granted_dcs_.clear();
         election_completed_ = false;
         // NOTE: Following `request_vote` will call `save_state()`,
         //       hence we don't call it here even though `state_` changes.
@@ -237,6 +238,7 @@ void raft_server::request_vote(bool force_vote) {
     ctx_->state_mgr_->save_state(*state_);
     votes_granted_ += 1;
     votes_responded_ += 1;
+    votes_granted_dcs_.insert( get_dc_id(id_) );
     p_in("[VOTE INIT] my id %d, my role %s, term %" PRIu64 ", log idx %" PRIu64 ", "
          "log term %" PRIu64 ", priority (target %d / mine %d)\n",
          id_, srv_role_to_string(role_).c_str(),
@@ -245,7 +247,8 @@ void raft_server::request_vote(bool force_vote) {
          target_priority_, my_priority_);
 
     // is this the only server?
-    if (votes_granted_ > get_quorum_for_election()) {
+    if ( votes_granted_ > get_quorum_for_election() &&
+         check_election_zones() ) {
         election_completed_ = true;
         become_leader();
         return;
@@ -318,6 +321,13 @@ ptr<resp_msg> raft_server::handle_vote_req(req_msg& req) {
         ( state_->get_voted_for() == req.get_src() ||
           state_->get_voted_for() == -1 );
 
+    if (grant && recovering_logs_) {
+        // The candidate may not have the logs that this server
+        // acknowledged before losing them.
+        p_in("[VOTE REQ] this server is recovering lost logs, deny");
+        grant = false;
+    }
+
     bool ignore_priority = false;
     if (req.log_entries().size() > 0) {
         p_in("[VOTE REQ] force vote request, will ignore priority");
@@ -380,6 +390,7 @@ void raft_server::handle_vote_resp(resp_msg& resp) {
 
     if (resp.get_accepted()) {
         votes_granted_ += 1;
+        votes_granted_dcs_.insert( get_dc_id(resp.get_src()) );
     }
 
     if (votes_responded_ >= get_num_voting_members()) {
@@ -396,7 +407,8 @@ void raft_server::handle_vote_resp(resp_msg& resp) {
          (int)votes_granted_, (int)votes_responded_,
          get_num_voting_members(), election_quorum_size);
 
-    if (votes_granted_ >= election_quorum_size) {
+    if ( votes_granted_ >= election_quorum_size &&
+         check_election_zones() ) {
         p_in("Server is elected as leader for term %" PRIu64, state_->get_term());
         election_completed_ = true;
         become_leader();
@@ -0,0 +1,190 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "basic_types.hxx"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace nuraft {
+
+/**
+ * Latency-aware leader placement.
+ *
+ * Keeps the matrix of round-trip times between members, and finds
+ * the member that would give the lowest commit latency as a leader.
+ * The commit latency of a candidate is estimated as the RTT to the
+ * farthest member among the closest ones forming a quorum.
+ *
+ * Not thread-safe, should be protected by the caller.
+ */
+class leader_placement {
+public:
+    using rtt_map = std::map<int32, uint64_t>;
+
+    leader_placement()
+        : best_candidate_(-1)
+        , consecutive_wins_(0)
+        {}
+
+    /**
+     * Set the RTTs measured by the given member.
+     *
+     * @param srv_id ID of the member who measured RTTs.
+     * @param rtts Map of {member ID, RTT in microseconds}.
+     */
+    void set_rtts(int32 srv_id, const rtt_map& rtts) {
+        rtts_[srv_id] = rtts;
+    }
+
+    /**
+     * Clear all measurements and decision history.
+     */
+    void reset() {
+        rtts_.clear();
+        best_candidate_ = -1;
+        consecutive_wins_ = 0;
+    }
+
+    /**
+     * Get the RTT between two members, using either direction.
+     *
+     * @return RTT in microseconds, 0 if unknown.
+     */
+    uint64_t get_rtt(int32 from, int32 to) const {
+        uint64_t ret = find_rtt(from, to);
+        if (ret) return ret;
+        return find_rtt(to, from);
+    }
+
+    /**
+     * Estimate the commit latency when the given member is the leader.
+     *
+     * @param candidate ID of the candidate.
+     * @param voters IDs of voting members, including the candidate.
+     * @param quorum Number of acks from other members to commit.
+     * @return Estimated latency in microseconds, 0 if unknown.
+     */
+    uint64_t estimate_commit_latency_us(int32 candidate,
+                                        const std::vector<int32>& voters,
+                                        size_t quorum) const
+    {
+        if (!quorum) return 0;
+        std::vector<uint64_t> rtts;
+        for (int32 vv: voters) {
+            if (vv == candidate) continue;
+            uint64_t rtt = get_rtt(candidate, vv);
+            if (rtt) rtts.push_back(rtt);
+        }
+        // Not enough measurements to make a quorum.
+        if (rtts.size() < quorum) return 0;
+
+        std::nth_element(rtts.begin(), rtts.begin() + (quorum - 1), rtts.end());
+        return rtts[quorum - 1];
+    }
+
+    /**
+     * Evaluate the current placement.
+     *
+     * @param leader_id ID of the current leader.
+     * @param candidates IDs of members that can be a leader.
+     * @param voters IDs of voting members, including the leader.
+     * @param quorum Number of acks from other members to commit.
+     * @param min_gain_pct Minimum improvement of the estimated
+     *                     latency, in percentage, to move the leader.
+     * @param min_gain_us Minimum improvement of the estimated
+     *                    latency, in microseconds, to move the leader.
+     * @param required_wins Number of consecutive evaluations that the
+     *                      same candidate should win.
+     * @return ID of the member to transfer the leadership to,
+     *         or -1 if the leader should stay.
+     */
+    int32 evaluate(int32 leader_id,
+                   const std::vector<int32>& candidates,
+                   const std::vector<int32>& voters,
+                   size_t quorum,
+                   int32 min_gain_pct,
+                   uint64_t min_gain_us,
+                   size_t required_wins)
+    {
+        uint64_t cur_latency =
+            estimate_commit_latency_us(leader_id, voters, quorum);
+        int32 best = -1;
+        uint64_t best_latency = cur_latency;
+        if (cur_latency) {
+            for (int32 cc: candidates) {
+                if (cc == leader_id) continue;
+                uint64_t latency = estimate_commit_latency_us(cc, voters, quorum);
+                if (!latency) continue;
+                if (latency < best_latency) {
+                    best = cc;
+                    best_latency = latency;
+                }
+            }
+        }
+
+        // Hysteresis: the gain should be big enough, and
+        // the same candidate should keep winning.
+        if ( best < 0 ||
+             best_latency + min_gain_us > cur_latency ||
+             best_latency * 100 >
+                 cur_latency * (uint64_t)(100 - std::min(min_gain_pct, 100)) ) {
+            best_candidate_ = -1;
+            consecutive_wins_ = 0;
+            return -1;
+        }
+        if (best != best_candidate_) {
+            best_candidate_ = best;
+            consecutive_wins_ = 0;
+        }
+        if (++consecutive_wins_ < required_wins) return -1;
+
+        best_candidate_ = -1;
+        consecutive_wins_ = 0;
+        return best;
+    }
+
+private:
+    uint64_t find_rtt(int32 from, int32 to) const {
+        auto entry = rtts_.find(from);
+        if (entry == rtts_.end()) return 0;
+        auto ee = entry->second.find(to);
+        if (ee == entry->second.end()) return 0;
+        return ee->second;
+    }
+
+    /**
+     * Map of {member ID, RTTs measured by the member}.
+     */
+    std::map<int32, rtt_map> rtts_;
+
+    /**
+     * The candidate that won the last evaluation.
+     */
+    int32 best_candidate_;
+
+    /**
+     * Number of consecutive wins of `best_candidate_`.
+     */
+    size_t consecutive_wins_;
+};
+
+}
+
@@ -1,6 +1,9 @@
 #include "crc32.hxx"
 #include "log_entry.hxx"
 
+#include <cstring>
+#include <memory>
+
 namespace nuraft {
 log_entry::log_entry(ulong term,
                      const ptr<buffer>& buff,
@@ -12,6 +15,7 @@ log_entry::log_entry(ulong term,
     : term_(term)
     , value_type_(value_type)
     , buff_(buff)
+    , inline_buf_(nullptr)
     , timestamp_us_(log_timestamp)
     , has_crc32_(has_crc32)
     , crc32_(crc32)
@@ -24,8 +28,88 @@ log_entry::log_entry(ulong term,
         }
     }
 
+namespace {
+
+// Allocator reserving extra space right after the object,
+// for a log entry and its payload in a single allocation.
+template<typename T>
+struct tail_space_allocator {
+    using value_type = T;
+
+    tail_space_allocator(size_t tail_size, void** tail_out)
+        : tail_size_(tail_size), tail_out_(tail_out) {}
+
+    template<typename U>
+    tail_space_allocator(const tail_space_allocator<U>& src)
+        : tail_size_(src.tail_size_), tail_out_(src.tail_out_) {}
+
+    T* allocate(size_t n) {
+        size_t obj_size = (n * sizeof(T) + TAIL_ALIGN - 1) & ~(TAIL_ALIGN - 1);
+        char* mem = new char[obj_size + tail_size_];
+        if (tail_out_) *tail_out_ = mem + obj_size;
+        return reinterpret_cast<T*>(mem);
+    }
+
+    void deallocate(T* p, size_t) {
+        delete[] reinterpret_cast<char*>(p);
+    }
+
+    static const size_t TAIL_ALIGN = 8;
+    size_t tail_size_;
+    void** tail_out_;
+};
+
+template<typename T, typename U>
+bool operator==(const tail_space_allocator<T>&, const tail_space_allocator<U>&) {
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const tail_space_allocator<T>&, const tail_space_allocator<U>&) {
+    return false;
+}
+
+// Payloads bigger than this are allocated separately.
+const size_t MAX_INLINE_PAYLOAD_SIZE = 0x4000;
+
+}
+
+ptr<log_entry> log_entry::make(ulong term,
+                               const byte* data,
+                               size_t size,
+                               log_val_type value_type,
+                               uint64_t log_timestamp,
+                               bool has_crc32,
+                               uint32_t crc32,
+                               bool compute_crc)
+{
+    if (size > MAX_INLINE_PAYLOAD_SIZE) {
+        ptr<buffer> buf = buffer::alloc(size);
+        buf->put_raw(data, size);
+        buf->pos(0);
+        return cs_new<log_entry>( term, buf, value_type, log_timestamp,
+                                  has_crc32, crc32, compute_crc );
+    }
+
+    void* tail = nullptr;
+    ptr<log_entry> entry = std::allocate_shared<log_entry>
+        ( tail_space_allocator<log_entry>( buffer::get_block_size(size), &tail ),
+          term, ptr<buffer>(), value_type, log_timestamp,
+          has_crc32, crc32, false );
+
+    buffer* buf = buffer::init_block(tail, size);
+    if (size) memcpy(buf->data_begin(), data, size);
+    entry->inline_buf_ = buf;
+    if (!has_crc32 && compute_crc) {
+        entry->has_crc32_ = true;
+        entry->crc32_ = crc32_8(buf->data_begin(), size, 0);
+    }
+    return entry;
+}
+
 void log_entry::change_buf(const ptr<buffer>& buff) {
     buff_ = buff;
+    inline_buf_ = nullptr;
     if (buff_ && has_crc32_) {
         crc32_ = crc32_8(buff_->data_begin(),
                          buff_->size(),
@@ -0,0 +1,151 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "async.hxx"
+#include "buffer.hxx"
+#include "buffer_serializer.hxx"
+#include "ptr.hxx"
+
+#include <vector>
+
+namespace nuraft {
+
+/**
+ * Pack a list of buffers into a single buffer. Used for the payload of
+ * `log_val_type::packed_app_log` and for its results.
+ *
+ * Format:
+ *   number of buffers (4 bytes),
+ *   { flag if buffer exists (1 byte),
+ *     buffer (4-byte length + data, only if exists) } * number of buffers
+ *
+ * @param bufs List of buffers, can contain `nullptr`.
+ * @return Packed buffer.
+ */
+inline ptr<buffer> pack_buffers(const std::vector< ptr<buffer> >& bufs) {
+    size_t buf_size = sizeof(uint32_t);
+    for (const ptr<buffer>& bb: bufs) {
+        buf_size += sizeof(uint8_t);
+        if (bb) buf_size += sizeof(uint32_t) + bb->size();
+    }
+
+    ptr<buffer> ret = buffer::alloc(buf_size);
+    buffer_serializer bs(ret);
+    bs.put_u32(bufs.size());
+    for (const ptr<buffer>& bb: bufs) {
+        bs.put_u8(bb ? 1 : 0);
+        if (bb) bs.put_bytes(bb->data_begin(), bb->size());
+    }
+    ret->pos(0);
+    return ret;
+}
+
+/**
+ * Unpack the buffer made by `pack_buffers`.
+ * Will throw an exception if the buffer is corrupted.
+ *
+ * @param packed Packed buffer.
+ * @return List of buffers.
+ */
+inline std::vector< ptr<buffer> > unpack_buffers(buffer& packed) {
+    std::vector< ptr<buffer> > ret;
+    buffer_serializer bs(packed);
+    uint32_t num_bufs = bs.get_u32();
+    ret.reserve(num_bufs);
+    for (uint32_t ii = 0; ii < num_bufs; ++ii) {
+        ptr<buffer> bb = nullptr;
+        if (bs.get_u8()) {
+            size_t len = 0;
+            void* data = bs.get_bytes(len);
+            bb = buffer::alloc(len);
+            bb->put_raw(static_cast<byte*>(data), len);
+            bb->pos(0);
+        }
+        ret.push_back(bb);
+    }
+    return ret;
+}
+
+/**
+ * Pack the results of a batch of forwarded requests, along with
+ * their result codes.
+ *
+ * Format:
+ *   number of results (4 bytes),
+ *   { result code (4 bytes),
+ *     flag if buffer exists (1 byte),
+ *     buffer (4-byte length + data, only if exists) } * number of results
+ *
+ * @param bufs List of result buffers, can contain `nullptr`.
+ * @param codes List of result codes, of the same size as `bufs`.
+ * @return Packed buffer.
+ */
+inline ptr<buffer> pack_results(const std::vector< ptr<buffer> >& bufs,
+                                const std::vector<cmd_result_code>& codes)
+{
+    size_t buf_size = sizeof(uint32_t);
+    for (const ptr<buffer>& bb: bufs) {
+        buf_size += sizeof(int32_t) + sizeof(uint8_t);
+        if (bb) buf_size += sizeof(uint32_t) + bb->size();
+    }
+
+    ptr<buffer> ret = buffer::alloc(buf_size);
+    buffer_serializer bs(ret);
+    bs.put_u32(bufs.size());
+    for (size_t ii = 0; ii < bufs.size(); ++ii) {
+        const ptr<buffer>& bb = bufs[ii];
+        bs.put_i32(codes[ii]);
+        bs.put_u8(bb ? 1 : 0);
+        if (bb) bs.put_bytes(bb->data_begin(), bb->size());
+    }
+    ret->pos(0);
+    return ret;
+}
+
+/**
+ * Unpack the buffer made by `pack_results`.
+ * Will throw an exception if the buffer is corrupted.
+ *
+ * @param packed Packed buffer.
+ * @param[out] bufs List of result buffers.
+ * @param[out] codes List of result codes.
+ */
+inline void unpack_results(buffer& packed,
+                           std::vector< ptr<buffer> >& bufs,
+                           std::vector<cmd_result_code>& codes)
+{
+    buffer_serializer bs(packed);
+    uint32_t num_bufs = bs.get_u32();
+    bufs.reserve(num_bufs);
+    codes.reserve(num_bufs);
+    for (uint32_t ii = 0; ii < num_bufs; ++ii) {
+        codes.push_back( static_cast<cmd_result_code>(bs.get_i32()) );
+        ptr<buffer> bb = nullptr;
+        if (bs.get_u8()) {
+            size_t len = 0;
+            void* data = bs.get_bytes(len);
+            bb = buffer::alloc(len);
+            bb->put_raw(static_cast<byte*>(data), len);
+            bb->pos(0);
+        }
+        bufs.push_back(bb);
+    }
+}
+
+}
+
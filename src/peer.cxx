@@ -23,6 +23,7 @@ limitations under the License.
 #include "debugging_options.hxx"
 #include "tracer.hxx"
 
+#include <algorithm>
 #include <unordered_set>
 
 namespace nuraft {
@@ -63,6 +64,7 @@ void peer::send_req( ptr<peer> myself,
                       rpc_local,
                       req,
                       pending,
+                      monotonic_clock::now_ns(),
                       std::placeholders::_1,
                       std::placeholders::_2 );
     if (rpc_local) {
@@ -70,6 +72,55 @@ void peer::send_req( ptr<peer> myself,
     }
 }
 
+bool peer::send_ping( ptr<peer> myself,
+                      ptr<req_msg>& req,
+                      context& ctx )
+{
+    if (abandoned_) return false;
+
+    bool exp = false, desired = true;
+    if (!ping_in_flight_.compare_exchange_strong(exp, desired)) {
+        // Measure it next time.
+        return false;
+    }
+
+    ptr<rpc_client_factory> factory = nullptr;
+    {   std::lock_guard<std::mutex> l(ctx.ctx_lock_);
+        factory = ctx.rpc_cli_factory_;
+    }
+
+    ptr<rpc_client> rpc_local = nullptr;
+    {   std::lock_guard<std::mutex> l(rpc_protector_);
+        if (!ping_rpc_ && factory) {
+            ping_rpc_ = factory->create_client(config_->get_endpoint());
+        }
+        rpc_local = ping_rpc_;
+    }
+    if (!rpc_local) {
+        ping_in_flight_ = false;
+        return false;
+    }
+
+    p_tr("send ping %d -> %d", req->get_src(), req->get_dst());
+    uint64_t sent_ns = monotonic_clock::now_ns();
+    rpc_handler h = [this, myself, rpc_local, sent_ns]
+                    (ptr<resp_msg>& resp, ptr<rpc_exception>& err) {
+        if (abandoned_) return;
+        if (!err && resp) {
+            uint64_t now_ns = monotonic_clock::now_ns();
+            uint64_t rtt_us = now_ns > sent_ns ? (now_ns - sent_ns) / 1000 : 0;
+            update_ping_rtt_us( std::max(rtt_us, (uint64_t)1) );
+        } else {
+            // Will create a new connection next time.
+            std::lock_guard<std::mutex> l(rpc_protector_);
+            if (ping_rpc_ == rpc_local) ping_rpc_.reset();
+        }
+        ping_in_flight_ = false;
+    };
+    rpc_local->send(req, h);
+    return true;
+}
+
 // WARNING:
 //   We should have the shared pointer of itself (`myself`)
 //   and pointer to RPC client (`my_rpc_client`),
@@ -80,6 +131,7 @@ void peer::handle_rpc_result( ptr<peer> myself,
                               ptr<rpc_client> my_rpc_client,
                               ptr<req_msg>& req,
                               ptr<rpc_result>& pending_result,
+                              uint64_t sent_ns,
                               ptr<resp_msg>& resp,
                               ptr<rpc_exception>& err )
 {
@@ -138,6 +190,13 @@ void peer::handle_rpc_result( ptr<peer> myself,
             auto_lock(lock_);
             resume_hb_speed();
         }
+        if (req) {
+            uint64_t now_ns = monotonic_clock::now_ns();
+            uint64_t rtt_us = now_ns > sent_ns ? (now_ns - sent_ns) / 1000 : 0;
+            if (req->get_type() == msg_type::append_entries_request) {
+                if (rtt_us) update_rtt_us(rtt_us);
+            }
+        }
         ptr<rpc_exception> no_except;
         resp->set_peer(myself);
         pending_result->set_result(resp, no_except);
@@ -225,6 +284,7 @@ bool peer::recreate_rpc(ptr<srv_config>& config,
 
         rpc_ = factory->create_client(config->get_endpoint());
         p_tr("%p reconnect peer %d", rpc_.get(), config_->get_id());
+        features_ = 0;
 
         // WARNING:
         //   A reconnection attempt should be treated as an activity,
@@ -251,6 +311,7 @@ void peer::shutdown() {
         // (race between send_req()).
         std::lock_guard<std::mutex> l(rpc_protector_);
         rpc_.reset();
+        ping_rpc_.reset();
     }
     hb_task_.reset();
 }
@@ -0,0 +1,157 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "pre_commit_pipeline.hxx"
+
+#include "packed_buffers.hxx"
+#include "state_machine.hxx"
+#include "tracer.hxx"
+
+#include <vector>
+
+namespace nuraft {
+
+struct pre_commit_pipeline::pre_commit_elem {
+    pre_commit_elem(ulong log_idx,
+                    const ptr<log_entry>& le,
+                    const raft_server::req_ext_cb& cb,
+                    const raft_server::req_ext_cb_params& cb_params)
+        : log_idx_(log_idx)
+        , data_(le->get_buf_ptr())
+        , packed_(le->get_val_type() == log_val_type::packed_app_log)
+        , cb_(cb)
+        , cb_params_(cb_params)
+        {}
+    ulong log_idx_;
+    ptr<buffer> data_;
+    bool packed_;
+    raft_server::req_ext_cb cb_;
+    raft_server::req_ext_cb_params cb_params_;
+};
+
+pre_commit_pipeline::pre_commit_pipeline(const ptr<state_machine>& sm,
+                                         const ptr<logger>& l)
+    : sm_(sm)
+    , l_(l)
+    , delivering_idx_(0)
+    , terminating_(false)
+{
+    pre_commit_thread_ = std::thread(&pre_commit_pipeline::pre_commit_loop, this);
+}
+
+pre_commit_pipeline::~pre_commit_pipeline() {
+    shutdown();
+}
+
+void pre_commit_pipeline::enqueue(ulong log_idx,
+                                  const ptr<log_entry>& le,
+                                  const raft_server::req_ext_cb& cb,
+                                  const raft_server::req_ext_cb_params& cb_params)
+{
+    std::lock_guard<std::mutex> l(lock_);
+    queue_.push_back( cs_new<pre_commit_elem>(log_idx, le, cb, cb_params) );
+    pre_commit_cv_.notify_one();
+}
+
+bool pre_commit_pipeline::wait_for(ulong log_idx) {
+    std::unique_lock<std::mutex> l(lock_);
+    waiter_cv_.wait( l, [&]() {
+        if (terminating_) return true;
+        if (delivering_idx_ && delivering_idx_ <= log_idx) return false;
+        return queue_.empty() || queue_.front()->log_idx_ > log_idx;
+    } );
+    return !terminating_;
+}
+
+bool pre_commit_pipeline::flush() {
+    std::unique_lock<std::mutex> l(lock_);
+    waiter_cv_.wait( l, [&]() {
+        return terminating_ || (queue_.empty() && !delivering_idx_);
+    } );
+    return !terminating_;
+}
+
+size_t pre_commit_pipeline::get_queue_size() {
+    std::lock_guard<std::mutex> l(lock_);
+    return queue_.size();
+}
+
+void pre_commit_pipeline::shutdown() {
+    {   std::lock_guard<std::mutex> l(lock_);
+        terminating_ = true;
+        pre_commit_cv_.notify_all();
+        waiter_cv_.notify_all();
+    }
+    if (pre_commit_thread_.joinable()) {
+        pre_commit_thread_.join();
+    }
+}
+
+void pre_commit_pipeline::pre_commit_loop() {
+    std::string thread_name = "nuraft_pre_cmt";
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+#elif __APPLE__
+    pthread_setname_np(thread_name.c_str());
+#endif
+
+    std::unique_lock<std::mutex> l(lock_);
+    while (!terminating_) {
+        pre_commit_cv_.wait( l, [&]() {
+            return terminating_ || !queue_.empty();
+        } );
+        if (terminating_) break;
+
+        // Take all logs in the queue as a batch.
+        std::list< ptr<pre_commit_elem> > batch;
+        batch.swap(queue_);
+        delivering_idx_ = batch.front()->log_idx_;
+        l.unlock();
+
+        std::vector<state_machine::ext_op_params> params;
+        params.reserve(batch.size());
+        for (auto& entry: batch) {
+            entry->data_->pos(0);
+            if (entry->packed_) {
+                // Packed log cannot be a part of the batch,
+                // deliver the logs before it first.
+                if (!params.empty()) {
+                    sm_->pre_commit_batch(params);
+                    params.clear();
+                }
+                sm_->pre_commit_packed( entry->log_idx_,
+                                        unpack_buffers(*entry->data_) );
+                continue;
+            }
+            params.emplace_back(entry->log_idx_, entry->data_);
+        }
+        p_tr("pre-commit batch %" PRIu64 " - %" PRIu64 " (%zu logs)",
+             batch.front()->log_idx_, batch.back()->log_idx_, batch.size());
+        if (!params.empty()) {
+            sm_->pre_commit_batch(params);
+        }
+
+        for (auto& entry: batch) {
+            if (entry->cb_) entry->cb_(entry->cb_params_);
+        }
+
+        l.lock();
+        delivering_idx_ = 0;
+        waiter_cv_.notify_all();
+    }
+}
+
+}
@@ -0,0 +1,150 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#pragma once
+
+#include "buffer.hxx"
+#include "log_entry.hxx"
+#include "logger.hxx"
+#include "pp_util.hxx"
+#include "ptr.hxx"
+#include "raft_server.hxx"
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+
+namespace nuraft {
+
+class state_machine;
+
+/**
+ * Background stage delivering pre-commits to the state machine,
+ * used when `raft_params::async_pre_commit_` is set.
+ *
+ * Logs are enqueued in log index order, and all logs in the queue
+ * are delivered at once through `state_machine::pre_commit_batch`,
+ * except for packed logs delivered through `pre_commit_packed`.
+ */
+class pre_commit_pipeline {
+public:
+    pre_commit_pipeline(const ptr<state_machine>& sm,
+                        const ptr<logger>& l);
+
+    ~pre_commit_pipeline();
+
+    __nocopy__(pre_commit_pipeline);
+
+public:
+    /**
+     * Enqueue a log to be pre-committed. It never blocks.
+     *
+     * @param log_idx Log index.
+     * @param le Log entry, either `app_log` or `packed_app_log`.
+     * @param cb Callback function to invoke after the pre-commit, can be empty.
+     * @param cb_params Parameters to the callback function.
+     */
+    void enqueue(ulong log_idx,
+                 const ptr<log_entry>& le,
+                 const raft_server::req_ext_cb& cb =
+                     raft_server::req_ext_cb(),
+                 const raft_server::req_ext_cb_params& cb_params =
+                     raft_server::req_ext_cb_params());
+
+    /**
+     * Wait until all logs up to the given index are pre-committed.
+     *
+     * @param log_idx Log index.
+     * @return `false` if the pipeline is shutting down.
+     */
+    bool wait_for(ulong log_idx);
+
+    /**
+     * Wait until all logs in the queue are pre-committed.
+     * Should be called before rolling back logs, so that rollbacks
+     * are always invoked after the pre-commits of the same logs.
+     *
+     * @return `false` if the pipeline is shutting down.
+     */
+    bool flush();
+
+    /**
+     * Get the number of logs waiting to be pre-committed.
+     *
+     * @return Number of logs.
+     */
+    size_t get_queue_size();
+
+    /**
+     * Stop the pre-commit thread.
+     * Pending logs will not be pre-committed.
+     */
+    void shutdown();
+
+private:
+    struct pre_commit_elem;
+
+    void pre_commit_loop();
+
+    /**
+     * State machine to deliver pre-commits.
+     */
+    ptr<state_machine> sm_;
+
+    /**
+     * Logger.
+     */
+    ptr<logger> l_;
+
+    /**
+     * Dedicated thread for pre-commits.
+     */
+    std::thread pre_commit_thread_;
+
+    /**
+     * Logs waiting to be pre-committed, in log index order.
+     */
+    std::list< ptr<pre_commit_elem> > queue_;
+
+    /**
+     * Smallest log index of the batch being delivered,
+     * 0 if nothing is being delivered.
+     */
+    ulong delivering_idx_;
+
+    /**
+     * `true` if we are closing this pipeline.
+     */
+    bool terminating_;
+
+    /**
+     * Lock for above members.
+     */
+    std::mutex lock_;
+
+    /**
+     * Condition variable for the pre-commit thread.
+     */
+    std::condition_variable pre_commit_cv_;
+
+    /**
+     * Condition variable for the threads waiting for pre-commits.
+     */
+    std::condition_variable waiter_cv_;
+};
+
+}
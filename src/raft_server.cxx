@@ -24,11 +24,14 @@ limitations under the License.
 #include "context.hxx"
 #include "error_code.hxx"
 #include "event_awaiter.hxx"
+#include "failure_detector.hxx"
 #include "global_mgr.hxx"
 #include "handle_client_request.hxx"
 #include "handle_custom_notification.hxx"
 #include "internal_timer.hxx"
+#include "leader_placement.hxx"
 #include "peer.hxx"
+#include "pre_commit_pipeline.hxx"
 #include "snapshot.hxx"
 #include "snapshot_sync_ctx.hxx"
 #include "stat_mgr.hxx"
@@ -36,6 +39,7 @@ limitations under the License.
 #include "state_mgr.hxx"
 #include "tracer.hxx"
 
+#include <algorithm>
 #include <cassert>
 #include <random>
 #include <sstream>
@@ -47,6 +51,18 @@ const int raft_server::default_snapshot_sync_block_size = 4 * 1024;
 
 raft_server::limits raft_server::raft_limits_;
 
+// Number of consecutive evaluations that the same member should
+// win, to move the leadership to it.
+static const size_t LEADER_PLACEMENT_REQUIRED_WINS = 3;
+
+// Minimum improvement of the estimated commit latency to move the
+// leadership, so as not to chase the noise of sub-millisecond RTTs.
+static const uint64_t LEADER_PLACEMENT_MIN_GAIN_US = 1000;
+
+// Number of evaluation intervals during which the leader placement
+// is not evaluated, after becoming a leader or yielding the leadership.
+static const int32 LEADER_PLACEMENT_HOLD_INTERVALS = 10;
+
 raft_server::raft_server(context* ctx, const init_options& opt)
     : bg_append_ea_(nullptr)
     , initialized_(false)
@@ -55,6 +71,8 @@ raft_server::raft_server(context* ctx, const init_options& opt)
     , target_priority_(srv_config::INIT_PRIORITY)
     , votes_responded_(0)
     , votes_granted_(0)
+    , pending_bytes_(0)
+    , num_admission_waiters_(0)
     , leader_commit_index_(0)
     , quick_commit_index_(ctx->state_machine_->last_commit_index())
     , sm_commit_index_(ctx->state_machine_->last_commit_index())
@@ -75,6 +93,7 @@ raft_server::raft_server(context* ctx, const init_options& opt)
     , ea_sm_commit_exec_in_progress_(new EventAwaiter())
     , next_leader_candidate_(-1)
     , im_learner_(false)
+    , im_witness_(false)
     , serving_req_(false)
     , steps_to_down_(0)
     , snp_in_progress_(false)
@@ -84,11 +103,14 @@ raft_server::raft_server(context* ctx, const init_options& opt)
     , scheduler_(ctx->scheduler_)
     , election_exec_(std::bind(&raft_server::handle_election_timeout, this))
     , election_task_(nullptr)
+    , handoff_in_progress_(false)
     , role_(srv_role::follower)
     , state_(ctx->state_mgr_->read_state())
     , log_store_(ctx->state_mgr_->load_log_store())
     , state_machine_(ctx->state_machine_)
     , receiving_snapshot_(false)
+    , bulk_ingest_in_progress_(false)
+    , ingest_snp_missing_idx_(0)
     , et_cnt_receiving_snapshot_(0)
     , first_snapshot_distance_(0)
     , l_(ctx->logger_)
@@ -109,11 +131,18 @@ raft_server::raft_server(context* ctx, const init_options& opt)
                                                 std::placeholders::_1,
                                                 std::placeholders::_2 ) )
     , last_snapshot_(ctx->state_machine_->last_snapshot())
-    , ea_follower_log_append_(new EventAwaiter())
     , test_mode_flag_(opt.test_mode_flag_)
+    , result_executor_(opt.result_executor_)
+    , cur_election_timeout_ms_(0)
+    , hb_detector_(cs_new<phi_accrual_detector>())
+    , placement_(cs_new<leader_placement>())
+    , features_reported_to_(-1)
+    , hibernating_(false)
+    , hibernation_log_idx_(0)
+    , recovering_logs_(false)
 {
     if (opt.raft_callback_) {
-        ctx->set_cb_func(opt.raft_callback_);
+        ctx->set_cb_func(opt.raft_callback_, opt.raft_callback_event_mask_);
     }
 
     ptr<raft_params> params = ctx_->get_params();
@@ -142,9 +171,33 @@ raft_server::raft_server(context* ctx, const init_options& opt)
 
     apply_and_log_current_params();
     update_rand_timeout();
+
+    ptr<snapshot> init_snp = get_last_snapshot();
+    ulong init_snp_idx = init_snp ? init_snp->get_last_log_idx() : 0;
+    bool logs_lost = params->memory_only_durability_ &&
+                     log_store_->next_slot() - 1 <= init_snp_idx;
+    if ( params->memory_only_durability_ &&
+         init_snp &&
+         log_store_->next_slot() <= init_snp->get_last_log_idx() ) {
+        // Logs in memory have been lost, and the state machine
+        // has been recovered from the last checkpoint.
+        // Log store should start right after it.
+        p_wn("log store end %" PRIu64 " is behind the last checkpoint %" PRIu64
+             ", logs after the checkpoint should be recovered from other members",
+             log_store_->next_slot() - 1, init_snp->get_last_log_idx());
+        log_store_->compact(init_snp->get_last_log_idx());
+    }
     precommit_index_ = log_store_->next_slot() - 1;
     lagging_sm_target_index_ = log_store_->next_slot() - 1;
 
+    ptr<srv_config> my_srv_config = get_config()->get_server(id_);
+    im_witness_ = my_srv_config && my_srv_config->is_witness();
+
+    // Witness does not execute logs, no pre-commit is needed.
+    if (params->async_pre_commit_ && !im_witness_) {
+        pre_commit_pipeline_ = cs_new<pre_commit_pipeline>(state_machine_, l_);
+    }
+
     if (!state_) {
         state_ = cs_new<srv_state>();
         state_->set_term(0);
@@ -152,6 +205,39 @@ raft_server::raft_server(context* ctx, const init_options& opt)
     }
     vote_init_timer_term_ = state_->get_term();
 
+    ulong witness_snp_idx = state_->get_witness_snapshot_idx();
+    if (im_witness_ && witness_snp_idx) {
+        // Witness's state machine does not know what has been committed,
+        // recover it from the metadata snapshot, which is behind the
+        // log store start index after the compaction.
+        ptr<snapshot> cur_snp = get_last_snapshot();
+        if (!cur_snp || cur_snp->get_last_log_idx() < witness_snp_idx) {
+            set_last_snapshot
+                ( cs_new<snapshot>( witness_snp_idx,
+                                    state_->get_witness_snapshot_term(),
+                                    get_config() ) );
+        }
+        if (sm_commit_index_ < witness_snp_idx) {
+            p_in("recover commit index %" PRIu64 " from the witness snapshot",
+                 witness_snp_idx);
+            sm_commit_index_ = witness_snp_idx;
+            quick_commit_index_ = witness_snp_idx;
+            initial_commit_index_ = witness_snp_idx;
+        }
+    }
+
+    if ( logs_lost &&
+         state_->get_term() > 0 &&
+         get_config()->get_servers().size() > 1 ) {
+        // This server may have acknowledged the logs it lost, so that
+        // it should not vote or be counted for commit until it catches
+        // up with the leader. Otherwise, a quorum without those logs
+        // can elect a new leader.
+        p_wn("logs after %" PRIu64 " may have been lost, will not vote "
+             "until catching up with the leader", init_snp_idx);
+        recovering_logs_ = true;
+    }
+
     ptr<cluster_config> c_conf = get_config();
     std::stringstream init_msg;
     init_msg << "   === INIT RAFT SERVER ===\n"
@@ -200,11 +286,16 @@ raft_server::raft_server(context* ctx, const init_options& opt)
           i < log_store_->next_slot();
           ++i ) {
         auto const entry = log_store_->entry_at(i);
-        if (entry->get_val_type() == log_val_type::conf) {
+        if ( entry->get_val_type() == log_val_type::conf &&
+             !config_changing_ ) {
             p_in( "detect a configuration change "
                   "that is not committed yet at index %" PRIu64 "", i );
             config_changing_ = true;
-            break;
+        }
+        // Logs appended before restart will also be subtracted
+        // from `pending_bytes_` once they are committed.
+        if (entry->is_app_log()) {
+            pending_bytes_ += entry->get_buf().size();
         }
     }
 
@@ -249,12 +340,14 @@ raft_server::raft_server(context* ctx, const init_options& opt)
             << ": DC ID " << cur_srv->get_dc_id()
             << ", " << cur_srv->get_endpoint()
             << ", " << (cur_srv->is_learner() ? "learner" : "voting member")
+            << (cur_srv->is_witness() ? " (witness)" : "")
             << ", " << cur_srv->get_priority()
             << std::endl;
     }
 
     peer_info_msg << "my id: " << id_
                   << ", " << ((im_learner_) ? "learner" : "voting_member")
+                  << ((im_witness_) ? " (witness)" : "")
                   << std::endl;
     peer_info_msg << "num peers: " << peers_.size() << std::endl;
     p_in("%s", peer_info_msg.str().c_str());
@@ -332,7 +425,6 @@ raft_server::~raft_server() {
     cancel_schedulers();
     delete bg_append_ea_;
     delete ea_sm_commit_exec_in_progress_;
-    delete ea_follower_log_append_;
 }
 
 void raft_server::update_rand_timeout() {
@@ -349,6 +441,208 @@ void raft_server::update_rand_timeout() {
          params->election_timeout_upper_bound_);
 }
 
+int32 raft_server::get_election_timeout_ms() {
+    int32 timeout_ms = rand_timeout_();
+    ptr<raft_params> params = ctx_->get_params();
+    if (!params->adaptive_election_timeout_) return timeout_ms;
+
+    uint64_t adaptive_us =
+        hb_detector_->get_timeout_us(params->failure_detection_phi_threshold_);
+    if (!adaptive_us) {
+        // Not enough samples yet.
+        return timeout_ms;
+    }
+
+    // Randomize it in the same ratio as the static range,
+    // and make sure that at least one heartbeat is missed.
+    int32 lower = std::max(params->election_timeout_lower_bound_, 1);
+    double ratio = (double)timeout_ms / lower;
+    int32 adaptive_ms = (int32)(adaptive_us * ratio / 1000);
+    int32 min_ms = (int32)(hb_detector_->mean_us() * 2 / 1000);
+    adaptive_ms = std::max(adaptive_ms, std::max(min_ms, 1));
+    adaptive_ms = std::min(adaptive_ms, params->election_timeout_upper_bound_);
+    p_tr("adaptive election timeout %d ms (static %d ms), "
+         "heartbeat interval mean %.1f ms, stddev %.1f ms",
+         adaptive_ms, timeout_ms,
+         hb_detector_->mean_us() / 1000, hb_detector_->stddev_us() / 1000);
+    return adaptive_ms;
+}
+
+void raft_server::record_leader_hb(int32 leader_id) {
+    ptr<raft_params> params = ctx_->get_params();
+    int32 min_hb_ms = params->adaptive_heart_beat_min_interval_ > 0
+                      ? params->adaptive_heart_beat_min_interval_
+                      : params->heart_beat_interval_;
+    // Messages arriving in less than half of the minimum heartbeat
+    // interval are regular traffic, they don't reflect the heartbeat
+    // distribution.
+    hb_detector_->heartbeat( leader_id,
+                             monotonic_clock::now_ns() / 1000,
+                             (uint64_t)min_hb_ms * 1000 / 2 );
+}
+
+void raft_server::adapt_hb_interval(peer& p) {
+    ptr<raft_params> params = ctx_->get_params();
+    int32 min_interval = params->adaptive_heart_beat_min_interval_;
+    if (min_interval <= 0) return;
+
+    uint64_t rtt_us = p.get_rtt_us();
+    if (!rtt_us) return;
+
+    // Send heartbeats at a few times of RTT, within the given range.
+    const uint64_t HB_TO_RTT_RATIO = 4;
+    int32 new_interval = (int32)std::min<uint64_t>
+                         ( rtt_us * HB_TO_RTT_RATIO / 1000,
+                           params->heart_beat_interval_ );
+    new_interval = std::max(new_interval, min_interval);
+
+    // This is called on a successful response,
+    // so that the peer is not backing off now.
+    auto_lock(p.get_lock());
+    p.set_hb_interval(new_interval);
+    p.resume_hb_speed();
+}
+
+void raft_server::check_slow_follower(peer& p) {
+    ptr<raft_params> params = ctx_->get_params();
+    int32 ratio = params->slow_follower_rtt_ratio_;
+    if (ratio <= 0) {
+        // Disabled while it is quarantined.
+        if (p.is_quarantined()) set_quarantine(p, false, p.get_rtt_us());
+        return;
+    }
+    if (p.is_learner() || p.is_witness()) return;
+
+    uint64_t rtt_us = p.get_rtt_us();
+    if (!rtt_us) return;
+
+    // Compare with the median of the other followers keeping log
+    // payloads, as witnesses respond without appending logs.
+    std::vector<uint64_t> rtts;
+    for (auto& entry: peers_) {
+        ptr<peer>& pp = entry.second;
+        if (pp.get() == &p || !is_regular_member(pp) || pp->is_witness()) {
+            continue;
+        }
+        uint64_t pp_rtt_us = pp->get_rtt_us();
+        if (pp_rtt_us) rtts.push_back(pp_rtt_us);
+    }
+    if (rtts.empty()) return;
+    std::nth_element( rtts.begin(), rtts.begin() + rtts.size() / 2, rtts.end() );
+    uint64_t threshold_us = rtts[rtts.size() / 2] * ratio;
+
+    // To avoid flapping, a quarantined follower should get back
+    // below the half of the threshold.
+    bool quarantined = p.is_quarantined();
+    bool to_change = quarantined
+                     ? ( rtt_us * 2 <= threshold_us )
+                     : ( rtt_us > threshold_us );
+    if (!to_change) {
+        p.reset_quarantine_check_cnt();
+        return;
+    }
+    if (p.inc_quarantine_check_cnt() < params->slow_follower_detection_count_) {
+        return;
+    }
+    p_in( "peer %d rtt %" PRIu64 " us, threshold %" PRIu64 " us",
+          p.get_id(), rtt_us, threshold_us );
+    set_quarantine(p, !quarantined, rtt_us);
+}
+
+void raft_server::set_quarantine(peer& p, bool to, uint64_t rtt_us) {
+    p.set_quarantined(to);
+    p_wn( "peer %d is %s", p.get_id(),
+          to ? "quarantined as a slow follower" : "restored from quarantine" );
+
+    cb_func::Param param(id_, leader_, p.get_id(), &rtt_us);
+    CbReturnCode rc = ctx_->cb_func_.call
+                      ( to ? cb_func::FollowerQuarantined
+                           : cb_func::FollowerRestored,
+                        &param );
+    (void)rc;
+}
+
+void raft_server::probe_peer_rtts() {
+    for (auto& entry: peers_) {
+        ptr<peer> pp = entry.second;
+        if (!is_regular_member(pp)) continue;
+
+        // Sent through a separate connection, so that it does not
+        // delay append entries requests to the peer.
+        ptr<req_msg> req( cs_new<req_msg>
+                          ( state_->get_term(),
+                            msg_type::ping_request,
+                            id_,
+                            pp->get_id(),
+                            0, 0, 0 ) );
+        pp->send_ping(pp, req, *ctx_);
+    }
+}
+
+std::map<int32, uint64_t> raft_server::get_peer_rtts() {
+    std::map<int32, uint64_t> ret;
+    for (auto& entry: peers_) {
+        ptr<peer>& pp = entry.second;
+        if (!is_regular_member(pp)) continue;
+        uint64_t rtt_us = pp->get_ping_rtt_us();
+        if (rtt_us) ret[pp->get_id()] = rtt_us;
+    }
+    return ret;
+}
+
+void raft_server::check_leader_placement(peer& p,
+                                         const std::map<int32, uint64_t>* rtts)
+{
+    ptr<raft_params> params = ctx_->get_params();
+    if (params->leader_placement_interval_ms_ <= 0) return;
+
+    if (rtts) placement_->set_rtts(p.get_id(), *rtts);
+    if (rtt_probe_timer_.timeout_and_reset()) {
+        placement_->set_rtts(id_, get_peer_rtts());
+        probe_peer_rtts();
+    }
+
+    if (!placement_timer_.timeout_and_reset()) return;
+    if (!placement_hold_timer_.timeout()) return;
+    // Leadership transfer is already in progress.
+    if (write_paused_) return;
+
+    std::vector<int32> voters(1, id_);
+    std::vector<int32> candidates;
+    uint64_t max_resp_us =
+        (uint64_t)params->election_timeout_lower_bound_ * 1000;
+    for (auto& entry: peers_) {
+        ptr<peer>& pp = entry.second;
+        if (!is_regular_member(pp)) continue;
+        voters.push_back(pp->get_id());
+
+        // Zero-priority members and witnesses cannot be a leader, and
+        // the member not responding recently will not win the election soon.
+        if (pp->get_config().get_priority() <= 0) continue;
+        if (pp->is_witness()) continue;
+        if (pp->get_resp_timer_us() > max_resp_us) continue;
+        candidates.push_back(pp->get_id());
+    }
+
+    size_t quorum = get_quorum_for_commit();
+    uint64_t my_latency_us =
+        placement_->estimate_commit_latency_us(id_, voters, quorum);
+    int32 target = placement_->evaluate( id_, candidates, voters, quorum,
+                                         params->leader_placement_min_gain_pct_,
+                                         LEADER_PLACEMENT_MIN_GAIN_US,
+                                         LEADER_PLACEMENT_REQUIRED_WINS );
+    if (target < 0) return;
+
+    p_in("[LEADER PLACEMENT] estimated commit latency %" PRIu64 " us, "
+         "%" PRIu64 " us if server %d is the leader, yield leadership",
+         my_latency_us,
+         placement_->estimate_commit_latency_us(target, voters, quorum),
+         target);
+    // Do not try again for a while, even if the transfer fails.
+    placement_hold_timer_.reset();
+    yield_leadership(false, target);
+}
+
 void raft_server::update_params(const raft_params& new_params) {
     recur_lock(lock_);
 
@@ -400,7 +694,20 @@ void raft_server::apply_and_log_current_params() {
           "leadership transfer wait time %d, "
           "grace period of lagging state machine %d, "
           "snapshot IO: %s, "
-          "parallel log appending: %s",
+          "parallel log appending: %s, "
+          "memory-only durability: %s, checkpoint interval %d, "
+          "snapshot save queue %d, "
+          "async pre-commit: %s, "
+          "admission limits: uncommitted %d, unapplied %d, "
+          "pending bytes %" PRId64 ", wait %d ms, "
+          "auto forwarding max batch %d, packed commands %d (up to %d bytes), "
+          "adaptive election timeout %s (phi %.1f), "
+          "adaptive heartbeat min interval %d, "
+          "leader placement interval %d (min gain %d%%), "
+          "leadership handoff %s, "
+          "hibernation timeout %d, "
+          "min zones for commit %d, election %d, "
+          "slow follower rtt ratio %d (%d responses)",
           params->election_timeout_lower_bound_,
           params->election_timeout_upper_bound_,
           params->heart_beat_interval_,
@@ -421,10 +728,42 @@ void raft_server::apply_and_log_current_params() {
           params->leadership_transfer_min_wait_time_,
           params->grace_period_of_lagging_state_machine_,
           params->use_bg_thread_for_snapshot_io_ ? "ASYNC" : "BLOCKING",
-          params->parallel_log_appending_ ? "ON" : "OFF" );
+          params->parallel_log_appending_ ? "ON" : "OFF",
+          params->memory_only_durability_ ? "ON" : "OFF",
+          params->checkpoint_interval_ms_,
+          params->snapshot_save_queue_size_,
+          params->async_pre_commit_ ? "ON" : "OFF",
+          params->max_uncommitted_logs_,
+          params->max_unapplied_logs_,
+          params->max_pending_bytes_,
+          params->admission_wait_ms_,
+          params->auto_forwarding_max_batch_size_,
+          params->max_packed_cmds_,
+          params->max_packed_cmd_size_,
+          params->adaptive_election_timeout_ ? "ON" : "OFF",
+          params->failure_detection_phi_threshold_,
+          params->adaptive_heart_beat_min_interval_,
+          params->leader_placement_interval_ms_,
+          params->leader_placement_min_gain_pct_,
+          params->leadership_handoff_ ? "ON" : "OFF",
+          params->hibernation_timeout_ms_,
+          params->min_commit_zones_,
+          params->min_election_zones_,
+          params->slow_follower_rtt_ratio_,
+          params->slow_follower_detection_count_ );
 
     status_check_timer_.set_duration_ms(params->heart_beat_interval_);
     status_check_timer_.reset();
+    features_report_timer_.set_duration_ms
+        ( params->election_timeout_upper_bound_ );
+
+    if (params->leader_placement_interval_ms_ > 0) {
+        rtt_probe_timer_.set_duration_ms(params->leader_placement_interval_ms_);
+        placement_timer_.set_duration_ms(params->leader_placement_interval_ms_);
+        placement_hold_timer_.set_duration_ms
+            ( params->leader_placement_interval_ms_ *
+              LEADER_PLACEMENT_HOLD_INTERVALS );
+    }
 
     leadership_transfer_timer_.set_duration_ms
         (params->leadership_transfer_min_wait_time_);
@@ -438,7 +777,10 @@ void raft_server::stop_server() {
     stopping_ = true;
 
     // Cancel all awaiting client requests.
+    handoff_in_progress_ = false;
+    flush_handoff_reqs();
     drop_all_pending_commit_elems();
+    drop_deferred_append_resps();
 }
 
 void raft_server::cancel_global_requests() {
@@ -470,6 +812,14 @@ void raft_server::shutdown() {
 
     p_in("sent stop signal to the commit thread.");
 
+    notify_admission_waiters();
+
+    // Stop pre-commit pipeline first, as the commit thread
+    // may be waiting for it.
+    if (pre_commit_pipeline_) {
+        pre_commit_pipeline_->shutdown();
+    }
+
     // Cancel all scheduler tasks.
     // TODO: how do we guarantee all tasks are done?
     cancel_schedulers();
@@ -486,7 +836,13 @@ void raft_server::shutdown() {
 
     p_in("commit thread stopped.");
 
+    // Stop background snapshot writer if exists.
+    if (snp_obj_writer_) {
+        snp_obj_writer_->shutdown();
+    }
+
     drop_all_pending_commit_elems();
+    drop_deferred_append_resps();
 
     p_in("all pending commit elements dropped.");
 
@@ -538,6 +894,11 @@ void raft_server::shutdown() {
     p_in("raft_server shutdown completed.");
 }
 
+bool raft_server::is_membership_changing() {
+    recur_lock(lock_);
+    return config_changing_ || srv_to_join_ || srv_to_leave_;
+}
+
 bool raft_server::is_regular_member(const ptr<peer>& p) {
     // Skip to-be-removed server.
     if (srv_to_leave_ && srv_to_leave_->get_id() == p->get_id()) return false;
@@ -574,6 +935,26 @@ int32 raft_server::get_quorum_for_election() {
     return params->custom_election_quorum_size_ - 1;
 }
 
+bool raft_server::check_election_zones() {
+    int32 min_zones = ctx_->get_params()->min_election_zones_;
+    if (min_zones <= 1) return true;
+
+    // Cannot require more zones than the voting members span.
+    std::unordered_set<int32> zones;
+    if (!im_learner_) zones.insert( get_dc_id(id_) );
+    for (auto& entry: peers_) {
+        ptr<peer>& p = entry.second;
+        if (!is_regular_member(p)) continue;
+        zones.insert( p->get_config().get_dc_id() );
+    }
+    size_t num_required = std::min( (size_t)min_zones, zones.size() );
+    if (votes_granted_dcs_.size() >= num_required) return true;
+
+    p_in("got votes from %zu zones, %zu zones are required",
+         votes_granted_dcs_.size(), num_required);
+    return false;
+}
+
 int32 raft_server::get_quorum_for_commit() {
     ptr<raft_params> params = ctx_->get_params();
     int32 num_voting_members = get_num_voting_members();
@@ -631,6 +1012,27 @@ size_t raft_server::get_not_responding_peers() {
     return num_not_resp_nodes;
 }
 
+size_t raft_server::get_num_quarantined_peers() {
+    size_t num_quarantined = 0;
+
+    ptr<raft_params> params = ctx_->get_params();
+    int expiry = params->heart_beat_interval_ *
+                     raft_server::raft_limits_.response_limit_;
+
+    for (auto& entry: peers_) {
+        ptr<peer> p = entry.second;
+
+        if (!is_regular_member(p) || !p->is_quarantined()) continue;
+
+        // Already counted by `get_not_responding_peers()`.
+        int32 resp_elapsed_ms = (int32)(p->get_resp_timer_us() / 1000);
+        if ( resp_elapsed_ms > expiry ) continue;
+
+        num_quarantined++;
+    }
+    return num_quarantined;
+}
+
 size_t raft_server::get_num_stale_peers() {
     // Check the number of peers lagging more than `stale_log_gap_`.
     if (leader_ != id_) return 0;
@@ -648,12 +1050,14 @@ size_t raft_server::get_num_stale_peers() {
 
 ptr<resp_msg> raft_server::process_req(req_msg& req,
                                        const req_ext_params& ext_params) {
-    cb_func::Param param(id_, leader_);
-    param.ctx = &req;
-    CbReturnCode rc = ctx_->cb_func_.call(cb_func::ProcessReq, &param);
-    if (rc == CbReturnCode::ReturnNull) {
-        p_wn("by callback, return null");
-        return nullptr;
+    if (ctx_->cb_func_.is_subscribed(cb_func::ProcessReq)) {
+        cb_func::Param param(id_, leader_);
+        param.ctx = &req;
+        CbReturnCode rc = ctx_->cb_func_.call(cb_func::ProcessReq, &param);
+        if (rc == CbReturnCode::ReturnNull) {
+            p_wn("by callback, return null");
+            return nullptr;
+        }
     }
 
     p_db( "Receive a %s message from %d with LastLogIndex=%" PRIu64 ", "
@@ -672,11 +1076,26 @@ ptr<resp_msg> raft_server::process_req(req_msg& req,
         return nullptr;
     }
 
+    if ( hibernating_ &&
+         req.get_type() != msg_type::ping_request ) {
+        wake_up();
+    }
+
     if ( req.get_type() == msg_type::client_request ) {
         // Client request doesn't need to go through below process.
         return handle_cli_req_prelock(req, ext_params);
     }
 
+    if ( req.get_type() == msg_type::ping_request ) {
+        // Ping is used for measuring RTT,
+        // respond without waiting for the lock.
+        p_db("got ping from %d", req.get_src());
+        return cs_new<resp_msg>( state_->get_term(),
+                                 msg_type::ping_response,
+                                 id_,
+                                 req.get_src() );
+    }
+
     recur_lock(lock_);
     if ( req.get_type() == msg_type::append_entries_request ||
          req.get_type() == msg_type::request_vote_request ||
@@ -704,12 +1123,12 @@ ptr<resp_msg> raft_server::process_req(req_msg& req,
 
     ptr<resp_msg> resp;
     if (req.get_type() == msg_type::append_entries_request) {
-        {
+        if (ctx_->cb_func_.is_subscribed(cb_func::ReceivedAppendEntriesReq)) {
             cb_func::Param param(id_, leader_, req.get_src(), &req);
             ctx_->cb_func_.call(cb_func::ReceivedAppendEntriesReq, &param);
         }
         resp = handle_append_entries(req);
-        {
+        if (ctx_->cb_func_.is_subscribed(cb_func::SentAppendEntriesResp)) {
             cb_func::Param param(id_, leader_, req.get_src(), resp.get());
             ctx_->cb_func_.call(cb_func::SentAppendEntriesResp, &param);
         }
@@ -720,13 +1139,6 @@ ptr<resp_msg> raft_server::process_req(req_msg& req,
     } else if (req.get_type() == msg_type::pre_vote_request) {
         resp = handle_prevote_req(req);
 
-    } else if (req.get_type() == msg_type::ping_request) {
-        p_in("got ping from %d", req.get_src());
-        resp = cs_new<resp_msg>( state_->get_term(),
-                                 msg_type::ping_response,
-                                 id_,
-                                 req.get_src() );
-
     } else if (req.get_type() == msg_type::priority_change_request) {
         resp = handle_priority_change_req(req);
 
@@ -864,7 +1276,7 @@ void raft_server::handle_peer_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err)
         break;
 
     case msg_type::append_entries_response:
-        {
+        if (ctx_->cb_func_.is_subscribed(cb_func::ReceivedAppendEntriesResp)) {
             cb_func::Param param(id_, leader_, resp->get_src(), resp.get());
             ctx_->cb_func_.call(cb_func::ReceivedAppendEntriesResp, &param);
         }
@@ -880,7 +1292,7 @@ void raft_server::handle_peer_resp(ptr<resp_msg>& resp, ptr<rpc_exception>& err)
         break;
 
     case msg_type::ping_response:
-        p_in("got ping response from %d", resp->get_src());
+        p_db("got ping response from %d", resp->get_src());
         break;
 
     case msg_type::custom_notification_response:
@@ -988,6 +1400,10 @@ bool raft_server::reconnect_client(peer& p) {
 
 void raft_server::become_leader() {
     stop_election_timer();
+    hibernating_ = false;
+    hb_detector_->reset();
+    placement_->reset();
+    placement_hold_timer_.reset();
 
     {   auto_lock(commit_ret_elems_lock_);
         p_in("number of pending commit elements: %zu",
@@ -1018,6 +1434,7 @@ void raft_server::become_leader() {
             // reconnect_client(*pp);
 
             pp->set_next_log_idx(log_store_->next_slot());
+            pp->set_quarantined(false);
             enable_hb_for_peer(*pp);
         }
 
@@ -1066,6 +1483,7 @@ void raft_server::become_leader() {
     data_fresh_ = true;
 
     request_append_entries();
+    check_handoff();
 
     if (my_priority_ == 0 && get_num_voting_members() > 1) {
         // If this member's priority is zero, this node owns a temporary
@@ -1143,7 +1561,7 @@ void raft_server::check_leadership_transfer() {
         ptr<peer> peer_elem = entry.second;
         const srv_config& s_conf = peer_elem->get_config();
         int32 cur_priority = s_conf.get_priority();
-        if (cur_priority > max_priority) {
+        if (cur_priority > max_priority && !s_conf.is_witness()) {
             max_priority = cur_priority;
             successor_id = s_conf.get_id();
         }
@@ -1233,7 +1651,7 @@ void raft_server::yield_leadership(bool immediate_yield,
     if (successor_id >= 0) {
         // If successor is given, find that one.
         auto entry = peers_.find(successor_id);
-        if (entry != peers_.end()) {
+        if (entry != peers_.end() && !entry->second->is_witness()) {
             int32 srv_id = entry->first;
             ptr<peer>& pp = entry->second;
             max_priority = pp->get_config().get_priority();
@@ -1252,6 +1670,8 @@ void raft_server::yield_leadership(bool immediate_yield,
             uint64_t pp_last_resp_ms = pp->get_resp_timer_us() / 1000;
 
             if ( srv_id != id_ &&
+                 !pp->is_witness() &&
+                 !pp->is_quarantined() &&
                  pp_last_resp_ms <= hb_interval_ms &&
                  pp->get_config().get_priority() > max_priority ) {
                 max_priority = pp->get_config().get_priority();
@@ -1293,6 +1713,20 @@ void raft_server::yield_leadership(bool immediate_yield,
     reelection_timer_.set_duration_ms
                       ( ctx_->get_params()->election_timeout_upper_bound_ );
     reelection_timer_.reset();
+
+    if (ctx_->get_params()->leadership_handoff_) {
+        handoff_in_progress_ = true;
+        handoff_timer_.set_duration_ms
+                       ( ctx_->get_params()->election_timeout_upper_bound_ * 2 );
+        handoff_timer_.reset();
+
+        // Send logs to the successor now, instead of waiting for
+        // the next heartbeat, so that it catches up sooner.
+        auto entry = peers_.find(candidate_id);
+        if (entry != peers_.end()) {
+            request_append_entries(entry->second);
+        }
+    }
 }
 
 bool raft_server::request_leadership() {
@@ -1305,6 +1739,10 @@ bool raft_server::request_leadership() {
         p_er("cannot request leadership: cannot find leader");
         return false;
     }
+    if (im_witness_) {
+        p_er("cannot request leadership: this server is a witness");
+        return false;
+    }
 
     recur_lock(lock_);
     auto entry = peers_.find(leader_);
@@ -1342,6 +1780,9 @@ bool raft_server::request_leadership() {
 void raft_server::become_follower() {
     // stop hb for all peers
     p_in("[BECOME FOLLOWER] term %" PRIu64 "", state_->get_term());
+    hibernating_ = false;
+    // Responses to the previous leader should not be sent.
+    reject_deferred_append_resps(0);
     {   std::lock_guard<std::mutex> ll(cli_lock_);
         for (peer_itor it = peers_.begin(); it != peers_.end(); ++it) {
             it->second->enable_hb(false);
@@ -1375,8 +1816,11 @@ void raft_server::become_follower() {
             ctx_->set_params(clone);
         }
 
-        // Drain all pending callback functions.
-        drop_all_pending_commit_elems();
+        // Drain all pending callback functions, unless they are
+        // being handed off to the new leader.
+        if (!handoff_in_progress_) {
+            drop_all_pending_commit_elems();
+        }
     }
 
     restart_election_timer();
@@ -1408,6 +1852,7 @@ bool raft_server::update_term(ulong term) {
         election_completed_ = false;
         votes_granted_ = 0;
         votes_responded_ = 0;
+        votes_granted_dcs_.clear();
         ctx_->state_mgr_->save_state(*state_);
         become_follower();
         return true;
@@ -1568,9 +2013,13 @@ ulong raft_server::term_for_log(ulong log_idx) {
         return log_store_->term_at(log_idx);
     }
 
-    ptr<snapshot> last_snapshot(state_machine_->last_snapshot());
+    // Witness's state machine does not have snapshots,
+    // but it keeps the metadata of the last snapshot.
+    ptr<snapshot> last_snapshot( im_witness_
+                                 ? get_last_snapshot()
+                                 : state_machine_->last_snapshot() );
     if ( !last_snapshot || log_idx != last_snapshot->get_last_log_idx() ) {
-        static timer_helper bad_log_timer(1000000, true);
+        static timer_helper bad_log_timer(1000000, true, true);
         int log_lv = bad_log_timer.timeout_and_reset() ? L_ERROR : L_TRACE;
 
         p_lv(log_lv, "bad log_idx %" PRIu64 " for retrieving the term value, "
@@ -1655,6 +2104,24 @@ raft_server::peer_info raft_server::get_peer_info(int32 srv_id) const {
     ret.id_ = pp->get_id();
     ret.last_log_idx_ = pp->get_last_accepted_log_idx();
     ret.last_succ_resp_us_ = pp->get_resp_timer_us();
+    ret.rtt_us_ = pp->get_rtt_us();
+    ret.hb_interval_ms_ = pp->get_current_hb_interval();
+    ret.quarantined_ = pp->is_quarantined();
+    return ret;
+}
+
+raft_server::pending_log_info raft_server::get_pending_log_info() const {
+    pending_log_info ret;
+    ulong last_log_idx = log_store_->next_slot() - 1;
+    ulong quick_commit_idx = quick_commit_index_;
+    ulong sm_commit_idx = sm_commit_index_;
+    if (last_log_idx > quick_commit_idx) {
+        ret.num_uncommitted_logs_ = last_log_idx - quick_commit_idx;
+    }
+    if (quick_commit_idx > sm_commit_idx) {
+        ret.num_unapplied_logs_ = quick_commit_idx - sm_commit_idx;
+    }
+    ret.pending_bytes_ = std::max((int64)0, pending_bytes_.load());
     return ret;
 }
 
@@ -1669,6 +2136,9 @@ std::vector<raft_server::peer_info> raft_server::get_peer_info_all() const {
         pi.id_ = pp->get_id();
         pi.last_log_idx_ = pp->get_last_accepted_log_idx();
         pi.last_succ_resp_us_ = pp->get_resp_timer_us();
+        pi.rtt_us_ = pp->get_rtt_us();
+        pi.hb_interval_ms_ = pp->get_current_hb_interval();
+        pi.quarantined_ = pp->is_quarantined();
         ret.push_back(pi);
     }
     return ret;
@@ -1697,6 +2167,12 @@ void raft_server::set_last_snapshot(const ptr<snapshot>& new_snapshot) {
     last_snapshot_ = new_snapshot;
 }
 
+ptr<snapshot> raft_server::get_ingest_snapshot() const {
+    std::lock_guard<std::mutex> l(last_snapshot_lock_);
+    ptr<snapshot> ret = ingest_snp_;
+    return ret;
+}
+
 ulong raft_server::store_log_entry(ptr<log_entry>& entry, ulong index) {
     ulong log_index = index;
     if (index == 0) {
@@ -1704,12 +2180,18 @@ ulong raft_server::store_log_entry(ptr<log_entry>& entry, ulong index) {
     } else {
         log_store_->write_at(log_index, entry);
     }
+    if (entry->is_app_log()) {
+        pending_bytes_ += entry->get_buf().size();
+    }
 
     if ( entry->get_val_type() == log_val_type::conf ) {
         // Force persistence of config_change logs to guarantee the durability of
         // cluster membership change log entries.  Losing cluster membership log
         // entries may lead to split brain.
-        if ( !log_store_->flush() ) {
+        // With memory-only durability, the committed config is persisted
+        // through `state_mgr::save_config` only.
+        if ( !ctx_->get_params()->memory_only_durability_ &&
+             !log_store_->flush() ) {
             // LCOV_EXCL_START
             p_ft("log store flush failed");
             ctx_->state_mgr_->system_exit(N21_log_flush_failed);
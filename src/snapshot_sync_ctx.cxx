@@ -21,6 +21,7 @@ limitations under the License.
 #include "peer.hxx"
 #include "raft_server.hxx"
 #include "state_machine.hxx"
+#include "snapshot.hxx"
 #include "tracer.hxx"
 
 namespace nuraft {
@@ -273,5 +274,161 @@ void snapshot_io_mgr::async_io_loop() {
     } while (!terminating_);
 }
 
+struct snapshot_obj_writer::write_elem {
+    write_elem(const ptr<snapshot>& s,
+               ulong obj_id,
+               const ptr<buffer>& data,
+               bool is_first_obj,
+               bool is_last_obj,
+               uint64_t generation)
+        : snapshot_(s)
+        , obj_id_(obj_id)
+        , data_(data)
+        , is_first_obj_(is_first_obj)
+        , is_last_obj_(is_last_obj)
+        , generation_(generation)
+        {}
+    ptr<snapshot> snapshot_;
+    ulong obj_id_;
+    ptr<buffer> data_;
+    bool is_first_obj_;
+    bool is_last_obj_;
+    uint64_t generation_;
+};
+
+snapshot_obj_writer::snapshot_obj_writer(const ptr<state_machine>& sm,
+                                         const ptr<logger>& l)
+    : sm_(sm)
+    , l_(l)
+    , writing_(false)
+    , failed_(false)
+    , generation_(0)
+    , terminating_(false)
+{
+    writer_thread_ = std::thread(&snapshot_obj_writer::writer_loop, this);
+}
+
+snapshot_obj_writer::~snapshot_obj_writer() {
+    shutdown();
+}
+
+bool snapshot_obj_writer::push(const ptr<snapshot>& s,
+                               ulong obj_id,
+                               const ptr<buffer>& data,
+                               bool is_first_obj,
+                               bool is_last_obj,
+                               size_t max_queue_size,
+                               uint64_t generation)
+{
+    std::unique_lock<std::mutex> l(lock_);
+    // Back-pressure: wait until there is an empty slot.
+    waiter_cv_.wait( l, [&]() {
+        return terminating_ || failed_ || generation_ != generation ||
+               queue_.size() < max_queue_size;
+    } );
+    // If `reset()` was called in the meantime, this object belongs to
+    // the previous attempt and should not be mixed with the new one.
+    if (terminating_ || failed_ || generation_ != generation) return false;
+
+    queue_.push_back( cs_new<write_elem>( s, obj_id, data,
+                                          is_first_obj, is_last_obj,
+                                          generation_ ) );
+    writer_cv_.notify_one();
+    return true;
+}
+
+bool snapshot_obj_writer::wait_for_all(uint64_t generation) {
+    std::unique_lock<std::mutex> l(lock_);
+    waiter_cv_.wait( l, [&]() {
+        return terminating_ || failed_ || generation_ != generation ||
+               (queue_.empty() && !writing_);
+    } );
+    return !terminating_ && !failed_ && generation_ == generation;
+}
+
+uint64_t snapshot_obj_writer::get_generation() {
+    std::lock_guard<std::mutex> l(lock_);
+    return generation_;
+}
+
+bool snapshot_obj_writer::has_failed() {
+    std::lock_guard<std::mutex> l(lock_);
+    return failed_;
+}
+
+void snapshot_obj_writer::reset() {
+    std::lock_guard<std::mutex> l(lock_);
+    queue_.clear();
+    failed_ = false;
+    generation_++;
+    waiter_cv_.notify_all();
+}
+
+void snapshot_obj_writer::shutdown() {
+    {   std::lock_guard<std::mutex> l(lock_);
+        terminating_ = true;
+        writer_cv_.notify_all();
+        waiter_cv_.notify_all();
+    }
+    if (writer_thread_.joinable()) {
+        writer_thread_.join();
+    }
+}
+
+void snapshot_obj_writer::writer_loop() {
+    std::string thread_name = "nuraft_snp_wr";
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+#elif __APPLE__
+    pthread_setname_np(thread_name.c_str());
+#endif
+
+    std::unique_lock<std::mutex> l(lock_);
+    while (!terminating_) {
+        writer_cv_.wait( l, [&]() {
+            return terminating_ || !queue_.empty();
+        } );
+        if (terminating_) break;
+
+        ptr<write_elem> elem = queue_.front();
+        queue_.pop_front();
+        writing_ = true;
+        // Objects can be received in the meantime.
+        waiter_cv_.notify_all();
+        l.unlock();
+
+        bool ok = true;
+        ulong next_obj_id = elem->obj_id_;
+        try {
+            elem->data_->pos(0);
+            sm_->save_logical_snp_obj( *elem->snapshot_,
+                                       next_obj_id,
+                                       *elem->data_,
+                                       elem->is_first_obj_,
+                                       elem->is_last_obj_ );
+            if (!elem->is_last_obj_ && next_obj_id != elem->obj_id_ + 1) {
+                // Receiver already acknowledged `obj_id + 1` to the leader.
+                p_er("state machine requested object %" PRIu64 " after %" PRIu64
+                     ", but pipelined snapshot requires sequential object IDs",
+                     next_obj_id, elem->obj_id_);
+                ok = false;
+            }
+        } catch (std::exception& e) {
+            p_er("failed to save snapshot (idx %" PRIu64 ") object %" PRIu64
+                 ": %s",
+                 elem->snapshot_->get_last_log_idx(), elem->obj_id_, e.what());
+            ok = false;
+        }
+
+        l.lock();
+        writing_ = false;
+        if (!ok && elem->generation_ == generation_) {
+            failed_ = true;
+            queue_.clear();
+        }
+        waiter_cv_.notify_all();
+    }
+}
+
 }
 
@@ -22,6 +22,9 @@ limitations under the License.
 
 namespace nuraft {
 
+static const byte LEARNER_FLAG = 0x1;
+static const byte WITNESS_FLAG = 0x2;
+
 ptr<srv_config> srv_config::deserialize(buffer& buf) {
     buffer_serializer bs(buf);
     return deserialize(bs);
@@ -34,9 +37,12 @@ ptr<srv_config> srv_config::deserialize(buffer_serializer& bs) {
     const char* aux_char = bs.get_cstr();
     std::string endpoint( (endpoint_char) ? endpoint_char : std::string() );
     std::string aux( (aux_char) ? aux_char : std::string() );
-    byte is_learner = bs.get_u8();
+    byte flags = bs.get_u8();
     int32 priority = bs.get_i32();
-    return cs_new<srv_config>(id, dc_id, endpoint, aux, is_learner, priority);
+    return cs_new<srv_config>( id, dc_id, endpoint, aux,
+                               (flags & LEARNER_FLAG) != 0,
+                               priority,
+                               (flags & WITNESS_FLAG) != 0 );
 }
 
 ptr<buffer> srv_config::serialize() const{
@@ -52,7 +58,13 @@ ptr<buffer> srv_config::serialize() const{
     buf->put(dc_id_);
     buf->put(endpoint_);
     buf->put(aux_);
-    buf->put((byte)(learner_?(1):(0)));
+    // Older versions read this byte as a boolean learner flag, so that
+    // they decode a witness as a learner. The leader does not add
+    // a witness until all members report that they support it.
+    byte flags = 0;
+    if (learner_) flags |= LEARNER_FLAG;
+    if (witness_) flags |= WITNESS_FLAG;
+    buf->put(flags);
     buf->put(priority_);
     buf->pos(0);
     return buf;
@@ -147,6 +147,54 @@ int make_group_test() {
     return 0;
 }
 
+int large_message_test() {
+    reset_log_files();
+
+    std::string s1_addr = "localhost:20010";
+    std::string s2_addr = "localhost:20020";
+    std::string s3_addr = "localhost:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    // Mix of small messages and messages bigger than
+    // the receive buffer of the session.
+    const size_t NUM = 20;
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        size_t msg_size = (ii % 5 == 4) ? 200 * 1024 + ii : 16 + ii;
+        ptr<buffer> msg = buffer::alloc(msg_size);
+        memset(msg->data_begin(), 'a' + (ii % 26), msg_size);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+    }
+
+    TestSuite::sleep_sec(1, "replication");
+
+    uint64_t last_idx = s1.raftServer->get_last_log_idx();
+    for (RaftAsioPkg* pp: {&s2, &s3}) {
+        CHK_EQ( last_idx, pp->raftServer->get_last_log_idx() );
+        CHK_EQ( last_idx, pp->raftServer->get_committed_log_idx() );
+        CHK_OK( pp->getTestSm()->isSame( *s1.getTestSm() ) );
+    }
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
 int leader_election_test(bool crc_on_entire_message) {
     reset_log_files();
 
@@ -1268,6 +1316,67 @@ int global_mgr_heavy_test() {
     return 0;
 }
 
+int global_mgr_leader_balancing_test() {
+    reset_log_files();
+
+    const size_t NUM_GROUPS = 3;
+    const size_t NUM_MEMBERS = 3;
+
+    // The i-th member of each group is on the i-th host.
+    nuraft_global_config g_config;
+    g_config.host_resolver_ = [NUM_MEMBERS](const srv_config& s) -> std::string {
+        return "host" + std::to_string( (s.get_id() - 1) % NUM_MEMBERS );
+    };
+    nuraft_global_mgr* mgr = nuraft_global_mgr::init(g_config);
+
+    std::vector< std::vector<RaftAsioPkg*> > groups(NUM_GROUPS);
+    for (size_t gg = 0; gg < NUM_GROUPS; ++gg) {
+        for (size_t ii = 0; ii < NUM_MEMBERS; ++ii) {
+            int srv_id = gg * NUM_MEMBERS + ii + 1;
+            std::string addr = "127.0.0.1:" + std::to_string(20000 + srv_id * 10);
+            groups[gg].push_back( new RaftAsioPkg(srv_id, addr) );
+        }
+        CHK_Z( launch_servers(groups[gg], false, true) );
+        CHK_Z( make_group(groups[gg]) );
+    }
+    TestSuite::sleep_sec(1, "wait for Raft groups ready");
+
+    // All groups are led by host0.
+    std::map<std::string, size_t> counts = mgr->get_leader_counts();
+    CHK_EQ(NUM_GROUPS, counts["host0"]);
+    CHK_EQ(0, counts["host1"]);
+    CHK_EQ(0, counts["host2"]);
+
+    TestSuite::Timer timer(10 * 1000);
+    while (!timer.timeout()) {
+        mgr->balance_leaders();
+        TestSuite::sleep_ms(1000);
+        counts = mgr->get_leader_counts();
+        if ( counts["host0"] == 1 &&
+             counts["host1"] == 1 &&
+             counts["host2"] == 1 ) break;
+    }
+    CHK_EQ(1, counts["host0"]);
+    CHK_EQ(1, counts["host1"]);
+    CHK_EQ(1, counts["host2"]);
+    CHK_EQ(NUM_GROUPS - 1, mgr->get_num_leader_moves());
+
+    // Already balanced, nothing to move.
+    CHK_Z( mgr->balance_leaders() );
+
+    for (auto& group: groups) {
+        for (RaftAsioPkg* pkg: group) pkg->raftServer->shutdown();
+    }
+    TestSuite::sleep_sec(1, "shutting down");
+    for (auto& group: groups) {
+        for (RaftAsioPkg* pkg: group) delete pkg;
+    }
+
+    SimpleLogger::shutdown();
+    nuraft_global_mgr::shutdown();
+    return 0;
+}
+
 int leadership_transfer_test() {
     reset_log_files();
 
@@ -1369,6 +1478,77 @@ int leadership_transfer_test() {
     return 0;
 }
 
+int hibernation_test() {
+    reset_log_files();
+
+    std::string s1_addr = "127.0.0.1:20010";
+    std::string s2_addr = "127.0.0.1:20020";
+    std::string s3_addr = "127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers(pkgs, false) );
+    CHK_Z( make_group(pkgs) );
+
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.auto_forwarding_ = true;
+        param.hibernation_timeout_ms_ = 500;
+        pp->raftServer->update_params(param);
+    }
+
+    auto wait_for_hibernation = [&]() -> bool {
+        TestSuite::Timer timer(5 * 1000);
+        while (!timer.timeout()) {
+            bool all_hibernating = true;
+            for (auto& entry: pkgs) {
+                if (!entry->raftServer->is_hibernating()) all_hibernating = false;
+            }
+            if (all_hibernating) return true;
+            TestSuite::sleep_ms(100);
+        }
+        return false;
+    };
+
+    for (size_t ii = 0; ii < 2; ++ii) {
+        CHK_TRUE( wait_for_hibernation() );
+
+        // Leader should not be changed during hibernation.
+        TestSuite::sleep_sec(1, "hibernating");
+        CHK_TRUE( s1.raftServer->is_leader() );
+
+        // Request to the leader first, and then to a follower,
+        // over the released connections.
+        RaftAsioPkg* pp = (ii == 0) ? &s1 : &s3;
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            pp->raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+        CHK_EQ( cmd_result_code::OK, ret->get_result_code() );
+
+        TestSuite::sleep_ms(500, "replication");
+        ulong committed_idx = s1.raftServer->get_committed_log_idx();
+        CHK_EQ( committed_idx, s2.raftServer->get_committed_log_idx() );
+        CHK_EQ( committed_idx, s3.raftServer->get_committed_log_idx() );
+        CHK_EQ( 1, s2.raftServer->get_leader() );
+        CHK_EQ( 1, s3.raftServer->get_leader() );
+    }
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
 int auto_forwarding_timeout_test() {
     std::string s1_addr = "127.0.0.1:20010";
     std::string s2_addr = "127.0.0.1:20020";
@@ -1548,6 +1728,199 @@ int auto_forwarding_test(bool async) {
     return 0;
 }
 
+int auto_forwarding_single_worker_test() {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+
+    // Only one thread serves both forwarded requests and
+    // replication on the leader.
+    s1.threadPoolSize = 1;
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    // Leader is in blocking mode.
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.auto_forwarding_ = true;
+        param.auto_forwarding_max_connections_ = 4;
+        param.return_method_ = raft_params::blocking;
+        pp->raftServer->update_params(param);
+    }
+
+    // Append messages in parallel into S2 (follower).
+    struct MsgArgs : TestSuite::ThreadArgs {
+        size_t ii;
+    };
+
+    std::mutex handlers_lock;
+    std::list< ptr< cmd_result< ptr<buffer> > > > handlers;
+    auto send_msg = [&](TestSuite::ThreadArgs* t_args) -> int {
+        MsgArgs* args = (MsgArgs*)t_args;
+        std::string test_msg = "test" + std::to_string(args->ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s2.raftServer->append_entries( {msg} );
+
+        std::lock_guard<std::mutex> l(handlers_lock);
+        handlers.push_back(ret);
+        return 0;
+    };
+
+    const size_t NUM_PARALLEL_MSGS = 8;
+    TestSuite::Timer timer;
+    std::vector<TestSuite::ThreadHolder> th(NUM_PARALLEL_MSGS);
+    std::vector<MsgArgs> m_args(NUM_PARALLEL_MSGS);
+    for (size_t ii = 0; ii < NUM_PARALLEL_MSGS; ++ii) {
+        m_args[ii].ii = ii;
+        th[ii].spawn(&m_args[ii], send_msg, nullptr);
+    }
+    for (size_t ii = 0; ii < NUM_PARALLEL_MSGS; ++ii) {
+        th[ii].join();
+        CHK_Z(th[ii].getResult());
+    }
+
+    // The leader's thread should not be blocked by forwarded requests,
+    // so that they are committed way before the client request timeout.
+    CHK_SM( timer.getTimeMs(),
+            (uint64_t)s1.raftServer->get_current_params().client_req_timeout_ );
+
+    // All handlers should have the result.
+    {
+        std::lock_guard<std::mutex> l(handlers_lock);
+        for (auto& handler: handlers) {
+            CHK_TRUE( handler->get_accepted() );
+            CHK_EQ( cmd_result_code::OK, handler->get_result_code() );
+            CHK_NONNULL( handler->get() );
+        }
+    }
+
+    // All messages should have been committed in the state machine.
+    for (size_t ii = 0; ii < NUM_PARALLEL_MSGS; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        CHK_GT(s1.getTestSm()->isCommitted(test_msg), 0);
+    }
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
+int auto_forwarding_batch_test(bool async) {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    // Single connection, so that concurrent requests are batched.
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.auto_forwarding_ = true;
+        param.auto_forwarding_max_connections_ = 1;
+        param.auto_forwarding_max_batch_size_ = 8;
+        if (async) {
+            param.return_method_ = raft_params::async_handler;
+        }
+        pp->raftServer->update_params(param);
+    }
+
+    // Requests are batched only after the leader says that it accepts
+    // batches, by the response to the first forwarded request.
+    {   std::string test_msg = "first";
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret = s2.raftServer->append_entries( {msg} );
+        TestSuite::sleep_ms(100, "first request");
+        CHK_TRUE( ret->get_accepted() );
+    }
+
+    // Append messages in parallel into S2 (follower).
+    struct MsgArgs : TestSuite::ThreadArgs {
+        size_t ii;
+    };
+
+    const size_t NUM_PARALLEL_MSGS = 20;
+    std::vector< ptr< cmd_result< ptr<buffer> > > > handlers(NUM_PARALLEL_MSGS);
+    auto send_msg = [&](TestSuite::ThreadArgs* t_args) -> int {
+        MsgArgs* args = (MsgArgs*)t_args;
+        std::string test_msg = "test" + std::to_string(args->ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        handlers[args->ii] = s2.raftServer->append_entries( {msg} );
+        return 0;
+    };
+
+    std::vector<TestSuite::ThreadHolder> th(NUM_PARALLEL_MSGS);
+    std::vector<MsgArgs> m_args(NUM_PARALLEL_MSGS);
+    for (size_t ii = 0; ii < NUM_PARALLEL_MSGS; ++ii) {
+        m_args[ii].ii = ii;
+        th[ii].spawn(&m_args[ii], send_msg, nullptr);
+    }
+    TestSuite::sleep_sec(1, "replication");
+    for (size_t ii = 0; ii < NUM_PARALLEL_MSGS; ++ii) {
+        th[ii].join();
+        CHK_Z(th[ii].getResult());
+    }
+
+    // Each request should get the result of its own log,
+    // which is the log index returned by the state machine.
+    for (size_t ii = 0; ii < NUM_PARALLEL_MSGS; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        uint64_t log_idx = s1.getTestSm()->isCommitted(test_msg);
+        CHK_GT(log_idx, 0);
+
+        CHK_TRUE( handlers[ii]->get_accepted() );
+        CHK_EQ( cmd_result_code::OK, handlers[ii]->get_result_code() );
+        ptr<buffer> h_result = handlers[ii]->get();
+        CHK_NONNULL(h_result);
+        CHK_EQ(8, h_result->size());
+        buffer_serializer bs(h_result);
+        CHK_EQ(log_idx, bs.get_u64());
+    }
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
 int enforced_state_machine_catchup_test() {
     reset_log_files();
 
@@ -2515,6 +2888,75 @@ int parallel_log_append_test() {
     return 0;
 }
 
+int parallel_log_append_follower_test() {
+    reset_log_files();
+
+    std::string s1_addr = "tcp://127.0.0.1:20010";
+    std::string s2_addr = "tcp://127.0.0.1:20020";
+    std::string s3_addr = "tcp://127.0.0.1:20030";
+
+    RaftAsioPkg s1(1, s1_addr);
+    RaftAsioPkg s2(2, s2_addr);
+    RaftAsioPkg s3(3, s3_addr);
+    std::vector<RaftAsioPkg*> pkgs = {&s1, &s2, &s3};
+
+    _msg("launching asio-raft servers\n");
+    CHK_Z( launch_servers(pkgs, false) );
+
+    _msg("organizing raft group\n");
+    CHK_Z( make_group(pkgs) );
+
+    // Set disk delay (10ms for S1, 250ms for S2 and S3).
+    // Followers ignore election timeouts only for up to
+    // the election timeout upper bound (400ms) while waiting.
+    s1.getTestMgr()->set_disk_delay(s1.raftServer.get(), 10);
+    s2.getTestMgr()->set_disk_delay(s2.raftServer.get(), 250);
+    s3.getTestMgr()->set_disk_delay(s3.raftServer.get(), 250);
+
+    // Set async mode.
+    for (auto& entry: pkgs) {
+        RaftAsioPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.parallel_log_appending_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 10;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+    }
+
+    TestSuite::sleep_ms(100, "wait for replication");
+
+    // Followers have the logs, but they are not durable yet.
+    uint64_t last_idx = s1.getTestMgr()->load_log_store()->next_slot() - 1;
+    CHK_EQ( last_idx, s2.getTestMgr()->load_log_store()->next_slot() - 1 );
+    CHK_EQ( last_idx, s3.getTestMgr()->load_log_store()->next_slot() - 1 );
+    CHK_SM( s2.getTestMgr()->load_log_store()->last_durable_index(), last_idx );
+
+    // Followers should not respond until the logs are durable,
+    // so that the last log cannot be committed.
+    CHK_SM( s1.raftServer->get_committed_log_idx(), last_idx );
+
+    TestSuite::sleep_ms(500, "wait for disk delay");
+
+    // Deferred responses should have been sent.
+    CHK_EQ( last_idx, s1.raftServer->get_committed_log_idx() );
+    CHK_TRUE( s1.raftServer->is_leader() );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+    TestSuite::sleep_sec(1, "shutting down");
+
+    SimpleLogger::shutdown();
+    return 0;
+}
+
 int custom_resolver_test() {
     reset_log_files();
 
@@ -2753,6 +3195,9 @@ int main(int argc, char** argv) {
     ts.doTest( "make group test",
                make_group_test );
 
+    ts.doTest( "large message test",
+               large_message_test );
+
     ts.doTest( "leader election test",
                leader_election_test,
                TestRange<bool>( {false, true} ) );
@@ -2795,16 +3240,29 @@ int main(int argc, char** argv) {
     ts.doTest( "global manager heavy test",
                global_mgr_heavy_test );
 
+    ts.doTest( "global manager leader balancing test",
+               global_mgr_leader_balancing_test );
+
     ts.doTest( "leadership transfer test",
                leadership_transfer_test );
 
     ts.doTest( "auto forwarding timeout test",
                auto_forwarding_timeout_test );
 
+    ts.doTest( "hibernation test",
+               hibernation_test );
+
     ts.doTest( "auto forwarding test",
                auto_forwarding_test,
                TestRange<bool>( {false, true} ) );
 
+    ts.doTest( "auto forwarding single worker test",
+               auto_forwarding_single_worker_test );
+
+    ts.doTest( "auto forwarding batch test",
+               auto_forwarding_batch_test,
+               TestRange<bool>( {false, true} ) );
+
     ts.doTest( "enforced state machine catch-up test",
                enforced_state_machine_catchup_test );
 
@@ -2846,6 +3304,9 @@ int main(int argc, char** argv) {
     ts.doTest( "parallel log append test",
                parallel_log_append_test );
 
+    ts.doTest( "parallel log append follower test",
+               parallel_log_append_follower_test );
+
     ts.doTest( "custom resolver test",
                custom_resolver_test );
 
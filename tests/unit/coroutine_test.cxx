@@ -0,0 +1,201 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+// This test should be built as C++20.
+
+#include "nuraft.hxx"
+
+#include "test_common.h"
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <list>
+
+#ifndef NURAFT_COROUTINE_SUPPORT
+#error "coroutine support is not enabled"
+#endif
+
+using namespace nuraft;
+
+namespace coroutine_test {
+
+using result_t = cmd_result< ptr<buffer> >;
+
+// Minimal fire-and-forget coroutine type.
+struct detached_task {
+    struct promise_type {
+        detached_task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+struct await_state {
+    await_state() : resumed(false), code(cmd_result_code::OK), value(0) {}
+    bool resumed;
+    cmd_result_code code;
+    uint64_t value;
+};
+
+detached_task await_result(ptr<result_t> res, await_state* state) {
+    ptr<result_t> ret = co_await res;
+    state->resumed = true;
+    state->code = ret->get_result_code();
+    ptr<buffer> buf = ret->get();
+    if (buf) {
+        buf->pos(0);
+        state->value = buf->get_ulong();
+    }
+}
+
+ptr<buffer> make_value(uint64_t val) {
+    ptr<buffer> buf = buffer::alloc(sizeof(uint64_t));
+    buf->put(val);
+    buf->pos(0);
+    return buf;
+}
+
+int await_ready_result_test() {
+    ptr<buffer> val = make_value(123);
+    ptr<result_t> res = cs_new<result_t>(val, true);
+
+    // Result exists, should not be suspended.
+    await_state state;
+    await_result(res, &state);
+    CHK_TRUE( state.resumed );
+    CHK_EQ( cmd_result_code::OK, state.code );
+    CHK_EQ( 123, state.value );
+
+    return 0;
+}
+
+int await_pending_result_test() {
+    ptr<result_t> res = cs_new<result_t>();
+
+    await_state state;
+    await_result(res, &state);
+    CHK_FALSE( state.resumed );
+
+    ptr<buffer> val = make_value(456);
+    ptr<std::exception> err;
+    res->accept();
+    res->set_result(val, err);
+    CHK_TRUE( state.resumed );
+    CHK_EQ( cmd_result_code::OK, state.code );
+    CHK_EQ( 456, state.value );
+
+    return 0;
+}
+
+int await_failed_result_test() {
+    ptr<result_t> res = cs_new<result_t>();
+
+    await_state state;
+    await_result(res, &state);
+    CHK_FALSE( state.resumed );
+
+    // Result code should be visible to the coroutine.
+    ptr<buffer> val = nullptr;
+    ptr<std::exception> err;
+    res->set_result(val, err, cmd_result_code::TIMEOUT);
+    CHK_TRUE( state.resumed );
+    CHK_EQ( cmd_result_code::TIMEOUT, state.code );
+    CHK_EQ( 0, state.value );
+
+    return 0;
+}
+
+int await_with_executor_test() {
+    std::list< std::function<void()> > tasks;
+    cmd_result_executor executor = [&tasks](std::function<void()> task) {
+        tasks.push_back(task);
+    };
+
+    ptr<result_t> res = cs_new<result_t>();
+    res->set_executor(executor);
+
+    await_state state;
+    await_result(res, &state);
+    CHK_FALSE( state.resumed );
+
+    ptr<buffer> val = make_value(789);
+    ptr<std::exception> err;
+    res->set_result(val, err);
+
+    // Should be resumed by the executor, not by `set_result`.
+    CHK_FALSE( state.resumed );
+    CHK_EQ( 1, tasks.size() );
+    tasks.front()();
+    CHK_TRUE( state.resumed );
+    CHK_EQ( 789, state.value );
+
+    return 0;
+}
+
+int executor_without_ptr_test() {
+    std::list< std::function<void()> > tasks;
+    cmd_result_executor executor = [&tasks](std::function<void()> task) {
+        tasks.push_back(task);
+    };
+
+    // Not owned by `ptr`, the executor cannot be used.
+    result_t res;
+    res.set_executor(executor);
+
+    bool invoked = false;
+    res.when_ready( [&invoked](ptr<buffer>&, ptr<std::exception>&) {
+        invoked = true;
+    } );
+
+    ptr<buffer> val = make_value(1);
+    ptr<std::exception> err;
+    res.set_result(val, err);
+
+    // Should be invoked by the thread setting the result.
+    CHK_TRUE( invoked );
+    CHK_EQ( 0, tasks.size() );
+
+    return 0;
+}
+
+}  // namespace coroutine_test;
+using namespace coroutine_test;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    ts.options.printTestMessage = false;
+
+    ts.doTest( "await ready result test",
+               await_ready_result_test );
+
+    ts.doTest( "await pending result test",
+               await_pending_result_test );
+
+    ts.doTest( "await failed result test",
+               await_failed_result_test );
+
+    ts.doTest( "await with executor test",
+               await_with_executor_test );
+
+    ts.doTest( "executor without ptr test",
+               executor_without_ptr_test );
+
+    return 0;
+}
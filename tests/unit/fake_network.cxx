@@ -21,6 +21,8 @@ limitations under the License.
 #include "logger.h"
 
 #include <cassert>
+#include <chrono>
+#include <thread>
 
 namespace nuraft {
 
@@ -61,6 +63,22 @@ FakeNetwork* FakeNetworkBase::findNetwork(const std::string& endpoint) {
     return (entry->second).get();
 }
 
+void FakeNetworkBase::setLatencyMs(const std::string& a,
+                                   const std::string& b,
+                                   int32 latency_ms)
+{
+    latencies[std::make_pair(a, b)] = latency_ms;
+    latencies[std::make_pair(b, a)] = latency_ms;
+}
+
+int32 FakeNetworkBase::getLatencyMs(const std::string& src,
+                                    const std::string& dst)
+{
+    auto entry = latencies.find(std::make_pair(src, dst));
+    if (entry == latencies.end()) return 0;
+    return entry->second;
+}
+
 
 // === FakeNetwork
 
@@ -77,15 +95,18 @@ ptr<rpc_client> FakeNetwork::create_client(const std::string& endpoint) {
     if (!dst_net) return nullptr;
 
     std::lock_guard<std::mutex> ll(clientsLock);
+    ptr<FakeClient> prev;
     auto entry = clients.find(endpoint);
     if (entry != clients.end()) {
         // Already exists, move it to garbage list as it will be
         // replaced below.
+        prev = entry->second;
         staleClients.push_back(entry->second);
         clients.erase(entry);
     }
 
     ptr<FakeClient> ret = cs_new<FakeClient>(this, dst_net);
+    ret->replaced = prev;
     clients[endpoint] = ret;
     return ret;
 }
@@ -95,6 +116,7 @@ void FakeNetwork::listen(ptr<msg_handler>& _handler) {
 }
 
 ptr<resp_msg> FakeNetwork::gotMsg(ptr<req_msg>& msg) {
+    if (!handler) return nullptr;
     ptr<resp_msg> resp = raft_server_handler::process_req(handler.get(), *msg);
     return resp;
 }
@@ -285,6 +307,22 @@ void FakeNetwork::shutdown() {
     clients.clear();
 }
 
+void FakeNetwork::detachPingClient(FakeClient* client) {
+    // A client used for ping requests only (e.g., the one created by
+    // `peer::send_ping`) does not replace the existing connection.
+    std::lock_guard<std::mutex> ll(clientsLock);
+    const std::string& endpoint = client->dstNet->getEndpoint();
+    auto entry = clients.find(endpoint);
+    if (entry == clients.end() || entry->second.get() != client) return;
+
+    clients.erase(entry);
+    ptr<FakeClient> prev = client->replaced;
+    if (prev) {
+        staleClients.remove(prev);
+        clients[endpoint] = prev;
+    }
+}
+
 
 // === FakeClient
 static std::atomic<uint64_t> fake_client_id_counter(1);
@@ -307,6 +345,33 @@ void FakeClient::send(ptr<req_msg>& req,
               motherNet->getEndpoint().c_str(),
               dstNet->getEndpoint().c_str(),
               msg_type_to_string( req->get_type() ).c_str() );
+
+    if (req->get_type() == msg_type::ping_request) {
+        // Ping does not wait for the lock of the destination,
+        // answer it right away after the latency of the link.
+        if (replaced) motherNet->detachPingClient(this);
+        replaced.reset();
+
+        int32 latency_ms = motherNet->getBase()->getLatencyMs
+                           ( motherNet->getEndpoint(), dstNet->getEndpoint() );
+        if (latency_ms > 0) {
+            std::this_thread::sleep_for( std::chrono::milliseconds(latency_ms) );
+        }
+
+        ptr<resp_msg> resp;
+        if (isDstOnline()) resp = dstNet->gotMsg(req);
+        ptr<rpc_exception> exp;
+        if (!resp) {
+            exp = cs_new<rpc_exception>
+                  ( sstrfmt( "failed to send ping to peer %d" )
+                           .fmt( req->get_dst() ),
+                    req );
+        }
+        when_done(resp, exp);
+        return;
+    }
+
+    replaced.reset();
     pendingReqs.push_back( FakeNetwork::ReqPkg(req, when_done) );
 }
 
@@ -99,6 +99,8 @@ public:
 
     void shutdown();
 
+    void detachPingClient(FakeClient* client);
+
 private:
     std::string myEndpoint;
     ptr<FakeNetworkBase> base;
@@ -128,10 +130,21 @@ public:
 
     SimpleLogger* getLogger() const { return myLog; }
 
+    // Latency of the link between two endpoints (both directions).
+    // It applies to ping requests only, as they are answered right away.
+    void setLatencyMs(const std::string& a,
+                      const std::string& b,
+                      int32 latency_ms);
+
+    int32 getLatencyMs(const std::string& src, const std::string& dst);
+
 private:
     // <endpoint, network instance>
     std::map<std::string, ptr<FakeNetwork>> nets;
 
+    // <{src, dst}, latency in ms>
+    std::map< std::pair<std::string, std::string>, int32 > latencies;
+
     SimpleLogger* myLog;
 };
 
@@ -157,6 +170,9 @@ private:
     uint64_t myId;
     FakeNetwork* motherNet;
     FakeNetwork* dstNet;
+    // Client to the same endpoint that this client replaced,
+    // until the first request is sent.
+    ptr<FakeClient> replaced;
     std::list<FakeNetwork::ReqPkg> pendingReqs;
     std::list<FakeNetwork::RespPkg> pendingResps;
 };
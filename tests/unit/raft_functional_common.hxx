@@ -29,6 +29,7 @@ limitations under the License.
 #include <map>
 #include <set>
 #include <sstream>
+#include <stdexcept>
 
 #define INT_UNUSED      int ATTR_UNUSED
 #define VOID_UNUSED     void ATTR_UNUSED
@@ -45,7 +46,12 @@ public:
         : customBatchSize(0)
         , lastCommittedConfigIdx(0)
         , targetSnpReadFailures(0)
+        , targetSnpWriteFailures(0)
         , snpDelayMs(0)
+        , preCommitDelayMs(0)
+        , numPreCommitBatches(0)
+        , numPackedLogs(0)
+        , numPackedCmds(0)
         , numSnapshotCreations(0)
         , myLog(logger)
     {
@@ -78,6 +84,29 @@ public:
         return ret;
     }
 
+    void pre_commit_batch(const std::vector<ext_op_params>& params) {
+        numPreCommitBatches++;
+        if (preCommitDelayMs) {
+            TestSuite::sleep_ms(preCommitDelayMs);
+        }
+        state_machine::pre_commit_batch(params);
+    }
+
+    std::vector< ptr<buffer> > commit_packed(const ulong log_idx,
+                                             const std::vector< ptr<buffer> >& cmds)
+    {
+        std::vector< ptr<buffer> > ret = state_machine::commit_packed(log_idx, cmds);
+        numPackedLogs++;
+        numPackedCmds += cmds.size();
+
+        // Return the command itself, so that each caller
+        // can check whether it got its own result.
+        for (size_t ii = 0; ii < cmds.size(); ++ii) {
+            ret[ii] = buffer::copy(*cmds[ii]);
+        }
+        return ret;
+    }
+
     void rollback(const ulong log_idx, buffer& data) {
         std::lock_guard<std::mutex> ll(dataLock);
         rollbacks.push_back(log_idx);
@@ -93,8 +122,17 @@ public:
             TestSuite::sleep_ms(snpDelayMs);
         }
 
+        if (targetSnpWriteFailures > 0) {
+            targetSnpWriteFailures--;
+            throw std::runtime_error("snapshot write failure");
+        }
+
         if (obj_id == 0) {
             // Special object containing metadata.
+            if (is_first_obj) {
+                std::lock_guard<std::mutex> ll(dataLock);
+                staged.clear();
+            }
             // Request next object.
             obj_id++;
             return;
@@ -119,16 +157,23 @@ public:
         ptr<buffer> data_commit = buffer::alloc(data_size);
         bs.get_buffer( data_commit );
 
-        commits[log_idx] = data_commit;
-
-        ptr<buffer> data_precommit = buffer::copy(*data_commit);
-        preCommits[log_idx] = data_precommit;
+        // Not visible until the snapshot is applied.
+        {   std::lock_guard<std::mutex> ll(dataLock);
+            staged[log_idx] = data_commit;
+        }
 
         // Request next object.
         obj_id++;
     }
 
     bool apply_snapshot(snapshot& s) {
+        {   std::lock_guard<std::mutex> ll(dataLock);
+            for (auto& entry: staged) {
+                commits[entry.first] = entry.second;
+                preCommits[entry.first] = buffer::copy(*entry.second);
+            }
+            staged.clear();
+        }
         std::lock_guard<std::mutex> ll(lastSnapshotLock);
         // NOTE: We only handle logical snapshot.
         ptr<buffer> snp_buf = s.serialize();
@@ -181,15 +226,23 @@ public:
 
         // Otherwise:
         //   just copy data corresponding to obj id (== log number).
-        auto entry = commits.find(obj_id);
-        if (entry == commits.end()) {
+        ptr<buffer> local_data = nullptr;
+        {   std::lock_guard<std::mutex> ll(dataLock);
+            auto entry = commits.find(obj_id);
+            if (entry != commits.end()) {
+                local_data = entry->second;
+            } else if (staged.find(obj_id) != staged.end()) {
+                // Ingested data set, not applied yet.
+                local_data = staged[obj_id];
+            }
+        }
+        if (!local_data) {
             // Corresponding log number doesn't exist,
             // it happens when that log number is used for config change.
             data_out = buffer::alloc( sizeof(ulong) );
             buffer_serializer bs(data_out);
             bs.put_u64( obj_id );
         } else {
-            ptr<buffer> local_data = entry->second;
             data_out = buffer::alloc( sizeof(ulong) + sizeof(int32) +
                                       local_data->size() );
             buffer_serializer bs(data_out);
@@ -249,6 +302,25 @@ public:
         when_done(ret, except);
     }
 
+    bool ingest_snapshot(snapshot& s, void* ingest_ctx) {
+        buffer* data = static_cast<buffer*>(ingest_ctx);
+        if (!data) return false;
+        std::lock_guard<std::mutex> ll(dataLock);
+        staged.clear();
+        staged[s.get_last_log_idx()] = buffer::copy(*data);
+        return true;
+    }
+
+    void abort_ingest(snapshot& s) {
+        std::lock_guard<std::mutex> ll(dataLock);
+        staged.clear();
+    }
+
+    size_t getNumStagedObjs() const {
+        std::lock_guard<std::mutex> ll(dataLock);
+        return staged.size();
+    }
+
     void set_next_batch_size_hint_in_bytes(ulong to) {
         customBatchSize = to;
     }
@@ -365,10 +437,30 @@ public:
         targetSnpReadFailures = num_failures;
     }
 
+    void setSnpWriteFailure(int num_failures) {
+        targetSnpWriteFailures = num_failures;
+    }
+
     void setSnpDelay(size_t delay_ms) {
         snpDelayMs = delay_ms;
     }
 
+    void setPreCommitDelay(size_t delay_ms) {
+        preCommitDelayMs = delay_ms;
+    }
+
+    uint64_t getNumPreCommitBatches() const {
+        return numPreCommitBatches;
+    }
+
+    uint64_t getNumPackedLogs() const {
+        return numPackedLogs;
+    }
+
+    uint64_t getNumPackedCmds() const {
+        return numPackedCmds;
+    }
+
     void setServersForCommit(const std::list<int>& src) {
         std::lock_guard<std::mutex> l(serversForCommitLock);
         serversForCommit = src;
@@ -381,6 +473,8 @@ public:
 private:
     std::map<uint64_t, ptr<buffer>> preCommits;
     std::map<uint64_t, ptr<buffer>> commits;
+    // Snapshot objects received or ingested, but not applied yet.
+    std::map<uint64_t, ptr<buffer>> staged;
     std::list<uint64_t> rollbacks;
     mutable std::mutex dataLock;
 
@@ -393,8 +487,18 @@ private:
 
     std::atomic<int> targetSnpReadFailures;
 
+    std::atomic<int> targetSnpWriteFailures;
+
     std::atomic<size_t> snpDelayMs;
 
+    std::atomic<size_t> preCommitDelayMs;
+
+    std::atomic<uint64_t> numPreCommitBatches;
+
+    std::atomic<uint64_t> numPackedLogs;
+
+    std::atomic<uint64_t> numPackedCmds;
+
     std::set<void*> openedUserCtxs;
     mutable std::mutex openedUserCtxsLock;
 
@@ -456,12 +560,20 @@ public:
 
     ptr<srv_config> get_srv_config() const { return mySrvConfig; }
 
+    void set_srv_config(ptr<srv_config> new_config) {
+        mySrvConfig = new_config;
+        savedConfig = cs_new<cluster_config>();
+        savedConfig->get_servers().push_back(mySrvConfig);
+    }
+
     void set_disk_delay(raft_server* raft, size_t delay_ms) {
         curLogStore->set_disk_delay(raft, delay_ms);
     }
 
     ptr<inmem_log_store> get_inmem_log_store() const { return curLogStore; }
 
+    void reset_log_store() { curLogStore = cs_new<inmem_log_store>(); }
+
 private:
     int myId;
     std::string myEndpoint;
@@ -55,6 +55,7 @@ public:
         , useCustomResolver(false)
         , useLogTimestamp(false)
         , useCrcOnEntireMessage(false)
+        , threadPoolSize(4)
         , myLogWrapper(nullptr)
         , myLog(nullptr)
         {}
@@ -99,7 +100,7 @@ public:
         sm = cs_new<TestSm>( myLogWrapper->getLogger() );
 
         asio_service::options asio_opt;
-        asio_opt.thread_pool_size_  = 4;
+        asio_opt.thread_pool_size_  = threadPoolSize;
         if (enable_ssl) {
             asio_opt.enable_ssl_        = enable_ssl;
             asio_opt.verify_sn_         = RaftAsioPkg::verifySn;
@@ -180,7 +181,7 @@ public:
             bool use_global_asio = false,
             const raft_server::init_options& opt = raft_server::init_options()) {
         asio_service::options asio_opt;
-        asio_opt.thread_pool_size_  = 4;
+        asio_opt.thread_pool_size_  = threadPoolSize;
         if (enable_ssl) {
             asio_opt.enable_ssl_        = enable_ssl;
             asio_opt.verify_sn_         = RaftAsioPkg::verifySn;
@@ -278,6 +279,8 @@ public:
 
     bool useCrcOnEntireMessage;
 
+    size_t threadPoolSize;
+
     ptr<logger_wrapper> myLogWrapper;
     ptr<logger> myLog;
 };
@@ -20,9 +20,12 @@ limitations under the License.
 #include "raft_package_fake.hxx"
 
 #include "event_awaiter.hxx"
+#include "failure_detector.hxx"
+#include "leader_placement.hxx"
 #include "raft_params.hxx"
 #include "test_common.h"
 
+#include <set>
 #include <stdio.h>
 
 using namespace nuraft;
@@ -2071,6 +2074,83 @@ int snapshot_basic_test() {
     return 0;
 }
 
+int snapshot_pipelined_install_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.snapshot_save_queue_size_ = 4;
+        pp->raftServer->update_params(param);
+    }
+
+    for (size_t ii=0; ii<10; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+
+        // NOTE: Send it to S2 only, S3 will be lagging behind.
+        s1.fNet->execReqResp("S2"); // replication.
+        s1.fNet->execReqResp("S2"); // commit.
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // commit execution.
+    }
+    // Make req to S3 failed.
+    s1.fNet->makeReqFail("S3");
+
+    // Slow writes on S3, and one of them fails.
+    s3.getTestSm()->setSnpDelay(5);
+    s3.getTestSm()->setSnpWriteFailure(1);
+
+    // Trigger heartbeat to S3, it will initiate snapshot transmission.
+    s1.fTimer->invoke(timer_task_type::heartbeat_timer);
+    s1.fNet->execReqResp();
+
+    // Send the entire snapshot. The failed write will be reported
+    // through the following ack, and then the snapshot will start over.
+    do {
+        s1.fNet->execReqResp();
+    } while (s3.raftServer->is_receiving_snapshot());
+    CHK_EQ( s1.raftServer->get_last_snapshot_idx(),
+            s3.raftServer->get_last_snapshot_idx() );
+
+    s1.fNet->execReqResp(); // commit.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // commit execution.
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    // There shouldn't be any open snapshot ctx.
+    CHK_Z( s1.getTestSm()->getNumOpenedUserCtxs() );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
 int snapshot_manual_creation_test() {
     reset_log_files();
     ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
@@ -2520,7 +2600,7 @@ int snapshot_close_for_removed_peer_test() {
     return 0;
 }
 
-int join_empty_node_test() {
+int bulk_ingest_test() {
     reset_log_files();
     ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
 
@@ -2532,103 +2612,243 @@ int join_empty_node_test() {
     RaftPkg s2(f_base, 2, s2_addr);
     RaftPkg s3(f_base, 3, s3_addr);
     std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
-    CHK_Z( launch_servers( pkgs ) );
-
-    // Organize group by using S1 and S2 only.
-    CHK_Z( make_group( {&s1, &s2} ) );
 
-    // Append a message using separate thread.
-    ExecArgs exec_args(&s1);
-    TestSuite::ThreadHolder hh(&exec_args, fake_executer, fake_executer_killer);
-
-    for (size_t ii=0; ii<5; ++ii) {
-        std::string test_msg = "test" + std::to_string(ii);
-        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
-        msg->put(test_msg);
-        exec_args.setMsg(msg);
-        exec_args.eaExecuter.invoke();
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
 
-        // Wait for executer thread.
-        TestSuite::sleep_ms(EXECUTOR_WAIT_MS);
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
 
-        CHK_NULL( exec_args.getMsg().get() );
+    auto append_msgs = [&](size_t num) -> int {
+        for (size_t ii=0; ii<num; ++ii) {
+            std::string test_msg = "test" + std::to_string(ii);
+            ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+            msg->put(test_msg);
+            ptr< cmd_result< ptr<buffer> > > ret =
+                s1.raftServer->append_entries( {msg} );
+            CHK_TRUE( ret->get_accepted() );
+        }
+        s1.fNet->execReqResp(); // replication.
+        s1.fNet->execReqResp(); // commit.
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        return 0;
+    };
+    CHK_Z( append_msgs(3) );
+
+    std::string ingest_str = "bulk ingested data set";
+    ptr<buffer> ingest_data = buffer::alloc(ingest_str.size() + 1);
+    ingest_data->put(ingest_str);
+    ingest_data->pos(0);
+
+    // Only leader can ingest.
+    ulong snp_idx = 0;
+    CHK_EQ( cmd_result_code::NOT_LEADER,
+            s2.raftServer->bulk_ingest(ingest_data.get(), snp_idx) );
+
+    // `bulk_ingest` blocks until a quorum has the ingested data set,
+    // run it in another thread.
+    ulong last_log_idx = s1.raftServer->get_last_log_idx();
+    std::atomic<bool> ingest_done(false);
+    cmd_result_code ingest_rc = cmd_result_code::FAILED;
+    std::thread ingest_thread([&]() {
+        ingest_rc = s1.raftServer->bulk_ingest(ingest_data.get(), snp_idx);
+        ingest_done = true;
+    });
 
-        // NOTE: Send it to S2 only, S3 will be lagging behind.
-        s1.fNet->execReqResp("S2"); // replication.
-        s1.fNet->execReqResp("S2"); // commit.
-        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // commit execution.
+    // Wait for the marker log at the index of the ingested snapshot.
+    while (s1.raftServer->get_last_log_idx() < last_log_idx + 1) {
+        TestSuite::sleep_ms(1);
     }
 
-    // Now add S3 to leader.
-    s1.raftServer->add_srv( *(s3.getTestMgr()->get_srv_config()) );
-    s1.fNet->execReqResp(); // join req/resp.
-    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // S1 & S3: commit config.
-
-    s1.fNet->execReqResp(); // req to S2 for new config.
-    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // S2: commit config.
+    // The data set is staged, not visible until a quorum has it.
+    CHK_EQ( last_log_idx, s1.raftServer->get_target_committed_log_idx() );
+    CHK_SM( s1.raftServer->get_last_snapshot_idx(), last_log_idx + 1 );
+    CHK_Z( s1.getTestSm()->isCommitted(ingest_str) );
+    CHK_FALSE( ingest_done );
+    CHK_TRUE( s1.raftServer->is_bulk_ingest_in_progress() );
 
-    // First heartbeat to S3, it will initiate snapshot transmission.
-    s1.fTimer->invoke(timer_task_type::heartbeat_timer);
+    // Followers will stage the data set received as a snapshot,
+    // once the pending responses are handled.
     s1.fNet->execReqResp();
-
-    // Send the entire snapshot.
     do {
         s1.fNet->execReqResp();
-    } while (s3.raftServer->is_receiving_snapshot());
-
-    // Configuration change.
-    s1.fTimer->invoke(timer_task_type::heartbeat_timer);
-    s1.fNet->execReqResp(); // replication.
+    } while ( s2.raftServer->is_receiving_snapshot() ||
+              s3.raftServer->is_receiving_snapshot() );
+    CHK_GT( s2.getTestSm()->getNumStagedObjs(), 0 );
+    CHK_GT( s3.getTestSm()->getNumStagedObjs(), 0 );
+    CHK_Z( s2.getTestSm()->isCommitted(ingest_str) );
+    CHK_Z( s3.getTestSm()->isCommitted(ingest_str) );
+
+    // Replicate and commit the marker log.
+    for (size_t ii = 0; ii < 1000 && !ingest_done; ++ii) {
+        s1.fNet->execReqResp();
+        TestSuite::sleep_ms(1);
+    }
+    ingest_thread.join();
+    CHK_EQ( cmd_result_code::OK, ingest_rc );
+    CHK_EQ( last_log_idx + 1, snp_idx );
+    CHK_EQ( snp_idx, s1.raftServer->get_last_snapshot_idx() );
+    CHK_EQ( snp_idx, s1.getTestSm()->isCommitted(ingest_str) );
+    CHK_FALSE( s1.raftServer->is_bulk_ingest_in_progress() );
     s1.fNet->execReqResp(); // commit.
-    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // commit execution.
-
-    s1.fTimer->invoke(timer_task_type::heartbeat_timer);
-    s1.fNet->execReqResp(); // replication.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_EQ( snp_idx, s2.raftServer->get_last_snapshot_idx() );
+    CHK_EQ( snp_idx, s3.raftServer->get_last_snapshot_idx() );
+    CHK_Z( s2.getTestSm()->getNumStagedObjs() );
+    CHK_Z( s3.getTestSm()->getNumStagedObjs() );
+
+    // Normal replication should work after ingestion.
+    CHK_Z( append_msgs(3) );
+    CHK_EQ( snp_idx + 3, s1.raftServer->get_committed_log_idx() );
     s1.fNet->execReqResp(); // commit.
-    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // commit execution.
-    print_stats(pkgs);
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_EQ( snp_idx + 3, s2.raftServer->get_committed_log_idx() );
+    CHK_EQ( snp_idx + 3, s3.raftServer->get_committed_log_idx() );
 
     // State machine should be identical.
     CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
-
-    // For S3, do not check pre-commit list.
     CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_EQ( snp_idx, s3.getTestSm()->isCommitted(ingest_str) );
+
+    // There shouldn't be any open snapshot ctx.
+    CHK_Z( s1.getTestSm()->getNumOpenedUserCtxs() );
+
+    print_stats(pkgs);
 
     s1.raftServer->shutdown();
     s2.raftServer->shutdown();
     s3.raftServer->shutdown();
 
-    fake_executer_killer(&exec_args);
-    hh.join();
-    CHK_Z( hh.getResult() );
-
     f_base->destroy();
 
     return 0;
 }
 
-static int async_handler(std::list<ulong>* idx_list,
-                         ptr< cmd_result< ptr<buffer> > >& cmd_result,
-                         cmd_result_code expected_code,
-                         ptr<buffer>& result,
-                         ptr<std::exception>& err)
-{
-    CHK_EQ( expected_code, cmd_result->get_result_code() );
+int bulk_ingest_rollback_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
 
-    if (expected_code == cmd_result_code::OK) {
-        result->pos(0);
-        ulong idx = result->get_ulong();
-        if (idx_list) {
-            idx_list->push_back(idx);
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    raft_params custom_params;
+    custom_params.election_timeout_lower_bound_ = 0;
+    custom_params.election_timeout_upper_bound_ = 1000;
+    custom_params.heart_beat_interval_ = 10;
+    custom_params.client_req_timeout_ = 10000;
+    CHK_Z( launch_servers( pkgs, &custom_params ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    auto append_msgs = [&](RaftPkg& leader, size_t num) -> int {
+        for (size_t ii=0; ii<num; ++ii) {
+            std::string test_msg = "test" + std::to_string(ii);
+            ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+            msg->put(test_msg);
+            ptr< cmd_result< ptr<buffer> > > ret =
+                leader.raftServer->append_entries( {msg} );
+            CHK_TRUE( ret->get_accepted() );
         }
+        leader.fNet->execReqResp(); // replication.
+        leader.fNet->execReqResp(); // commit.
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        return 0;
+    };
+    CHK_Z( append_msgs(s1, 3) );
+
+    std::string ingest_str = "bulk ingested data set";
+    ptr<buffer> ingest_data = buffer::alloc(ingest_str.size() + 1);
+    ingest_data->put(ingest_str);
+    ingest_data->pos(0);
+
+    ulong last_log_idx = s1.raftServer->get_last_log_idx();
+    ulong snp_idx = 0;
+    cmd_result_code ingest_rc = cmd_result_code::OK;
+    std::thread ingest_thread([&]() {
+        ingest_rc = s1.raftServer->bulk_ingest(ingest_data.get(), snp_idx);
+    });
+    while (s1.raftServer->get_last_log_idx() < last_log_idx + 1) {
+        TestSuite::sleep_ms(1);
+    }
 
-    } else {
-        CHK_NULL( result.get() );
+    // S1 goes offline before any follower stages the data set,
+    // and one of the others becomes the leader.
+    s1.fNet->goesOffline();
+    const size_t MAX_ATTEMPTS = 100;
+    size_t attempts = 0;
+    do {
+        s2.fTimer->invoke( timer_task_type::election_timer );
+        s2.fNet->execReqResp();
+        s2.fNet->execReqResp();
+
+        s3.fTimer->invoke( timer_task_type::election_timer );
+        s3.fNet->execReqResp();
+        s3.fNet->execReqResp();
+
+        attempts++;
+        TestSuite::sleep_ms(custom_params.heart_beat_interval_);
+    } while ( !s2.raftServer->is_leader() &&
+              !s3.raftServer->is_leader() &&
+              attempts < MAX_ATTEMPTS );
+    CHK_SM(attempts, MAX_ATTEMPTS);
+    RaftPkg& leader = s2.raftServer->is_leader() ? s2 : s3;
+    RaftPkg& follower = s2.raftServer->is_leader() ? s3 : s2;
+    leader.fNet->execReqResp();
+    leader.fNet->execReqResp();
+
+    // S1 comes back, then its marker log is overwritten.
+    s1.fNet->goesOnline();
+    leader.fTimer->invoke( timer_task_type::heartbeat_timer );
+    for (size_t ii = 0; ii < 5; ++ii) leader.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    ingest_thread.join();
+    CHK_EQ( cmd_result_code::NOT_LEADER, ingest_rc );
+    CHK_Z( snp_idx );
+    CHK_FALSE( s1.raftServer->is_bulk_ingest_in_progress() );
+
+    // The staged data set is discarded, and it has never been visible.
+    CHK_Z( s1.getTestSm()->getNumStagedObjs() );
+    CHK_SM( s1.raftServer->get_last_snapshot_idx(), last_log_idx + 1 );
+    for (RaftPkg* pp: pkgs) {
+        CHK_Z( pp->getTestSm()->isCommitted(ingest_str) );
     }
+
+    // Normal replication should work with the new leader.
+    CHK_Z( append_msgs(leader, 3) );
+    leader.fNet->execReqResp(); // commit.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_OK( s1.getTestSm()->isSame( *leader.getTestSm() ) );
+    CHK_OK( follower.getTestSm()->isSame( *leader.getTestSm() ) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
     return 0;
 }
 
-int async_append_handler_test() {
+int memory_only_durability_test() {
     reset_log_files();
     ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
 
@@ -2644,65 +2864,1433 @@ int async_append_handler_test() {
     CHK_Z( launch_servers( pkgs ) );
     CHK_Z( make_group( pkgs ) );
 
-    for (auto& entry: pkgs) {
-        RaftPkg* pp = entry;
-        raft_params param = pp->raftServer->get_current_params();
-        param.return_method_ = raft_params::async_handler;
-        pp->raftServer->update_params(param);
+    const int CHECKPOINT_INTERVAL_MS = 100;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        // Snapshot by distance is disabled, only checkpoints will be created.
+        param.snapshot_distance_ = 0;
+        param.memory_only_durability_ = true;
+        param.checkpoint_interval_ms_ = CHECKPOINT_INTERVAL_MS;
+        pp->raftServer->update_params(param);
+    }
+
+    auto append_msgs = [&](size_t num) -> int {
+        for (size_t ii=0; ii<num; ++ii) {
+            std::string test_msg = "test" + std::to_string(ii);
+            ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+            msg->put(test_msg);
+            ptr< cmd_result< ptr<buffer> > > ret =
+                s1.raftServer->append_entries( {msg} );
+            CHK_TRUE( ret->get_accepted() );
+        }
+        s1.fNet->execReqResp(); // replication.
+        s1.fNet->execReqResp(); // commit.
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        return 0;
+    };
+    CHK_Z( append_msgs(5) );
+    s1.fNet->execReqResp(); // commit.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Even without new commits, checkpoints should be created on schedule.
+    ulong committed_idx = s1.raftServer->get_committed_log_idx();
+    TestSuite::sleep_ms(CHECKPOINT_INTERVAL_MS * 3);
+    CHK_EQ( committed_idx, s1.raftServer->get_last_snapshot_idx() );
+    CHK_EQ( committed_idx, s2.raftServer->get_last_snapshot_idx() );
+    CHK_EQ( committed_idx, s3.raftServer->get_last_snapshot_idx() );
+
+    // Restart S3 with empty log store, its log should start
+    // right after the checkpoint.
+    raft_params s3_params = s3.raftServer->get_current_params();
+    s3.raftServer->shutdown();
+    s3.getTestMgr()->reset_log_store();
+    raft_server::init_options opt(false, true, true);
+    opt.raft_callback_ = cb_default;
+    s3.restartServer(&s3_params, opt);
+    s3.fNet->listen(s3.raftServer);
+    CHK_EQ( committed_idx, s3.raftServer->get_last_log_idx() );
+    CHK_EQ( committed_idx, s3.raftServer->get_committed_log_idx() );
+    CHK_TRUE( s3.raftServer->is_recovering_logs() );
+
+    // S3 should catch up with new logs.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    CHK_Z( append_msgs(3) );
+    s1.fNet->execReqResp(); // commit.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_EQ( committed_idx + 3, s3.raftServer->get_committed_log_idx() );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_FALSE( s3.raftServer->is_recovering_logs() );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int memory_only_restart_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const int CHECKPOINT_INTERVAL_MS = 100;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.snapshot_distance_ = 0;
+        param.memory_only_durability_ = true;
+        param.checkpoint_interval_ms_ = CHECKPOINT_INTERVAL_MS;
+        pp->raftServer->update_params(param);
+    }
+
+    auto append_msg = [&](const std::string& test_msg) {
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+    };
+    for (size_t ii = 0; ii < 3; ++ii) {
+        append_msg("test" + std::to_string(ii));
+    }
+    s1.fNet->execReqResp(); // replication.
+    s1.fNet->execReqResp(); // commit.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    s1.fNet->execReqResp(); // commit.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    ulong checkpoint_idx = s1.raftServer->get_committed_log_idx();
+    TestSuite::sleep_ms(CHECKPOINT_INTERVAL_MS * 3);
+    CHK_EQ( checkpoint_idx, s2.raftServer->get_last_snapshot_idx() );
+
+    // Log X is committed by S1 and S2, S3 does not have it.
+    append_msg("X");
+    s1.fNet->execReqResp(s2_addr);
+    s1.fNet->makeReqFailAll(s3_addr);
+    ulong x_idx = checkpoint_idx + 1;
+    CHK_EQ( x_idx, s1.raftServer->get_target_committed_log_idx() );
+
+    // S2 restarts and loses X.
+    raft_params s2_params = s2.raftServer->get_current_params();
+    s2.raftServer->shutdown();
+    s2.getTestMgr()->reset_log_store();
+    raft_server::init_options opt(false, true, true);
+    opt.raft_callback_ = cb_default;
+    s2.restartServer(&s2_params, opt);
+    s2.fNet->listen(s2.raftServer);
+    CHK_EQ( checkpoint_idx, s2.raftServer->get_last_log_idx() );
+    CHK_TRUE( s2.raftServer->is_recovering_logs() );
+
+    // S1 dies. S2 and S3 form a quorum, but they should not elect
+    // a leader without X.
+    s1.fNet->goesOffline();
+    s2.fTimer->invoke( timer_task_type::election_timer );
+    CHK_Z( s2.fNet->getNumPendingReqs(s3_addr) );
+
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    s3.fNet->execReqResp(); // pre-vote.
+    s3.fNet->execReqResp(); // vote.
+    CHK_FALSE( s3.raftServer->is_leader() );
+    CHK_FALSE( s2.raftServer->is_leader() );
+
+    // S1 comes back and is elected again, as the other members
+    // (including S3) accept its log.
+    s1.fNet->goesOnline();
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    CHK_FALSE( s1.raftServer->is_leader() );
+    s1.fTimer->invoke( timer_task_type::election_timer );
+    s1.fNet->execReqResp(s3_addr); // pre-vote.
+    s1.fNet->execReqResp(s3_addr); // vote.
+    CHK_TRUE( s1.raftServer->is_leader() );
+
+    // S2 recovers the logs from S1, and X survives.
+    // It may need a snapshot, which takes a few rounds.
+    for (size_t ii = 0; ii < 50 && s2.raftServer->is_recovering_logs(); ++ii) {
+        s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+        s1.fNet->execReqResp();
+    }
+    CHK_FALSE( s2.raftServer->is_recovering_logs() );
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_GT( s2.raftServer->get_committed_log_idx(), x_idx );
+    CHK_GT( s3.raftServer->get_committed_log_idx(), x_idx );
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int join_empty_node_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+    CHK_Z( launch_servers( pkgs ) );
+
+    // Organize group by using S1 and S2 only.
+    CHK_Z( make_group( {&s1, &s2} ) );
+
+    // Append a message using separate thread.
+    ExecArgs exec_args(&s1);
+    TestSuite::ThreadHolder hh(&exec_args, fake_executer, fake_executer_killer);
+
+    for (size_t ii=0; ii<5; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        exec_args.setMsg(msg);
+        exec_args.eaExecuter.invoke();
+
+        // Wait for executer thread.
+        TestSuite::sleep_ms(EXECUTOR_WAIT_MS);
+
+        CHK_NULL( exec_args.getMsg().get() );
+
+        // NOTE: Send it to S2 only, S3 will be lagging behind.
+        s1.fNet->execReqResp("S2"); // replication.
+        s1.fNet->execReqResp("S2"); // commit.
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // commit execution.
+    }
+
+    // Now add S3 to leader.
+    s1.raftServer->add_srv( *(s3.getTestMgr()->get_srv_config()) );
+    s1.fNet->execReqResp(); // join req/resp.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // S1 & S3: commit config.
+
+    s1.fNet->execReqResp(); // req to S2 for new config.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // S2: commit config.
+
+    // First heartbeat to S3, it will initiate snapshot transmission.
+    s1.fTimer->invoke(timer_task_type::heartbeat_timer);
+    s1.fNet->execReqResp();
+
+    // Send the entire snapshot.
+    do {
+        s1.fNet->execReqResp();
+    } while (s3.raftServer->is_receiving_snapshot());
+
+    // Configuration change.
+    s1.fTimer->invoke(timer_task_type::heartbeat_timer);
+    s1.fNet->execReqResp(); // replication.
+    s1.fNet->execReqResp(); // commit.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // commit execution.
+
+    s1.fTimer->invoke(timer_task_type::heartbeat_timer);
+    s1.fNet->execReqResp(); // replication.
+    s1.fNet->execReqResp(); // commit.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) ); // commit execution.
+    print_stats(pkgs);
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    // For S3, do not check pre-commit list.
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    fake_executer_killer(&exec_args);
+    hh.join();
+    CHK_Z( hh.getResult() );
+
+    f_base->destroy();
+
+    return 0;
+}
+
+static int async_handler(std::list<ulong>* idx_list,
+                         ptr< cmd_result< ptr<buffer> > >& cmd_result,
+                         cmd_result_code expected_code,
+                         ptr<buffer>& result,
+                         ptr<std::exception>& err)
+{
+    CHK_EQ( expected_code, cmd_result->get_result_code() );
+
+    if (expected_code == cmd_result_code::OK) {
+        result->pos(0);
+        ulong idx = result->get_ulong();
+        if (idx_list) {
+            idx_list->push_back(idx);
+        }
+
+    } else {
+        CHK_NULL( result.get() );
+    }
+    return 0;
+}
+
+int async_append_handler_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 10;
+
+    // Append messages asynchronously.
+    std::list< ptr< cmd_result< ptr<buffer> > > > handlers;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+
+        CHK_TRUE( ret->get_accepted() );
+
+        handlers.push_back(ret);
+    }
+
+    // Packet for pre-commit.
+    s1.fNet->execReqResp();
+    // Packet for commit.
+    s1.fNet->execReqResp();
+    // Wait for bg commit.
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // One more time to make sure.
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Now all async handlers should have result.
+    std::list<ulong> idx_list;
+    for (auto& entry: handlers) {
+        ptr< cmd_result< ptr<buffer> > > result = entry;
+        cmd_result< ptr<buffer> >::handler_type my_handler =
+            std::bind( async_handler,
+                       &idx_list,
+                       result,
+                       cmd_result_code::OK,
+                       std::placeholders::_1,
+                       std::placeholders::_2 );
+        result->when_ready( my_handler );
+    }
+
+    // Check if all messages are committed.
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        uint64_t idx = s1.getTestSm()->isCommitted(test_msg);
+        CHK_GT(idx, 0);
+    }
+
+    // State machine should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int async_pre_commit_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    raft_params custom_params;
+    custom_params.election_timeout_lower_bound_ = 0;
+    custom_params.election_timeout_upper_bound_ = 10000;
+    custom_params.heart_beat_interval_ = 5000;
+    custom_params.client_req_timeout_ = 1000000;
+    custom_params.reserved_log_items_ = 0;
+    custom_params.snapshot_distance_ = 0;
+    custom_params.log_sync_stop_gap_ = 1;
+    custom_params.return_method_ = raft_params::async_handler;
+    custom_params.async_pre_commit_ = true;
+    CHK_Z( launch_servers( pkgs, &custom_params ) );
+    CHK_Z( make_group( pkgs ) );
+
+    // Make pre-commit on the leader very slow.
+    const size_t PRE_COMMIT_DELAY_MS = 200;
+    s1.getTestSm()->setPreCommitDelay(PRE_COMMIT_DELAY_MS);
+
+    const size_t NUM = 10;
+
+    // Appending logs should not wait for pre-commits.
+    TestSuite::Timer timer;
+    std::list< ptr< cmd_result< ptr<buffer> > > > handlers;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+        handlers.push_back(ret);
+    }
+    CHK_SM( timer.getTimeMs(), PRE_COMMIT_DELAY_MS * 2 );
+
+    // Replication should not wait for pre-commits either.
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // All logs should be committed after their pre-commits.
+    for (auto& entry: handlers) {
+        CHK_EQ( cmd_result_code::OK, entry->get_result_code() );
+    }
+
+    // Pre-commits queued during the slow one should have been batched.
+    CHK_SM( s1.getTestSm()->getNumPreCommitBatches(), NUM );
+
+    // Pre-commits and commits should be identical.
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm(), true ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm(), true ) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int admission_control_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const size_t MAX_UNCOMMITTED = 5;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.max_uncommitted_logs_ = MAX_UNCOMMITTED;
+        pp->raftServer->update_params(param);
+    }
+
+    auto append_msg = [&](size_t ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        return s1.raftServer->append_entries( {msg} );
+    };
+
+    // Until the limit, requests should be accepted.
+    for (size_t ii=0; ii<MAX_UNCOMMITTED; ++ii) {
+        CHK_TRUE( append_msg(ii)->get_accepted() );
+    }
+    raft_server::pending_log_info info = s1.raftServer->get_pending_log_info();
+    CHK_EQ( MAX_UNCOMMITTED, info.num_uncommitted_logs_ );
+    CHK_GT( info.pending_bytes_, 0 );
+
+    // Now it should be rejected immediately.
+    ptr< cmd_result< ptr<buffer> > > ret = append_msg(MAX_UNCOMMITTED);
+    CHK_FALSE( ret->get_accepted() );
+    CHK_EQ( cmd_result_code::SERVER_IS_BUSY, ret->get_result_code() );
+
+    // Commit pending logs.
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    info = s1.raftServer->get_pending_log_info();
+    CHK_Z( info.num_uncommitted_logs_ );
+    CHK_Z( info.num_unapplied_logs_ );
+    CHK_Z( info.pending_bytes_ );
+
+    // Should be accepted again.
+    CHK_TRUE( append_msg(MAX_UNCOMMITTED)->get_accepted() );
+
+    // Limit by pending bytes, waiting for the state machine.
+    const size_t WAIT_MS = 100;
+    {   raft_params param = s1.raftServer->get_current_params();
+        param.max_uncommitted_logs_ = 0;
+        param.max_pending_bytes_ = 1;
+        param.admission_wait_ms_ = WAIT_MS;
+        s1.raftServer->update_params(param);
+    }
+    TestSuite::Timer timer;
+    ret = append_msg(MAX_UNCOMMITTED + 1);
+    CHK_FALSE( ret->get_accepted() );
+    CHK_EQ( cmd_result_code::SERVER_IS_BUSY, ret->get_result_code() );
+    CHK_GTEQ( timer.getTimeMs(), WAIT_MS );
+
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_TRUE( append_msg(MAX_UNCOMMITTED + 1)->get_accepted() );
+
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // S2 receives a log but restarts before committing it.
+    CHK_TRUE( append_msg(MAX_UNCOMMITTED + 2)->get_accepted() );
+    s1.fNet->execReqResp(s2_addr);
+    s1.fNet->execReqResp(s2_addr);
+    CHK_GT( s2.raftServer->get_last_log_idx(),
+            s2.raftServer->get_committed_log_idx() );
+    {   raft_params param = s2.raftServer->get_current_params();
+        s2.raftServer->shutdown();
+        s2.restartServer(&param);
+        s2.fNet->listen(s2.raftServer);
+    }
+
+    // Logs appended before restart should be counted.
+    info = s2.raftServer->get_pending_log_info();
+    CHK_GT( info.pending_bytes_, 0 );
+
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_Z( s2.raftServer->get_pending_log_info().pending_bytes_ );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int async_result_executor_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    // Executor that just queues tasks, to run them manually.
+    std::mutex tasks_lock;
+    std::list< std::function<void()> > tasks;
+    auto run_tasks = [&]() {
+        std::list< std::function<void()> > cur_tasks;
+        {   std::lock_guard<std::mutex> l(tasks_lock);
+            cur_tasks.swap(tasks);
+        }
+        for (auto& entry: cur_tasks) entry();
+        return cur_tasks.size();
+    };
+
+    raft_server::init_options opt(false, true, true);
+    opt.raft_callback_ = cb_default;
+    opt.result_executor_ = [&](std::function<void()> task) {
+        std::lock_guard<std::mutex> l(tasks_lock);
+        tasks.push_back(task);
+    };
+    for (auto& entry: pkgs) {
+        RaftPkg* ff = entry;
+        ff->initServer(nullptr, opt);
+        ff->fNet->listen(ff->raftServer);
+        ff->fTimer->invoke( timer_task_type::election_timer );
+    }
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 10;
+    std::atomic<size_t> num_invoked(0);
+    std::list< ptr< cmd_result<uint64_t> > > chained;
+    for (size_t ii=0; ii<NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+
+        // Chain a continuation returning the committed log index.
+        chained.push_back( ret->then( [&](cmd_result< ptr<buffer> >& res) {
+            num_invoked++;
+            buffer_serializer bs(res.get());
+            return bs.get_u64();
+        } ) );
+    }
+
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Commit thread should not invoke handlers by itself.
+    CHK_Z( num_invoked.load() );
+    for (auto& entry: chained) {
+        CHK_FALSE( entry->has_result() );
+    }
+
+    // Results should have been delivered in a smaller number of tasks.
+    // Tasks are submitted after the commit, wait for all of them.
+    size_t num_tasks = 0;
+    TestSuite::Timer timer;
+    while (num_invoked < NUM && timer.getTimeMs() < COMMIT_TIMEOUT_SEC * 1000) {
+        num_tasks += run_tasks();
+        TestSuite::sleep_ms(1);
+    }
+    CHK_GTEQ( num_tasks, 1 );
+    CHK_SM( num_tasks, NUM );
+    CHK_EQ( NUM, num_invoked.load() );
+
+    uint64_t last_idx = 0;
+    for (auto& entry: chained) {
+        CHK_EQ( cmd_result_code::OK, entry->get_result_code() );
+        CHK_TRUE( entry->get_accepted() );
+        CHK_GT( entry->get(), last_idx );
+        last_idx = entry->get();
+    }
+    CHK_EQ( s1.getTestSm()->last_commit_index(), last_idx );
+
+    // Handler bound to an executor should be invoked by the executor.
+    ptr< cmd_result<bool> > local_res = cs_new< cmd_result<bool> >();
+    local_res->set_executor( opt.result_executor_ );
+    bool local_invoked = false;
+    local_res->when_ready( [&](bool& res, ptr<std::exception>& err) {
+        local_invoked = res;
+    } );
+    bool val = true;
+    ptr<std::exception> err = nullptr;
+    local_res->set_result(val, err);
+    CHK_FALSE( local_invoked );
+    CHK_EQ( 1, run_tasks() );
+    CHK_TRUE( local_invoked );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int packed_commands_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const size_t MAX_PACKED = 16;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.max_packed_cmds_ = MAX_PACKED;
+        pp->raftServer->update_params(param);
+    }
+    uint64_t last_idx_before = s1.raftServer->get_last_log_idx();
+
+    // Slow down appending, so that concurrent commands are packed.
+    debugging_options::get_instance().handle_cli_req_sleep_us_ = 10000;
+
+    const size_t NUM_THREADS = 8;
+    const size_t NUM_PER_THREAD = 10;
+    std::mutex results_lock;
+    std::list< std::pair< std::string, ptr< cmd_result< ptr<buffer> > > > > results;
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < NUM_THREADS; ++ii) {
+        threads.push_back( std::thread( [&, ii]() {
+            for (size_t jj = 0; jj < NUM_PER_THREAD; ++jj) {
+                std::string test_msg = "test" + std::to_string(ii) +
+                                       "_" + std::to_string(jj);
+                ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+                msg->put(test_msg);
+                ptr< cmd_result< ptr<buffer> > > ret =
+                    s1.raftServer->append_entries( {msg} );
+                std::lock_guard<std::mutex> l(results_lock);
+                results.push_back( std::make_pair(test_msg, ret) );
+            }
+        } ) );
+    }
+    for (auto& entry: threads) entry.join();
+    debugging_options::get_instance().handle_cli_req_sleep_us_ = 0;
+
+    // Commands should be packed into a smaller number of logs.
+    uint64_t num_logs = s1.raftServer->get_last_log_idx() - last_idx_before;
+    CHK_SM( num_logs, NUM_THREADS * NUM_PER_THREAD );
+
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Each caller should get the result of its own command.
+    for (auto& entry: results) {
+        CHK_TRUE( entry.second->get_accepted() );
+        CHK_EQ( cmd_result_code::OK, entry.second->get_result_code() );
+        ptr<buffer> result = entry.second->get();
+        CHK_NONNULL( result );
+        result->pos(0);
+        CHK_EQ( entry.first, std::string(result->get_str()) );
+    }
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        CHK_EQ( num_logs, pp->getTestSm()->getNumPackedLogs() );
+        CHK_EQ( NUM_THREADS * NUM_PER_THREAD,
+                pp->getTestSm()->getNumPackedCmds() );
+    }
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int callback_event_mask_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    // Empty callback subscribes nothing.
+    CHK_FALSE( cb_func().is_subscribed(cb_func::ProcessReq) );
+    CHK_FALSE( cb_func(nullptr).is_subscribed(cb_func::ProcessReq) );
+
+    // If the library is built with `NURAFT_DISABLE_HOT_PATH_CALLBACKS`,
+    // hot path events (including state machine execution) are never
+    // delivered regardless of the mask.
+    bool hot_path_on = !cb_func::hot_path_disabled();
+
+    // Subscribe state machine execution only.
+    std::mutex events_lock;
+    std::set<cb_func::Type> events;
+    cb_func::event_mask mask = cb_func::event_bit(cb_func::StateMachineExecution);
+    s1.ctx->set_cb_func([&](cb_func::Type t, cb_func::Param* p) -> cb_func::ReturnCode {
+        {   std::lock_guard<std::mutex> l(events_lock);
+            events.insert(t);
+        }
+        return cb_default(t, p);
+    }, mask);
+    CHK_EQ( hot_path_on,
+            s1.ctx->cb_func_.is_subscribed(cb_func::StateMachineExecution) );
+    CHK_FALSE( s1.ctx->cb_func_.is_subscribed(cb_func::AppendLogs) );
+    CHK_FALSE( s1.ctx->cb_func_.is_subscribed(cb_func::RequestAppendEntries) );
+
+    const size_t NUM = 5;
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+    }
+    // Heartbeat should not be delivered either.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    {   std::lock_guard<std::mutex> l(events_lock);
+        CHK_EQ( hot_path_on, events.count(cb_func::StateMachineExecution) > 0 );
+        for (cb_func::Type t: events) {
+            CHK_EQ( cb_func::StateMachineExecution, t );
+        }
+    }
+
+    if (hot_path_on) {
+        // Subscribe all events, now hot path events should be delivered.
+        {   std::lock_guard<std::mutex> l(events_lock);
+            events.clear();
+        }
+        s1.ctx->set_cb_func( [&](cb_func::Type t, cb_func::Param* p)
+                                 -> cb_func::ReturnCode {
+            {   std::lock_guard<std::mutex> l(events_lock);
+                events.insert(t);
+            }
+            return cb_default(t, p);
+        });
+        for (size_t ii = 0; ii < NUM; ++ii) {
+            std::string test_msg = "test" + std::to_string(ii);
+            ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+            msg->put(test_msg);
+            s1.raftServer->append_entries( {msg} );
+        }
+        s1.fNet->execReqResp();
+        s1.fNet->execReqResp();
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+        {   std::lock_guard<std::mutex> l(events_lock);
+            CHK_TRUE( events.count(cb_func::AppendLogs) );
+            CHK_TRUE( events.count(cb_func::RequestAppendEntries) );
+            CHK_TRUE( events.count(cb_func::GotAppendEntryRespFromPeer) );
+        }
+    }
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int adaptive_timeout_test() {
+    // Failure detector itself.
+    {
+        phi_accrual_detector det;
+        CHK_FALSE( det.ready() );
+        CHK_Z( det.get_timeout_us(8.0) );
+
+        // Heartbeats every 100 ms with 5 ms jitter.
+        uint64_t ts_us = 1000000;
+        for (size_t ii = 0; ii < 20; ++ii) {
+            ts_us += (ii % 2) ? 105000 : 95000;
+            det.heartbeat(1, ts_us, 50000);
+        }
+        CHK_TRUE( det.ready() );
+        CHK_GT( det.mean_us(), 99000 );
+        CHK_SM( det.mean_us(), 101000 );
+
+        // Stddev is rounded up to 10 ms, and z is about 5.6 for phi 8.
+        uint64_t timeout_us = det.get_timeout_us(8.0);
+        CHK_GT( timeout_us, 150000 );
+        CHK_SM( timeout_us, 162000 );
+        CHK_GT( det.get_timeout_us(12.0), timeout_us );
+
+        // Short intervals (regular traffic) should not be sampled.
+        double prev_mean = det.mean_us();
+        det.heartbeat(1, ts_us + 1000, 50000);
+        CHK_EQ( prev_mean, det.mean_us() );
+
+        // Noisy heartbeats should make the timeout longer.
+        for (size_t ii = 0; ii < 100; ++ii) {
+            ts_us += (ii % 2) ? 150000 : 60000;
+            det.heartbeat(1, ts_us, 50000);
+        }
+        CHK_GT( det.get_timeout_us(8.0), timeout_us );
+
+        // New leader, samples should be cleared.
+        det.heartbeat(2, ts_us + 100000, 50000);
+        CHK_FALSE( det.ready() );
+    }
+
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const int32 MIN_HB_INTERVAL = 10;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.adaptive_election_timeout_ = true;
+        param.adaptive_heart_beat_min_interval_ = MIN_HB_INTERVAL;
+        pp->raftServer->update_params(param);
+    }
+    raft_params params = s1.raftServer->get_current_params();
+    CHK_GT( params.heart_beat_interval_, MIN_HB_INTERVAL );
+
+    for (size_t ii = 0; ii < 5; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+    }
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // RTT of fake network is very short,
+    // heartbeat interval should be the minimum.
+    std::vector<raft_server::peer_info> infos = s1.raftServer->get_peer_info_all();
+    CHK_EQ( 2, infos.size() );
+    for (auto& entry: infos) {
+        CHK_GT( entry.rtt_us_, 0 );
+        CHK_EQ( MIN_HB_INTERVAL, entry.hb_interval_ms_ );
+    }
+
+    // Followers keep working with the adaptive election timeout.
+    for (size_t ii = 0; ii < 3; ++ii) {
+        s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+        s1.fNet->execReqResp();
+    }
+    CHK_TRUE( s1.raftServer->is_leader() );
+    CHK_EQ( 1, s2.raftServer->get_leader() );
+    CHK_EQ( 1, s3.raftServer->get_leader() );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int leader_placement_test() {
+    // Estimation and decision logic.
+    {
+        const uint64_t FAR_US = 50000;
+        const uint64_t NEAR_US = 2000;
+        std::vector<int32> voters = {1, 2, 3, 4, 5};
+        const size_t QUORUM = 2;
+
+        // S1 (leader) is far from all others.
+        leader_placement lp;
+        lp.set_rtts(1, { {2, FAR_US}, {3, FAR_US}, {4, FAR_US}, {5, FAR_US} });
+        lp.set_rtts(2, { {1, FAR_US}, {3, NEAR_US}, {4, NEAR_US},
+                         {5, NEAR_US + 1000} });
+
+        CHK_EQ( FAR_US, lp.estimate_commit_latency_us(1, voters, QUORUM) );
+        CHK_EQ( NEAR_US, lp.estimate_commit_latency_us(2, voters, QUORUM) );
+        // S3 has no report, but the reverse direction is used.
+        CHK_EQ( NEAR_US, lp.get_rtt(3, 2) );
+        CHK_EQ( FAR_US, lp.estimate_commit_latency_us(3, voters, QUORUM) );
+        // Not enough measurements.
+        CHK_Z( lp.estimate_commit_latency_us(2, voters, 5) );
+
+        // The same candidate should win 3 times in a row.
+        CHK_EQ( -1, lp.evaluate(1, voters, voters, QUORUM, 20, 1000, 3) );
+        CHK_EQ( -1, lp.evaluate(1, voters, voters, QUORUM, 20, 1000, 3) );
+        CHK_EQ( 2, lp.evaluate(1, voters, voters, QUORUM, 20, 1000, 3) );
+
+        // History is cleared after the decision.
+        CHK_EQ( -1, lp.evaluate(1, voters, voters, QUORUM, 20, 1000, 3) );
+
+        // Member not in the candidate list cannot be chosen.
+        std::vector<int32> candidates = {1, 3, 4, 5};
+        for (size_t ii = 0; ii < 5; ++ii) {
+            CHK_EQ( -1, lp.evaluate(1, candidates, voters, QUORUM, 20, 1000, 3) );
+        }
+
+        // Not enough gain.
+        CHK_EQ( -1, lp.evaluate(1, voters, voters, QUORUM, 100, 1000, 1) );
+        CHK_EQ( -1, lp.evaluate(1, voters, voters, QUORUM, 20, FAR_US, 1) );
+
+        // Nothing is known after reset.
+        lp.reset();
+        CHK_Z( lp.estimate_commit_latency_us(1, voters, QUORUM) );
+        CHK_EQ( -1, lp.evaluate(1, voters, voters, QUORUM, 20, 1000, 1) );
+    }
+
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    // S3 cannot be the leader, so that only one member
+    // can gain from being the leader in each layout below.
+    CHK_EQ( raft_server::PrioritySetResult::SET, s1.raftServer->set_priority(3, 0) );
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Same as `LEADER_PLACEMENT_REQUIRED_WINS` and
+    // `LEADER_PLACEMENT_HOLD_INTERVALS` in `raft_server.cxx`.
+    const size_t REQUIRED_WINS = 3;
+    const uint64_t HOLD_INTERVALS = 10;
+    const int32 PLACEMENT_INTERVAL_MS = 50;
+    const uint64_t HOLD_MS = PLACEMENT_INTERVAL_MS * HOLD_INTERVALS;
+    const int32 FAR_MS = 5;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.leader_placement_interval_ms_ = PLACEMENT_INTERVAL_MS;
+        // A member not responding within the lower bound
+        // cannot be a candidate.
+        param.election_timeout_lower_bound_ = 1000;
+        pp->raftServer->update_params(param);
+    }
+
+    // A round: the leader sends heartbeats and gets the responses,
+    // which carry the RTTs measured by followers. The leader evaluates
+    // the placement at most once per round.
+    auto run_round = [&](RaftPkg& leader) {
+        TestSuite::sleep_ms(PLACEMENT_INTERVAL_MS);
+        leader.fTimer->invoke( timer_task_type::heartbeat_timer );
+        leader.fNet->execReqResp();
+    };
+    // After the leader resigns, let the successor win the election.
+    auto elect = [&](RaftPkg& next) -> int {
+        for (size_t ii = 0; ii < 10 && !next.raftServer->is_leader(); ++ii) {
+            for (auto& entry: pkgs) entry->fNet->execReqResp();
+            CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        }
+        CHK_TRUE( next.raftServer->is_leader() );
+        for (auto& entry: pkgs) entry->fNet->execReqResp();
+        for (auto& entry: pkgs) entry->fNet->execReqResp();
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        return 0;
+    };
+
+    // Members ping each other, and followers report RTTs to the leader.
+    // All RTTs of fake network are too short to gain anything,
+    // leader should stay, even after the hold interval.
+    for (size_t ii = 0; ii < HOLD_INTERVALS + 2; ++ii) run_round(s1);
+    CHK_TRUE( s1.raftServer->is_leader() );
+    CHK_EQ( 1, s2.raftServer->get_leader() );
+    CHK_EQ( 1, s3.raftServer->get_leader() );
+
+    // S1 is far from the others. S1 itself knows only its own RTTs, so
+    // the move below is possible only by the RTTs reported by S2 and S3.
+    f_base->setLatencyMs(s1_addr, s2_addr, FAR_MS);
+    f_base->setLatencyMs(s1_addr, s3_addr, FAR_MS);
+    size_t num_rounds = 0;
+    while (s1.raftServer->is_leader() && num_rounds < 50) {
+        run_round(s1);
+        num_rounds++;
+    }
+    // The same candidate should win `REQUIRED_WINS` evaluations in a row,
+    // and S1 resigns by the next heartbeat response.
+    CHK_FALSE( s1.raftServer->is_leader() );
+    CHK_GT( num_rounds, REQUIRED_WINS );
+    CHK_Z( elect(s2) );
+    CHK_EQ( 2, s1.raftServer->get_leader() );
+    CHK_EQ( 2, s3.raftServer->get_leader() );
+
+    // Move the leadership back to S1 manually. S1 should not move it
+    // again until the hold interval passes since it became the leader,
+    // even though S2 is still the better place.
+    s2.raftServer->yield_leadership(false, 1);
+    s2.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s2.fNet->execReqResp();
+    s2.fNet->execReqResp();
+    CHK_Z( elect(s1) );
+    TestSuite::Timer hold_timer;
+
+    num_rounds = 0;
+    while (s1.raftServer->is_leader() && num_rounds < 50) {
+        run_round(s1);
+        num_rounds++;
+    }
+    CHK_FALSE( s1.raftServer->is_leader() );
+    CHK_GTEQ( hold_timer.getTimeMs(), HOLD_MS );
+    CHK_Z( elect(s2) );
+
+    // Replication works as usual.
+    for (size_t ii = 0; ii < 5; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s2.raftServer->append_entries( {msg} );
+    }
+    s2.fNet->execReqResp();
+    s2.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    for (size_t ii = 0; ii < 5; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        CHK_GT( s2.getTestSm()->isCommitted(test_msg), 0 );
+    }
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int leadership_handoff_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.auto_forwarding_ = true;
+        param.leadership_handoff_ = true;
+        pp->raftServer->update_params(param);
+    }
+
+    // Appended, but not replicated yet.
+    ptr<buffer> msg_a = buffer::alloc(sizeof(uint64_t));
+    msg_a->put( (uint64_t)1 );
+    ptr< cmd_result< ptr<buffer> > > ret_a =
+        s1.raftServer->append_entries( {msg_a} );
+    CHK_TRUE( ret_a->get_accepted() );
+    CHK_FALSE( ret_a->has_result() );
+
+    // Yield leadership to S2.
+    s1.dbgLog(" --- yield leadership ---");
+    s1.raftServer->yield_leadership(false, 2);
+
+    // Request during the transfer should be held, not rejected.
+    ptr<buffer> msg_b = buffer::alloc(sizeof(uint64_t));
+    msg_b->put( (uint64_t)2 );
+    ptr< cmd_result< ptr<buffer> > > ret_b =
+        s1.raftServer->append_entries( {msg_b} );
+    CHK_FALSE( ret_b->has_result() );
+
+    // Replicate logs.
+    s1.fNet->execReqResp();
+    CHK_TRUE( s1.raftServer->is_leader() );
+
+    // Send heartbeat. After getting response of heartbeat,
+    // S1 will resign.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    CHK_FALSE( s1.raftServer->is_leader() );
+    CHK_FALSE( ret_b->has_result() );
+    // Send takeover request.
+    s1.fNet->execReqResp();
+
+    // S2 sends vote requests.
+    s2.fNet->execReqResp();
+    CHK_TRUE( s2.raftServer->is_leader() );
+
+    // Send new config as a new leader,
+    // then S1 forwards the held request to S2.
+    s2.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_TRUE( ret_b->has_result() );
+    CHK_EQ( cmd_result_code::OK, ret_b->get_result_code() );
+
+    // Commit all logs.
+    s2.fNet->execReqResp();
+    s2.fNet->execReqResp();
+    s2.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // The request appended by S1 was completed
+    // as S2 committed it, instead of being cancelled.
+    CHK_TRUE( ret_a->has_result() );
+    CHK_EQ( cmd_result_code::OK, ret_a->get_result_code() );
+
+    uint64_t last_idx = s2.raftServer->get_committed_log_idx();
+    CHK_EQ( last_idx, s1.raftServer->get_committed_log_idx() );
+    CHK_EQ( last_idx, s3.raftServer->get_committed_log_idx() );
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int witness_member_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+
+    // Restart S3 as a witness.
+    s3.raftServer->shutdown();
+    s3.getTestMgr()->set_srv_config
+        ( cs_new<srv_config>(3, 1, s3_addr, "server 3", false, 50, true) );
+    CHK_Z( launch_servers( {&s3}, nullptr, true ) );
+    CHK_FALSE( s3.raftServer->is_leader() );
+
+    CHK_Z( make_group( pkgs ) );
+    CHK_TRUE( s1.raftServer->get_srv_config(3)->is_witness() );
+    CHK_FALSE( s1.raftServer->get_srv_config(2)->is_witness() );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        pp->raftServer->update_params(param);
+    }
+
+    const size_t NUM = 3;
+    for (size_t ii = 0; ii < NUM; ++ii) {
+        std::string test_msg = "test" + std::to_string(ii);
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+
+        s1.fNet->execReqResp(); // replication.
+        s1.fNet->execReqResp(); // commit.
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        CHK_TRUE( ret->has_result() );
+    }
+
+    uint64_t last_idx = s1.raftServer->get_committed_log_idx();
+    CHK_EQ( last_idx, s2.raftServer->get_committed_log_idx() );
+    CHK_EQ( last_idx, s3.raftServer->get_committed_log_idx() );
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
+
+    // Witness keeps the checksum of the payload only,
+    // and does not execute logs.
+    ptr<log_entry> le = s1.getTestMgr()->get_inmem_log_store()->entry_at(last_idx);
+    ptr<log_entry> wle = s3.getTestMgr()->get_inmem_log_store()->entry_at(last_idx);
+    CHK_EQ( le->get_term(), wle->get_term() );
+    CHK_EQ( sizeof(uint32_t), wle->get_buf().size() );
+    uint32_t wcrc = 0;
+    memcpy(&wcrc, wle->get_buf().data_begin(), sizeof(wcrc));
+    CHK_EQ( le->get_crc32(), wcrc );
+    CHK_Z( s3.getTestSm()->isCommitted("test0") );
+    CHK_GT( s2.getTestSm()->isCommitted("test0"), 0 );
+
+    // Replicated to the witness only: should not be committed,
+    // until the other member keeping payloads gets it.
+    {
+        std::string test_msg = "witness_only";
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
+
+        s1.fNet->execReqResp("S3");
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        CHK_EQ( last_idx, s1.raftServer->get_committed_log_idx() );
+        CHK_FALSE( ret->has_result() );
+
+        s1.fNet->execReqResp("S2");
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        CHK_EQ( last_idx + 1, s1.raftServer->get_committed_log_idx() );
+        CHK_TRUE( ret->has_result() );
+
+        s1.fNet->execReqResp();
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
     }
 
-    const size_t NUM = 10;
+    // Witness never tries to be a leader.
+    s3.fTimer->invoke( timer_task_type::election_timer );
+    CHK_FALSE( s3.raftServer->is_leader() );
+    CHK_EQ( 1, s3.raftServer->get_leader() );
+    CHK_FALSE( s3.raftServer->request_leadership() );
 
-    // Append messages asynchronously.
-    std::list< ptr< cmd_result< ptr<buffer> > > > handlers;
-    for (size_t ii=0; ii<NUM; ++ii) {
-        std::string test_msg = "test" + std::to_string(ii);
+    // Make S3 lag behind, so that snapshot is needed.
+    for (size_t ii = 0; ii < 10; ++ii) {
+        std::string test_msg = "lag" + std::to_string(ii);
         ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
         msg->put(test_msg);
         ptr< cmd_result< ptr<buffer> > > ret =
             s1.raftServer->append_entries( {msg} );
-
         CHK_TRUE( ret->get_accepted() );
 
-        handlers.push_back(ret);
+        s1.fNet->execReqResp("S2"); // replication.
+        s1.fNet->execReqResp("S2"); // commit.
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
     }
+    s1.fNet->makeReqFail("S3");
+    CHK_GT( s1.raftServer->get_last_snapshot_idx(),
+            s3.raftServer->get_last_log_idx() );
 
-    // Packet for pre-commit.
-    s1.fNet->execReqResp();
-    // Packet for commit.
+    // Snapshot to the witness has the metadata only.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
     s1.fNet->execReqResp();
-    // Wait for bg commit.
+    for (size_t ii = 0; ii < 3; ++ii) {
+        s1.fNet->execReqResp();
+    }
     CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_EQ( s1.raftServer->get_last_snapshot_idx(),
+            s3.raftServer->get_last_snapshot_idx() );
+    CHK_NULL( s3.getTestSm()->last_snapshot().get() );
+    CHK_Z( s3.getTestSm()->getNumSnapshotCreations() );
 
-    // One more time to make sure.
+    // Catch up the rest of logs.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
     s1.fNet->execReqResp();
     s1.fNet->execReqResp();
     CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    CHK_EQ( s1.raftServer->get_committed_log_idx(),
+            s3.raftServer->get_committed_log_idx() );
+    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
 
-    // Now all async handlers should have result.
-    std::list<ulong> idx_list;
-    for (auto& entry: handlers) {
-        ptr< cmd_result< ptr<buffer> > > result = entry;
-        cmd_result< ptr<buffer> >::handler_type my_handler =
-            std::bind( async_handler,
-                       &idx_list,
-                       result,
-                       cmd_result_code::OK,
-                       std::placeholders::_1,
-                       std::placeholders::_2 );
-        result->when_ready( my_handler );
-    }
+    // Restart the witness after the log compaction, the commit index
+    // and the snapshot metadata should be recovered.
+    uint64_t witness_snp_idx = s3.raftServer->get_last_snapshot_idx();
+    CHK_GT( witness_snp_idx, 0 );
+    CHK_GT( s3.getTestMgr()->get_inmem_log_store()->start_index(), 1 );
+    s3.raftServer->shutdown();
+    s3.restartServer();
+    s3.fNet->listen(s3.raftServer);
+    CHK_EQ( witness_snp_idx, s3.raftServer->get_last_snapshot_idx() );
+    CHK_GTEQ( s3.raftServer->get_committed_log_idx(), witness_snp_idx );
 
-    // Check if all messages are committed.
-    for (size_t ii=0; ii<NUM; ++ii) {
-        std::string test_msg = "test" + std::to_string(ii);
-        uint64_t idx = s1.getTestSm()->isCommitted(test_msg);
-        CHK_GT(idx, 0);
-    }
+    {
+        std::string test_msg = "after_restart";
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        ptr< cmd_result< ptr<buffer> > > ret =
+            s1.raftServer->append_entries( {msg} );
+        CHK_TRUE( ret->get_accepted() );
 
-    // State machine should be identical.
-    CHK_OK( s2.getTestSm()->isSame( *s1.getTestSm() ) );
-    CHK_OK( s3.getTestSm()->isSame( *s1.getTestSm() ) );
+        s1.fNet->execReqResp(); // replication.
+        s1.fNet->execReqResp(); // commit.
+        CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+        CHK_TRUE( ret->has_result() );
+    }
+    CHK_EQ( s1.raftServer->get_committed_log_idx(),
+            s3.raftServer->get_committed_log_idx() );
 
     print_stats(pkgs);
 
@@ -3435,6 +5023,294 @@ int extended_append_entries_api_test() {
     return 0;
 }
 
+int hibernation_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    const int32 HIBERNATION_TIMEOUT_MS = 10;
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.hibernation_timeout_ms_ = HIBERNATION_TIMEOUT_MS;
+        pp->raftServer->update_params(param);
+    }
+
+    auto append_and_replicate = [&](const std::string& test_msg) {
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+        s1.fNet->execReqResp();
+        s1.fNet->execReqResp();
+    };
+    append_and_replicate("test1");
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Not idle long enough.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    for (auto& entry: pkgs) CHK_FALSE( entry->raftServer->is_hibernating() );
+
+    // Idle, the whole group hibernates.
+    TestSuite::sleep_ms(HIBERNATION_TIMEOUT_MS * 2);
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    for (auto& entry: pkgs) CHK_TRUE( entry->raftServer->is_hibernating() );
+
+    // No timers are running.
+    CHK_Z( s1.fTimer->getNumPendingTasks( timer_task_type::heartbeat_timer ) );
+    CHK_Z( s2.fTimer->getNumPendingTasks( timer_task_type::election_timer ) );
+    CHK_Z( s3.fTimer->getNumPendingTasks( timer_task_type::election_timer ) );
+
+    // Client request wakes up the leader, and then followers.
+    append_and_replicate("test2");
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    for (auto& entry: pkgs) CHK_FALSE( entry->raftServer->is_hibernating() );
+    CHK_GT( s1.fTimer->getNumPendingTasks( timer_task_type::heartbeat_timer ), 0 );
+    CHK_GT( s2.fTimer->getNumPendingTasks( timer_task_type::election_timer ), 0 );
+    CHK_GT( s3.fTimer->getNumPendingTasks( timer_task_type::election_timer ), 0 );
+    CHK_TRUE( s1.raftServer->is_leader() );
+
+    // Hibernate again, and then a follower wakes up by itself.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    TestSuite::sleep_ms(HIBERNATION_TIMEOUT_MS * 2);
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    for (auto& entry: pkgs) CHK_TRUE( entry->raftServer->is_hibernating() );
+
+    s2.raftServer->wake_up();
+    CHK_FALSE( s2.raftServer->is_hibernating() );
+    CHK_GT( s2.fTimer->getNumPendingTasks( timer_task_type::election_timer ), 0 );
+
+    // Its pre-vote wakes up the others.
+    s2.dbgLog(" --- S2 election timeout ---");
+    s2.fTimer->invoke( timer_task_type::election_timer );
+    s2.fNet->execReqResp();
+    CHK_FALSE( s1.raftServer->is_hibernating() );
+    CHK_FALSE( s3.raftServer->is_hibernating() );
+
+    // Leader's heartbeat keeps the group as it is.
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    CHK_TRUE( s1.raftServer->is_leader() );
+    CHK_EQ( 1, s2.raftServer->get_leader() );
+    CHK_EQ( 1, s3.raftServer->get_leader() );
+
+    append_and_replicate("test3");
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    print_stats(pkgs);
+
+    s1.raftServer->shutdown();
+    s2.raftServer->shutdown();
+    s3.raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int zone_aware_quorum_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+    std::string s4_addr = "S4";
+    std::string s5_addr = "S5";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    RaftPkg s4(f_base, 4, s4_addr);
+    RaftPkg s5(f_base, 5, s5_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3, &s4, &s5};
+
+    CHK_Z( launch_servers( pkgs ) );
+
+    // S1 - S4 are in zone 1, and S5 is in zone 2.
+    s5.getTestMgr()->set_srv_config
+        ( cs_new<srv_config>(5, 2, s5_addr, "", false) );
+    CHK_Z( make_group( pkgs ) );
+    CHK_EQ( 2, s1.raftServer->get_dc_id(5) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.min_commit_zones_ = 2;
+        param.min_election_zones_ = 2;
+        pp->raftServer->update_params(param);
+    }
+
+    ulong committed_idx = s1.raftServer->get_target_committed_log_idx();
+    std::string test_msg = "test";
+    ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+    msg->put(test_msg);
+    s1.raftServer->append_entries( {msg} );
+
+    // Quorum in zone 1 only, should not be committed.
+    s1.fNet->execReqResp(s2_addr);
+    s1.fNet->execReqResp(s3_addr);
+    s1.fNet->execReqResp(s4_addr);
+    CHK_EQ( committed_idx, s1.raftServer->get_target_committed_log_idx() );
+
+    // Now zone 2 has it.
+    s1.fNet->execReqResp(s5_addr);
+    CHK_EQ( committed_idx + 1, s1.raftServer->get_target_committed_log_idx() );
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    // Move the leadership to S2.
+    s1.dbgLog(" --- yield leadership ---");
+    s1.raftServer->yield_leadership(false, 2);
+    s1.fTimer->invoke( timer_task_type::heartbeat_timer );
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+
+    // Votes from zone 1 only, S2 should not be the leader.
+    s2.fNet->execReqResp(s1_addr);
+    s2.fNet->execReqResp(s3_addr);
+    s2.fNet->execReqResp(s4_addr);
+    CHK_FALSE( s2.raftServer->is_leader() );
+
+    // Now S5 in zone 2 votes.
+    s2.fNet->execReqResp(s5_addr);
+    CHK_TRUE( s2.raftServer->is_leader() );
+
+    // Send new config as a new leader.
+    s2.fNet->execReqResp();
+    // Follow-up: commit.
+    s2.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+    for (auto& entry: pkgs) CHK_EQ( 2, entry->raftServer->get_leader() );
+
+    print_stats(pkgs);
+
+    for (auto& entry: pkgs) entry->raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
+int slow_follower_quarantine_test() {
+    reset_log_files();
+    ptr<FakeNetworkBase> f_base = cs_new<FakeNetworkBase>();
+
+    std::string s1_addr = "S1";
+    std::string s2_addr = "S2";
+    std::string s3_addr = "S3";
+
+    RaftPkg s1(f_base, 1, s1_addr);
+    RaftPkg s2(f_base, 2, s2_addr);
+    RaftPkg s3(f_base, 3, s3_addr);
+    std::vector<RaftPkg*> pkgs = {&s1, &s2, &s3};
+
+    CHK_Z( launch_servers( pkgs ) );
+    CHK_Z( make_group( pkgs ) );
+
+    for (auto& entry: pkgs) {
+        RaftPkg* pp = entry;
+        raft_params param = pp->raftServer->get_current_params();
+        param.return_method_ = raft_params::async_handler;
+        param.use_full_consensus_among_healthy_members_ = true;
+        param.slow_follower_rtt_ratio_ = 10;
+        param.slow_follower_detection_count_ = 3;
+        pp->raftServer->update_params(param);
+    }
+
+    size_t num_quarantined = 0;
+    size_t num_restored = 0;
+    s1.ctx->set_cb_func([&](cb_func::Type t, cb_func::Param* p) -> cb_func::ReturnCode {
+        if (t == cb_func::Type::FollowerQuarantined && p->peerId == 3) {
+            num_quarantined++;
+        } else if (t == cb_func::Type::FollowerRestored && p->peerId == 3) {
+            num_restored++;
+        }
+        return cb_default(t, p);
+    });
+
+    // Requests to S2 are handled right away, so that
+    // nothing sent to S2 waits for the delay to S3.
+    auto drain_s2 = [&]() {
+        while (s1.fNet->getNumPendingReqs(s2_addr)) {
+            s1.fNet->execReqResp(s2_addr);
+        }
+    };
+    auto append_and_replicate_to_s2 = [&](const std::string& test_msg) {
+        ptr<buffer> msg = buffer::alloc(test_msg.size() + 1);
+        msg->put(test_msg);
+        s1.raftServer->append_entries( {msg} );
+        drain_s2();
+    };
+    auto replicate_to_s3 = [&](size_t delay_ms) {
+        while (s1.fNet->getNumPendingReqs(s3_addr)) {
+            if (delay_ms) TestSuite::sleep_ms(delay_ms, "slow follower");
+            s1.fNet->execReqResp(s3_addr);
+            drain_s2();
+        }
+    };
+
+    // S3 responds slowly.
+    const size_t DELAY_MS = 100;
+    for (size_t ii = 0; ii < 5; ++ii) {
+        if (s1.raftServer->get_peer_info(3).quarantined_) break;
+
+        ulong committed_idx = s1.raftServer->get_target_committed_log_idx();
+        append_and_replicate_to_s2("slow" + std::to_string(ii));
+        // Full consensus, should wait for S3.
+        CHK_EQ( committed_idx, s1.raftServer->get_target_committed_log_idx() );
+
+        replicate_to_s3(DELAY_MS);
+        CHK_EQ( committed_idx + 1, s1.raftServer->get_target_committed_log_idx() );
+    }
+    CHK_TRUE( s1.raftServer->get_peer_info(3).quarantined_ );
+    CHK_FALSE( s1.raftServer->get_peer_info(2).quarantined_ );
+    CHK_EQ(1, num_quarantined);
+
+    // S3 is quarantined, the leader does not wait for it anymore.
+    ulong committed_idx = s1.raftServer->get_target_committed_log_idx();
+    append_and_replicate_to_s2("quarantined");
+    CHK_EQ( committed_idx + 1, s1.raftServer->get_target_committed_log_idx() );
+    CHK_EQ(0, num_restored);
+
+    // S3 gets back to normal, it should be restored eventually.
+    for (size_t ii = 0; ii < 100; ++ii) {
+        replicate_to_s3(0);
+        if (!s1.raftServer->get_peer_info(3).quarantined_) break;
+        append_and_replicate_to_s2("fast" + std::to_string(ii));
+    }
+    CHK_FALSE( s1.raftServer->get_peer_info(3).quarantined_ );
+    CHK_EQ(1, num_restored);
+
+    s1.fNet->execReqResp();
+    s1.fNet->execReqResp();
+    CHK_Z( wait_for_sm_exec(pkgs, COMMIT_TIMEOUT_SEC) );
+
+    print_stats(pkgs);
+
+    for (auto& entry: pkgs) entry->raftServer->shutdown();
+
+    f_base->destroy();
+
+    return 0;
+}
+
 }  // namespace raft_server_test;
 using namespace raft_server_test;
 
@@ -3512,6 +5388,9 @@ int main(int argc, char** argv) {
     ts.doTest( "snapshot basic test",
                snapshot_basic_test );
 
+    ts.doTest( "snapshot pipelined install test",
+               snapshot_pipelined_install_test );
+
     ts.doTest( "snapshot manual creation test",
                snapshot_manual_creation_test );
 
@@ -3527,12 +5406,51 @@ int main(int argc, char** argv) {
     ts.doTest( "snapshot close for removed peer test",
                snapshot_close_for_removed_peer_test );
 
+    ts.doTest( "bulk ingest test",
+               bulk_ingest_test );
+
+    ts.doTest( "bulk ingest rollback test",
+               bulk_ingest_rollback_test );
+
+    ts.doTest( "memory-only durability test",
+               memory_only_durability_test );
+
+    ts.doTest( "memory-only durability restart test",
+               memory_only_restart_test );
+
     ts.doTest( "join empty node test",
                join_empty_node_test );
 
     ts.doTest( "async append handler test",
                async_append_handler_test );
 
+    ts.doTest( "async pre-commit test",
+               async_pre_commit_test );
+
+    ts.doTest( "admission control test",
+               admission_control_test );
+
+    ts.doTest( "async result executor test",
+               async_result_executor_test );
+
+    ts.doTest( "packed commands test",
+               packed_commands_test );
+
+    ts.doTest( "callback event mask test",
+               callback_event_mask_test );
+
+    ts.doTest( "adaptive timeout test",
+               adaptive_timeout_test );
+
+    ts.doTest( "leader placement test",
+               leader_placement_test );
+
+    ts.doTest( "leadership handoff test",
+               leadership_handoff_test );
+
+    ts.doTest( "witness member test",
+               witness_member_test );
+
     ts.doTest( "async append handler cancel test",
                async_append_handler_cancel_test );
 
@@ -3551,6 +5469,15 @@ int main(int argc, char** argv) {
     ts.doTest( "extended append_entries API test",
                extended_append_entries_api_test );
 
+    ts.doTest( "hibernation test",
+               hibernation_test );
+
+    ts.doTest( "zone aware quorum test",
+               zone_aware_quorum_test );
+
+    ts.doTest( "slow follower quarantine test",
+               slow_follower_quarantine_test );
+
 #ifdef ENABLE_RAFT_STATS
     _msg("raft stats: ENABLED\n");
 #else
@@ -56,6 +56,20 @@ int srv_config_test() {
 
     CHK_EQ( srv_conf->get_endpoint(), srv_conf1->get_endpoint() );
     CHK_EQ( srv_conf->get_id(), srv_conf1->get_id() );
+    CHK_FALSE( srv_conf1->is_learner() );
+    CHK_FALSE( srv_conf1->is_witness() );
+
+    // Witness flag shares the byte with learner flag.
+    ptr<srv_config> witness_conf
+                    ( cs_new<srv_config>
+                      ( rnd(), 1, "witness", "aux", false, 0, true ) );
+    ptr<buffer> witness_conf_buf( witness_conf->serialize() );
+
+    ptr<srv_config> witness_conf1( srv_config::deserialize(*witness_conf_buf) );
+    CHK_EQ( witness_conf->get_id(), witness_conf1->get_id() );
+    CHK_EQ( 0, witness_conf1->get_priority() );
+    CHK_FALSE( witness_conf1->is_learner() );
+    CHK_TRUE( witness_conf1->is_witness() );
 
     return 0;
 }
@@ -238,6 +252,37 @@ int log_entry_test() {
     return 0;
 }
 
+int inline_log_entry_test() {
+    for (size_t data_size: {size_t(0), size_t(100), size_t(0x4000), size_t(0x10000)}) {
+        ptr<buffer> data = buffer::alloc(data_size);
+        for (size_t i = 0; i < data->size(); ++i) {
+            data->put( static_cast<byte>( rnd() % 255 ) );
+        }
+        data->pos(0);
+
+        ulong term = long_val( rnd() );
+        ptr<log_entry> entry = log_entry::make( term,
+                                                data->data_begin(),
+                                                data->size(),
+                                                log_val_type::app_log );
+        ptr<log_entry> ref_entry = cs_new<log_entry>
+                                   ( term, data, log_val_type::app_log );
+        CHK_FALSE( entry->is_buf_null() );
+        CHK_Z( compare_log_entries(entry, ref_entry) );
+        CHK_EQ( ref_entry->get_crc32(), entry->get_crc32() );
+
+        ptr<buffer> buf2 = entry->serialize();
+        CHK_Z( compare_log_entries(entry, log_entry::deserialize(*buf2)) );
+
+        // Buffer pointer should be valid even after the log entry is gone.
+        ptr<buffer> payload = entry->get_buf_ptr();
+        entry.reset();
+        CHK_EQ( data_size, payload->size() );
+        CHK_Z( memcmp( data->data_begin(), payload->data_begin(), data_size ) );
+    }
+    return 0;
+}
+
 int custom_notification_msg_test(bool empty_context) {
     custom_notification_msg orig_msg;
     orig_msg.type_ = custom_notification_msg::out_of_log_range_warning;
@@ -297,6 +342,7 @@ int main(int argc, char** argv) {
                snapshot_sync_req_zero_buffer_test,
                TestRange<bool>( {true, false} ) );
     ts.doTest( "log_entry test", log_entry_test );
+    ts.doTest( "inline log_entry test", inline_log_entry_test );
     ts.doTest( "custom_notification_msg test",
                custom_notification_msg_test,
                TestRange<bool>( {true, false} ) );
@@ -0,0 +1,412 @@
+/************************************************************************
+Copyright 2017-2019 eBay Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+**************************************************************************/
+
+#include "nuraft.hxx"
+#include "shared_wal.hxx"
+
+#include "test_common.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace nuraft;
+
+namespace shared_wal_test {
+
+static ptr<log_entry> make_log(ulong term, const std::string& str) {
+    ptr<buffer> buf = buffer::alloc(str.size() + 1);
+    buf->put(str);
+    buf->pos(0);
+    return cs_new<log_entry>(term, buf);
+}
+
+static std::string get_str(ptr<log_entry> le) {
+    buffer& buf = le->get_buf();
+    buf.pos(0);
+    return buf.get_str();
+}
+
+static std::string get_log_str(uint64_t group_id, ulong idx) {
+    return "group " + std::to_string(group_id) +
+           " log " + std::to_string(idx);
+}
+
+int basic_recovery_test() {
+    std::string path;
+    TEST_SUITE_PREPARE_PATH(path);
+    TestSuite::mkdir(path);
+
+    const size_t NUM_GROUPS = 3;
+    const size_t NUM_LOGS = 10;
+    {   ptr<shared_wal> wal = cs_new<shared_wal>(path);
+        CHK_TRUE( wal->open() );
+
+        for (size_t gg = 1; gg <= NUM_GROUPS; ++gg) {
+            ptr<shared_wal_log_store> ls = wal->get_log_store(gg);
+            for (size_t ii = 1; ii <= NUM_LOGS; ++ii) {
+                ptr<log_entry> le = make_log(1, get_log_str(gg, ii));
+                CHK_EQ(ii, ls->append(le));
+            }
+            ls->end_of_append_batch(1, NUM_LOGS);
+            CHK_EQ(NUM_LOGS, ls->last_durable_index());
+
+            srv_state state(gg * 10, gg, true);
+            wal->save_state(gg, state);
+        }
+
+        // Overwrite the last 3 logs of group 2 with a new term.
+        ptr<shared_wal_log_store> ls2 = wal->get_log_store(2);
+        ptr<log_entry> le = make_log(2, "overwritten");
+        ls2->write_at(NUM_LOGS - 2, le);
+        CHK_EQ(NUM_LOGS - 1, ls2->next_slot());
+        CHK_EQ(2, ls2->term_at(NUM_LOGS - 2));
+
+        // Compact group 3.
+        ptr<shared_wal_log_store> ls3 = wal->get_log_store(3);
+        ls3->compact(5);
+        CHK_EQ(6, ls3->start_index());
+        CHK_TRUE( ls3->flush() );
+        wal->close();
+    }
+
+    {   ptr<shared_wal> wal = cs_new<shared_wal>(path);
+        CHK_TRUE( wal->open() );
+        CHK_EQ(NUM_GROUPS, wal->get_group_ids().size());
+
+        ptr<shared_wal_log_store> ls1 = wal->get_log_store(1);
+        CHK_EQ(1, ls1->start_index());
+        CHK_EQ(NUM_LOGS + 1, ls1->next_slot());
+        CHK_EQ(NUM_LOGS, ls1->last_durable_index());
+        for (size_t ii = 1; ii <= NUM_LOGS; ++ii) {
+            CHK_EQ( get_log_str(1, ii), get_str(ls1->entry_at(ii)) );
+        }
+
+        ptr<shared_wal_log_store> ls2 = wal->get_log_store(2);
+        CHK_EQ(NUM_LOGS - 1, ls2->next_slot());
+        CHK_EQ( std::string("overwritten"), get_str(ls2->last_entry()) );
+        CHK_EQ(2, ls2->last_entry()->get_term());
+        CHK_EQ(1, ls2->term_at(NUM_LOGS - 3));
+
+        ptr<shared_wal_log_store> ls3 = wal->get_log_store(3);
+        CHK_EQ(6, ls3->start_index());
+        CHK_EQ(NUM_LOGS + 1, ls3->next_slot());
+        ptr<std::vector<ptr<log_entry>>> logs = ls3->log_entries(6, NUM_LOGS + 1);
+        CHK_EQ(NUM_LOGS - 5, logs->size());
+        for (size_t ii = 0; ii < logs->size(); ++ii) {
+            CHK_EQ( get_log_str(3, ii + 6), get_str((*logs)[ii]) );
+        }
+
+        for (size_t gg = 1; gg <= NUM_GROUPS; ++gg) {
+            ptr<srv_state> state = wal->read_state(gg);
+            CHK_NONNULL(state.get());
+            CHK_EQ(gg * 10, state->get_term());
+            CHK_EQ((int)gg, state->get_voted_for());
+        }
+        CHK_NULL( wal->load_config(1).get() );
+        wal->close();
+    }
+
+    TEST_SUITE_CLEANUP_PATH();
+    return 0;
+}
+
+int group_commit_test() {
+    std::string path;
+    TEST_SUITE_PREPARE_PATH(path);
+    TestSuite::mkdir(path);
+
+    ptr<shared_wal> wal = cs_new<shared_wal>(path);
+    CHK_TRUE( wal->open() );
+
+    const size_t NUM_GROUPS = 16;
+    const size_t NUM_BATCHES = 50;
+    std::vector<std::thread> threads;
+    for (size_t gg = 1; gg <= NUM_GROUPS; ++gg) {
+        threads.push_back( std::thread( [wal, gg, NUM_BATCHES]() {
+            ptr<shared_wal_log_store> ls = wal->get_log_store(gg);
+            for (size_t ii = 1; ii <= NUM_BATCHES; ++ii) {
+                ptr<log_entry> le = make_log(1, get_log_str(gg, ii));
+                ls->append(le);
+                ls->end_of_append_batch(ii, 1);
+            }
+        } ) );
+    }
+    for (std::thread& tt: threads) tt.join();
+
+    for (size_t gg = 1; gg <= NUM_GROUPS; ++gg) {
+        ptr<shared_wal_log_store> ls = wal->get_log_store(gg);
+        CHK_EQ(NUM_BATCHES, ls->last_durable_index());
+    }
+
+    // Each batch waited for its durability, but
+    // syncs are shared among groups.
+    TestSuite::_msg( "%zu batches, %zu syncs\n",
+                     NUM_GROUPS * NUM_BATCHES,
+                     (size_t)wal->get_num_syncs() );
+    CHK_GT(NUM_GROUPS * NUM_BATCHES, wal->get_num_syncs());
+    wal->close();
+
+    TEST_SUITE_CLEANUP_PATH();
+    return 0;
+}
+
+int checkpoint_test() {
+    std::string path;
+    TEST_SUITE_PREPARE_PATH(path);
+    TestSuite::mkdir(path);
+
+    shared_wal_options opt;
+    opt.segment_size_ = 4096;
+    opt.do_sync_ = false;
+
+    const size_t NUM_GROUPS = 4;
+    const size_t NUM_LOGS = 100;
+    {   ptr<shared_wal> wal = cs_new<shared_wal>(path, opt);
+        CHK_TRUE( wal->open() );
+
+        for (size_t gg = 1; gg <= NUM_GROUPS; ++gg) {
+            cluster_config config(1, 0);
+            config.get_servers().push_back
+                ( cs_new<srv_config>(1, "tcp://127.0.0.1:20000") );
+            wal->save_config(gg, config);
+        }
+        for (size_t ii = 1; ii <= NUM_LOGS; ++ii) {
+            for (size_t gg = 1; gg <= NUM_GROUPS; ++gg) {
+                ptr<shared_wal_log_store> ls = wal->get_log_store(gg);
+                ptr<log_entry> le = make_log(1, get_log_str(gg, ii));
+                ls->append(le);
+                ls->end_of_append_batch(ii, 1);
+            }
+        }
+        size_t num_segs = wal->get_num_segments();
+        CHK_GT(num_segs, 2);
+
+        // Nothing can be removed until all groups compact their logs.
+        for (size_t gg = 1; gg < NUM_GROUPS; ++gg) {
+            wal->get_log_store(gg)->compact(NUM_LOGS - 1);
+        }
+        CHK_EQ(0, wal->checkpoint());
+        CHK_EQ(num_segs, wal->get_num_segments());
+
+        wal->get_log_store(NUM_GROUPS)->compact(NUM_LOGS - 1);
+        CHK_GT(wal->checkpoint(), 0);
+        CHK_GT(num_segs, wal->get_num_segments());
+        wal->close();
+    }
+
+    {   ptr<shared_wal> wal = cs_new<shared_wal>(path, opt);
+        CHK_TRUE( wal->open() );
+        for (size_t gg = 1; gg <= NUM_GROUPS; ++gg) {
+            ptr<shared_wal_log_store> ls = wal->get_log_store(gg);
+            CHK_EQ(NUM_LOGS, ls->start_index());
+            CHK_EQ(NUM_LOGS + 1, ls->next_slot());
+            CHK_EQ( get_log_str(gg, NUM_LOGS), get_str(ls->entry_at(NUM_LOGS)) );
+
+            // Config was re-written by checkpoint.
+            ptr<cluster_config> config = wal->load_config(gg);
+            CHK_NONNULL(config.get());
+            CHK_EQ(1, config->get_servers().size());
+        }
+        wal->close();
+    }
+
+    TEST_SUITE_CLEANUP_PATH();
+    return 0;
+}
+
+int checkpoint_compacted_group_test() {
+    std::string path;
+    TEST_SUITE_PREPARE_PATH(path);
+    TestSuite::mkdir(path);
+
+    shared_wal_options opt;
+    opt.segment_size_ = 4096;
+    opt.do_sync_ = false;
+
+    const size_t NUM_LOGS = 100;
+    {   ptr<shared_wal> wal = cs_new<shared_wal>(path, opt);
+        CHK_TRUE( wal->open() );
+
+        // Group 1 compacts all its logs, and its compaction record
+        // goes into an old segment.
+        ptr<shared_wal_log_store> ls1 = wal->get_log_store(1);
+        for (size_t ii = 1; ii <= 10; ++ii) {
+            ptr<log_entry> le = make_log(1, get_log_str(1, ii));
+            ls1->append(le);
+        }
+        ls1->end_of_append_batch(1, 10);
+        ls1->compact(10);
+
+        ptr<shared_wal_log_store> ls2 = wal->get_log_store(2);
+        for (size_t ii = 1; ii <= NUM_LOGS; ++ii) {
+            ptr<log_entry> le = make_log(1, get_log_str(2, ii));
+            ls2->append(le);
+            ls2->end_of_append_batch(ii, 1);
+        }
+        ls2->compact(NUM_LOGS - 1);
+        CHK_GT(wal->checkpoint(), 0);
+        wal->close();
+    }
+
+    {   ptr<shared_wal> wal = cs_new<shared_wal>(path, opt);
+        CHK_TRUE( wal->open() );
+
+        // Start index should be recovered even without logs.
+        ptr<shared_wal_log_store> ls1 = wal->get_log_store(1);
+        CHK_EQ(11, ls1->start_index());
+        CHK_EQ(11, ls1->next_slot());
+
+        ptr<shared_wal_log_store> ls2 = wal->get_log_store(2);
+        CHK_EQ(NUM_LOGS, ls2->start_index());
+        CHK_EQ(NUM_LOGS + 1, ls2->next_slot());
+        wal->close();
+    }
+
+    TEST_SUITE_CLEANUP_PATH();
+    return 0;
+}
+
+int write_failure_test() {
+    std::string path;
+    TEST_SUITE_PREPARE_PATH(path);
+    TestSuite::mkdir(path);
+
+    shared_wal_options opt;
+    opt.segment_size_ = 4096;
+    opt.do_sync_ = false;
+
+    ptr<shared_wal> wal = cs_new<shared_wal>(path, opt);
+    CHK_TRUE( wal->open() );
+    ptr<shared_wal_log_store> ls = wal->get_log_store(1);
+
+    // Move the directory away, so that the next segment
+    // cannot be created.
+    std::string moved_path = path + "_moved";
+    CHK_Z( ::rename(path.c_str(), moved_path.c_str()) );
+
+    ulong last_ok_idx = 0;
+    bool failed = false;
+    for (size_t ii = 1; ii <= 100; ++ii) {
+        ptr<log_entry> le = make_log(1, get_log_str(1, ii));
+        ls->append(le);
+        if (ls->next_slot() != ii + 1) {
+            failed = true;
+            break;
+        }
+        last_ok_idx = ii;
+    }
+    CHK_TRUE( failed );
+
+    // The failed log should not be indexed or reported durable,
+    // and further writes should fail as well.
+    CHK_EQ( last_ok_idx + 1, ls->next_slot() );
+    CHK_EQ( get_log_str(1, last_ok_idx), get_str(ls->entry_at(last_ok_idx)) );
+    CHK_FALSE( ls->flush() );
+    CHK_GT( last_ok_idx + 1, ls->last_durable_index() );
+    ptr<log_entry> le = make_log(1, "after failure");
+    ls->append(le);
+    CHK_EQ( last_ok_idx + 1, ls->next_slot() );
+    CHK_Z( wal->checkpoint() );
+
+    srv_state state(1, 1, true);
+    CHK_FALSE( wal->save_state(1, state) );
+    wal->close();
+
+    CHK_Z( ::rename(moved_path.c_str(), path.c_str()) );
+    TEST_SUITE_CLEANUP_PATH();
+    return 0;
+}
+
+int torn_tail_test() {
+    std::string path;
+    TEST_SUITE_PREPARE_PATH(path);
+    TestSuite::mkdir(path);
+
+    const size_t NUM_LOGS = 10;
+    {   ptr<shared_wal> wal = cs_new<shared_wal>(path);
+        CHK_TRUE( wal->open() );
+        ptr<shared_wal_log_store> ls = wal->get_log_store(1);
+        for (size_t ii = 1; ii <= NUM_LOGS; ++ii) {
+            ptr<log_entry> le = make_log(1, get_log_str(1, ii));
+            ls->append(le);
+        }
+        ls->end_of_append_batch(1, NUM_LOGS);
+        wal->close();
+    }
+
+    // Partially written record at the end.
+    {   std::ofstream fs( path + "/wal_0000000000000000.log",
+                          std::ios::binary | std::ios::app );
+        fs.write("\x31\x4c\x41\x57garbage", 11);
+    }
+
+    {   ptr<shared_wal> wal = cs_new<shared_wal>(path);
+        CHK_TRUE( wal->open() );
+        ptr<shared_wal_log_store> ls = wal->get_log_store(1);
+        CHK_EQ(NUM_LOGS + 1, ls->next_slot());
+
+        // New logs go after the truncated tail.
+        ptr<log_entry> le = make_log(2, "new log");
+        ls->append(le);
+        ls->end_of_append_batch(NUM_LOGS + 1, 1);
+        wal->close();
+    }
+
+    {   ptr<shared_wal> wal = cs_new<shared_wal>(path);
+        CHK_TRUE( wal->open() );
+        ptr<shared_wal_log_store> ls = wal->get_log_store(1);
+        CHK_EQ(NUM_LOGS + 2, ls->next_slot());
+        CHK_EQ( std::string("new log"), get_str(ls->last_entry()) );
+        wal->close();
+    }
+
+    TEST_SUITE_CLEANUP_PATH();
+    return 0;
+}
+
+}  // namespace shared_wal_test;
+using namespace shared_wal_test;
+
+int main(int argc, char** argv) {
+    TestSuite ts(argc, argv);
+
+    ts.options.printTestMessage = false;
+
+    ts.doTest( "basic recovery test",
+               basic_recovery_test );
+
+    ts.doTest( "group commit test",
+               group_commit_test );
+
+    ts.doTest( "checkpoint test",
+               checkpoint_test );
+
+    ts.doTest( "checkpoint compacted group test",
+               checkpoint_compacted_group_test );
+
+    ts.doTest( "write failure test",
+               write_failure_test );
+
+    ts.doTest( "torn tail test",
+               torn_tail_test );
+
+    return 0;
+}
+
@@ -18,6 +18,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 **************************************************************************/
 
+#include "internal_timer.hxx"
 #include "nuraft.hxx"
 
 #include "test_common.h"
@@ -91,6 +92,53 @@ int timer_cancel_test() {
     return 0;
 }
 
+int monotonic_clock_test() {
+    TestSuite::_msg("clock source: %s\n",
+                    monotonic_clock::get_source() == monotonic_clock::tsc
+                    ? "tsc" : "steady_clock");
+
+    // Should never go backward.
+    uint64_t prev = monotonic_clock::now_ns();
+    for (size_t ii = 0; ii < 100000; ++ii) {
+        uint64_t cur = monotonic_clock::now_ns();
+        CHK_GTEQ(cur, prev);
+        prev = cur;
+    }
+
+    // Both clocks should follow the real elapsed time.
+    uint64_t fine_begin = monotonic_clock::now_ns();
+    uint64_t coarse_begin = monotonic_clock::coarse_now_ns();
+    TestSuite::sleep_ms(100);
+    uint64_t fine_elapsed_ms = (monotonic_clock::now_ns() - fine_begin) / 1000000;
+    uint64_t coarse_elapsed_ms =
+        (monotonic_clock::coarse_now_ns() - coarse_begin) / 1000000;
+    CHK_GTEQ(fine_elapsed_ms, 95);
+    CHK_SM(fine_elapsed_ms, 1000);
+    CHK_GTEQ(coarse_elapsed_ms, 90);
+    CHK_SM(coarse_elapsed_ms, 1000);
+
+    return 0;
+}
+
+int timer_helper_test() {
+    for (bool coarse: {false, true}) {
+        timer_helper tt(100 * 1000, false, coarse);
+        CHK_FALSE( tt.timeout() );
+        TestSuite::sleep_ms(150);
+        CHK_TRUE( tt.timeout() );
+        CHK_GTEQ( tt.get_ms(), 140 );
+        CHK_TRUE( tt.timeout_and_reset() );
+        CHK_FALSE( tt.timeout() );
+        CHK_SM( tt.get_ms(), 100 );
+
+        // First event should fire immediately.
+        timer_helper first(1000 * 1000, true, coarse);
+        CHK_TRUE( first.timeout_and_reset() );
+        CHK_FALSE( first.timeout_and_reset() );
+    }
+    return 0;
+}
+
 }  // namespace timer_test;
 using namespace timer_test;
 
@@ -105,6 +153,12 @@ int main(int argc, char** argv) {
     ts.doTest( "timer cancel test",
                timer_cancel_test );
 
+    ts.doTest( "monotonic clock test",
+               monotonic_clock_test );
+
+    ts.doTest( "timer helper test",
+               timer_helper_test );
+
     return 0;
 }
 